@@ -0,0 +1,27 @@
+# Generates a single module with a large number of distinct constants, for measuring how compile time scales with the
+# size of the constant pool(Chunk::addConstant)
+#
+# Usage: python3 genConstants.py <output file> [constants] [constants per function]
+# Defaults to 100000 constants split over functions of 50000 each, half of them numbers and half strings
+# The functions are never called, so running the file is all compile time
+#
+#   ESL <output file>
+#
+# Delete the .eslc file next to the output between measurements, otherwise ESL loads the cached bytecode instead of
+# compiling
+import sys
+
+out = sys.argv[1] if len(sys.argv) > 1 else "constants.esl"
+constantCount = int(sys.argv[2]) if len(sys.argv) > 2 else 100000
+# A function's constants share one pool, which holds at most 65536 of them
+perFunc = int(sys.argv[3]) if len(sys.argv) > 3 else 50000
+
+lines = []
+for start in range(0, constantCount, perFunc):
+    lines.append("fn f%d() {" % (start // perFunc))
+    for i in range(start, min(start + perFunc, constantCount)):
+        lines.append("    %d.5;" % i if i % 2 == 0 else "    \"s%d\";" % i)
+    lines.append("}")
+lines.append("print(\"done\");")
+with open(out, "w") as f:
+    f.write("\n".join(lines) + "\n")
@@ -0,0 +1,44 @@
+# Generates a synthetic multi module project for measuring the frontend(scanning, parsing, macro expansion)
+# and the compiler on something the size of a real program
+#
+# Usage: python3 genModules.py <output dir> [modules] [functions per module]
+# Defaults to 400 modules with 40 functions each(plus one that calls into them), main.esl imports all of them
+#
+#   ESL <output dir>/main.esl -validate-file    scanning and parsing only
+#   ESL <output dir>/main.esl -run              full compile, running the program itself is negligible
+#
+# Delete the .eslc files in the output dir between -run measurements, otherwise ESL loads the cached bytecode
+# instead of compiling
+import os
+import sys
+
+out = sys.argv[1] if len(sys.argv) > 1 else "modules"
+moduleCount = int(sys.argv[2]) if len(sys.argv) > 2 else 400
+funcCount = int(sys.argv[3]) if len(sys.argv) > 3 else 40
+os.makedirs(out, exist_ok=True)
+
+main = []
+for i in range(moduleCount):
+    body = []
+    # A macro that's used by another module, and a chain of imports between modules
+    if i == 7:
+        body.append("addMacro! twice { ($e:expr) => { $e * 2 }; }")
+    if i == 9 and moduleCount > 7:
+        body.append("import \"m7.esl\"")
+        body.append("pub fn f9u(x){ return twice!(x); }")
+    if i % 10 == 0 and i + 1 < moduleCount:
+        body.append("import \"m%d.esl\" as dep" % (i + 1))
+    for k in range(funcCount):
+        body.append("pub fn f%d_%d(x){ let s = 0; for(let j = 0; j < x; j++){ if(j %% 3 == 0) s += j; else s -= 1; } "
+                    "return s + %d; }" % (i, k, i))
+    body.append("pub fn f%d(x){ return f%d_0(x) + f%d_%d(x); }" % (i, i, i, funcCount - 1))
+    with open(os.path.join(out, "m%d.esl" % i), "w") as f:
+        f.write("\n".join(body) + "\n")
+    main.append("import \"m%d.esl\" as m%d" % (i, i))
+
+main.append("let t = 0;")
+for i in range(moduleCount):
+    main.append("let g%d = m%d::f%d; t += g%d(10);" % (i, i, i, i))
+main.append("print(t);")
+with open(os.path.join(out, "main.esl"), "w") as f:
+    f.write("\n".join(main) + "\n")
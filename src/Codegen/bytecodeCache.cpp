@@ -0,0 +1,903 @@
+#include "bytecodeCache.h"
+#include "../codegen/valueHelpersInline.cpp"
+#include "../Runtime/nativeFunctions.h"
+#include "../Runtime/vm.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <string_view>
+#include <algorithm>
+#if defined(_WIN32) || defined(WIN32)
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace bytecodeCache;
+using namespace object;
+using namespace valueHelpers;
+
+// Every value in the file is prefixed by one of these
+enum class ValueTag : byte {
+    // Number, bool or nil, stored as is
+    RAW,
+    // Index into the string table
+    STRING,
+    // Index into the object table
+    OBJECT,
+    // Builtin class, stored by name
+    NATIVE_CLASS,
+    // Native function or native method of a builtin class, stored as the name of the class(empty for functions)
+    // followed by its own name
+    NATIVE,
+};
+inline constexpr unsigned operator+ (ValueTag const val) { return static_cast<byte>(val); }
+
+static const char magic[4] = {'E', 'S', 'L', 'C'};
+
+static uInt64 hashSource(const string& source) {
+    return ankerl::unordered_dense::hash<string>{}(source);
+}
+
+// Covers everything after the header, a file that was cut short or changed on disk is treated like an out of date one
+static uInt64 hashBody(std::string_view body) {
+    return ankerl::unordered_dense::hash<std::string_view>{}(body);
+}
+
+// Identifies the build of ESL that wrote a file, the bytecode depends on what this build's compiler made of the source
+// and not only on what the opcodes mean, so a file written by any other build is ignored
+// Size and modification time of the executable change with every build, when the executable can't be found only the
+// time this file was compiled is left
+static uInt64 buildFingerprint() {
+    static const uInt64 fingerprint = [] {
+        string id = __DATE__ " " __TIME__;
+        #if !defined(_WIN32) && !defined(WIN32)
+        std::error_code ec;
+        std::filesystem::path exe("/proc/self/exe");
+        auto size = std::filesystem::file_size(exe, ec);
+        if (!ec) id += " " + std::to_string(size);
+        auto time = std::filesystem::last_write_time(exe, ec);
+        if (!ec) id += " " + std::to_string(time.time_since_epoch().count());
+        #endif
+        return hashSource(id);
+    }();
+    return fingerprint;
+}
+
+// Reads the file the same way the scanner does, so the hashes match
+static bool readSource(const string& path, string& source) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::stringstream ss;
+    ss << file.rdbuf();
+    source = ss.str();
+    return true;
+}
+
+#if defined(_WIN32) || defined(WIN32)
+// Not mapped on windows, the file is read into memory that's only freed if the cache turns out to be out of date
+static const char* mapFile(const string& path, size_t& size) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return nullptr;
+    size = file.tellg();
+    char* data = new char[size];
+    file.seekg(0);
+    file.read(data, size);
+    if (file) return data;
+    delete[] data;
+    return nullptr;
+}
+
+static void unmapFile(const char* data, size_t size) {
+    delete[] data;
+}
+#else
+static const char* mapFile(const string& path, size_t& size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return nullptr;
+    void* data = MAP_FAILED;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = st.st_size;
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping stays valid after the file is closed, and after a newer cache is renamed over it
+    close(fd);
+    return data == MAP_FAILED ? nullptr : static_cast<const char*>(data);
+}
+
+static void unmapFile(const char* data, size_t size) {
+    munmap(const_cast<char*>(data), size);
+}
+#endif
+
+namespace bytecodeCache {
+    class Writer {
+    public:
+        Writer(Image& image);
+        // Empty unless something couldn't be stored
+        string error;
+        string out;
+    private:
+        // Objects are written once into the object table and referenced by index everywhere else
+        ankerl::unordered_dense::map<Obj*, uInt> indexes;
+        vector<Obj*> objects;
+        ankerl::unordered_dense::map<ObjString*, uInt> stringIndexes;
+        vector<ObjString*> strings;
+        // Class name(empty for native functions) and name of every native, and names of the builtin classes
+        ankerl::unordered_dense::map<Obj*, std::pair<string, string>> natives;
+        ankerl::unordered_dense::map<Obj*, string> nativeClasses;
+
+        void collect(Value val);
+        void collect(Obj* obj);
+        void trace(Obj* obj);
+        void sortObjects();
+        void addString(ObjString* str);
+        void writeHeader(Obj* obj);
+        void writeBody(Obj* obj);
+
+        void writeByte(byte val);
+        void write32(uInt val);
+        void write64(uInt64 val);
+        void writeString(const string& str);
+        void writeValue(Value val);
+    };
+
+    class Reader {
+    public:
+        Reader(std::string_view _in, compileCore::CompilerOptions _options);
+        bool failed;
+        Image* read();
+    private:
+        std::string_view in;
+        compileCore::CompilerOptions options;
+        size_t pos;
+        vector<ObjString*> strings;
+        vector<Obj*> objects;
+        Image* image;
+
+        bool readFiles(vector<File*>& files);
+        void readStrings();
+        void readHeader();
+        void readBody(Obj* obj);
+        ObjFunc* readFuncRef(bool canBeNil);
+
+        byte readByte();
+        uInt read32();
+        uInt64 read64();
+        string readString();
+        ObjString* readStringRef();
+        Value readValue();
+        uInt readIndex(size_t size);
+    };
+}
+
+// Objects are created before any of them is filled in, since they can reference each other
+// Functions and classes are created first, because closures and instances need them to be created
+static int creationOrder(ObjType type) {
+    switch (type) {
+        case ObjType::FUNC: return 0;
+        case ObjType::CLASS: return 1;
+        default: return 2;
+    }
+}
+
+#pragma region Writer
+Writer::Writer(Image& image) {
+    for (ObjNativeFunc* func : image.nativeFuncs) natives.try_emplace(func, "", func->name);
+    // Builtin classes share the methods of the base class, those are stored as methods of the base class
+    for (auto it = image.nativeClasses.rbegin(); it != image.nativeClasses.rend(); it++) {
+        ObjClass* klass = *it;
+        nativeClasses[klass] = klass->name->str;
+        for (auto& [name, method] : klass->methods) natives.try_emplace(method, klass->name->str, name->str);
+    }
+
+    if (image.initBlockFunc) collect(image.initBlockFunc);
+    collect(image.mainBlockFunc);
+    for (Value val : image.code.constants) collect(val);
+    for (Globalvar& var : image.globals) collect(var.val);
+    // Objects are traced breadth first, deeply nested data(eg. a long linked list) would overflow the stack otherwise
+    for (size_t i = 0; i < objects.size() && error.empty(); i++) trace(objects[i]);
+    if (!error.empty()) return;
+    sortObjects();
+
+    out.append(magic, sizeof(magic));
+    write32(ESLC_VERSION);
+    write32(+OpCode::INSTANCEOF + 1);
+    write64(buildFingerprint());
+    writeByte(image.options.inlining);
+    // Filled in once the rest of the file is written
+    size_t hashPos = out.size();
+    write64(0);
+    size_t bodyPos = out.size();
+
+    write32(image.sourceFiles.size());
+    for (File* file : image.sourceFiles) {
+        writeString(file->name);
+        writeString(file->path);
+        write64(hashSource(file->sourceFile));
+    }
+
+    write32(strings.size());
+    for (ObjString* str : strings) writeString(str->str);
+
+    write32(objects.size());
+    for (Obj* obj : objects) writeHeader(obj);
+    for (Obj* obj : objects) writeBody(obj);
+    writeValue(image.initBlockFunc ? encodeObj(image.initBlockFunc) : encodeNil());
+    writeValue(encodeObj(image.mainBlockFunc));
+
+    Chunk& code = image.code;
+    write32(code.lines.size());
+    for (codeLine& line : code.lines) {
+        write32(line.end);
+        write32(line.line);
+        writeByte(line.fileIndex);
+    }
+    write32(code.constants.size());
+    for (Value val : code.constants) writeValue(val);
+
+    write32(image.globals.size());
+    for (Globalvar& var : image.globals) {
+        writeString(var.name);
+        writeValue(var.val);
+    }
+    // Last, so it can be used straight from the mapping
+    write64(image.bytecodeSize);
+    out.append(reinterpret_cast<const char*>(image.bytecode), image.bytecodeSize);
+
+    uInt64 hash = hashBody(std::string_view(out).substr(bodyPos));
+    for (int i = 0; i < 8; i++) out[hashPos + i] = static_cast<char>((hash >> (i * 8)) & 0xff);
+}
+
+void Writer::collect(Value val) {
+    if (isObj(val)) collect(decodeObj(val));
+}
+
+// Adds obj to the object table(or the string table) if it wasn't seen before, it's traced later
+void Writer::collect(Obj* obj) {
+    if (!obj) {
+        error = "Uninitialized object";
+        return;
+    }
+    switch (obj->type) {
+        case ObjType::STRING:
+            addString(reinterpret_cast<ObjString*>(obj));
+            return;
+        case ObjType::NATIVE:
+            if (!natives.contains(obj)) error = "Unknown native function";
+            return;
+        case ObjType::FILE: error = "Can't store a file"; return;
+        case ObjType::MUTEX: error = "Can't store a mutex"; return;
+        case ObjType::FUTURE: error = "Can't store a future"; return;
+        case ObjType::CLASS:
+            if (nativeClasses.contains(obj)) return;
+            [[fallthrough]];
+        default:
+            if (indexes.try_emplace(obj, objects.size()).second) objects.push_back(obj);
+            return;
+    }
+}
+
+void Writer::trace(Obj* obj) {
+    switch (obj->type) {
+        case ObjType::CLOSURE: {
+            auto closure = reinterpret_cast<ObjClosure*>(obj);
+            collect(closure->func);
+            for (ObjUpval* upval : closure->upvals) collect(upval);
+            return;
+        }
+        case ObjType::UPVALUE:
+            collect(reinterpret_cast<ObjUpval*>(obj)->val);
+            return;
+        case ObjType::CLASS: {
+            auto klass = reinterpret_cast<ObjClass*>(obj);
+            if (klass->superclass) collect(klass->superclass);
+            for (auto& [name, method] : klass->methods) {
+                addString(name);
+                collect(method);
+            }
+            for (auto& [name, val] : klass->fieldsInit) {
+                addString(name);
+                collect(val);
+            }
+            return;
+        }
+        case ObjType::INSTANCE: {
+            auto inst = reinterpret_cast<ObjInstance*>(obj);
+            collect(inst->klass);
+            for (auto& [name, val] : inst->fields) {
+                addString(name);
+                collect(val);
+            }
+            return;
+        }
+        case ObjType::HASH_MAP:
+            for (auto& [name, val] : reinterpret_cast<ObjHashMap*>(obj)->fields) {
+                addString(name);
+                collect(val);
+            }
+            return;
+        case ObjType::ARRAY:
+            for (Value val : reinterpret_cast<ObjArray*>(obj)->values) collect(val);
+            return;
+        case ObjType::BOUND_METHOD: {
+            auto bound = reinterpret_cast<ObjBoundMethod*>(obj);
+            collect(bound->receiver);
+            collect(bound->method);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+void Writer::sortObjects() {
+    std::stable_sort(objects.begin(), objects.end(), [](Obj* a, Obj* b) {
+        return creationOrder(a->type) < creationOrder(b->type);
+    });
+    for (uInt i = 0; i < objects.size(); i++) indexes[objects[i]] = i;
+}
+
+void Writer::addString(ObjString* str) {
+    if (stringIndexes.try_emplace(str, strings.size()).second) strings.push_back(str);
+}
+
+// Everything needed to create the object
+void Writer::writeHeader(Obj* obj) {
+    writeByte(static_cast<byte>(obj->type));
+    switch (obj->type) {
+        case ObjType::FUNC: {
+            auto func = reinterpret_cast<ObjFunc*>(obj);
+            writeString(func->name);
+            writeByte(func->arity);
+            write32(func->upvalueCount);
+            write64(func->bytecodeOffset);
+            write64(func->constantsOffset);
+            return;
+        }
+        case ObjType::CLASS:
+            writeString(reinterpret_cast<ObjClass*>(obj)->name->str);
+            return;
+        case ObjType::CLOSURE:
+            write32(indexes[reinterpret_cast<ObjClosure*>(obj)->func]);
+            return;
+        case ObjType::INSTANCE:
+            writeValue(encodeObj(reinterpret_cast<ObjInstance*>(obj)->klass));
+            return;
+        case ObjType::RANGE: {
+            auto range = reinterpret_cast<ObjRange*>(obj);
+            writeValue(encodeNumber(range->start));
+            writeValue(encodeNumber(range->end));
+            writeByte(range->isEndInclusive);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+// Everything the object references
+void Writer::writeBody(Obj* obj) {
+    switch (obj->type) {
+        case ObjType::CLOSURE: {
+            auto closure = reinterpret_cast<ObjClosure*>(obj);
+            write32(closure->upvals.size());
+            for (ObjUpval* upval : closure->upvals) write32(indexes[upval]);
+            return;
+        }
+        case ObjType::UPVALUE:
+            writeValue(reinterpret_cast<ObjUpval*>(obj)->val);
+            return;
+        case ObjType::CLASS: {
+            auto klass = reinterpret_cast<ObjClass*>(obj);
+            writeValue(klass->superclass ? encodeObj(klass->superclass) : encodeNil());
+            write32(klass->methods.size());
+            for (auto& [name, method] : klass->methods) {
+                write32(stringIndexes[name]);
+                writeValue(encodeObj(method));
+            }
+            write32(klass->fieldsInit.size());
+            for (auto& [name, val] : klass->fieldsInit) {
+                write32(stringIndexes[name]);
+                writeValue(val);
+            }
+            return;
+        }
+        case ObjType::INSTANCE:
+        case ObjType::HASH_MAP: {
+            auto& fields = obj->type == ObjType::INSTANCE ? reinterpret_cast<ObjInstance*>(obj)->fields
+                                                          : reinterpret_cast<ObjHashMap*>(obj)->fields;
+            write32(fields.size());
+            for (auto& [name, val] : fields) {
+                write32(stringIndexes[name]);
+                writeValue(val);
+            }
+            return;
+        }
+        case ObjType::ARRAY: {
+            auto& values = reinterpret_cast<ObjArray*>(obj)->values;
+            write32(values.size());
+            for (Value val : values) writeValue(val);
+            return;
+        }
+        case ObjType::BOUND_METHOD: {
+            auto bound = reinterpret_cast<ObjBoundMethod*>(obj);
+            writeValue(bound->receiver);
+            writeValue(encodeObj(bound->method));
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+void Writer::writeByte(byte val) {
+    out.push_back(static_cast<char>(val));
+}
+
+void Writer::write32(uInt val) {
+    for (int i = 0; i < 4; i++) writeByte((val >> (i * 8)) & 0xff);
+}
+
+void Writer::write64(uInt64 val) {
+    for (int i = 0; i < 8; i++) writeByte((val >> (i * 8)) & 0xff);
+}
+
+void Writer::writeString(const string& str) {
+    write32(str.size());
+    out.append(str);
+}
+
+void Writer::writeValue(Value val) {
+    if (!isObj(val)) {
+        writeByte(+ValueTag::RAW);
+        write64(val);
+        return;
+    }
+    Obj* obj = decodeObj(val);
+    if (obj->type == ObjType::STRING) {
+        writeByte(+ValueTag::STRING);
+        write32(stringIndexes[reinterpret_cast<ObjString*>(obj)]);
+        return;
+    }
+    if (auto it = natives.find(obj); it != natives.end()) {
+        writeByte(+ValueTag::NATIVE);
+        writeString(it->second.first);
+        writeString(it->second.second);
+        return;
+    }
+    if (auto it = nativeClasses.find(obj); it != nativeClasses.end()) {
+        writeByte(+ValueTag::NATIVE_CLASS);
+        writeString(it->second);
+        return;
+    }
+    writeByte(+ValueTag::OBJECT);
+    write32(indexes[obj]);
+}
+#pragma endregion
+
+#pragma region Reader
+Reader::Reader(std::string_view _in, compileCore::CompilerOptions _options) : in(_in), options(_options) {
+    pos = 0;
+    failed = false;
+    image = nullptr;
+}
+
+Image* Reader::read() {
+    if (in.substr(0, sizeof(magic)) != std::string_view(magic, sizeof(magic))) return nullptr;
+    pos = sizeof(magic);
+    if (read32() != ESLC_VERSION || read32() != +OpCode::INSTANCEOF + 1) return nullptr;
+    if (read64() != buildFingerprint()) return nullptr;
+    if (readByte() != options.inlining) return nullptr;
+    uInt64 hash = read64();
+    if (failed || hashBody(in.substr(pos)) != hash) return nullptr;
+
+    image = new Image();
+    image->options = options;
+    // Nothing is allocated until every source file is known to be unchanged
+    if (!readFiles(image->sourceFiles)) {
+        delete image;
+        return nullptr;
+    }
+    image->nativeFuncs = runtime::createNativeFuncs();
+    ObjClass* baseClass = runtime::createBaseClass();
+    image->nativeClasses = runtime::createBuiltinClasses(baseClass);
+    image->nativeClasses.push_back(baseClass);
+    readStrings();
+
+    uInt count = read32();
+    if (count > in.size() - pos) failed = true;
+    for (uInt i = 0; i < count && !failed; i++) readHeader();
+    for (Obj* obj : objects) {
+        if (failed) break;
+        readBody(obj);
+    }
+    image->initBlockFunc = readFuncRef(true);
+    image->mainBlockFunc = readFuncRef(false);
+
+    Chunk& code = image->code;
+    count = read32();
+    for (uInt i = 0; i < count && !failed; i++) {
+        codeLine line;
+        line.end = read32();
+        line.line = read32();
+        line.fileIndex = readByte();
+        code.lines.push_back(line);
+    }
+    count = read32();
+    for (uInt i = 0; i < count && !failed; i++) code.constants.push_back(readValue());
+
+    count = read32();
+    for (uInt i = 0; i < count && !failed; i++) {
+        string name = readString();
+        Globalvar var(name, readValue());
+        var.isDefined = true;
+        image->globals.push_back(var);
+    }
+    uInt64 size = read64();
+    if (size != in.size() - pos) failed = true;
+    else {
+        image->bytecode = reinterpret_cast<const byte*>(in.data() + pos);
+        image->bytecodeSize = size;
+    }
+    // Functions run straight from these offsets, a function with no constants can point at the end of the pool
+    for (Obj* obj : objects) {
+        if (failed) break;
+        if (obj->type != ObjType::FUNC) continue;
+        auto func = reinterpret_cast<ObjFunc*>(obj);
+        if (func->bytecodeOffset >= size || func->constantsOffset > code.constants.size()) failed = true;
+    }
+    // Objects that were already created are unreachable and get freed by the next collection
+    if (failed) {
+        for (File* file : image->sourceFiles) delete file;
+        delete image;
+        return nullptr;
+    }
+    return image;
+}
+
+bool Reader::readFiles(vector<File*>& files) {
+    uInt count = read32();
+    vector<string> sources;
+    vector<std::pair<string, string>> names;
+    for (uInt i = 0; i < count && !failed; i++) {
+        string name = readString();
+        string path = readString();
+        uInt64 hash = read64();
+        string source;
+        if (failed || !readSource(path, source) || hashSource(source) != hash) return false;
+        names.emplace_back(name, path);
+        sources.push_back(std::move(source));
+    }
+    if (failed) return false;
+    for (uInt i = 0; i < count; i++) {
+        files.push_back(new File(std::move(sources[i]), names[i].first, names[i].second));
+    }
+    return true;
+}
+
+// Every string is constructed in a single block, outside of the heap
+// Strings that are interned already(eg. names of natives) are used instead of the copy
+void Reader::readStrings() {
+    uInt count = read32();
+    if (failed || count > in.size() - pos) {
+        failed = true;
+        return;
+    }
+    auto block = static_cast<ObjString*>(::operator new(sizeof(ObjString) * count));
+    for (uInt i = 0; i < count && !failed; i++) {
+        string str = readString();
+        auto staticStr = ::new (&block[i]) ObjString(str);
+        strings.push_back(memory::gc.interned.internStatic(staticStr));
+    }
+}
+
+// Creates the object, its contents are filled in by readBody once every object exists
+void Reader::readHeader() {
+    Obj* obj = nullptr;
+    switch (static_cast<ObjType>(readByte())) {
+        case ObjType::FUNC: {
+            auto func = new ObjFunc();
+            func->name = readString();
+            func->arity = readByte();
+            func->upvalueCount = read32();
+            func->bytecodeOffset = read64();
+            func->constantsOffset = read64();
+            obj = func;
+            break;
+        }
+        case ObjType::CLASS:
+            obj = new ObjClass(readString(), nullptr);
+            break;
+        case ObjType::CLOSURE: {
+            uInt index = readIndex(objects.size());
+            if (!failed && objects[index]->type == ObjType::FUNC) {
+                obj = new ObjClosure(reinterpret_cast<ObjFunc*>(objects[index]));
+            }
+            break;
+        }
+        case ObjType::INSTANCE: {
+            Value klass = readValue();
+            if (!failed && isClass(klass)) obj = new ObjInstance(asClass(klass));
+            break;
+        }
+        case ObjType::RANGE: {
+            Value start = readValue();
+            Value end = readValue();
+            bool isEndInclusive = readByte();
+            if (isNumber(start) && isNumber(end)) {
+                obj = new ObjRange(decodeNumber(start), decodeNumber(end), isEndInclusive);
+            }
+            break;
+        }
+        case ObjType::UPVALUE: {
+            Value val = encodeNil();
+            obj = new ObjUpval(val);
+            break;
+        }
+        case ObjType::ARRAY: obj = new ObjArray(); break;
+        case ObjType::HASH_MAP: obj = new ObjHashMap(); break;
+        case ObjType::BOUND_METHOD: obj = new ObjBoundMethod(encodeNil(), nullptr); break;
+        default: break;
+    }
+    if (!obj) failed = true;
+    else objects.push_back(obj);
+}
+
+void Reader::readBody(Obj* obj) {
+    // Reads count name/value pairs into fields
+    auto readFields = [&](ankerl::unordered_dense::map<ObjString*, Value>& fields) {
+        fields.clear();
+        uInt count = read32();
+        for (uInt i = 0; i < count && !failed; i++) {
+            ObjString* name = readStringRef();
+            Value val = readValue();
+            if (!failed) fields.insert_or_assign(name, val);
+        }
+    };
+    switch (obj->type) {
+        case ObjType::CLOSURE: {
+            auto closure = reinterpret_cast<ObjClosure*>(obj);
+            if (read32() != closure->upvals.size()) failed = true;
+            for (auto& upval : closure->upvals) {
+                uInt index = readIndex(objects.size());
+                if (failed || objects[index]->type != ObjType::UPVALUE) {
+                    failed = true;
+                    return;
+                }
+                upval = reinterpret_cast<ObjUpval*>(objects[index]);
+            }
+            return;
+        }
+        case ObjType::UPVALUE:
+            reinterpret_cast<ObjUpval*>(obj)->val = readValue();
+            return;
+        case ObjType::CLASS: {
+            auto klass = reinterpret_cast<ObjClass*>(obj);
+            Value superclass = readValue();
+            if (isClass(superclass)) klass->superclass = asClass(superclass);
+            uInt methodCount = read32();
+            for (uInt i = 0; i < methodCount && !failed; i++) {
+                ObjString* name = readStringRef();
+                Value method = readValue();
+                if (!isObj(method)) failed = true;
+                else klass->methods.insert_or_assign(name, decodeObj(method));
+            }
+            readFields(klass->fieldsInit);
+            return;
+        }
+        case ObjType::INSTANCE:
+            readFields(reinterpret_cast<ObjInstance*>(obj)->fields);
+            return;
+        case ObjType::HASH_MAP:
+            readFields(reinterpret_cast<ObjHashMap*>(obj)->fields);
+            return;
+        case ObjType::ARRAY: {
+            auto arr = reinterpret_cast<ObjArray*>(obj);
+            uInt count = read32();
+            if (count > in.size() - pos) failed = true;
+            for (uInt i = 0; i < count && !failed; i++) {
+                Value val = readValue();
+                if (isObj(val)) arr->numOfHeapPtr++;
+                arr->values.push_back(val);
+            }
+            return;
+        }
+        case ObjType::BOUND_METHOD: {
+            auto bound = reinterpret_cast<ObjBoundMethod*>(obj);
+            bound->receiver = readValue();
+            Value method = readValue();
+            if (!isObj(method)) failed = true;
+            else bound->method = decodeObj(method);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+ObjFunc* Reader::readFuncRef(bool canBeNil) {
+    Value func = readValue();
+    if (canBeNil && isNil(func)) return nullptr;
+    if (failed || !isObj(func) || decodeObj(func)->type != ObjType::FUNC) {
+        failed = true;
+        return nullptr;
+    }
+    return reinterpret_cast<ObjFunc*>(decodeObj(func));
+}
+
+byte Reader::readByte() {
+    if (pos >= in.size()) {
+        failed = true;
+        return 0;
+    }
+    return static_cast<byte>(in[pos++]);
+}
+
+uInt Reader::read32() {
+    uInt val = 0;
+    for (int i = 0; i < 4; i++) val |= static_cast<uInt>(readByte()) << (i * 8);
+    return val;
+}
+
+uInt64 Reader::read64() {
+    uInt64 val = 0;
+    for (int i = 0; i < 8; i++) val |= static_cast<uInt64>(readByte()) << (i * 8);
+    return val;
+}
+
+string Reader::readString() {
+    uInt size = read32();
+    if (failed || size > in.size() - pos) {
+        failed = true;
+        return "";
+    }
+    string str(in.substr(pos, size));
+    pos += size;
+    return str;
+}
+
+ObjString* Reader::readStringRef() {
+    uInt index = readIndex(strings.size());
+    return failed ? nullptr : strings[index];
+}
+
+Value Reader::readValue() {
+    switch (readByte()) {
+        case +ValueTag::RAW: return read64();
+        case +ValueTag::STRING: {
+            ObjString* str = readStringRef();
+            return failed ? encodeNil() : encodeObj(str);
+        }
+        case +ValueTag::OBJECT: {
+            uInt index = readIndex(objects.size());
+            return failed ? encodeNil() : encodeObj(objects[index]);
+        }
+        case +ValueTag::NATIVE_CLASS: {
+            string name = readString();
+            for (ObjClass* klass : image->nativeClasses) {
+                if (!failed && klass->name->str == name) return encodeObj(klass);
+            }
+            break;
+        }
+        case +ValueTag::NATIVE: {
+            string className = readString();
+            string name = readString();
+            if (failed) break;
+            if (className.empty()) {
+                for (ObjNativeFunc* func : image->nativeFuncs) {
+                    if (name == func->name) return encodeObj(func);
+                }
+                break;
+            }
+            for (ObjClass* klass : image->nativeClasses) {
+                if (klass->name->str != className) continue;
+                for (auto& [methodName, method] : klass->methods) {
+                    if (methodName->str == name) return encodeObj(method);
+                }
+            }
+            break;
+        }
+        default: break;
+    }
+    failed = true;
+    return encodeNil();
+}
+
+uInt Reader::readIndex(size_t size) {
+    uInt index = read32();
+    if (index >= size) failed = true;
+    return index;
+}
+#pragma endregion
+
+string bytecodeCache::cachePath(string mainFilePath) {
+    return std::filesystem::path(mainFilePath).replace_extension(".eslc").string();
+}
+
+string bytecodeCache::snapshotPath(string mainFilePath) {
+    return std::filesystem::path(mainFilePath).replace_extension(".esls").string();
+}
+
+// Written to a temporary file first, so a process starting at the same time never sees a partial file
+static bool writeFile(const string& path, const string& data) {
+    string tempPath = path + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write(data.data(), data.size());
+        if (!file) {
+            file.close();
+            std::error_code ec;
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool bytecodeCache::write(string path, compileCore::Compiler& compiler) {
+    Image image;
+    image.code.lines = compiler.mainCodeBlock.lines;
+    image.code.constants = compiler.mainCodeBlock.constants;
+    image.bytecode = compiler.mainCodeBlock.bytecode.data();
+    image.bytecodeSize = compiler.mainCodeBlock.bytecode.size();
+    image.initBlockFunc = compiler.initBlockFunc;
+    image.mainBlockFunc = compiler.mainBlockFunc;
+    image.globals = compiler.globals;
+    image.sourceFiles = compiler.sourceFiles;
+    image.nativeFuncs = compiler.nativeFuncs;
+    image.nativeClasses.push_back(compiler.baseClass);
+    image.options = compiler.options;
+    Writer writer(image);
+    return writer.error.empty() && writeFile(path, writer.out);
+}
+
+bool bytecodeCache::writeSnapshot(string path, runtime::VM* vm, compileCore::CompilerOptions options, string& error) {
+    if (vm->hasRunningThreads()) {
+        error = "Threads started by the imported modules are still running";
+        return false;
+    }
+    Image image;
+    image.code.lines = vm->code.lines;
+    image.code.constants = vm->code.constants;
+    image.bytecode = vm->code.bytecode.data();
+    image.bytecodeSize = vm->code.bytecode.size();
+    image.initBlockFunc = vm->initClosure ? vm->initClosure->func : nullptr;
+    image.mainBlockFunc = vm->mainClosure->func;
+    for (uInt i = 0; i < vm->globals.size(); i++) {
+        image.globals.emplace_back(vm->globalNames[i], vm->getGlobal(i));
+    }
+    image.sourceFiles = vm->sourceFiles;
+    image.nativeFuncs = vm->nativeFuncs;
+    image.nativeClasses = vm->nativeClasses;
+    image.options = options;
+    Writer writer(image);
+    error = writer.error;
+    if (!error.empty()) return false;
+    if (!writeFile(path, writer.out)) {
+        error = "Couldn't write " + path;
+        return false;
+    }
+    return true;
+}
+
+// The mapping is never released once the image is used, the VM runs the bytecode straight from it
+Image* bytecodeCache::load(string path, compileCore::CompilerOptions options) {
+    size_t size = 0;
+    const char* data = mapFile(path, size);
+    if (!data) return nullptr;
+    Image* image = Reader(std::string_view(data, size), options).read();
+    if (!image) unmapFile(data, size);
+    return image;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "codegenDefs.h"
+#include "../Objects/objects.h"
+#include "compiler.h"
+// On disk cache of a compiled program(.eslc), written next to the main source file after a successful compile
+//
+// Holds the main code block(bytecode, constants and line info), every object reachable from the constants and globals,
+// the globals and the names and paths of every source file along with a hash of its contents
+// A cache is only used if every source file it was built from still hashes to the same value, and it was written by
+// the same build of ESL(see buildFingerprint) with the same compiler options, and if the rest of the file still hashes
+// to the value stored after the header, otherwise the program is compiled again and the cache is overwritten
+//
+// Heap snapshots(.esls) use the same format, but are written after the top level code of the imported modules ran,
+// so the globals and objects are stored in whatever state that code left them in, and only the main module runs
+// when the snapshot is loaded
+// Objects tied to the outside world(files, mutexes and futures) can't be stored, neither can the state of the rng
+//
+// Natives aren't stored, they're recreated when loading and referenced by name
+//
+// The file is mapped read only instead of being read, and the bytecode(the last section) is run straight from the
+// mapping, so processes running the same program share those pages
+// Strings are allocated in one block outside of the heap and are never collected
+
+// Bump whenever the layout of the file or the meaning of any opcode changes
+#define ESLC_VERSION 6
+
+namespace runtime {
+    class VM;
+}
+
+namespace bytecodeCache {
+    // Everything the VM needs to start running a program
+    struct Image {
+        // Lines and constants, the bytecode itself stays in the mapping
+        Chunk code;
+        const byte* bytecode = nullptr;
+        uInt64 bytecodeSize = 0;
+        // Top level code of the imported modules, nullptr if there's nothing left to run
+        object::ObjFunc* initBlockFunc = nullptr;
+        object::ObjFunc* mainBlockFunc = nullptr;
+        vector<Globalvar> globals;
+        vector<File*> sourceFiles;
+        vector<object::ObjNativeFunc*> nativeFuncs;
+        // Same layout as VM::nativeClasses, the base class is last
+        vector<object::ObjClass*> nativeClasses;
+        compileCore::CompilerOptions options;
+    };
+
+    // Paths of the cache and the snapshot for the program whose main file is at mainFilePath
+    string cachePath(string mainFilePath);
+    string snapshotPath(string mainFilePath);
+    // Returns false if the program contains something that can't be cached, or if the file couldn't be written
+    bool write(string path, compileCore::Compiler& compiler);
+    // Stores the current state of a VM created from a compiler, meant to be called after VM::runModuleInit
+    // Returns false and sets error if the heap holds something that can't be stored, or if the file couldn't be written
+    // options are the ones the VM's compiler was created with
+    bool writeSnapshot(string path, runtime::VM* vm, compileCore::CompilerOptions options, string& error);
+    // Returns nullptr if there is no cache(or snapshot) at path, if it's out of date or if it was compiled with different options
+    Image* load(string path, compileCore::CompilerOptions options);
+}
@@ -45,14 +45,10 @@ void Chunk::disassemble(string name, int startingOffset, int constantsOffset) {
 //adds the constant to the array and returns it's index, which is used in conjuction with OP_CONSTANT
 //first checks if this value already exists, this helps keep the constants array small
 //returns index of the constant
-// TODO: Adding constants is O(n)?? Make it O(1) with a hash set
 uInt Chunk::addConstant(Value val) {
-	for (uInt i = 0; i < constants.size(); i++) {
-		if (constants[i] == val) return i;
-	}
-	uInt size = constants.size();
-	constants.push_back(val);
-	return size;
+	auto [it, inserted] = constantIndexes.try_emplace(val, constants.size());
+	if (inserted) constants.push_back(val);
+	return it->second;
 }
 
 string valueHelpers::toString(Value x, std::shared_ptr<ankerl::unordered_dense::set<object::Obj*>> stack){
@@ -60,7 +56,10 @@ string valueHelpers::toString(Value x, std::shared_ptr<ankerl::unordered_dense::
         case ValueType::NUMBER:
             // TODO: Make custom precision with string streams?
             // TODO: Do some funky stuff with ints
-            if(isInt(x)) return std::to_string(static_cast<uInt64>(round(decodeNumber(x))));
+            // Integral numbers outside of the int64_t range can't be cast, they're printed like every other double
+            if(isInt(x) && std::abs(decodeNumber(x)) < 9223372036854775808.0) {
+                return std::to_string(static_cast<int64_t>(round(decodeNumber(x))));
+            }
             return std::to_string(decodeNumber(x));
         case ValueType::BOOL:
             return (decodeBool(x)) ? "true" : "false";
@@ -53,10 +53,13 @@ struct Globalvar {
 	string name;
 	Value val;
 	bool isDefined;
+	// Functions and classes, assigned at compile time and never reassigned, so reads compile to their value
+	bool isConstant;
 	Globalvar(string _name, Value _val) {
 		name = _name;
 		val = _val;
 		isDefined = false;
+		isConstant = false;
 	}
 };
 
@@ -73,6 +76,7 @@ enum class OpCode {
 	FALSE,
 	// Unary
 	NEGATE,
+	NEGATE_NUM,
 	NOT,
 	BIN_NOT,
 	INCREMENT,//arg: bit flags for type of incrementation and optional 8-16bit arg
@@ -87,6 +91,12 @@ enum class OpCode {
 	MOD,
 	BITSHIFT_LEFT,
 	BITSHIFT_RIGHT,
+	// Used when typeInference proves both operands are numbers(or strings for ADD_STR), these don't check types
+	ADD_NUM,
+	SUBTRACT_NUM,
+	MULTIPLY_NUM,
+	DIVIDE_NUM,
+	ADD_STR,
 
 	// Comparisons and equality
 	EQUAL,
@@ -96,6 +106,11 @@ enum class OpCode {
 	LESS,
 	LESS_EQUAL,
     IN,
+    GREATER_NUM,
+    GREATER_EQUAL_NUM,
+    LESS_NUM,
+    LESS_EQUAL_NUM,
+    IN_RANGE,//arg: 8-bit is end inclusive, range bounds are on the stack instead of a range object
 
 
 	// Variables
@@ -119,11 +134,13 @@ enum class OpCode {
 	JUMP_IF_FALSE,//arg: 16-bit jump offset
 	JUMP_IF_TRUE,//arg: 16-bit jump offset
 	JUMP_IF_FALSE_POP,//arg: 16-bit jump offset
+	JUMP_IF_TRUE_POP,//arg: 16-bit jump offset, only emitted by the peephole optimizer
 	LOOP_IF_TRUE,//arg: 16-bit jump offset(gets negated)
 	LOOP,//arg: 16-bit jump offset(gets negated)
 	JUMP_POPN, //arg: 16-bit jump offset, 8-bit num to pop
-	SWITCH, //arg: 16-bit number of constants in cases, followed by 8-bit case constants and 16-bit jump offsets
-	SWITCH_LONG, //arg: 16-bit number of constants in cases, followed by 16-bit case constants and 16-bit jump offsets
+	SWITCH, //arg: 16-bit number of constants in cases, followed by 8-bit case constants(sorted by value) and 16-bit jump offsets
+	SWITCH_LONG, //arg: 16-bit number of constants in cases, followed by 16-bit case constants(sorted by value) and 16-bit jump offsets
+	SWITCH_TABLE, //arg: 16-bit constant of the lowest case, 16-bit table size, followed by 16-bit jump offsets for each integer in the range
 
 	// Functions
 	CALL,//arg: 8-bit argument count
@@ -141,6 +158,14 @@ enum class OpCode {
     // gets optimized to use GET_PROPERTY
     GET,
     SET,
+    GET_RANGE,//arg: 8-bit is end inclusive, slices an array using the range bounds on the stack
+    SET_RANGE,//arg: 8-bit is end inclusive
+    // Index is proven to be a non negative integer at compile time, only the upper bound is checked
+    GET_INDEX,
+    SET_INDEX,
+    // Index is also proven to be below the length of the array, no bounds are checked
+    GET_INDEX_UNCHECKED,
+    SET_INDEX_UNCHECKED,
 
 	//OOP
 	GET_PROPERTY,//arg: 8-bit ObjString constant index
@@ -164,6 +189,9 @@ enum class OpCode {
 	GET_SUPER_LONG,//arg: 16-bit ObjString constant index
 	SUPER_INVOKE,//arg: 8-bit ObjString constant index, 8-bit argument count
 	SUPER_INVOKE_LONG,//arg: 16-bit ObjString constant index, 8-bit argument count
+    // Method was resolved at compile time, the receiver is already in the slot below the args
+    CALL_DIRECT,//arg: 8-bit ObjClosure constant index, 8-bit argument count
+    CALL_DIRECT_LONG,//arg: 16-bit ObjClosure constant index, 8-bit argument count
 
     INSTANCEOF,//arg: 16-bit ObjClass constant index
 };
@@ -198,6 +226,8 @@ public:
 	vector<codeLine> lines;
 	vector<uint8_t> bytecode;
 	vector<Value> constants;
+	// Index of each value in constants, interned strings with the same contents share a Value so they're deduplicated as well
+	ankerl::unordered_dense::map<Value, uInt> constantIndexes;
 	Chunk();
 	void writeData(uint8_t opCode, uInt line, byte fileIndex);
 	codeLine getLine(uInt offset);
@@ -210,7 +240,7 @@ public:
 
 struct CallFrame {
 	object::ObjClosure* closure;
-	byte* ip;
+	const byte* ip;
 	Value* slots;
 	CallFrame() : closure(nullptr), ip(nullptr), slots(nullptr) {};
 };
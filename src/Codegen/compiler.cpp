@@ -1,10 +1,17 @@
 #include "compiler.h"
 #include "../ErrorHandling/errorHandler.h"
 #include <unordered_set>
+#include <algorithm>
 #include <iostream>
 #include "../Includes/fmt/format.h"
 #include "../codegen/valueHelpersInline.cpp"
 #include "upvalueFinder.h"
+#include "constantFolder.h"
+#include "inliner.h"
+#include "typeInference.h"
+#include "loopOptimizer.h"
+#include "peephole.h"
+#include "nameResolver.h"
 #include "../Runtime/thread.h"
 #include "../Runtime/nativeFunctions.h"
 
@@ -18,13 +25,15 @@ using namespace valueHelpers;
 #define SHORT_CONSTANT_LIMIT UINT8_MAX
 #endif
 
+//switch statements with fewer cases than this always use the sorted case list
+#define SWITCH_TABLE_MIN_CASES 4
+
 //only checks the closest loop/switch, since any break, continue or advance is going to break out of that loop/switch
 #define CHECK_SCOPE_FOR_LOOP (current->scopeWithLoop.size() > 0 && local.depth <= current->scopeWithLoop.back())
 #define CHECK_SCOPE_FOR_SWITCH (current->scopeWithSwitch.size() > 0 && local.depth <= current->scopeWithSwitch.back())
 
 CurrentChunkInfo::CurrentChunkInfo(CurrentChunkInfo* _enclosing, FuncType _type) : enclosing(_enclosing), type(_type) {
     upvalues = std::array<Upvalue, UPVAL_MAX>();
-    hasReturnStmt = false;
     hasCapturedLocals = false;
     localCount = 0;
     scopeDepth = 0;
@@ -34,27 +43,41 @@ CurrentChunkInfo::CurrentChunkInfo(CurrentChunkInfo* _enclosing, FuncType _type)
         // First slot is claimed for function name
         Local* local = &locals[localCount++];
         local->depth = 0;
-        local->name = "";
+        local->symbol = 0;
     }
     chunk = Chunk();
     func = new ObjFunc();
 }
 
-Compiler::Compiler(vector<CSLModule*>& _units) {
+Compiler::Compiler(vector<CSLModule*>& _units, bool _compileLazily, CompilerOptions _options) : irPasses(_options.dumpIR) {
+    options = _options;
+    if (options.inlining) inliner::Inliner inl(_units);
+    constantFolder::ConstantFolder folder(_units);
+    typeInference::TypeInference types(_units);
+    loopOptimizer::LoopOptimizer loops(_units);
     upvalueFinder::UpvalueFinder f(_units);
     current = new CurrentChunkInfo(nullptr, FuncType::TYPE_SCRIPT);
-    baseClass = new object::ObjClass("base class", nullptr);
-    baseClass->methods.insert_or_assign(ObjString::createStr("to_string"), new object::ObjNativeFunc([](runtime::Thread* thread, int8_t argCount){
-        thread->push(encodeObj(object::ObjString::createStr(valueHelpers::toString(thread->pop()))));
-    }, 0, "to_string"));
+    baseClass = runtime::createBaseClass();
     currentClass = nullptr;
     curUnitIndex = 0;
     curGlobalIndex = 0;
     units = _units;
+    compileLazily = _compileLazily;
+    lazyCompileFailed = false;
     nativeFuncs = runtime::createNativeFuncs();
     nativeFuncNames = runtime::createNativeNameTable(nativeFuncs);
+    findOverridingDecls();
+
+    initBlockFunc = nullptr;
 
     for (CSLModule* unit : units) {
+        // Units are sorted by dependencies so the main one comes last, top level code of everything it imports is
+        // split into its own function which the VM runs first(and which a heap snapshot can run ahead of time)
+        if (unit == units.back() && units.size() > 1) {
+            initBlockFunc = endFuncDecl();
+            initBlockFunc->name = "script";
+            current = new CurrentChunkInfo(nullptr, FuncType::TYPE_SCRIPT);
+        }
         curUnit = unit;
         sourceFiles.push_back(unit->file);
         for (const auto decl : unit->topDeclarations) {
@@ -76,7 +99,11 @@ Compiler::Compiler(vector<CSLModule*>& _units) {
     mainBlockFunc = endFuncDecl();
     mainBlockFunc->name = "script";
     memory::gc.collect(this);
-    for (CSLModule* unit : units) delete unit;
+    // Bodies of functions that weren't compiled yet are compiled from the AST later
+    if (lazyFuncs.empty()) {
+        for (CSLModule* unit : units) delete unit;
+        units.clear();
+    }
 }
 
 static Token probeToken(AST::ASTNodePtr ptr){
@@ -104,8 +131,14 @@ void Compiler::visitSetExpr(AST::SetExpr* expr) {
         // Allows for things like object["field" + "name"]
         expr->value->accept(this);
         expr->callee->accept(this);
+        // arr[a..b] = val doesn't need a range object
+        if(emitRangeBounds(expr->field)){
+            emitBytes(+OpCode::SET_RANGE, static_cast<AST::RangeExpr*>(expr->field)->endInclusive);
+            return;
+        }
         expr->field->accept(this);
-        emitByte(+OpCode::SET);
+        if (expr->isInBounds) emitByte(+OpCode::SET_INDEX_UNCHECKED);
+        else emitByte(expr->hasNonNegativeIndex ? +OpCode::SET_INDEX : +OpCode::SET);
         return;
     }
     if(resolveThis(expr)) return;
@@ -167,6 +200,16 @@ void Compiler::visitBinaryExpr(AST::BinaryExpr* expr) {
             patchJump(jump);
             return;
         }
+        case TokenType::IN:{
+            // The range is only used for the check, so it never gets allocated
+            if(emitRangeBounds(expr->right)){
+                emitBytes(+OpCode::IN_RANGE, static_cast<AST::RangeExpr*>(expr->right)->endInclusive);
+                return;
+            }
+            expr->right->accept(this);
+            emitByte(+OpCode::IN);
+            return;
+        }
         case TokenType::INSTANCEOF:{
             auto klass = getClassFromExpr(expr->right);
             uint16_t index = makeConstant(encodeObj(klass));
@@ -192,12 +235,11 @@ void Compiler::visitBinaryExpr(AST::BinaryExpr* expr) {
         case TokenType::GREATER_EQUAL:	 op = +OpCode::GREATER_EQUAL; break;
         case TokenType::LESS:			 op = +OpCode::LESS; break;
         case TokenType::LESS_EQUAL:		 op = +OpCode::LESS_EQUAL; break;
-        case TokenType::IN:              op = +OpCode::IN; break;
         // Should never be hit
         default: error(expr->op, "Unrecognized token in binary expression.");
     }
     expr->right->accept(this);
-    emitByte(op);
+    emitByte(specializeBinaryOp(op, expr->operandType));
 }
 
 void Compiler::visitUnaryExpr(AST::UnaryExpr* expr) {
@@ -236,7 +278,7 @@ void Compiler::visitUnaryExpr(AST::UnaryExpr* expr) {
         }
         else if (expr->right->type == AST::ASTType::FIELD_ACCESS) {
             // If a field is being incremented, compile the object, and then if it's not a dot access also compile the field
-            auto left = std::static_pointer_cast<AST::FieldAccessExpr>(expr->right);
+            auto left = static_cast<AST::FieldAccessExpr*>(expr->right);
             updateLine(left->accessor);
             left->callee->accept(this);
 
@@ -277,7 +319,9 @@ void Compiler::visitUnaryExpr(AST::UnaryExpr* expr) {
     if (expr->isPrefix) {
         expr->right->accept(this);
         switch (expr->op.type) {
-            case TokenType::MINUS: emitByte(+OpCode::NEGATE); break;
+            case TokenType::MINUS:
+                emitByte(expr->operandType == AST::InferredType::NUMBER ? +OpCode::NEGATE_NUM : +OpCode::NEGATE);
+                break;
             case TokenType::BANG: emitByte(+OpCode::NOT); break;
             case TokenType::TILDA: emitByte(+OpCode::BIN_NOT); break;
         }
@@ -321,8 +365,14 @@ void Compiler::visitFieldAccessExpr(AST::FieldAccessExpr* expr) {
     //array[index] or object["propertyAsString"]
     if(expr->accessor.type == TokenType::LEFT_BRACKET){
         expr->callee->accept(this);
+        // Slicing with arr[a..b] doesn't need a range object
+        if(emitRangeBounds(expr->field)){
+            emitBytes(+OpCode::GET_RANGE, static_cast<AST::RangeExpr*>(expr->field)->endInclusive);
+            return;
+        }
         expr->field->accept(this);
-        emitByte(+OpCode::GET);
+        if (expr->isInBounds) emitByte(+OpCode::GET_INDEX_UNCHECKED);
+        else emitByte(expr->hasNonNegativeIndex ? +OpCode::GET_INDEX : +OpCode::GET);
         return;
     }
 
@@ -393,7 +443,8 @@ void Compiler::visitLiteralExpr(AST::LiteralExpr* expr) {
         case TokenType::NUMBER: {
             string num = expr->token.getLexeme();
             double val = std::stod(num);
-            if (isInt(val) && val <= SHORT_CONSTANT_LIMIT) { emitBytes(+OpCode::LOAD_INT, val); }
+            // LOAD_INT only holds non negative integers, -0 must also go to the constant pool to keep its sign
+            if (val >= 0 && val <= SHORT_CONSTANT_LIMIT && std::trunc(val) == val && !std::signbit(val)) { emitBytes(+OpCode::LOAD_INT, val); }
             else { emitConstant(encodeNumber(val)); }
             break;
         }
@@ -466,6 +517,10 @@ void Compiler::visitFuncLiteral(AST::FuncLiteral* expr) {
 
 void Compiler::visitModuleAccessExpr(AST::ModuleAccessExpr* expr) {
     uint16_t arg = resolveModuleVariable(expr->moduleName, expr->ident);
+    if (globals[arg].isConstant) {
+        emitConstant(globals[arg].val);
+        return;
+    }
 
     if (arg > SHORT_CONSTANT_LIMIT) {
         emitByteAnd16Bit(+OpCode::GET_GLOBAL_LONG, arg);
@@ -519,37 +574,17 @@ void Compiler::visitFuncDecl(AST::FuncDecl* decl) {
     uint16_t index = declareGlobalVar(decl->getName());
     // Defining the function here to allow for recursion
     defineGlobalVar(index);
-    //creating a new compilerInfo sets us up with a clean slate for writing bytecode, the enclosing functions info
-    //is stored in parserCurrent->enclosing
-    current = new CurrentChunkInfo(current, FuncType::TYPE_FUNC);
-    //no need for a endScope, since returning from the function discards the entire callstack
-    beginScope();
-    //we define the args as locals, when the function is called, the args will be sitting on the stack in order
-    //we just assign those positions to each arg
-    for (AST::ASTVar& var : decl->args) {
-        declareLocalVar(var);
-        defineLocalVar();
-    }
-    for(auto stmt : decl->body->statements){
-        try {
-            stmt->accept(this);
-        }catch(CompilerException e){
-
+    ObjFunc* func = deferFunc(decl, FuncType::TYPE_FUNC);
+    if (!func) {
+        func = funcBody(decl, FuncType::TYPE_FUNC);
+        //Not possible but just in case
+        if (func->upvalueCount != 0) {
+            error(decl->getName(), "Global function with upvalues detected, aborting...");
         }
     }
-    current->func->arity = decl->args.size();
-    current->func->name = decl->getName().getLexeme();
-    //have to do this here since endFuncDecl() deletes the compilerInfo
-    std::array<Upvalue, UPVAL_MAX> upvals = current->upvalues;
-
-    ObjFunc* func = endFuncDecl();
-
-    //Not possible but just in case
-    if(func->upvalueCount != 0){
-        error(decl->getName(), "Global function with upvalues detected, aborting...");
-    }
     // Assigning at compile time to save on bytecode
     globals[index].val = encodeObj(new ObjClosure(func));
+    globals[index].isConstant = true;
 }
 
 void Compiler::visitClassDecl(AST::ClassDecl* decl) {
@@ -558,7 +593,7 @@ void Compiler::visitClassDecl(AST::ClassDecl* decl) {
     auto klass = new object::ObjClass(className.getLexeme(), nullptr);
 
 
-    currentClass = std::make_unique<ClassChunkInfo>(klass);
+    currentClass = std::make_unique<ClassChunkInfo>(klass, decl);
 
     if (decl->inheritedClass) {
         //if the class inherits from some other class, load the parent class and declare 'super' as a local variable which holds the superclass
@@ -597,10 +632,15 @@ void Compiler::visitClassDecl(AST::ClassDecl* decl) {
     defineGlobalVar(index);
     // Assigning at compile time to save on bytecode, also to get access to the class in getClassFromExpr
     globals[index].val = encodeObj(klass);
+    globals[index].isConstant = true;
 
     for (auto& _method : decl->methods) {
         //At this point the name is guaranteed to exist as a string, so createStr just returns the already created string
-        klass->methods[ObjString::createStr((_method.isPublic ? "" : "!") + _method.method->getName().getLexeme())] = method(_method.method.get(), className);
+        klass->methods[ObjString::createStr((_method.isPublic ? "" : "!") + _method.method->getName().getLexeme())] = method(_method.method, className);
+    }
+    // Every method has a closure now, fill in the constants of direct calls made before the callee was compiled
+    for (auto& [constant, name] : currentClass->directCalls) {
+        mainCodeBlock.constants[constant] = encodeObj(klass->methods[name]);
     }
     currentClass = nullptr;
 }
@@ -758,13 +798,13 @@ void Compiler::visitSwitchStmt(AST::SwitchStmt* stmt) {
     current->scopeWithSwitch.push_back(current->scopeDepth);
     //compile the expression in parentheses
     stmt->expr->accept(this);
-    vector<uint16_t> constants;
-    vector<uint16_t> jumps;
-    bool isLong = false;
-    for (const auto & _case : stmt->cases) {
+    //every case constant paired with the index of the case it jumps to
+    vector<std::pair<Value, uInt>> constants;
+    ankerl::unordered_dense::set<Value> seen;
+    for (uInt i = 0; i < stmt->cases.size(); i++) {
         //a single case can contain multiple constants(eg. case 1 | 4 | 9:), each constant is compiled and its jump will point to the
         //same case code block
-        for (const Token& constant : _case->constants) {
+        for (const Token& constant : stmt->cases[i]->constants) {
             Value val;
             updateLine(constant);
             //create constant and add it to the constants array
@@ -790,54 +830,26 @@ void Compiler::visitSwitchStmt(AST::SwitchStmt* stmt) {
                         error(constant, "Case expression can only be a constant.");
                     }
                 }
-                constants.push_back(makeConstant(val));
-                if (constants.back() > SHORT_CONSTANT_LIMIT) isLong = true;
+                //only the first case with a given constant can ever be reached
+                if (seen.insert(val).second) constants.emplace_back(val, i);
             }
             catch (CompilerException e) {}
         }
     }
-    //the arguments for a switch op code are:
-    //16-bit number n of case constants
-    //n 8 or 16 bit numbers for each constant
-    //n + 1 16-bit numbers of jump offsets(default case is excluded from constants, so the number of jumps is the number of constants + 1)
-    //the default jump offset is always the last
-    if (isLong) {
-        emitByteAnd16Bit(+OpCode::SWITCH_LONG, constants.size());
-        for (uInt16 constant : constants) {
-            emit16Bit(constant);
-        }
-    }
-    else {
-        emitByteAnd16Bit(+OpCode::SWITCH, constants.size());
-        for (uInt16 constant : constants) {
-            emitByte(constant);
-        }
-    }
-
-    for (int i = 0; i < constants.size(); i++) {
-        jumps.push_back(getChunk()->bytecode.size());
-        emit16Bit(0xffff);
-    }
-    //default jump
-    jumps.push_back(getChunk()->bytecode.size());
-    emit16Bit(0xffff);
+    //positions of the jump offsets that lead to each case, and to the default case
+    vector<vector<uInt>> caseJumps(stmt->cases.size());
+    vector<uInt> defaultJumps;
+    if (isDenseSwitch(constants)) emitSwitchTable(constants, caseJumps, defaultJumps);
+    else emitSwitchSorted(constants, caseJumps, defaultJumps);
 
     //at the end of each case is a implicit break
     vector<uint32_t> implicitBreaks;
 
-    //compile the code of all cases, before each case update the jump for that case to the parserCurrent ip
-    int i = 0;
-    for (const std::shared_ptr<AST::CaseStmt>& _case : stmt->cases) {
-        if (_case->caseType.getLexeme() == "default") {
-            patchJump(jumps[jumps.size() - 1]);
-        }
-        else {
-            //a single case can contain multiple constants(eg. case 1 | 4 | 9:), need to update jumps for each constant
-            int constantNum = _case->constants.size();
-            for (int j = 0; j < constantNum; j++) {
-                patchJump(jumps[i]);
-                i++;
-            }
+    //compile the code of all cases, before each case update the jumps for that case to the parserCurrent ip
+    for (uInt i = 0; i < stmt->cases.size(); i++) {
+        auto& _case = stmt->cases[i];
+        for (uInt jump : _case->caseType.type == TokenType::DEFAULT ? defaultJumps : caseJumps[i]) {
+            patchJump(jump);
         }
         //new scope because patchScopeJumps only looks at scope deeper than the one it's called at
         beginScope();
@@ -849,7 +861,9 @@ void Compiler::visitSwitchStmt(AST::SwitchStmt* stmt) {
         patchScopeJumps(ScopeJumpType::ADVANCE);
     }
     //if there is no default case the default jump goes to the end of the switch stmt
-    if (!stmt->hasDefault) jumps[jumps.size() - 1] = getChunk()->bytecode.size();
+    if (!stmt->hasDefault) {
+        for (uInt jump : defaultJumps) patchJump(jump);
+    }
 
     //all implicit breaks lead to the end of the switch statement
     for (uInt jmp : implicitBreaks) {
@@ -896,7 +910,6 @@ void Compiler::visitReturnStmt(AST::ReturnStmt* stmt) {
     else if (current->type == FuncType::TYPE_CONSTRUCTOR) {
         error(stmt->keyword, "Can't return a value from a constructor.");
     }
-    current->hasReturnStmt = true;
     //if no expression is given, null is returned
     if (stmt->expr == nullptr) {
         emitReturn();
@@ -912,7 +925,7 @@ void Compiler::visitReturnStmt(AST::ReturnStmt* stmt) {
 
 void Compiler::emitByte(byte byte) {
     //line is incremented whenever we find a statement/expression that contains tokens
-    getChunk()->writeData(byte, current->line, sourceFiles.size() - 1);
+    getChunk()->writeData(byte, current->line, curUnitIndex);
 }
 
 void Compiler::emitBytes(byte byte1, byte byte2) {
@@ -1007,6 +1020,102 @@ void Compiler::patchScopeJumps(ScopeJumpType type) {
     }
 }
 
+// Integer cases that fill at least half of the range between the lowest and the highest case get a jump table
+bool Compiler::isDenseSwitch(vector<std::pair<Value, uInt>>& constants) {
+    if (constants.size() < SWITCH_TABLE_MIN_CASES) return false;
+    double low = INT32_MAX, high = INT32_MIN;
+    for (auto& [val, caseIndex] : constants) {
+        if (!isNumber(val)) return false;
+        double num = decodeNumber(val);
+        if (num != std::trunc(num) || num < INT32_MIN || num > INT32_MAX) return false;
+        low = std::min(low, num);
+        high = std::max(high, num);
+    }
+    double range = high - low + 1;
+    return range <= constants.size() * 2 && range <= UINT16_MAX;
+}
+
+// Arguments: 16-bit constant of the lowest case, 16-bit table size n, then n + 1 16-bit jump offsets(last one is default)
+// Slots between cases lead to the default case
+void Compiler::emitSwitchTable(vector<std::pair<Value, uInt>>& constants, vector<vector<uInt>>& caseJumps, vector<uInt>& defaultJumps) {
+    double low = INT32_MAX;
+    for (auto& [val, caseIndex] : constants) low = std::min(low, decodeNumber(val));
+
+    vector<int> slots;
+    for (auto& [val, caseIndex] : constants) {
+        uInt slot = decodeNumber(val) - low;
+        if (slot >= slots.size()) slots.resize(slot + 1, -1);
+        slots[slot] = caseIndex;
+    }
+    emitByte(+OpCode::SWITCH_TABLE);
+    emit16Bit(makeConstant(encodeNumber(low)));
+    emit16Bit(slots.size());
+    for (int caseIndex : slots) {
+        if (caseIndex == -1) defaultJumps.push_back(getChunk()->bytecode.size());
+        else caseJumps[caseIndex].push_back(getChunk()->bytecode.size());
+        emit16Bit(0xffff);
+    }
+    defaultJumps.push_back(getChunk()->bytecode.size());
+    emit16Bit(0xffff);
+}
+
+//the arguments for a switch op code are:
+//16-bit number n of case constants
+//n 8 or 16 bit numbers for each constant
+//n + 1 16-bit numbers of jump offsets(default case is excluded from constants, so the number of jumps is the number of constants + 1)
+//the default jump offset is always the last
+//constants are sorted by their raw value, which lets the VM binary search through larger switches
+void Compiler::emitSwitchSorted(vector<std::pair<Value, uInt>>& constants, vector<vector<uInt>>& caseJumps, vector<uInt>& defaultJumps) {
+    std::sort(constants.begin(), constants.end());
+    vector<uInt16> indexes;
+    bool isLong = false;
+    for (auto& [val, caseIndex] : constants) {
+        indexes.push_back(makeConstant(val));
+        if (indexes.back() > SHORT_CONSTANT_LIMIT) isLong = true;
+    }
+    emitByteAnd16Bit(isLong ? +OpCode::SWITCH_LONG : +OpCode::SWITCH, indexes.size());
+    for (uInt16 index : indexes) {
+        if (isLong) emit16Bit(index);
+        else emitByte(index);
+    }
+
+    for (auto& [val, caseIndex] : constants) {
+        caseJumps[caseIndex].push_back(getChunk()->bytecode.size());
+        emit16Bit(0xffff);
+    }
+    defaultJumps.push_back(getChunk()->bytecode.size());
+    emit16Bit(0xffff);
+}
+
+// Swaps a generic binary opcode for one that skips type checks, if typeInference proved the types of both operands
+byte Compiler::specializeBinaryOp(byte op, AST::InferredType operandType) {
+    if (operandType == AST::InferredType::STRING) return op == +OpCode::ADD ? +OpCode::ADD_STR : op;
+    if (operandType != AST::InferredType::NUMBER) return op;
+    switch (op) {
+        case +OpCode::ADD: return +OpCode::ADD_NUM;
+        case +OpCode::SUBTRACT: return +OpCode::SUBTRACT_NUM;
+        case +OpCode::MULTIPLY: return +OpCode::MULTIPLY_NUM;
+        case +OpCode::DIVIDE: return +OpCode::DIVIDE_NUM;
+        case +OpCode::GREATER: return +OpCode::GREATER_NUM;
+        case +OpCode::GREATER_EQUAL: return +OpCode::GREATER_EQUAL_NUM;
+        case +OpCode::LESS: return +OpCode::LESS_NUM;
+        case +OpCode::LESS_EQUAL: return +OpCode::LESS_EQUAL_NUM;
+        default: return op;
+    }
+}
+
+// If node is a range literal that's consumed right away(x in a..b, arr[a..b]) it can't escape,
+// so only its bounds are pushed and the VM builds the range on its stack instead of the heap
+bool Compiler::emitRangeBounds(AST::ASTNodePtr node) {
+    if (node->type != AST::ASTType::RANGE) return false;
+    auto range = static_cast<AST::RangeExpr*>(node);
+    if (range->start) range->start->accept(this);
+    else emitConstant(encodeNumber(-std::numeric_limits<double>::infinity()));
+    if (range->end) range->end->accept(this);
+    else emitConstant(encodeNumber(std::numeric_limits<double>::infinity()));
+    return true;
+}
+
 #pragma endregion
 
 #pragma region Variables
@@ -1057,6 +1166,11 @@ void Compiler::namedVar(Token token, bool canAssign) {
         // Classes cannot be accessed with variable get/set, only way they can be accessed is when inheriting,
         // within the 'instanceof' operator and within the 'new' operator
         if(isClass(globals[arg].val)) error(token, "Cannot access or mutate classes.");
+        // Functions can't be assigned to, no need to load them from the globals at runtime
+        if(!canAssign && globals[arg].isConstant){
+            emitConstant(globals[arg].val);
+            return;
+        }
 
         if (arg > SHORT_CONSTANT_LIMIT) {
             getOp = +OpCode::GET_GLOBAL_LONG;
@@ -1087,7 +1201,7 @@ uint16_t Compiler::declareGlobalVar(Token name) {
     // (globals.size() - curGlobalIndex = globals declared in current file)
     int index = curGlobalIndex;
     for (int i = curGlobalIndex; i < globals.size(); i++) {
-        if (name.getLexeme() == globals[i].name) return i;
+        if (name.getView() == globals[i].name) return i;
     }
     // Should never be hit, but here just in case
     error(name, "Couldn't find variable.");
@@ -1102,8 +1216,7 @@ void Compiler::declareLocalVar(AST::ASTVar& var) {
         if (local->depth != -1 && local->depth < current->scopeDepth) {
             break;
         }
-        string str = var.name.getLexeme();
-        if (str.compare(local->name) == 0) {
+        if (var.name.symbol == local->symbol) {
             error(var.name, "Already a variable with this name in this scope.");
         }
     }
@@ -1118,7 +1231,7 @@ void Compiler::addLocal(AST::ASTVar var) {
         return;
     }
     Local* local = &current->locals[current->localCount++];
-    local->name = var.name.getLexeme();
+    local->symbol = var.name.symbol;
     local->depth = -1;
     local->isLocalUpvalue = var.type == AST::ASTVarType::LOCAL_UPVALUE;
 }
@@ -1149,8 +1262,7 @@ int Compiler::resolveLocal(CurrentChunkInfo* func, Token name) {
     updateLine(name);
     for (int i = func->localCount - 1; i >= 0; i--) {
         Local* local = &func->locals[i];
-        string str = name.getLexeme();
-        if (str.compare(local->name) == 0) {
+        if (name.symbol == local->symbol) {
             if (local->depth == -1) {
                 error(name, "Can't read local variable in its own initializer.");
             }
@@ -1220,43 +1332,181 @@ object::ObjClosure* Compiler::method(AST::FuncDecl* _method, Token className) {
     FuncType type = FuncType::TYPE_METHOD;
     // Constructors are treated separately, but are still methods
     if (_method->getName().equals(className)) type = FuncType::TYPE_CONSTRUCTOR;
+    ObjFunc* func = deferFunc(_method, type);
+    if (!func) {
+        func = funcBody(_method, type);
+        if (func->upvalueCount != 0) error(_method->getName(), "Upvalues captured in method, aborting...");
+    }
+    return new ObjClosure(func);
+}
+
+// Compiles the args and body of a function or method declaration
+object::ObjFunc* Compiler::funcBody(AST::FuncDecl* decl, FuncType type) {
+    //creating a new compilerInfo sets us up with a clean slate for writing bytecode, the enclosing functions info
+    //is stored in parserCurrent->enclosing
     // "this" gets implicitly defined as the first local in methods and the constructor
     current = new CurrentChunkInfo(current, type);
+    //no need for a endScope, since returning from the function discards the entire callstack
     beginScope();
-    // Args defined as local in order they were passed to the function
-    for (AST::ASTVar& var : _method->args) {
+    //we define the args as locals, when the function is called, the args will be sitting on the stack in order
+    //we just assign those positions to each arg
+    for (AST::ASTVar& var : decl->args) {
         declareLocalVar(var);
         defineLocalVar();
     }
-    for(auto stmt : _method->body->statements){
+    for(auto stmt : decl->body->statements){
         try {
             stmt->accept(this);
         }catch(CompilerException e){
 
         }
     }
-    current->func->arity = _method->arity;
+    // Methods have "this" as their first arg, which isn't counted
+    current->func->arity = decl->arity;
+    current->func->name = decl->getName().getLexeme();
+    return endFuncDecl();
+}
+
+// Functions and methods of imported modules get an empty function object that's compiled on the first call,
+// returns nullptr if decl should be compiled right away
+object::ObjFunc* Compiler::deferFunc(AST::FuncDecl* decl, FuncType type) {
+    if (!compileLazily || curUnit == units.back()) return nullptr;
+    auto func = new ObjFunc();
+    func->arity = decl->arity;
+    func->name = decl->getName().getLexeme();
+    ObjClass* klass = currentClass ? currentClass->klass : nullptr;
+    AST::ClassDecl* classDecl = currentClass ? currentClass->decl : nullptr;
+    lazyFuncs.emplace(func, LazyFunc{decl, type, klass, classDecl, curUnit, curUnitIndex, curGlobalIndex, definedGlobals});
+    return func;
+}
 
-    current->func->name = _method->getName().getLexeme();
-    ObjFunc* func = endFuncDecl();
-    if (func->upvalueCount != 0) error(_method->getName(), "Upvalues captured in method, aborting...");
-    return new ObjClosure(func);
+// Puts the compiler back into the state it was in when it reached the declaration and compiles the body into whatever
+// the main code block currently is, closures already point to func so the offsets of the freshly compiled function
+// are handed over to it
+void Compiler::compileDeferred(object::ObjFunc* func) {
+    auto it = lazyFuncs.find(func);
+    LazyFunc lazy = std::move(it->second);
+    lazyFuncs.erase(it);
+    curUnit = lazy.unit;
+    curUnitIndex = lazy.unitIndex;
+    curGlobalIndex = lazy.globalIndex;
+    definedGlobals = std::move(lazy.definedGlobals);
+    if (lazy.klass) currentClass = std::make_unique<ClassChunkInfo>(lazy.klass, lazy.classDecl);
+    CurrentChunkInfo* enclosing = current;
+    ObjFunc* compiled;
+    try {
+        compiled = funcBody(lazy.decl, lazy.type);
+    }
+    catch (CompilerException e) {
+        // Errors in the args aren't caught by funcBody, the error is already reported so only the chunk is dropped
+        while (current != enclosing) {
+            CurrentChunkInfo* temp = current->enclosing;
+            delete current;
+            current = temp;
+        }
+        currentClass = nullptr;
+        return;
+    }
+    currentClass = nullptr;
+    func->bytecodeOffset = compiled->bytecodeOffset;
+    func->constantsOffset = compiled->constantsOffset;
+    // Closures declared in the body finish first, so the body itself is always the last function endFuncDecl added
+    compiledFuncs.back() = func;
+}
+
+LazyChunk* Compiler::compileLazyFunc(object::ObjFunc* func) {
+    if (!lazyFuncs.contains(func)) return nullptr;
+    auto lazyChunk = std::make_unique<LazyChunk>();
+    // Compiled into an empty main code block, which is then moved into the lazy chunk
+    std::swap(mainCodeBlock, lazyChunk->chunk);
+    compiledFuncs.clear();
+    compileDeferred(func);
+    std::swap(mainCodeBlock, lazyChunk->chunk);
+    lazyChunk->funcs = std::move(compiledFuncs);
+    compiledFuncs.clear();
+    if (errorHandler::hasErrors()) {
+        lazyCompileFailed = true;
+        return nullptr;
+    }
+    lazyChunks.push_back(std::move(lazyChunk));
+    return lazyChunks.back().get();
+}
+
+bool Compiler::checkLazyFuncs() {
+    nameResolver::NameResolver resolver(this);
+    vector<ObjFunc*> unresolved;
+    for (auto& [func, lazy] : lazyFuncs) {
+        curUnit = lazy.unit;
+        curUnitIndex = lazy.unitIndex;
+        curGlobalIndex = lazy.globalIndex;
+        // Swapped back right after, copying it for every function would make this quadratic
+        std::swap(definedGlobals, lazy.definedGlobals);
+        if (lazy.klass) currentClass = std::make_unique<ClassChunkInfo>(lazy.klass, lazy.classDecl);
+        if (!resolver.resolves(lazy.decl, lazy.type == FuncType::TYPE_CONSTRUCTOR)) unresolved.push_back(func);
+        currentClass = nullptr;
+        std::swap(definedGlobals, lazy.definedGlobals);
+    }
+    for (ObjFunc* func : unresolved) {
+        LazyChunk* lazyChunk = compileLazyFunc(func);
+        if (!lazyChunk) continue;
+        // Same as VM::prepareFunc, the VM doesn't exist yet
+        Chunk& chunk = lazyChunk->chunk;
+        for (ObjFunc* compiled : lazyChunk->funcs) {
+            compiled->constants = chunk.constants.data() + compiled->constantsOffset;
+            compiled->code = chunk.bytecode.data() + compiled->bytecodeOffset;
+        }
+    }
+    return !lazyCompileFailed;
+}
+
+void Compiler::finishLazyFuncs() {
+    for (auto& lazyChunk : lazyChunks) {
+        Chunk& chunk = lazyChunk->chunk;
+        uInt64 bytecodeOffset = mainCodeBlock.bytecode.size();
+        uInt64 constantsOffset = mainCodeBlock.constants.size();
+        mainCodeBlock.bytecode.insert(mainCodeBlock.bytecode.end(), chunk.bytecode.begin(), chunk.bytecode.end());
+        mainCodeBlock.constants.insert(mainCodeBlock.constants.end(), chunk.constants.begin(), chunk.constants.end());
+        for (codeLine line : chunk.lines) {
+            line.end += bytecodeOffset;
+            mainCodeBlock.lines.push_back(line);
+        }
+        // Code pointers stay where they are, the lazy chunk is kept alive
+        for (ObjFunc* func : lazyChunk->funcs) {
+            func->bytecodeOffset += bytecodeOffset;
+            func->constantsOffset += constantsOffset;
+        }
+    }
+    compiledFuncs.clear();
+    while (!lazyFuncs.empty()) compileDeferred(lazyFuncs.begin()->first);
+    // The VM only knows about its own copy of the main code block, so threads that are still running get pointers
+    // into this one
+    for (ObjFunc* func : compiledFuncs) {
+        func->constants = mainCodeBlock.constants.data() + func->constantsOffset;
+        std::atomic_ref<const byte*>(func->code).store(mainCodeBlock.bytecode.data() + func->bytecodeOffset,
+                                                      std::memory_order_release);
+    }
+    compiledFuncs.clear();
+    // Every function is compiled, the AST(and the arenas holding it) isn't needed anymore
+    for (CSLModule* unit : units) delete unit;
+    units.clear();
 }
 
 bool Compiler::invoke(AST::CallExpr* expr) {
     if (expr->callee->type == AST::ASTType::FIELD_ACCESS) {
         //currently we only optimizes field invoking(struct.field() or array[field]())
-        auto call = std::static_pointer_cast<AST::FieldAccessExpr>(expr->callee);
+        auto call = static_cast<AST::FieldAccessExpr*>(expr->callee);
         if(call->accessor.type == TokenType::LEFT_BRACKET) return false;
 
         call->callee->accept(this);
         uint16_t constant;
         Token name = probeToken(call->field);
+        int direct = -1;
         // If invoking a method inside another method, make sure to get the right(public/private) name
         if(isLiteralThis(call->callee)){
             int res = resolveClassField(name, false);
             if(res == -1) error(name, fmt::format("Field {}, doesn't exist in class {}.", name.getLexeme(), currentClass->klass->name->str));
             constant = res;
+            direct = resolveDirectCall(name, false);
         }else constant = identifierConstant(name);
 
         int argCount = 0;
@@ -1264,7 +1514,8 @@ bool Compiler::invoke(AST::CallExpr* expr) {
             arg->accept(this);
             argCount++;
         }
-        if(constant > SHORT_CONSTANT_LIMIT){
+        if(direct != -1) emitDirectCall(direct, argCount);
+        else if(constant > SHORT_CONSTANT_LIMIT){
             emitBytes(+OpCode::INVOKE_LONG, argCount);
             emit16Bit(constant);
         }
@@ -1275,7 +1526,7 @@ bool Compiler::invoke(AST::CallExpr* expr) {
         return true;
     }
     else if (expr->callee->type == AST::ASTType::SUPER) {
-        auto superCall = std::static_pointer_cast<AST::SuperExpr>(expr->callee);
+        auto superCall = static_cast<AST::SuperExpr*>(expr->callee);
         uint16_t name = identifierConstant(superCall->methodName);
 
         if (currentClass == nullptr) {
@@ -1289,6 +1540,7 @@ bool Compiler::invoke(AST::CallExpr* expr) {
         if(!res.first){
             error(superCall->methodName, fmt::format("Superclass '{}' doesn't contain method '{}'.", currentClass->klass->superclass->name->str, superCall->methodName.getLexeme()));
         }
+        int direct = resolveDirectCall(superCall->methodName, true);
         //in methods and constructors, "this" is implicitly defined as the first local
         namedVar(syntheticToken("this"), false);
         int argCount = 0;
@@ -1296,6 +1548,10 @@ bool Compiler::invoke(AST::CallExpr* expr) {
             arg->accept(this);
             argCount++;
         }
+        if(direct != -1){
+            emitDirectCall(direct, argCount);
+            return true;
+        }
         // superclass gets popped, leaving only the receiver and args on the stack
         emitConstant(encodeObj(currentClass->klass->superclass));
         if(name > SHORT_CONSTANT_LIMIT){
@@ -1347,6 +1603,115 @@ int Compiler::resolveClassField(Token name, bool canAssign){
     return -1;
 }
 
+int Compiler::classFieldKind(Token name) {
+    if (!currentClass) return 0;
+    string fieldName = name.getLexeme();
+    if (classContainsField(fieldName, currentClass->klass->fieldsInit).first) return 1;
+    if (classContainsMethod(fieldName, currentClass->klass->methods).first) return 2;
+    return 0;
+}
+
+// Same checks namedVar does once a name isn't a local or a class field
+bool Compiler::canResolveGlobal(Token name, bool canAssign) {
+    int index = curGlobalIndex;
+    for (auto decl : curUnit->topDeclarations) {
+        if (name.equals(decl->getName())) {
+            // Natives can still be read under the name of a global that isn't defined yet
+            if (!definedGlobals[index]) return !canAssign && nativeFuncNames.contains(name.getLexeme());
+            if (canAssign) return decl->type != AST::ASTType::FUNC && decl->type != AST::ASTType::CLASS;
+            return !isClass(globals[index].val);
+        }
+        index++;
+    }
+    if (canAssign) return false;
+    index = checkSymbol(name);
+    if (index != -1) return !isClass(globals[index].val);
+    return nativeFuncNames.contains(name.getLexeme());
+}
+
+bool Compiler::canResolveModuleVariable(Token moduleAlias, Token variable) {
+    return findModuleVariable(moduleAlias, variable) >= 0;
+}
+
+// Same checks as getClassFromExpr
+bool Compiler::canResolveClass(AST::ASTNodePtr expr) {
+    int index;
+    if (expr->type == AST::ASTType::LITERAL) index = resolveGlobal(probeToken(expr), false);
+    else {
+        auto moduleExpr = static_cast<AST::ModuleAccessExpr*>(expr);
+        index = findModuleVariable(moduleExpr->moduleName, moduleExpr->ident);
+    }
+    return index >= 0 && isClass(globals[index].val);
+}
+
+bool Compiler::canResolveSuperMethod(Token name) {
+    if (!currentClass || !currentClass->klass->superclass) return false;
+    string fieldName = name.getLexeme();
+    return classContainsMethod(fieldName, currentClass->klass->superclass->methods).first;
+}
+
+// Finds every method and field that can override a method of a superclass, classes can only be declared at the top level
+void Compiler::findOverridingDecls() {
+    auto addName = [&](string name, AST::ClassDecl* decl){
+        auto [it, inserted] = overridingDecls.try_emplace(name, decl);
+        if (!inserted && it->second != decl) it->second = nullptr;
+    };
+    for (CSLModule* unit : units) {
+        for (AST::ASTNodePtr stmt : unit->stmts) {
+            if (stmt->type != AST::ASTType::CLASS) continue;
+            auto decl = static_cast<AST::ClassDecl*>(stmt);
+            if (!decl->inheritedClass) continue;
+            for (auto& _method : decl->methods) addName(_method.method->getName().getLexeme(), decl);
+            // Fields of an instance are looked up before its methods, so a field can hide a method as well
+            for (auto& field : decl->fields) addName(field.field.getLexeme(), decl);
+        }
+    }
+}
+
+// super.method() and this.method() where no subclass overrides the method always call the same closure,
+// so the closure is put in the constant pool and called without a lookup or a bound method
+// Returns the constant index of the closure, or -1 if the method has to be looked up at runtime
+int Compiler::resolveDirectCall(Token name, bool isSuper) {
+    if (!currentClass) return -1;
+    object::ObjClass* klass = currentClass->klass;
+    string fieldName = name.getLexeme();
+    if (isSuper) {
+        // SUPER_INVOKE only ever looks up the public name
+        auto it = klass->superclass->methods.find(ObjString::createStr(fieldName));
+        if (it == klass->superclass->methods.end() || !it->second || it->second->type != object::ObjType::CLOSURE) return -1;
+        return makeConstant(encodeObj(it->second));
+    }
+    if (classContainsField(fieldName, klass->fieldsInit).first) return -1;
+    auto res = classContainsMethod(fieldName, klass->methods);
+    if (!res.first) return -1;
+    auto decl = overridingDecls.find(fieldName);
+    if (decl != overridingDecls.end() && decl->second != currentClass->decl) return -1;
+
+    ObjString* key = ObjString::createStr((res.second ? "" : "!") + fieldName);
+    Method method = klass->methods[key];
+    if (!method) {
+        // Method of this class that isn't compiled yet(or is being compiled right now), visitClassDecl fills the constant in
+        auto [it, inserted] = current->directCalls.try_emplace(key, current->chunk.constants.size());
+        if (inserted) current->chunk.constants.push_back(encodeNil());
+        if (it->second > UINT16_MAX) error("Too many constants in one chunk.");
+        return it->second;
+    }
+    // Native methods of the base class
+    if (method->type != object::ObjType::CLOSURE) return -1;
+    return makeConstant(encodeObj(method));
+}
+
+void Compiler::emitDirectCall(uInt16 constant, int argCount) {
+    if (constant > SHORT_CONSTANT_LIMIT) {
+        emitBytes(+OpCode::CALL_DIRECT_LONG, argCount);
+        emit16Bit(constant);
+    }
+    else {
+        emitBytes(+OpCode::CALL_DIRECT, argCount);
+        emitByte(constant);
+    }
+}
+
 // Makes sure the correct prefix is used when accessing private fields
 // this.private_field -> this.!private_field
 bool Compiler::resolveThis(AST::SetExpr *expr) {
@@ -1380,6 +1745,7 @@ bool Compiler::resolveImplicitObjectField(AST::CallExpr *expr) {
     int res = resolveClassField(name, false);
     if(res == -1) return false;
     if(current->type == FuncType::TYPE_FUNC) error(name, fmt::format("Cannot access fields without 'this' within a closure, use this.{}", name.getLexeme()));
+    int direct = resolveDirectCall(name, false);
     namedVar(syntheticToken("this"), false);
 
     int8_t argCount = 0;
@@ -1387,7 +1753,8 @@ bool Compiler::resolveImplicitObjectField(AST::CallExpr *expr) {
         arg->accept(this);
         argCount++;
     }
-    if(res > SHORT_CONSTANT_LIMIT){
+    if(direct != -1) emitDirectCall(direct, argCount);
+    else if(res > SHORT_CONSTANT_LIMIT){
         emitBytes(+OpCode::INVOKE_LONG, argCount);
         emit16Bit(res);
     }
@@ -1415,7 +1782,7 @@ object::ObjClass* Compiler::getClassFromExpr(AST::ASTNodePtr expr){
         token = superclass;
     }
     else {
-        auto moduleExpr = std::static_pointer_cast<AST::ModuleAccessExpr>(expr);
+        auto moduleExpr = static_cast<AST::ModuleAccessExpr*>(expr);
         classIndex = resolveModuleVariable(moduleExpr->moduleName, moduleExpr->ident);
         token = moduleExpr->ident;
     }
@@ -1439,18 +1806,25 @@ void Compiler::error(Token token, const string& msg) noexcept(false) {
 }
 
 ObjFunc* Compiler::endFuncDecl() {
-    if (!current->hasReturnStmt) emitReturn();
+    // A return statement doesn't mean every path returns(eg. if(x) return 1;), the implicit return is removed by the
+    // peephole optimizer if it can't be reached
+    emitReturn();
     // Get the parserCurrent function we've just compiled, delete it's compiler info, and replace it with the enclosing functions compiler info
     ObjFunc* func = current->func;
     Chunk& chunk = current->chunk;
+    // For the last line of code
+    chunk.lines[chunk.lines.size() - 1].end = chunk.bytecode.size();
+    if (irPasses.needsIR(chunk, func->arity)) {
+        ssa::IRFunction ir(chunk, func->arity);
+        if (ir.isValid() && irPasses.run(ir, func->name)) ir.lower();
+    }
+    peephole::PeepholeOptimizer optimizer(chunk);
 
     //Add the bytecode, lines and constants to the main code block
     uInt64 bytecodeOffset = mainCodeBlock.bytecode.size();
     mainCodeBlock.bytecode.insert(mainCodeBlock.bytecode.end(), chunk.bytecode.begin(), chunk.bytecode.end());
     uInt64 constantsOffset = mainCodeBlock.constants.size();
     mainCodeBlock.constants.insert(mainCodeBlock.constants.end(), chunk.constants.begin(), chunk.constants.end());
-    // For the last line of code
-    chunk.lines[chunk.lines.size() - 1].end = chunk.bytecode.size();
     // Update lines to reflect the offset in the main code block
     for (codeLine& line : chunk.lines) {
         line.end += bytecodeOffset;
@@ -1462,6 +1836,11 @@ ObjFunc* Compiler::endFuncDecl() {
     // Set the offsets in the function object
     func->bytecodeOffset = bytecodeOffset;
     func->constantsOffset = constantsOffset;
+    compiledFuncs.push_back(func);
+    // Constants for direct calls to methods that weren't compiled yet, patched when the class is done
+    for (auto& [name, constant] : current->directCalls) {
+        currentClass->directCalls.emplace_back(constantsOffset + constant, name);
+    }
 
     CurrentChunkInfo* temp = current->enclosing;
     delete current;
@@ -1476,8 +1855,7 @@ void Compiler::updateLine(Token token) {
 
 // For every dependency that's imported without an alias, check if any of its exports match 'symbol', return -1 if not
 int Compiler::checkSymbol(Token symbol) {
-    string lexeme = symbol.getLexeme();
-    for (Dependency dep : curUnit->deps) {
+    for (Dependency& dep : curUnit->deps) {
         auto& decls = dep.module->topDeclarations;
         if (dep.alias.type == TokenType::NONE) {
             int globalIndex = 0;
@@ -1500,7 +1878,7 @@ int Compiler::checkSymbol(Token symbol) {
 int Compiler::resolveGlobal(Token symbol, bool canAssign) {
     bool inThisFile = false;
     int index = curGlobalIndex;
-    std::shared_ptr<AST::ASTDecl> ptr = nullptr;
+    AST::ASTDecl* ptr = nullptr;
     for (auto decl : curUnit->topDeclarations) {
         if (symbol.equals(decl->getName())) {
             // It's an error to read from a variable during its initialization
@@ -1534,19 +1912,23 @@ int Compiler::resolveGlobal(Token symbol, bool canAssign) {
 // Checks if 'variable' exists in a module which was imported with the alias 'moduleAlias',
 // If it exists return the index of the 'variable' in globals array
 uint32_t Compiler::resolveModuleVariable(Token moduleAlias, Token variable) {
+    int index = findModuleVariable(moduleAlias, variable);
+    if (index == -1) error(moduleAlias, "Module alias doesn't exist.");
+    else if (index == -2) error(variable, fmt::format("Module {} doesn't export this symbol.", moduleAlias.getLexeme()));
+    return index;
+}
+
+int Compiler::findModuleVariable(Token moduleAlias, Token variable) {
     //first find the module with the correct alias
-    Dependency* depPtr = nullptr;
-    for (Dependency dep : curUnit->deps) {
+    CSLModule* unit = nullptr;
+    for (Dependency& dep : curUnit->deps) {
         if (dep.alias.equals(moduleAlias)) {
-            depPtr = &dep;
+            unit = dep.module;
             break;
         }
     }
-    if (depPtr == nullptr) {
-        error(moduleAlias, "Module alias doesn't exist.");
-    }
+    if (unit == nullptr) return -1;
 
-    CSLModule* unit = depPtr->module;
     int index = 0;
     for (auto& i : units) {
         if (i != unit) {
@@ -1559,15 +1941,13 @@ uint32_t Compiler::resolveModuleVariable(Token moduleAlias, Token variable) {
             index++;
         }
     }
-
-    error(variable, fmt::format("Module {} doesn't export this symbol.", depPtr->alias.getLexeme()));
-    // Never hit
-    return -1;
+    return -2;
 }
 #pragma endregion
 
 // Only used when debugging _LONG versions of op codes
 #undef SHORT_CONSTANT_LIMIT
+#undef SWITCH_TABLE_MIN_CASES
 
 #undef CHECK_SCOPE_FOR_LOOP
 #undef CHECK_SCOPE_FOR_SWITCH
\ No newline at end of file
@@ -3,8 +3,13 @@
 #include "../Objects/objects.h"
 #include "../Parsing/ASTDefs.h"
 #include "../Parsing/parser.h"
+#include "ssaPasses.h"
 #include <array>
 
+namespace nameResolver {
+	class NameResolver;
+}
+
 namespace compileCore {
 
 	enum class FuncType {
@@ -15,7 +20,8 @@ namespace compileCore {
 	};
 
 	struct Local {
-		string name = "";
+		// Interned name, 0 for the slot claimed by the function itself which no name resolves to
+		uInt symbol = 0;
 		int depth = -1;
 		bool isLocalUpvalue = false;//whether this local variable has been captured as an upvalue
 	};
@@ -41,7 +47,6 @@ namespace compileCore {
 		object::ObjFunc* func;
 		Chunk chunk;
 		FuncType type;
-		bool hasReturnStmt;
 
 		uInt line;
 		//information about unpatched 'continue' and 'break' statements
@@ -54,13 +59,50 @@ namespace compileCore {
 		vector<int> scopeWithSwitch;
 		std::array<Upvalue, UPVAL_MAX> upvalues;
 		bool hasCapturedLocals;
+		// Constants reserved for direct calls to methods of the class that weren't compiled yet, filled in once the class is done
+		ankerl::unordered_dense::map<object::ObjString*, uInt> directCalls;
 		CurrentChunkInfo(CurrentChunkInfo* _enclosing, FuncType _type);
 	};
 
 	struct ClassChunkInfo {
     // For statics
     object::ObjClass* klass;
-    ClassChunkInfo(object::ObjClass* _klass) : klass(_klass) {};
+    AST::ClassDecl* decl;
+    // Constants in the main code block(and the method they should hold) that get patched when the class is done
+    vector<std::pair<uInt, object::ObjString*>> directCalls;
+    ClassChunkInfo(object::ObjClass* _klass, AST::ClassDecl* _decl) : klass(_klass), decl(_decl) {};
+	};
+
+	// Function or method of an imported module whose body is only compiled once it's called for the first time
+	// Holds the state the compiler was in when it reached the declaration, so the body compiles the same way it
+	// would have back then
+	struct LazyFunc {
+		AST::FuncDecl* decl;
+		FuncType type;
+		// Class the method belongs to, both are nullptr for functions
+		object::ObjClass* klass;
+		AST::ClassDecl* classDecl;
+		CSLModule* unit;
+		int unitIndex;
+		int globalIndex;
+		vector<bool> definedGlobals;
+	};
+
+	// Code of a lazily compiled function, along with any closures declared inside of it
+	// Offsets of these functions are relative to this chunk, until finishLazyFuncs moves it into the main code block
+	struct LazyChunk {
+		Chunk chunk;
+		vector<object::ObjFunc*> funcs;
+	};
+
+	// Optimizations that can be turned off from the command line, stored in the .eslc cache since they change the bytecode
+	struct CompilerOptions {
+		// Inliner pass, -no-inline
+		bool inlining = true;
+		// Prints the SSA IR of every function, set by -dump-ir, doesn't change the bytecode so it isn't stored in the cache
+		bool dumpIR = false;
+
+		bool operator==(const CompilerOptions& other) const = default;
 	};
 
 	struct CompilerException {
@@ -68,6 +110,8 @@ namespace compileCore {
 	};
 
 	class Compiler : public AST::Visitor {
+		// Uses the lookups below that don't report errors
+		friend class nameResolver::NameResolver;
 	public:
 		// Compiler only ever emits the code for a single function, top level code is considered a function
 		CurrentChunkInfo* current;
@@ -78,14 +122,35 @@ namespace compileCore {
 		vector<Globalvar> globals;
 		Chunk mainCodeBlock;
         object::ObjFunc* mainBlockFunc;
+        // Top level code of the imported modules, nullptr if the program is a single module
+        object::ObjFunc* initBlockFunc;
         // Here to do name checking at compile time
         vector<object::ObjNativeFunc*> nativeFuncs;
         //Base class which implements toString
         object::ObjClass* baseClass;
 
-		Compiler(vector<CSLModule*>& units);
+        // Functions that weren't called yet, only filled if functions of imported modules are compiled lazily
+        ankerl::unordered_dense::map<object::ObjFunc*, LazyFunc> lazyFuncs;
+        vector<std::unique_ptr<LazyChunk>> lazyChunks;
+        // Set once compileLazyFunc runs into a body with compile errors, the program can't be cached after that
+        bool lazyCompileFailed;
+
+		CompilerOptions options;
+
+		Compiler(vector<CSLModule*>& units, bool compileLazily = false, CompilerOptions options = {});
 		Chunk* getChunk();
 		object::ObjFunc* endFuncDecl();
+		// Compiles the body of a function from lazyFuncs into a new chunk(also added to lazyChunks)
+		// Returns nullptr if the body has compile errors, parsing already went over the whole program so these are
+		// only the errors the compiler itself finds(undefined names, break outside of a loop...)
+		LazyChunk* compileLazyFunc(object::ObjFunc* func);
+		// Checks the names in every body that wasn't compiled yet(see nameResolver), bodies with a name that might not
+		// resolve are compiled right away so their errors are reported before the program runs
+		// Returns false if any of them has compile errors
+		bool checkLazyFuncs();
+		// Moves the lazily compiled chunks into the main code block and compiles everything that's still left,
+		// so the whole program can be cached
+		void finishLazyFuncs();
 
 		#pragma region Visitor pattern
 		void visitAssignmentExpr(AST::AssignmentExpr* expr) override;
@@ -128,10 +193,18 @@ namespace compileCore {
 		int curUnitIndex;
 		int curGlobalIndex;
 		vector<CSLModule*> units;
+		bool compileLazily;
+        // Passes run on the SSA IR of every finished function chunk
+        ssa::PassManager irPasses;
+        // Every function whose code was added to the main code block since this was last cleared
+        vector<object::ObjFunc*> compiledFuncs;
         // Every slot corresponds to a global variable in globals at the same index, used by compiler to detect if
         // a undefined global variable is being used
         vector<bool> definedGlobals;
         ankerl::unordered_dense::map<string, uInt> nativeFuncNames;
+        // Method and field names declared in classes that inherit from another class, mapped to the declaring class,
+        // or nullptr if more than one class declares the name. Calls on 'this' to any other method can't be overridden
+        ankerl::unordered_dense::map<string, AST::ClassDecl*> overridingDecls;
 
         #pragma region Helpers
         // Emitters
@@ -147,6 +220,14 @@ namespace compileCore {
         void emitLoop(int start);
 
         void patchScopeJumps(ScopeJumpType type);
+        // Switch lowering
+        bool isDenseSwitch(vector<std::pair<Value, uInt>>& constants);
+        void emitSwitchTable(vector<std::pair<Value, uInt>>& constants, vector<vector<uInt>>& caseJumps, vector<uInt>& defaultJumps);
+        void emitSwitchSorted(vector<std::pair<Value, uInt>>& constants, vector<vector<uInt>>& caseJumps, vector<uInt>& defaultJumps);
+        // Type specialized opcodes
+        byte specializeBinaryOp(byte op, AST::InferredType operandType);
+        // Ranges that don't escape
+        bool emitRangeBounds(AST::ASTNodePtr node);
 
         uInt16 makeConstant(Value value);
         // Variables
@@ -169,9 +250,16 @@ namespace compileCore {
 
         void beginScope();
         void endScope();
+        // Functions
+        object::ObjFunc* funcBody(AST::FuncDecl* decl, FuncType type);
+        object::ObjFunc* deferFunc(AST::FuncDecl* decl, FuncType type);
+        void compileDeferred(object::ObjFunc* func);
         // Classes and methods
         object::ObjClosure* method(AST::FuncDecl* _method, Token className);
         bool invoke(AST::CallExpr* expr);
+        void findOverridingDecls();
+        int resolveDirectCall(Token name, bool isSuper);
+        void emitDirectCall(uInt16 constant, int argCount);
         int resolveClassField(Token name, bool canAssign);
         object::ObjClass* getClassFromExpr(AST::ASTNodePtr expr);
         // Resolve public/private fields when this.object_field in encountered
@@ -189,6 +277,15 @@ namespace compileCore {
         int resolveGlobal(Token token, bool canAssign);
         // Given a token for module alias and a token for variable name, returns correct symbol to use
         uInt resolveModuleVariable(Token moduleAlias, Token variable);
+        // Returns -1 if the alias doesn't exist, -2 if the module doesn't export variable
+        int findModuleVariable(Token moduleAlias, Token variable);
+        // Name checks for nameResolver, these only look at the names and never report errors
+        // 0 if name isn't a field or method of the class being compiled, 1 for fields and 2 for methods
+        int classFieldKind(Token name);
+        bool canResolveGlobal(Token name, bool canAssign);
+        bool canResolveModuleVariable(Token moduleAlias, Token variable);
+        bool canResolveClass(AST::ASTNodePtr expr);
+        bool canResolveSuperMethod(Token name);
         #pragma endregion
 	};
 }
\ No newline at end of file
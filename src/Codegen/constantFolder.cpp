@@ -0,0 +1,244 @@
+#include "constantFolder.h"
+#include "../Includes/fmt/format.h"
+#include "../codegen/valueHelpersInline.cpp"
+#include <climits>
+#include <cfloat>
+
+using namespace constantFolder;
+using namespace valueHelpers;
+
+ConstantFolder::ConstantFolder(vector<CSLModule*>& units) {
+    // Assignments to a local can appear after a read of that local(eg. in a loop), so first find every local that's
+    // reassigned, and only then fold and propagate
+    isFolding = false;
+    replacement = nullptr;
+    run(units);
+    isFolding = true;
+    run(units);
+}
+
+void ConstantFolder::visitAssignmentExpr(AST::AssignmentExpr* expr) {
+    visitNode(expr->value);
+    LocalInfo* info = resolveInfo(expr->name);
+    if (info) info->isAssigned = true;
+}
+
+void ConstantFolder::visitConditionalExpr(AST::ConditionalExpr* expr) {
+    ScopedWalker::visitConditionalExpr(expr);
+
+    Value cond;
+    string str;
+    if (!isFolding || !expr->rhs) return;
+    // Strings are always truthy
+    if (getString(expr->condition, str)) replacement = expr->mhs;
+    else if (getConstant(expr->condition, cond)) replacement = isFalsey(cond) ? expr->rhs : expr->mhs;
+}
+
+void ConstantFolder::visitBinaryExpr(AST::BinaryExpr* expr) {
+    ScopedWalker::visitBinaryExpr(expr);
+    // Right side of instanceof is a class name, the compiler resolves it directly
+    if (!isFolding || expr->op.type == TokenType::INSTANCEOF) return;
+
+    Value left, right;
+    string leftStr;
+    // 'and' and 'or' evaluate to one of their operands, so if the left side is known so is the result
+    if (expr->op.type == TokenType::AND || expr->op.type == TokenType::OR) {
+        bool truthy;
+        if (getString(expr->left, leftStr)) truthy = true;
+        else if (getConstant(expr->left, left)) truthy = !isFalsey(left);
+        else return;
+
+        if (expr->op.type == TokenType::AND) replacement = truthy ? expr->right : expr->left;
+        else replacement = truthy ? expr->left : expr->right;
+        return;
+    }
+    if (!getConstant(expr->left, left) || !getConstant(expr->right, right)) return;
+
+    switch (expr->op.type) {
+        case TokenType::EQUAL_EQUAL: replacement = makeLiteral(expr->op, encodeBool(equals(left, right))); return;
+        case TokenType::BANG_EQUAL: replacement = makeLiteral(expr->op, encodeBool(!equals(left, right))); return;
+        default: break;
+    }
+    // Everything else is a type error for non numbers, that's reported at runtime
+    if (!isNumber(left) || !isNumber(right)) return;
+    double a = decodeNumber(left), b = decodeNumber(right);
+    double res;
+    switch (expr->op.type) {
+        case TokenType::PLUS:  res = a + b; break;
+        case TokenType::MINUS: res = a - b; break;
+        case TokenType::STAR:  res = a * b; break;
+        case TokenType::SLASH: res = a / b; break;
+        // Same epsilon comparisons as the VM
+        case TokenType::GREATER:       replacement = makeLiteral(expr->op, encodeBool(a > b)); return;
+        case TokenType::GREATER_EQUAL: replacement = makeLiteral(expr->op, encodeBool(a >= b - DBL_EPSILON)); return;
+        case TokenType::LESS:          replacement = makeLiteral(expr->op, encodeBool(a < b)); return;
+        case TokenType::LESS_EQUAL:    replacement = makeLiteral(expr->op, encodeBool(a < b + DBL_EPSILON)); return;
+        default: {
+            if (!isInt(left) || !isInt(right)) return;
+            int32_t x = decodeInt(left), y = decodeInt(right);
+            switch (expr->op.type) {
+                case TokenType::PERCENTAGE:
+                    if (y == 0 || (x == INT_MIN && y == -1)) return;
+                    res = x % y;
+                    break;
+                case TokenType::BITSHIFT_LEFT:
+                    if (y < 0 || y > 31) return;
+                    res = x << y;
+                    break;
+                case TokenType::BITSHIFT_RIGHT:
+                    if (y < 0 || y > 31) return;
+                    res = x >> y;
+                    break;
+                case TokenType::BITWISE_AND: res = x & y; break;
+                case TokenType::BITWISE_OR:  res = x | y; break;
+                case TokenType::BITWISE_XOR: res = x ^ y; break;
+                default: return;
+            }
+        }
+    }
+    // Infinities and NaN don't have a literal representation
+    if (!std::isfinite(res)) return;
+    replacement = makeLiteral(expr->op, encodeNumber(res));
+}
+
+void ConstantFolder::visitUnaryExpr(AST::UnaryExpr* expr) {
+    if (expr->op.type == TokenType::INCREMENT || expr->op.type == TokenType::DECREMENT) {
+        // The compiler expects a variable here, not its value
+        if (expr->right->type == AST::ASTType::LITERAL) {
+            LocalInfo* info = resolveInfo(static_cast<AST::LiteralExpr*>(expr->right)->token);
+            if (info) info->isAssigned = true;
+        }
+        else visitNode(expr->right);
+        return;
+    }
+    visitNode(expr->right);
+    if (!isFolding || !expr->isPrefix) return;
+
+    Value val;
+    string str;
+    if (expr->op.type == TokenType::BANG && getString(expr->right, str)) {
+        replacement = makeLiteral(expr->op, encodeBool(false));
+        return;
+    }
+    if (!getConstant(expr->right, val)) return;
+    switch (expr->op.type) {
+        case TokenType::MINUS:
+            if (isNumber(val)) replacement = makeLiteral(expr->op, encodeNumber(-decodeNumber(val)));
+            break;
+        case TokenType::BANG: replacement = makeLiteral(expr->op, encodeBool(isFalsey(val))); break;
+        case TokenType::TILDA:
+            if (isInt(val)) replacement = makeLiteral(expr->op, encodeNumber(~decodeInt(val)));
+            break;
+    }
+}
+
+void ConstantFolder::visitLiteralExpr(AST::LiteralExpr* expr) {
+    if (!isFolding || expr->token.type != TokenType::IDENTIFIER) return;
+    LocalInfo* info = resolveInfo(expr->token);
+    if (!info || !info->constant) return;
+    // Copy of the literal, but with the line info of the variable that's being replaced
+    auto literal = static_cast<AST::LiteralExpr*>(info->constant);
+    Token token = expr->token;
+    token.type = literal->token.type;
+    token.setSyntheticLexeme(literal->token.getLexeme());
+    replacement = curUnit->arena.make<AST::LiteralExpr>(token);
+}
+
+void ConstantFolder::visitVarDecl(AST::VarDecl* decl) {
+    ScopedWalker::visitVarDecl(decl);
+    // Globals are never propagated
+    if (scopeDepth == 0 || !decl->value) return;
+    LocalInfo& info = localInfo[&decl->var];
+    if (isFolding && !info.isAssigned && isLiteral(decl->value)) info.constant = decl->value;
+}
+
+void ConstantFolder::visitIfStmt(AST::IfStmt* stmt) {
+    ScopedWalker::visitIfStmt(stmt);
+    if (!isFolding) return;
+
+    Value cond;
+    string str;
+    bool truthy;
+    if (getString(stmt->condition, str)) truthy = true;
+    else if (getConstant(stmt->condition, cond)) truthy = !isFalsey(cond);
+    else return;
+
+    if (truthy) replacement = stmt->thenBranch;
+    else replacement = stmt->elseBranch ? stmt->elseBranch : emptyBlock();
+}
+
+void ConstantFolder::visitWhileStmt(AST::WhileStmt* stmt) {
+    ScopedWalker::visitWhileStmt(stmt);
+
+    Value cond;
+    // Only a loop that never runs is removed
+    if (isFolding && getConstant(stmt->condition, cond) && isFalsey(cond)) replacement = emptyBlock();
+}
+
+#pragma region Helpers
+void ConstantFolder::visitNode(AST::ASTNodePtr& node) {
+    replacement = nullptr;
+    node->accept(this);
+    if (replacement) node = replacement;
+    replacement = nullptr;
+}
+
+void ConstantFolder::declareLocal(AST::ASTVar& var) {
+    ScopedWalker::declareLocal(var);
+    localInfo.try_emplace(&var);
+}
+
+LocalInfo* ConstantFolder::resolveInfo(Token name) {
+    int index = resolveLocal(name);
+    return index == -1 ? nullptr : &localInfo[locals[index].var];
+}
+
+// Strings aren't converted to a Value since that would allocate a ObjString, use getString for those
+bool ConstantFolder::getConstant(AST::ASTNodePtr node, Value& val) {
+    if (node->type != AST::ASTType::LITERAL) return false;
+    Token& token = static_cast<AST::LiteralExpr*>(node)->token;
+    switch (token.type) {
+        case TokenType::NUMBER: val = encodeNumber(std::stod(token.getLexeme())); return true;
+        case TokenType::TRUE: val = encodeBool(true); return true;
+        case TokenType::FALSE: val = encodeBool(false); return true;
+        case TokenType::NIL: val = encodeNil(); return true;
+        default: return false;
+    }
+}
+
+// Contents of a string literal, without the quotes and with escape sequences left as is
+bool ConstantFolder::getString(AST::ASTNodePtr node, string& str) {
+    if (node->type != AST::ASTType::LITERAL) return false;
+    Token& token = static_cast<AST::LiteralExpr*>(node)->token;
+    if (token.type != TokenType::STRING) return false;
+    str = token.getLexeme();
+    str = str.substr(1, str.size() - 2);
+    return true;
+}
+
+bool ConstantFolder::isLiteral(AST::ASTNodePtr node) {
+    Value val;
+    string str;
+    return getConstant(node, val) || getString(node, str);
+}
+
+// Base token is used for line info
+AST::ASTNodePtr ConstantFolder::makeLiteral(Token base, Value val) {
+    Token token = base;
+    if (isNumber(val)) {
+        token.type = TokenType::NUMBER;
+        token.setSyntheticLexeme(fmt::format("{}", decodeNumber(val)));
+    } else if (isBool(val)) {
+        token.type = decodeBool(val) ? TokenType::TRUE : TokenType::FALSE;
+        token.setSyntheticLexeme(decodeBool(val) ? "true" : "false");
+    } else {
+        token.type = TokenType::NIL;
+        token.setSyntheticLexeme("null");
+    }
+    return curUnit->arena.make<AST::LiteralExpr>(token);
+}
+
+AST::ASTNodePtr ConstantFolder::emptyBlock() {
+    return curUnit->arena.make<AST::BlockStmt>(vector<AST::ASTNodePtr>());
+}
+#pragma endregion
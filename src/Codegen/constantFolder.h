@@ -0,0 +1,62 @@
+#pragma once
+#include "../Parsing/ASTDefs.h"
+#include "../Includes/unorderedDense.h"
+#include "scopedWalker.h"
+// Simplifies the AST before it's handed to the compiler
+//
+// Expressions whose operands are all number, bool or null literals are folded into a single literal,
+// e.g. 60 * 60 * 24 becomes 86400. Folding uses the same semantics as the VM, and anything that would produce a runtime
+// error(type errors, integer division by zero...) is left for the VM to report
+// String concatenation isn't folded: literals are interned and strings built at runtime aren't, so "a" + "b" == "ab"
+// would depend on whether the operands were known at compile time
+//
+// Local variables initialized with a literal that are never reassigned are replaced by that literal wherever they're read
+// Globals are left alone since they're late bound and could be read before they're initialized
+//
+// Trivial identities are simplified as well: 'and'/'or' and the conditional operator with a literal condition,
+// if statements with a literal condition and while loops that never run
+
+namespace constantFolder {
+    // Whether a local is ever assigned to, and if not the literal it was initialized with
+    struct LocalInfo {
+        bool isAssigned = false;
+        AST::ASTNodePtr constant = nullptr;
+    };
+
+    class ConstantFolder : public scopedWalker::ScopedWalker {
+    public:
+        ConstantFolder(vector<CSLModule*>& units);
+
+        #pragma region Visitor pattern
+        void visitAssignmentExpr(AST::AssignmentExpr* expr) override;
+        void visitConditionalExpr(AST::ConditionalExpr* expr) override;
+        void visitBinaryExpr(AST::BinaryExpr* expr) override;
+        void visitUnaryExpr(AST::UnaryExpr* expr) override;
+        void visitLiteralExpr(AST::LiteralExpr* expr) override;
+
+        void visitVarDecl(AST::VarDecl* decl) override;
+
+        void visitIfStmt(AST::IfStmt* stmt) override;
+        void visitWhileStmt(AST::WhileStmt* stmt) override;
+        #pragma endregion
+    private:
+        // First pass only finds locals that get reassigned, second one does the folding and propagation
+        bool isFolding;
+        // Set by a visit method when the visited node should be replaced
+        AST::ASTNodePtr replacement;
+        ankerl::unordered_dense::map<AST::ASTVar*, LocalInfo> localInfo;
+
+        #pragma region Helpers
+        // Visits node and swaps it out if the visitor produced a replacement
+        void visitNode(AST::ASTNodePtr& node) override;
+        void declareLocal(AST::ASTVar& var) override;
+        LocalInfo* resolveInfo(Token name);
+
+        bool getConstant(AST::ASTNodePtr node, Value& val);
+        bool getString(AST::ASTNodePtr node, string& str);
+        bool isLiteral(AST::ASTNodePtr node);
+        AST::ASTNodePtr makeLiteral(Token base, Value val);
+        AST::ASTNodePtr emptyBlock();
+        #pragma endregion
+    };
+}
@@ -0,0 +1,591 @@
+#include "inliner.h"
+
+using namespace inliner;
+
+#pragma region Body analysis
+static int paramIndex(vector<uInt>& params, Token& token) {
+    if (token.type != TokenType::IDENTIFIER) return -1;
+    for (int i = 0; i < params.size(); i++) {
+        if (params[i] == token.symbol) return i;
+    }
+    return -1;
+}
+
+static bool isClassField(AST::ClassDecl* klass, Token& token) {
+    for (auto& field : klass->fields) {
+        if (field.field.sameName(token)) return true;
+    }
+    return false;
+}
+
+// Checks that every node in the expression can be inlined and counts the nodes
+// klass is the class declaring the method whose body this is(nullptr for functions), 'this' and the fields of the class
+// can be used in it, fields used without 'this' are recorded in the candidate
+static bool canInline(AST::ASTNodePtr node, InlineCandidate& candidate, AST::ClassDecl* klass, int& size) {
+    if (++size > INLINE_NODE_BUDGET) return false;
+    switch (node->type) {
+        case AST::ASTType::LITERAL: {
+            Token& token = static_cast<AST::LiteralExpr*>(node)->token;
+            switch (token.type) {
+                case TokenType::NUMBER:
+                case TokenType::STRING:
+                case TokenType::TRUE:
+                case TokenType::FALSE:
+                case TokenType::NIL: return true;
+                case TokenType::THIS: {
+                    candidate.readsInstance = true;
+                    return klass != nullptr;
+                }
+                // Anything other than params(and fields inside a method) could resolve to something else at the call site
+                case TokenType::IDENTIFIER: {
+                    if (paramIndex(candidate.params, token) != -1) return true;
+                    if (!klass || !isClassField(klass, token)) return false;
+                    candidate.fields.push_back(token.symbol);
+                    candidate.readsInstance = true;
+                    return true;
+                }
+                default: return false;
+            }
+        }
+        case AST::ASTType::BINARY: {
+            auto expr = static_cast<AST::BinaryExpr*>(node);
+            // Right side of instanceof is a class name
+            if (expr->op.type == TokenType::INSTANCEOF) return false;
+            return canInline(expr->left, candidate, klass, size) && canInline(expr->right, candidate, klass, size);
+        }
+        case AST::ASTType::UNARY: {
+            auto expr = static_cast<AST::UnaryExpr*>(node);
+            // Incrementing a param would modify the variable passed as the argument
+            if (expr->op.type == TokenType::INCREMENT || expr->op.type == TokenType::DECREMENT) return false;
+            return canInline(expr->right, candidate, klass, size);
+        }
+        case AST::ASTType::CONDITIONAL: {
+            auto expr = static_cast<AST::ConditionalExpr*>(node);
+            if (!expr->rhs) return false;
+            return canInline(expr->condition, candidate, klass, size) && canInline(expr->mhs, candidate, klass, size)
+                   && canInline(expr->rhs, candidate, klass, size);
+        }
+        case AST::ASTType::FIELD_ACCESS: {
+            auto expr = static_cast<AST::FieldAccessExpr*>(node);
+            if (expr->accessor.type == TokenType::DOT) return canInline(expr->callee, candidate, klass, size);
+            return canInline(expr->callee, candidate, klass, size) && canInline(expr->field, candidate, klass, size);
+        }
+        case AST::ASTType::SET: {
+            auto expr = static_cast<AST::SetExpr*>(node);
+            if (!canInline(expr->value, candidate, klass, size) || !canInline(expr->callee, candidate, klass, size)) return false;
+            return expr->accessor.type == TokenType::DOT || canInline(expr->field, candidate, klass, size);
+        }
+        case AST::ASTType::CALL: {
+            auto expr = static_cast<AST::CallExpr*>(node);
+            if (!canInline(expr->callee, candidate, klass, size)) return false;
+            for (auto& arg : expr->args) {
+                if (!canInline(arg, candidate, klass, size)) return false;
+            }
+            return true;
+        }
+        case AST::ASTType::ARRAY_LITERAL: {
+            for (auto& mem : static_cast<AST::ArrayLiteralExpr*>(node)->members) {
+                if (!canInline(mem, candidate, klass, size)) return false;
+            }
+            return true;
+        }
+        case AST::ASTType::STRUCT: {
+            for (auto& entry : static_cast<AST::StructLiteral*>(node)->fields) {
+                if (!canInline(entry.expr, candidate, klass, size)) return false;
+            }
+            return true;
+        }
+        case AST::ASTType::RANGE: {
+            auto expr = static_cast<AST::RangeExpr*>(node);
+            return (!expr->start || canInline(expr->start, candidate, klass, size)) && (!expr->end || canInline(expr->end, candidate, klass, size));
+        }
+        default: return false;
+    }
+}
+
+// Records the order in which params are evaluated(-1 marks a call or a set, which could have side effects)
+// Params that might not be evaluated(right side of 'and'/'or', branches of ?:) mark the whole order as unusable
+static void evalOrder(AST::ASTNodePtr node, vector<uInt>& params, vector<int>& order, bool& isConditional, bool inBranch) {
+    switch (node->type) {
+        case AST::ASTType::LITERAL: {
+            int index = paramIndex(params, static_cast<AST::LiteralExpr*>(node)->token);
+            if (index == -1) return;
+            if (inBranch) isConditional = true;
+            order.push_back(index);
+            return;
+        }
+        case AST::ASTType::BINARY: {
+            auto expr = static_cast<AST::BinaryExpr*>(node);
+            bool shortCircuits = expr->op.type == TokenType::AND || expr->op.type == TokenType::OR;
+            evalOrder(expr->left, params, order, isConditional, inBranch);
+            evalOrder(expr->right, params, order, isConditional, inBranch || shortCircuits);
+            return;
+        }
+        case AST::ASTType::UNARY:
+            evalOrder(static_cast<AST::UnaryExpr*>(node)->right, params, order, isConditional, inBranch);
+            return;
+        case AST::ASTType::CONDITIONAL: {
+            auto expr = static_cast<AST::ConditionalExpr*>(node);
+            evalOrder(expr->condition, params, order, isConditional, inBranch);
+            evalOrder(expr->mhs, params, order, isConditional, true);
+            evalOrder(expr->rhs, params, order, isConditional, true);
+            return;
+        }
+        case AST::ASTType::FIELD_ACCESS: {
+            auto expr = static_cast<AST::FieldAccessExpr*>(node);
+            evalOrder(expr->callee, params, order, isConditional, inBranch);
+            if (expr->accessor.type == TokenType::LEFT_BRACKET) evalOrder(expr->field, params, order, isConditional, inBranch);
+            return;
+        }
+        case AST::ASTType::SET: {
+            auto expr = static_cast<AST::SetExpr*>(node);
+            evalOrder(expr->value, params, order, isConditional, inBranch);
+            evalOrder(expr->callee, params, order, isConditional, inBranch);
+            if (expr->accessor.type == TokenType::LEFT_BRACKET) evalOrder(expr->field, params, order, isConditional, inBranch);
+            order.push_back(-1);
+            return;
+        }
+        case AST::ASTType::CALL: {
+            auto expr = static_cast<AST::CallExpr*>(node);
+            evalOrder(expr->callee, params, order, isConditional, inBranch);
+            for (auto& arg : expr->args) evalOrder(arg, params, order, isConditional, inBranch);
+            order.push_back(-1);
+            return;
+        }
+        case AST::ASTType::ARRAY_LITERAL:
+            for (auto& mem : static_cast<AST::ArrayLiteralExpr*>(node)->members) {
+                evalOrder(mem, params, order, isConditional, inBranch);
+            }
+            return;
+        case AST::ASTType::STRUCT:
+            for (auto& entry : static_cast<AST::StructLiteral*>(node)->fields) {
+                evalOrder(entry.expr, params, order, isConditional, inBranch);
+            }
+            return;
+        case AST::ASTType::RANGE: {
+            auto expr = static_cast<AST::RangeExpr*>(node);
+            if (expr->start) evalOrder(expr->start, params, order, isConditional, inBranch);
+            if (expr->end) evalOrder(expr->end, params, order, isConditional, inBranch);
+            return;
+        }
+        default: return;
+    }
+}
+
+// Copy of the body with params replaced by args, nodes are never shared between the function and the call sites
+static AST::ASTNodePtr cloneBody(ASTArena& arena, AST::ASTNodePtr node, vector<uInt>& params, vector<AST::ASTNodePtr>& args) {
+    switch (node->type) {
+        case AST::ASTType::LITERAL: {
+            Token& token = static_cast<AST::LiteralExpr*>(node)->token;
+            int index = paramIndex(params, token);
+            if (index == -1) return arena.make<AST::LiteralExpr>(token);
+            AST::ASTNodePtr arg = args[index];
+            // Literal and variable args can be used any number of times, other args are only substituted once
+            if (arg->type == AST::ASTType::LITERAL) return arena.make<AST::LiteralExpr>(static_cast<AST::LiteralExpr*>(arg)->token);
+            return arg;
+        }
+        case AST::ASTType::BINARY: {
+            auto expr = static_cast<AST::BinaryExpr*>(node);
+            return arena.make<AST::BinaryExpr>(cloneBody(arena, expr->left, params, args), expr->op, cloneBody(arena, expr->right, params, args));
+        }
+        case AST::ASTType::UNARY: {
+            auto expr = static_cast<AST::UnaryExpr*>(node);
+            return arena.make<AST::UnaryExpr>(expr->op, cloneBody(arena, expr->right, params, args), expr->isPrefix);
+        }
+        case AST::ASTType::CONDITIONAL: {
+            auto expr = static_cast<AST::ConditionalExpr*>(node);
+            return arena.make<AST::ConditionalExpr>(cloneBody(arena, expr->condition, params, args), cloneBody(arena, expr->mhs, params, args),
+                                                    cloneBody(arena, expr->rhs, params, args));
+        }
+        case AST::ASTType::FIELD_ACCESS: {
+            auto expr = static_cast<AST::FieldAccessExpr*>(node);
+            // Field name after '.' is never a param
+            AST::ASTNodePtr field = expr->accessor.type == TokenType::DOT ? expr->field : cloneBody(arena, expr->field, params, args);
+            return arena.make<AST::FieldAccessExpr>(cloneBody(arena, expr->callee, params, args), expr->accessor, field);
+        }
+        case AST::ASTType::SET: {
+            auto expr = static_cast<AST::SetExpr*>(node);
+            // Same evaluation order as the compiler
+            AST::ASTNodePtr value = cloneBody(arena, expr->value, params, args);
+            AST::ASTNodePtr callee = cloneBody(arena, expr->callee, params, args);
+            AST::ASTNodePtr field = expr->accessor.type == TokenType::DOT ? expr->field : cloneBody(arena, expr->field, params, args);
+            return arena.make<AST::SetExpr>(callee, field, expr->accessor, value);
+        }
+        case AST::ASTType::CALL: {
+            auto expr = static_cast<AST::CallExpr*>(node);
+            AST::ASTNodePtr callee = cloneBody(arena, expr->callee, params, args);
+            vector<AST::ASTNodePtr> callArgs;
+            for (auto& arg : expr->args) callArgs.push_back(cloneBody(arena, arg, params, args));
+            return arena.make<AST::CallExpr>(callee, callArgs);
+        }
+        case AST::ASTType::ARRAY_LITERAL: {
+            vector<AST::ASTNodePtr> members;
+            for (auto& mem : static_cast<AST::ArrayLiteralExpr*>(node)->members) {
+                members.push_back(cloneBody(arena, mem, params, args));
+            }
+            return arena.make<AST::ArrayLiteralExpr>(members);
+        }
+        case AST::ASTType::STRUCT: {
+            vector<AST::StructEntry> fields;
+            for (auto& entry : static_cast<AST::StructLiteral*>(node)->fields) {
+                fields.emplace_back(entry.name, cloneBody(arena, entry.expr, params, args));
+            }
+            return arena.make<AST::StructLiteral>(fields);
+        }
+        case AST::ASTType::RANGE: {
+            auto expr = static_cast<AST::RangeExpr*>(node);
+            return arena.make<AST::RangeExpr>(expr->token, expr->start ? cloneBody(arena, expr->start, params, args) : nullptr,
+                                              expr->end ? cloneBody(arena, expr->end, params, args) : nullptr, expr->endInclusive);
+        }
+        // Never hit, canInline rejects every other node
+        default: return node;
+    }
+}
+#pragma endregion
+
+Inliner::Inliner(vector<CSLModule*>& units) {
+    scopeDepth = 0;
+    closureDepth = 0;
+    currentClass = nullptr;
+    replacement = nullptr;
+    curUnit = nullptr;
+    // Same as Compiler::findOverridingDecls, any class with a superclass could be overriding these
+    for (CSLModule* unit : units) {
+        for (AST::ASTNodePtr stmt : unit->stmts) {
+            if (stmt->type != AST::ASTType::CLASS) continue;
+            auto decl = static_cast<AST::ClassDecl*>(stmt);
+            if (!decl->inheritedClass) continue;
+            for (auto& _method : decl->methods) overridden.insert(_method.method->getName().symbol);
+            for (auto& field : decl->fields) overridden.insert(field.field.symbol);
+        }
+    }
+    for (CSLModule* unit : units) {
+        // Calls across modules aren't inlined
+        candidates.clear();
+        curUnit = unit;
+        for (auto& stmt : unit->stmts) {
+            visitNode(stmt);
+            // Calls made before the declaration are errors the compiler should report
+            if (stmt->type == AST::ASTType::FUNC) addCandidate(static_cast<AST::FuncDecl*>(stmt));
+        }
+    }
+}
+
+void Inliner::visitAssignmentExpr(AST::AssignmentExpr* expr) {
+    visitNode(expr->value);
+}
+
+void Inliner::visitSetExpr(AST::SetExpr* expr) {
+    visitNode(expr->value);
+    visitNode(expr->callee);
+    if (expr->accessor.type == TokenType::LEFT_BRACKET) visitNode(expr->field);
+}
+
+void Inliner::visitConditionalExpr(AST::ConditionalExpr* expr) {
+    visitNode(expr->condition);
+    visitNode(expr->mhs);
+    if (expr->rhs) visitNode(expr->rhs);
+}
+
+void Inliner::visitRangeExpr(AST::RangeExpr *expr) {
+    if (expr->start) visitNode(expr->start);
+    if (expr->end) visitNode(expr->end);
+}
+
+void Inliner::visitBinaryExpr(AST::BinaryExpr* expr) {
+    visitNode(expr->left);
+    if (expr->op.type != TokenType::INSTANCEOF) visitNode(expr->right);
+}
+
+void Inliner::visitUnaryExpr(AST::UnaryExpr* expr) {
+    visitNode(expr->right);
+}
+
+void Inliner::visitCallExpr(AST::CallExpr* expr) {
+    visitNode(expr->callee);
+    for (auto& arg : expr->args) {
+        visitNode(arg);
+    }
+    InlineCandidate* candidate = findMethod(expr->callee);
+    if (!candidate) candidate = findFunc(expr->callee);
+    // Calls with the wrong number of args are left for the VM to report
+    if (!candidate || candidate->params.size() != expr->args.size()) return;
+
+    if (!candidate->preservesOrder) {
+        for (auto& arg : expr->args) {
+            if (arg->type != AST::ASTType::LITERAL) return;
+            if (candidate->hasSideEffects && static_cast<AST::LiteralExpr*>(arg)->token.type == TokenType::IDENTIFIER) return;
+        }
+    }
+    // Fields read by a method would be hidden by locals of the same name
+    for (uInt field : candidate->fields) {
+        if (isLocal(field)) return;
+    }
+    replacement = cloneBody(curUnit->arena, candidate->body, candidate->params, expr->args);
+}
+
+void Inliner::visitNewExpr(AST::NewExpr* expr) {
+    for (auto& arg : expr->call->args) {
+        visitNode(arg);
+    }
+}
+
+void Inliner::visitFieldAccessExpr(AST::FieldAccessExpr* expr) {
+    visitNode(expr->callee);
+    if (expr->accessor.type == TokenType::LEFT_BRACKET) visitNode(expr->field);
+}
+
+void Inliner::visitAsyncExpr(AST::AsyncExpr* expr) {
+    // Async needs an actual function to run on a new thread, only args are looked at
+    for (auto& arg : expr->args) {
+        visitNode(arg);
+    }
+}
+
+void Inliner::visitAwaitExpr(AST::AwaitExpr* expr) {
+    visitNode(expr->expr);
+}
+
+void Inliner::visitArrayLiteralExpr(AST::ArrayLiteralExpr* expr) {
+    for (auto& mem : expr->members) {
+        visitNode(mem);
+    }
+}
+
+void Inliner::visitStructLiteralExpr(AST::StructLiteral* expr) {
+    for (AST::StructEntry& entry : expr->fields) {
+        visitNode(entry.expr);
+    }
+}
+
+void Inliner::visitLiteralExpr(AST::LiteralExpr* expr) {}
+
+void Inliner::visitSuperExpr(AST::SuperExpr* expr) {}
+
+void Inliner::visitFuncLiteral(AST::FuncLiteral* expr) {
+    closureDepth++;
+    visitFunc(expr->args, expr->body);
+    closureDepth--;
+}
+
+void Inliner::visitModuleAccessExpr(AST::ModuleAccessExpr* expr) {}
+
+// This shouldn't ever be visited as every macro should be expanded before compilation
+void Inliner::visitMacroExpr(AST::MacroExpr* expr) {}
+
+void Inliner::visitVarDecl(AST::VarDecl* decl) {
+    if (scopeDepth > 0) declareLocal(decl->var);
+    if (decl->value) visitNode(decl->value);
+}
+
+void Inliner::visitFuncDecl(AST::FuncDecl* decl) {
+    visitFunc(decl->args, decl->body);
+}
+
+void Inliner::visitClassDecl(AST::ClassDecl* decl) {
+    currentClass = decl;
+    methodCandidates.clear();
+    // A superclass could have a field that hides a method, and fields of other modules aren't known here
+    if (!decl->inheritedClass) {
+        for (auto& _method : decl->methods) {
+            Token name = _method.method->getName();
+            // Subclasses that declare a method or field with this name could override it
+            if (name.sameName(decl->getName()) || overridden.contains(name.symbol) || isClassField(decl, name)) continue;
+            InlineCandidate candidate;
+            if (makeCandidate(_method.method, decl, candidate)) methodCandidates.insert_or_assign(name.symbol, candidate);
+        }
+    }
+    for (auto& _method : decl->methods) {
+        _method.method->accept(this);
+    }
+    methodCandidates.clear();
+    currentClass = nullptr;
+}
+
+void Inliner::visitExprStmt(AST::ExprStmt* stmt) {
+    visitNode(stmt->expr);
+}
+
+void Inliner::visitBlockStmt(AST::BlockStmt* stmt) {
+    beginScope();
+    for (auto& node : stmt->statements) {
+        visitNode(node);
+    }
+    endScope();
+}
+
+void Inliner::visitIfStmt(AST::IfStmt* stmt) {
+    visitNode(stmt->condition);
+    visitNode(stmt->thenBranch);
+    if (stmt->elseBranch) visitNode(stmt->elseBranch);
+}
+
+void Inliner::visitWhileStmt(AST::WhileStmt* stmt) {
+    visitNode(stmt->condition);
+    beginScope();
+    visitNode(stmt->body);
+    endScope();
+}
+
+void Inliner::visitForStmt(AST::ForStmt* stmt) {
+    beginScope();
+    if (stmt->init) visitNode(stmt->init);
+    if (stmt->condition) visitNode(stmt->condition);
+    visitNode(stmt->body);
+    if (stmt->increment) visitNode(stmt->increment);
+    endScope();
+}
+
+void Inliner::visitBreakStmt(AST::BreakStmt* stmt) {}
+
+void Inliner::visitContinueStmt(AST::ContinueStmt* stmt) {}
+
+void Inliner::visitSwitchStmt(AST::SwitchStmt* stmt) {
+    visitNode(stmt->expr);
+    for (AST::CaseStmt* _case : stmt->cases) {
+        beginScope();
+        _case->accept(this);
+        endScope();
+    }
+}
+
+void Inliner::visitCaseStmt(AST::CaseStmt* stmt) {
+    for (auto& caseStmt : stmt->stmts) {
+        visitNode(caseStmt);
+    }
+}
+
+void Inliner::visitAdvanceStmt(AST::AdvanceStmt* stmt) {}
+
+void Inliner::visitReturnStmt(AST::ReturnStmt* stmt) {
+    if (stmt->expr) visitNode(stmt->expr);
+}
+
+#pragma region Helpers
+void Inliner::visitNode(AST::ASTNodePtr& node) {
+    replacement = nullptr;
+    node->accept(this);
+    if (replacement) node = replacement;
+    replacement = nullptr;
+}
+
+void Inliner::visitFunc(vector<AST::ASTVar>& args, AST::BlockStmt* body) {
+    beginScope();
+    for (AST::ASTVar& var : args) {
+        declareLocal(var);
+    }
+    for (auto& stmt : body->statements) {
+        visitNode(stmt);
+    }
+    endScope();
+}
+
+void Inliner::addCandidate(AST::FuncDecl* decl) {
+    InlineCandidate candidate;
+    if (makeCandidate(decl, nullptr, candidate)) candidates.insert_or_assign(decl->getName().symbol, candidate);
+}
+
+// Returns false if decl can't be inlined, klass is the class declaring the method(nullptr for functions)
+bool Inliner::makeCandidate(AST::FuncDecl* decl, AST::ClassDecl* klass, InlineCandidate& candidate) {
+    if (decl->body->statements.size() != 1 || decl->body->statements[0]->type != AST::ASTType::RETURN) return false;
+    auto ret = static_cast<AST::ReturnStmt*>(decl->body->statements[0]);
+    if (!ret->expr) return false;
+
+    // Methods start with the implicitly declared 'this'
+    for (size_t i = klass ? 1 : 0; i < decl->args.size(); i++) candidate.params.push_back(decl->args[i].name.symbol);
+    int size = 0;
+    if (!canInline(ret->expr, candidate, klass, size)) return false;
+
+    vector<int> order;
+    bool isConditional = false;
+    evalOrder(ret->expr, candidate.params, order, isConditional, false);
+    // Args have to be evaluated in the same order as they would be before the call, and none of them can be skipped
+    candidate.preservesOrder = !isConditional;
+    int next = 0;
+    for (int index : order) {
+        if (next == candidate.params.size()) break;
+        if (index != next) {
+            candidate.preservesOrder = false;
+            break;
+        }
+        next++;
+    }
+    if (next != candidate.params.size()) candidate.preservesOrder = false;
+    // Params used more than once after the last one
+    for (int i = 0; i < order.size(); i++) {
+        if (i >= candidate.params.size() && order[i] != -1) candidate.preservesOrder = false;
+        if (order[i] == -1) candidate.hasSideEffects = true;
+    }
+    // Reads of the instance would move in front of the args, which could change it
+    if (candidate.readsInstance) candidate.preservesOrder = false;
+
+    candidate.body = ret->expr;
+    return true;
+}
+
+// Module level function called by name
+InlineCandidate* Inliner::findFunc(AST::ASTNodePtr callee) {
+    if (callee->type != AST::ASTType::LITERAL) return nullptr;
+    Token& token = static_cast<AST::LiteralExpr*>(callee)->token;
+    if (token.type != TokenType::IDENTIFIER) return nullptr;
+    auto it = candidates.find(token.symbol);
+    if (it == candidates.end() || isShadowed(token)) return nullptr;
+    return &it->second;
+}
+
+// this.method(...) or method(...) in a method of the class declaring it, not inside a closure since fields can only
+// be used through 'this' there
+InlineCandidate* Inliner::findMethod(AST::ASTNodePtr callee) {
+    if (!currentClass || closureDepth > 0) return nullptr;
+    Token* name;
+    if (callee->type == AST::ASTType::LITERAL) {
+        name = &static_cast<AST::LiteralExpr*>(callee)->token;
+        if (name->type != TokenType::IDENTIFIER || isLocal(name->symbol)) return nullptr;
+    } else if (callee->type == AST::ASTType::FIELD_ACCESS) {
+        auto access = static_cast<AST::FieldAccessExpr*>(callee);
+        if (access->accessor.type != TokenType::DOT || access->callee->type != AST::ASTType::LITERAL
+            || static_cast<AST::LiteralExpr*>(access->callee)->token.type != TokenType::THIS
+            || access->field->type != AST::ASTType::LITERAL) return nullptr;
+        name = &static_cast<AST::LiteralExpr*>(access->field)->token;
+    } else return nullptr;
+    auto it = methodCandidates.find(name->symbol);
+    return it == methodCandidates.end() ? nullptr : &it->second;
+}
+
+bool Inliner::isLocal(uInt symbol) {
+    for (Local& local : locals) {
+        if (local.symbol == symbol) return true;
+    }
+    return false;
+}
+
+// Locals, and fields and methods inside a class take precedence over globals
+bool Inliner::isShadowed(Token& name) {
+    if (isLocal(name.symbol)) return true;
+    if (!currentClass) return false;
+    // Inherited fields and methods aren't known here
+    if (currentClass->inheritedClass) return true;
+    for (auto& field : currentClass->fields) {
+        if (field.field.sameName(name)) return true;
+    }
+    for (auto& _method : currentClass->methods) {
+        if (_method.method->getName().sameName(name)) return true;
+    }
+    return false;
+}
+
+void Inliner::declareLocal(AST::ASTVar& var) {
+    locals.push_back(Local{var.name.symbol, scopeDepth});
+}
+
+void Inliner::beginScope() {
+    scopeDepth++;
+}
+
+void Inliner::endScope() {
+    scopeDepth--;
+    while (!locals.empty() && locals.back().depth > scopeDepth) {
+        locals.pop_back();
+    }
+}
+#pragma endregion
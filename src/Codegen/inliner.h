@@ -0,0 +1,119 @@
+#pragma once
+#include "../Parsing/ASTDefs.h"
+#include "../Includes/unorderedDense.h"
+// Replaces calls to small module level functions with the body of the function
+//
+// A function is inlined if its body is a single return statement whose expression only uses the function arguments,
+// literals and operators(no globals, closures or assignments), and is no larger than INLINE_NODE_BUDGET nodes
+// Since the body can't reference any global, the function can't be recursive
+// Module level functions can't be reassigned, so a call site whose callee is the function name is guaranteed to call it,
+// as long as the name isn't shadowed by a local, or by a field or method when inside a class
+//
+// Arguments are substituted for the parameters, to preserve evaluation order and side effects arguments that aren't
+// literals or variables are only allowed if every parameter is used exactly once, unconditionally and in the order of declaration
+// Variables are read where the parameter is used instead of before the call, so they're only allowed in that case too
+// if the body contains a call or a set
+//
+// Methods of a class without a superclass are inlined into other methods of the same class when no class with a superclass
+// declares a method or field of that name(same rule Compiler::findOverridingDecls uses), the call then can't be dispatched
+// anywhere else. The call has to be 'this.method(...)' or 'method(...)' outside of closures, the body may also use 'this' and
+// the fields of the class, in which case only literals and variables are allowed as arguments
+// Pass -no-inline to ESL to turn this pass off when debugging
+
+#define INLINE_NODE_BUDGET 16
+
+namespace inliner {
+    struct Local {
+        // Interned name
+        uInt symbol = 0;
+        int depth = 0;
+    };
+
+    struct InlineCandidate {
+        // Interned names of the params
+        vector<uInt> params;
+        AST::ASTNodePtr body;
+        // True if every param is used once, unconditionally, in order and before any call
+        bool preservesOrder = false;
+        // True if the body contains a call or a set, either of which could change a variable passed as an argument
+        bool hasSideEffects = false;
+        // Methods only, true if the body uses 'this' or any field
+        bool readsInstance = false;
+        // Interned names of the fields a method uses without 'this'
+        vector<uInt> fields;
+    };
+
+    class Inliner : public AST::Visitor {
+    public:
+        Inliner(vector<CSLModule*>& units);
+
+        #pragma region Visitor pattern
+        void visitAssignmentExpr(AST::AssignmentExpr* expr) override;
+        void visitRangeExpr(AST::RangeExpr *expr) override;
+        void visitSetExpr(AST::SetExpr* expr) override;
+        void visitConditionalExpr(AST::ConditionalExpr* expr) override;
+        void visitBinaryExpr(AST::BinaryExpr* expr) override;
+        void visitUnaryExpr(AST::UnaryExpr* expr) override;
+        void visitCallExpr(AST::CallExpr* expr) override;
+        void visitNewExpr(AST::NewExpr* expr) override;
+        void visitFieldAccessExpr(AST::FieldAccessExpr* expr) override;
+        void visitAsyncExpr(AST::AsyncExpr* expr) override;
+        void visitAwaitExpr(AST::AwaitExpr* expr) override;
+        void visitArrayLiteralExpr(AST::ArrayLiteralExpr* expr) override;
+        void visitStructLiteralExpr(AST::StructLiteral* expr) override;
+        void visitLiteralExpr(AST::LiteralExpr* expr) override;
+        void visitSuperExpr(AST::SuperExpr* expr) override;
+        void visitFuncLiteral(AST::FuncLiteral* expr) override;
+        void visitModuleAccessExpr(AST::ModuleAccessExpr* expr) override;
+        void visitMacroExpr(AST::MacroExpr* expr) override;
+
+        void visitVarDecl(AST::VarDecl* decl) override;
+        void visitFuncDecl(AST::FuncDecl* decl) override;
+        void visitClassDecl(AST::ClassDecl* decl) override;
+
+        void visitExprStmt(AST::ExprStmt* stmt) override;
+        void visitBlockStmt(AST::BlockStmt* stmt) override;
+        void visitIfStmt(AST::IfStmt* stmt) override;
+        void visitWhileStmt(AST::WhileStmt* stmt) override;
+        void visitForStmt(AST::ForStmt* stmt) override;
+        void visitBreakStmt(AST::BreakStmt* stmt) override;
+        void visitContinueStmt(AST::ContinueStmt* stmt) override;
+        void visitSwitchStmt(AST::SwitchStmt* stmt) override;
+        void visitCaseStmt(AST::CaseStmt* _case) override;
+        void visitAdvanceStmt(AST::AdvanceStmt* stmt) override;
+        void visitReturnStmt(AST::ReturnStmt* stmt) override;
+        #pragma endregion
+    private:
+        // Functions of the module that's being processed(keyed by interned name), a function is added once its declaration is passed
+        ankerl::unordered_dense::map<uInt, InlineCandidate> candidates;
+        // Methods of the class that's being processed that no subclass can override
+        ankerl::unordered_dense::map<uInt, InlineCandidate> methodCandidates;
+        // Names of methods and fields declared by any class that has a superclass
+        ankerl::unordered_dense::set<uInt> overridden;
+        // Set by visitCallExpr when the call should be replaced
+        AST::ASTNodePtr replacement;
+        vector<Local> locals;
+        int scopeDepth;
+        // Number of function literals the visitor is in
+        int closureDepth;
+        AST::ClassDecl* currentClass;
+        // Module that's being processed, inlined bodies are cloned into its arena
+        CSLModule* curUnit;
+
+        #pragma region Helpers
+        // Visits node and swaps it out if it's an inlined call
+        void visitNode(AST::ASTNodePtr& node);
+        void visitFunc(vector<AST::ASTVar>& args, AST::BlockStmt* body);
+        void addCandidate(AST::FuncDecl* decl);
+        bool makeCandidate(AST::FuncDecl* decl, AST::ClassDecl* klass, InlineCandidate& candidate);
+        InlineCandidate* findFunc(AST::ASTNodePtr callee);
+        InlineCandidate* findMethod(AST::ASTNodePtr callee);
+        bool isLocal(uInt symbol);
+        bool isShadowed(Token& name);
+
+        void declareLocal(AST::ASTVar& var);
+        void beginScope();
+        void endScope();
+        #pragma endregion
+    };
+}
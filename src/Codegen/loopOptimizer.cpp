@@ -0,0 +1,307 @@
+#include "loopOptimizer.h"
+#include <cmath>
+
+using namespace loopOptimizer;
+
+// Induction variables can only start at and be incremented by these
+static bool isNonNegativeInt(AST::ASTNodePtr node) {
+    if (node->type != AST::ASTType::LITERAL) return false;
+    Token& token = static_cast<AST::LiteralExpr*>(node)->token;
+    if (token.type != TokenType::NUMBER) return false;
+    double val = std::stod(token.getLexeme());
+    return val >= 0 && std::trunc(val) == val;
+}
+
+static bool isArithmetic(TokenType type) {
+    return type == TokenType::PLUS || type == TokenType::MINUS || type == TokenType::STAR || type == TokenType::SLASH;
+}
+
+LoopOptimizer::LoopOptimizer(vector<CSLModule*>& units) {
+    hoistedCount = 0;
+    loopDepth = 0;
+    isAnalyzing = true;
+    run(units);
+    isAnalyzing = false;
+    run(units);
+}
+
+void LoopOptimizer::visitAssignmentExpr(AST::AssignmentExpr* expr) {
+    visitNode(expr->value);
+    recordAssignment(expr->name);
+}
+
+void LoopOptimizer::visitSetExpr(AST::SetExpr* expr) {
+    ScopedWalker::visitSetExpr(expr);
+    if (expr->accessor.type == TokenType::LEFT_BRACKET) {
+        markIndex(expr->callee, expr->field, expr->hasNonNegativeIndex, expr->isInBounds);
+    }
+}
+
+void LoopOptimizer::visitUnaryExpr(AST::UnaryExpr* expr) {
+    bool isIncrement = expr->op.type == TokenType::INCREMENT || expr->op.type == TokenType::DECREMENT;
+    if (isIncrement && expr->right->type == AST::ASTType::LITERAL) {
+        recordAssignment(static_cast<AST::LiteralExpr*>(expr->right)->token);
+        return;
+    }
+    visitNode(expr->right);
+}
+
+void LoopOptimizer::visitCallExpr(AST::CallExpr* expr) {
+    recordCall();
+    ScopedWalker::visitCallExpr(expr);
+}
+
+void LoopOptimizer::visitNewExpr(AST::NewExpr* expr) {
+    recordCall();
+    ScopedWalker::visitNewExpr(expr);
+}
+
+void LoopOptimizer::visitFieldAccessExpr(AST::FieldAccessExpr* expr) {
+    ScopedWalker::visitFieldAccessExpr(expr);
+    if (expr->accessor.type == TokenType::LEFT_BRACKET) {
+        markIndex(expr->callee, expr->field, expr->hasNonNegativeIndex, expr->isInBounds);
+    }
+}
+
+void LoopOptimizer::visitAsyncExpr(AST::AsyncExpr* expr) {
+    recordCall();
+    ScopedWalker::visitAsyncExpr(expr);
+}
+
+void LoopOptimizer::visitAwaitExpr(AST::AwaitExpr* expr) {
+    recordCall();
+    ScopedWalker::visitAwaitExpr(expr);
+}
+
+void LoopOptimizer::visitWhileStmt(AST::WhileStmt* stmt) {
+    beginLoop(stmt, locals.size());
+    visitNode(stmt->condition);
+    beginScope();
+    loops.back().inBody = true;
+    visitNode(stmt->body);
+    loops.back().inBody = false;
+    endScope();
+    endLoop();
+}
+
+void LoopOptimizer::visitForStmt(AST::ForStmt* stmt) {
+    beginScope();
+    // Locals declared in the initializer don't exist before the loop, so they can't be used by a hoisted expression
+    int localsBase = locals.size();
+    if (stmt->init) visitNode(stmt->init);
+    beginLoop(stmt, localsBase);
+    if (!isAnalyzing) {
+        findInductionVar(stmt);
+        findBoundedArray(stmt);
+    }
+    if (stmt->condition) visitNode(stmt->condition);
+    // Only the body runs between the condition and the next check of the condition, calls in the increment don't matter
+    loops.back().inBody = true;
+    visitNode(stmt->body);
+    loops.back().inBody = false;
+    if (stmt->increment) visitNode(stmt->increment);
+    endLoop();
+    endScope();
+}
+
+#pragma region Helpers
+// Visits node and swaps it out if it's a hoisted expression, or a loop that had something hoisted out of it
+void LoopOptimizer::visitNode(AST::ASTNodePtr& node) {
+    if (!isAnalyzing && hoist(node)) return;
+    node->accept(this);
+    if (toWrap.empty()) return;
+    vector<AST::ASTNodePtr> stmts(toWrap.begin(), toWrap.end());
+    stmts.push_back(node);
+    node = curUnit->arena.make<AST::BlockStmt>(stmts);
+    toWrap.clear();
+}
+
+void LoopOptimizer::visitFunc(vector<AST::ASTVar>& args, AST::BlockStmt* body) {
+    // Closures declared in a loop can still index arrays with its induction variable
+    if (isAnalyzing && loopDepth > 0) loopFuncs.insert(body);
+    if (!isAnalyzing && !loopFuncs.contains(body)) return;
+    funcBodies.push_back(body);
+    // Loops of the enclosing function are left alone, the closure could run long after they're finished
+    vector<Loop> enclosingLoops = std::move(loops);
+    loops.clear();
+    ScopedWalker::visitFunc(args, body);
+    loops = std::move(enclosingLoops);
+    funcBodies.pop_back();
+}
+
+void LoopOptimizer::beginLoop(AST::ASTNode* node, int localsBase) {
+    loops.push_back(Loop{node, localsBase, {}, false, nullptr, nullptr});
+    loopDepth++;
+    if (!isAnalyzing) return;
+    // Every function the loop is nested in has to be walked again to reach it, once a function is marked so are the
+    // ones enclosing it
+    for (int i = funcBodies.size() - 1; i >= 0; i--) {
+        if (!loopFuncs.insert(funcBodies[i]).second) break;
+    }
+}
+
+void LoopOptimizer::endLoop() {
+    toWrap = std::move(loops.back().hoisted);
+    loops.pop_back();
+    loopDepth--;
+}
+
+// Replaces node with a synthetic local if it's invariant in the innermost loop, returns true if it was replaced
+bool LoopOptimizer::hoist(AST::ASTNodePtr& node) {
+    if (loops.empty() || (node->type != AST::ASTType::BINARY && node->type != AST::ASTType::UNARY)) return false;
+    // Base is an operand of the expression, used for line info of the synthetic local
+    Token base;
+    // Expressions made up of only literals are left to the constant folder
+    if (!isInvariant(node, loops.back(), base) || base.type == TokenType::NONE) return false;
+    // Anything invariant in a loop is also invariant in every loop nested inside of it, so move it out of the outermost one
+    int target = loops.size() - 1;
+    while (target > 0 && isInvariant(node, loops[target - 1], base)) target--;
+    Loop& loop = loops[target];
+    if (loop.hoisted.size() >= LICM_MAX_HOISTED || countLocals() >= LICM_LOCAL_LIMIT) return false;
+
+    // '$' can't appear in an identifier, so this never clashes with a user defined variable
+    Token name = base;
+    name.setSyntheticLexeme("$licm" + std::to_string(hoistedCount++));
+    loop.hoisted.push_back(curUnit->arena.make<AST::VarDecl>(name, node));
+    node = curUnit->arena.make<AST::LiteralExpr>(name);
+    return true;
+}
+
+bool LoopOptimizer::isInvariant(AST::ASTNodePtr node, Loop& loop, Token& base) {
+    switch (node->type) {
+        case AST::ASTType::LITERAL: {
+            Token& token = static_cast<AST::LiteralExpr*>(node)->token;
+            if (token.type == TokenType::NUMBER) return true;
+            if (token.type != TokenType::IDENTIFIER) return false;
+            int index = resolveLocal(token);
+            // Upvalues are excluded as the enclosing function could be running on another thread
+            if (index == -1 || index >= loop.localsBase || locals[index].funcDepth != funcDepth) return false;
+            AST::ASTVar* var = locals[index].var;
+            if (closureAssigned.contains(var)) return false;
+            auto it = assignCounts.find(loop.node);
+            if (it != assignCounts.end() && it->second.contains(var)) return false;
+            base = token;
+            return true;
+        }
+        case AST::ASTType::BINARY: {
+            auto expr = static_cast<AST::BinaryExpr*>(node);
+            if (expr->operandType != AST::InferredType::NUMBER || !isArithmetic(expr->op.type)) return false;
+            return isInvariant(expr->left, loop, base) && isInvariant(expr->right, loop, base);
+        }
+        case AST::ASTType::UNARY: {
+            auto expr = static_cast<AST::UnaryExpr*>(node);
+            if (expr->operandType != AST::InferredType::NUMBER || expr->op.type != TokenType::MINUS) return false;
+            return isInvariant(expr->right, loop, base);
+        }
+        default: return false;
+    }
+}
+
+// Locals of the current function, including the ones that were hoisted out of the loops it's currently in
+int LoopOptimizer::countLocals() {
+    int count = 0;
+    for (scopedWalker::Local& local : locals) {
+        if (local.funcDepth == funcDepth) count++;
+    }
+    for (Loop& loop : loops) {
+        count += loop.hoisted.size();
+    }
+    return count;
+}
+
+// Looks for for(let i = a; ...; i++) where the increment is the only assignment to i
+void LoopOptimizer::findInductionVar(AST::ForStmt* stmt) {
+    if (!stmt->init || !stmt->increment || stmt->init->type != AST::ASTType::VAR) return;
+    auto decl = static_cast<AST::VarDecl*>(stmt->init);
+    if (!decl->value || !isNonNegativeInt(decl->value)) return;
+
+    Token name;
+    if (stmt->increment->type == AST::ASTType::UNARY) {
+        auto expr = static_cast<AST::UnaryExpr*>(stmt->increment);
+        if (expr->op.type != TokenType::INCREMENT || expr->right->type != AST::ASTType::LITERAL) return;
+        name = static_cast<AST::LiteralExpr*>(expr->right)->token;
+    } else if (stmt->increment->type == AST::ASTType::ASSIGNMENT) {
+        // i += b is parsed as i = i + b
+        auto expr = static_cast<AST::AssignmentExpr*>(stmt->increment);
+        if (expr->value->type != AST::ASTType::BINARY) return;
+        auto value = static_cast<AST::BinaryExpr*>(expr->value);
+        if (value->op.type != TokenType::PLUS || value->left->type != AST::ASTType::LITERAL || !isNonNegativeInt(value->right)) return;
+        if (!static_cast<AST::LiteralExpr*>(value->left)->token.sameName(expr->name)) return;
+        name = expr->name;
+    } else return;
+
+    AST::ASTVar* var = &decl->var;
+    int index = resolveLocal(name);
+    if (index == -1 || locals[index].var != var || closureAssigned.contains(var)) return;
+    auto it = assignCounts.find(stmt);
+    if (it == assignCounts.end() || it->second[var] != 1) return;
+    inductionVars.insert(var);
+}
+
+// Looks for 'i < arr.length()' as the condition of a loop with induction variable i and no calls in its body
+void LoopOptimizer::findBoundedArray(AST::ForStmt* stmt) {
+    if (!stmt->condition || stmt->condition->type != AST::ASTType::BINARY || callingLoops.contains(stmt)) return;
+    if (!stmt->init || stmt->init->type != AST::ASTType::VAR) return;
+    auto cond = static_cast<AST::BinaryExpr*>(stmt->condition);
+    if (cond->op.type != TokenType::LESS || cond->right->type != AST::ASTType::CALL) return;
+    auto call = static_cast<AST::CallExpr*>(cond->right);
+    if (!call->args.empty() || call->callee->type != AST::ASTType::FIELD_ACCESS) return;
+    auto length = static_cast<AST::FieldAccessExpr*>(call->callee);
+    if (length->accessor.type != TokenType::DOT || static_cast<AST::LiteralExpr*>(length->field)->token.getLexeme() != "length") return;
+
+    Loop& loop = loops.back();
+    AST::ASTVar* index = resolveLoopLocal(cond->left);
+    // The array has to be the same one on every iteration, the index can only be the variable the loop increments
+    AST::ASTVar* array = resolveLoopLocal(length->callee);
+    if (!index || !array || !inductionVars.contains(index) || index != &static_cast<AST::VarDecl*>(stmt->init)->var) return;
+    auto it = assignCounts.find(stmt);
+    if (it != assignCounts.end() && it->second.contains(array)) return;
+    loop.index = index;
+    loop.array = array;
+}
+
+// Integer and negative index checks are dropped for induction variables, the upper bound check too if the index is
+// bounded by the condition of a loop the access is in the body of
+void LoopOptimizer::markIndex(AST::ASTNodePtr callee, AST::ASTNodePtr field, bool& hasNonNegativeIndex, bool& isInBounds) {
+    if (isAnalyzing || field->type != AST::ASTType::LITERAL) return;
+    Token& token = static_cast<AST::LiteralExpr*>(field)->token;
+    if (token.type != TokenType::IDENTIFIER) return;
+    int index = resolveLocal(token);
+    if (index == -1 || !inductionVars.contains(locals[index].var)) return;
+    hasNonNegativeIndex = true;
+    for (Loop& loop : loops) {
+        if (!loop.inBody || loop.index != locals[index].var) continue;
+        if (resolveLoopLocal(callee) == loop.array) isInBounds = true;
+    }
+}
+
+void LoopOptimizer::recordAssignment(Token name) {
+    if (!isAnalyzing) return;
+    int index = resolveLocal(name);
+    if (index == -1) return;
+    AST::ASTVar* var = locals[index].var;
+    if (locals[index].funcDepth != funcDepth) closureAssigned.insert(var);
+    for (Loop& loop : loops) {
+        assignCounts[loop.node][var]++;
+    }
+}
+
+// A call in the body of a loop can resize any array
+void LoopOptimizer::recordCall() {
+    if (!isAnalyzing) return;
+    for (Loop& loop : loops) {
+        if (loop.inBody) callingLoops.insert(loop.node);
+    }
+}
+
+// Local of the current function that node refers to, as long as no closure assigns to it
+AST::ASTVar* LoopOptimizer::resolveLoopLocal(AST::ASTNodePtr node) {
+    if (node->type != AST::ASTType::LITERAL) return nullptr;
+    Token& token = static_cast<AST::LiteralExpr*>(node)->token;
+    if (token.type != TokenType::IDENTIFIER) return nullptr;
+    int index = resolveLocal(token);
+    if (index == -1 || locals[index].funcDepth != funcDepth || closureAssigned.contains(locals[index].var)) return nullptr;
+    return locals[index].var;
+}
+
+#pragma endregion
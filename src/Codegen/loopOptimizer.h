@@ -0,0 +1,102 @@
+#pragma once
+#include "../Parsing/ASTDefs.h"
+#include "../Includes/unorderedDense.h"
+#include "scopedWalker.h"
+// Moves work that doesn't change between iterations out of for and while loops
+//
+// Loop invariant code motion: arithmetic on numbers(proven by typeInference) whose operands are number literals or locals
+// declared before the loop and never assigned inside of it(or from a closure) is evaluated once before the loop
+// and stored in a synthetic local, the loop is wrapped in a block that declares those locals
+// Only the largest invariant expression is hoisted, out of the outermost loop it's invariant in
+// Number arithmetic has no side effects and can't throw, so it's fine to evaluate it even if the loop body never runs
+// Globals, fields and call results are never hoisted, any call(or another thread) could change them
+//
+// Induction variables: in 'for(let i = a; ...; i++)'(or ++i, i += b), where a and b are non negative integer literals
+// and i isn't assigned anywhere else, i is always a non negative integer
+// arr[i] and arr[i] = x are marked so the compiler emits GET_INDEX/SET_INDEX, which skip the integer and negative index checks
+// The upper bound is still checked at runtime, the array can be resized through another reference
+//
+// Bounds checks: if the loop is 'for(...; i < arr.length(); ...)', arr is a local the loop doesn't assign to and the body
+// has no calls, nothing can resize arr between the condition and the end of the body(arrays are only resized by their
+// natives), so in the body arr[i] and arr[i] = x emit GET_INDEX_UNCHECKED/SET_INDEX_UNCHECKED, the condition is the only
+// bounds check left
+// Like every other array access this doesn't protect against another thread resizing the array at the same time
+//
+// The AST is walked twice, the first walk finds which locals each loop assigns to, the second one transforms the loops
+// The second walk skips the body of every function that neither contains a loop nor is declared inside of one
+
+// Max number of expressions hoisted out of a single loop
+#define LICM_MAX_HOISTED 8
+// Nothing is hoisted once a function has this many locals, hoisted expressions take up local slots
+#define LICM_LOCAL_LIMIT 128
+
+namespace loopOptimizer {
+    struct Loop {
+        AST::ASTNode* node = nullptr;
+        // Locals below this index were declared before the loop
+        int localsBase = 0;
+        vector<AST::VarDecl*> hoisted;
+        // True while the walk is in the body of the loop
+        bool inBody = false;
+        // Set if the condition is 'index < array.length()' and indexing array with index can skip the bounds checks
+        AST::ASTVar* index = nullptr;
+        AST::ASTVar* array = nullptr;
+    };
+
+    class LoopOptimizer : public scopedWalker::ScopedWalker {
+    public:
+        LoopOptimizer(vector<CSLModule*>& units);
+
+        #pragma region Visitor pattern
+        void visitAssignmentExpr(AST::AssignmentExpr* expr) override;
+        void visitSetExpr(AST::SetExpr* expr) override;
+        void visitUnaryExpr(AST::UnaryExpr* expr) override;
+        void visitCallExpr(AST::CallExpr* expr) override;
+        void visitNewExpr(AST::NewExpr* expr) override;
+        void visitFieldAccessExpr(AST::FieldAccessExpr* expr) override;
+        void visitAsyncExpr(AST::AsyncExpr* expr) override;
+        void visitAwaitExpr(AST::AwaitExpr* expr) override;
+
+        void visitWhileStmt(AST::WhileStmt* stmt) override;
+        void visitForStmt(AST::ForStmt* stmt) override;
+        #pragma endregion
+    private:
+        // True during the first walk, which only records assignments
+        bool isAnalyzing;
+        // Loops of the function that's currently being walked, innermost is last
+        vector<Loop> loops;
+        // Number of loops the walk is in, counting the ones of enclosing functions
+        int loopDepth;
+        // Bodies of the functions that are currently being walked, innermost is last
+        vector<AST::BlockStmt*> funcBodies;
+        // Function bodies the second walk goes through, found by the first one
+        ankerl::unordered_dense::set<AST::BlockStmt*> loopFuncs;
+        // Number of assignments to each local inside of each loop
+        ankerl::unordered_dense::map<AST::ASTNode*, ankerl::unordered_dense::map<AST::ASTVar*, int>> assignCounts;
+        // Locals assigned from a function other than the one they were declared in
+        ankerl::unordered_dense::set<AST::ASTVar*> closureAssigned;
+        ankerl::unordered_dense::set<AST::ASTVar*> inductionVars;
+        // Loops whose body calls something, found by the first walk
+        ankerl::unordered_dense::set<AST::ASTNode*> callingLoops;
+        // Declarations of the loop that was just walked, visitNode wraps the loop in a block with these
+        vector<AST::VarDecl*> toWrap;
+        int hoistedCount;
+
+        #pragma region Helpers
+        void visitNode(AST::ASTNodePtr& node) override;
+        void visitFunc(vector<AST::ASTVar>& args, AST::BlockStmt* body) override;
+
+        void beginLoop(AST::ASTNode* node, int localsBase);
+        void endLoop();
+        bool hoist(AST::ASTNodePtr& node);
+        bool isInvariant(AST::ASTNodePtr node, Loop& loop, Token& base);
+        int countLocals();
+        void findInductionVar(AST::ForStmt* stmt);
+        void findBoundedArray(AST::ForStmt* stmt);
+        void markIndex(AST::ASTNodePtr callee, AST::ASTNodePtr field, bool& hasNonNegativeIndex, bool& isInBounds);
+        void recordAssignment(Token name);
+        void recordCall();
+        AST::ASTVar* resolveLoopLocal(AST::ASTNodePtr node);
+        #pragma endregion
+    };
+}
@@ -0,0 +1,172 @@
+#include "nameResolver.h"
+#include "compiler.h"
+#include <algorithm>
+
+using namespace nameResolver;
+
+NameResolver::NameResolver(compileCore::Compiler* _compiler) {
+    compiler = _compiler;
+    isResolved = true;
+    isConstructor = false;
+    nodeCount = 0;
+    localCount = 0;
+}
+
+bool NameResolver::resolves(AST::FuncDecl* decl, bool _isConstructor) {
+    isResolved = true;
+    isConstructor = _isConstructor;
+    nodeCount = 0;
+    localCount = 0;
+    locals.clear();
+    initializing.clear();
+    scopeDepth = 0;
+    funcDepth = 0;
+    visitFunc(decl->args, decl->body);
+    return isResolved;
+}
+
+void NameResolver::visitAssignmentExpr(AST::AssignmentExpr* expr) {
+    ScopedWalker::visitAssignmentExpr(expr);
+    namedVar(expr->name, true);
+}
+
+void NameResolver::visitSetExpr(AST::SetExpr* expr) {
+    ScopedWalker::visitSetExpr(expr);
+    if (expr->accessor.type == TokenType::DOT && isThis(expr->callee)) thisField(expr->field, true);
+}
+
+void NameResolver::visitBinaryExpr(AST::BinaryExpr* expr) {
+    visitNode(expr->left);
+    // Right side of 'instanceof' is a class name
+    if (expr->op.type == TokenType::INSTANCEOF) {
+        if (!compiler->canResolveClass(expr->right)) isResolved = false;
+        return;
+    }
+    visitNode(expr->right);
+}
+
+void NameResolver::visitUnaryExpr(AST::UnaryExpr* expr) {
+    bool isIncrement = expr->op.type == TokenType::INCREMENT || expr->op.type == TokenType::DECREMENT;
+    if (isIncrement && expr->right->type == AST::ASTType::LITERAL) {
+        namedVar(static_cast<AST::LiteralExpr*>(expr->right)->token, true);
+        return;
+    }
+    // Only variables and fields can be incremented, this.method++ assigns to a method
+    if (isIncrement && expr->right->type != AST::ASTType::FIELD_ACCESS) isResolved = false;
+    else if (isIncrement) {
+        auto field = static_cast<AST::FieldAccessExpr*>(expr->right);
+        if (field->accessor.type == TokenType::DOT && isThis(field->callee)) thisField(field->field, true);
+    }
+    visitNode(expr->right);
+}
+
+void NameResolver::visitCallExpr(AST::CallExpr* expr) {
+    // Inside of methods, fields and methods of the class can be called without 'this', they're looked up before locals
+    if (expr->callee->type == AST::ASTType::LITERAL
+        && compiler->classFieldKind(static_cast<AST::LiteralExpr*>(expr->callee)->token) != 0) {
+        if (funcDepth > 1) isResolved = false;
+    }
+    else visitNode(expr->callee);
+    for (auto& arg : expr->args) {
+        visitNode(arg);
+    }
+}
+
+void NameResolver::visitNewExpr(AST::NewExpr* expr) {
+    if (!compiler->canResolveClass(expr->call->callee)) isResolved = false;
+    for (auto& arg : expr->call->args) {
+        visitNode(arg);
+    }
+}
+
+void NameResolver::visitFieldAccessExpr(AST::FieldAccessExpr* expr) {
+    ScopedWalker::visitFieldAccessExpr(expr);
+    if (expr->accessor.type == TokenType::DOT && isThis(expr->callee)) thisField(expr->field, false);
+}
+
+void NameResolver::visitLiteralExpr(AST::LiteralExpr* expr) {
+    // 'this' is the first arg of every method, and can be captured by closures declared in them
+    if (expr->token.type == TokenType::THIS) {
+        if (!compiler->currentClass) isResolved = false;
+    }
+    else if (expr->token.type == TokenType::IDENTIFIER) namedVar(expr->token, false);
+}
+
+void NameResolver::visitSuperExpr(AST::SuperExpr* expr) {
+    if (!compiler->canResolveSuperMethod(expr->methodName)) isResolved = false;
+}
+
+void NameResolver::visitModuleAccessExpr(AST::ModuleAccessExpr* expr) {
+    if (!compiler->canResolveModuleVariable(expr->moduleName, expr->ident)) isResolved = false;
+}
+
+void NameResolver::visitVarDecl(AST::VarDecl* decl) {
+    // Declared before the initializer is walked, like the compiler does, so the initializer can't read it
+    declareLocal(decl->var);
+    initializing.push_back(&decl->var);
+    if (decl->value) visitNode(decl->value);
+    initializing.pop_back();
+}
+
+// Functions and classes are only declared at the top level, never inside of a function body
+void NameResolver::visitFuncDecl(AST::FuncDecl* decl) {}
+
+void NameResolver::visitClassDecl(AST::ClassDecl* decl) {}
+
+// Switch tables take up to 4 bytes per constant
+void NameResolver::visitCaseStmt(AST::CaseStmt* _case) {
+    nodeCount += _case->constants.size();
+    ScopedWalker::visitCaseStmt(_case);
+}
+
+// Constructors can't return at all, closures declared in them can
+void NameResolver::visitReturnStmt(AST::ReturnStmt* stmt) {
+    if (isConstructor && funcDepth == 1) isResolved = false;
+    ScopedWalker::visitReturnStmt(stmt);
+}
+
+#pragma region Helpers
+void NameResolver::visitNode(AST::ASTNodePtr& node) {
+    if (++nodeCount > RESOLVER_NODE_LIMIT) isResolved = false;
+    ScopedWalker::visitNode(node);
+}
+
+// Same check as Compiler::declareLocalVar, locals of enclosing functions and outer scopes can be shadowed
+// Every local of the body and its closures also has to fit into the locals(or upvalues) of a single function
+void NameResolver::declareLocal(AST::ASTVar& var) {
+    for (int i = locals.size() - 1; i >= 0 && locals[i].depth == scopeDepth && locals[i].funcDepth == funcDepth; i--) {
+        if (locals[i].symbol == var.name.symbol) isResolved = false;
+    }
+    // First slot of every function is taken by the function itself or 'this'
+    if (++localCount >= LOCAL_MAX - 1) isResolved = false;
+    ScopedWalker::declareLocal(var);
+}
+
+// Same order as Compiler::namedVar
+void NameResolver::namedVar(Token name, bool canAssign) {
+    int index = resolveLocal(name);
+    if (index != -1) {
+        // A captured local is an upvalue of every closure between the local and the one reading it
+        nodeCount += funcDepth - locals[index].funcDepth;
+        if (std::find(initializing.begin(), initializing.end(), locals[index].var) != initializing.end()) isResolved = false;
+        return;
+    }
+    int kind = compiler->classFieldKind(name);
+    if (kind != 0) {
+        // Closures have to go through 'this', and methods can't be assigned to
+        if (funcDepth > 1 || (canAssign && kind == 2)) isResolved = false;
+        return;
+    }
+    if (!compiler->canResolveGlobal(name, canAssign)) isResolved = false;
+}
+
+bool NameResolver::isThis(AST::ASTNodePtr node) {
+    return node->type == AST::ASTType::LITERAL && static_cast<AST::LiteralExpr*>(node)->token.type == TokenType::THIS;
+}
+
+// this.field has to name a field or method of the class, only fields can be assigned to
+void NameResolver::thisField(AST::ASTNodePtr field, bool canAssign) {
+    int kind = compiler->classFieldKind(static_cast<AST::LiteralExpr*>(field)->token);
+    if (kind == 0 || (canAssign && kind == 2)) isResolved = false;
+}
+#pragma endregion
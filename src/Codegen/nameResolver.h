@@ -0,0 +1,70 @@
+#pragma once
+#include "../Parsing/ASTDefs.h"
+#include "scopedWalker.h"
+// Checks that the body of a lazily compiled function would compile, without compiling the body
+//
+// Functions of imported modules are only compiled on their first call(see Compiler::deferFunc), so a compile error in
+// one of them would otherwise only be found once the program is already running
+// Names are looked up in the same order namedVar does: locals, locals of enclosing closures, fields and methods of the
+// class, globals of the module, imported globals, natives. Module access, 'new', 'instanceof', 'this' and 'super'
+// are checked as well
+// Every other error the compiler can report for a body is checked too: locals redeclared in the same scope or read in
+// their own initializer, assignments to functions, classes and methods, incrementing something that isn't a variable,
+// returning from a constructor, and bodies that could exceed the local, upvalue, constant or jump limits
+// Bodies that fail a check are compiled right away by Compiler::checkLazyFuncs, which reports the errors, so this only
+// has to be conservative: a body it lets through must compile, a body it stops only costs an early compile
+
+// Bodies with more nodes than this are compiled right away, case constants and the upvalues of closures count as nodes
+// too, none of them emits more than 32 bytes so below it no jump, loop or constant index of the body can overflow 16 bits
+#define RESOLVER_NODE_LIMIT 2048
+
+namespace compileCore {
+    class Compiler;
+}
+
+namespace nameResolver {
+    class NameResolver : public scopedWalker::ScopedWalker {
+    public:
+        // Compiler has to be in the state it was in when it reached the declaration, see Compiler::checkLazyFuncs
+        NameResolver(compileCore::Compiler* compiler);
+        // Returns false if the args or body of decl might not compile
+        bool resolves(AST::FuncDecl* decl, bool isConstructor);
+
+        #pragma region Visitor pattern
+        void visitAssignmentExpr(AST::AssignmentExpr* expr) override;
+        void visitSetExpr(AST::SetExpr* expr) override;
+        void visitBinaryExpr(AST::BinaryExpr* expr) override;
+        void visitUnaryExpr(AST::UnaryExpr* expr) override;
+        void visitCallExpr(AST::CallExpr* expr) override;
+        void visitNewExpr(AST::NewExpr* expr) override;
+        void visitFieldAccessExpr(AST::FieldAccessExpr* expr) override;
+        void visitLiteralExpr(AST::LiteralExpr* expr) override;
+        void visitSuperExpr(AST::SuperExpr* expr) override;
+        void visitModuleAccessExpr(AST::ModuleAccessExpr* expr) override;
+
+        void visitVarDecl(AST::VarDecl* decl) override;
+        void visitFuncDecl(AST::FuncDecl* decl) override;
+        void visitClassDecl(AST::ClassDecl* decl) override;
+
+        void visitCaseStmt(AST::CaseStmt* _case) override;
+        void visitReturnStmt(AST::ReturnStmt* stmt) override;
+        #pragma endregion
+    private:
+        compileCore::Compiler* compiler;
+        // Locals whose initializer is being walked, reading one of them is an error
+        vector<AST::ASTVar*> initializing;
+        bool isResolved;
+        bool isConstructor;
+        // Nodes and locals in the body and its closures
+        int nodeCount;
+        int localCount;
+
+        #pragma region Helpers
+        void visitNode(AST::ASTNodePtr& node) override;
+        void declareLocal(AST::ASTVar& var) override;
+        void namedVar(Token name, bool canAssign);
+        bool isThis(AST::ASTNodePtr node);
+        void thisField(AST::ASTNodePtr field, bool canAssign);
+        #pragma endregion
+    };
+}
@@ -0,0 +1,464 @@
+#include "peephole.h"
+#include "../codegen/valueHelpersInline.cpp"
+#include <queue>
+
+using namespace peephole;
+using namespace valueHelpers;
+
+#pragma region Bytecode helpers
+// Size of the instruction at offset(including the opcode), 0 if the opcode isn't known
+uInt peephole::instructionLength(Chunk& chunk, uInt offset) {
+    auto& code = chunk.bytecode;
+    auto readShort = [&](uInt pos) { return static_cast<uInt>((code[pos] << 8) | code[pos + 1]); };
+    switch (code[offset]) {
+        case +OpCode::POP:
+        case +OpCode::NIL:
+        case +OpCode::TRUE:
+        case +OpCode::FALSE:
+        case +OpCode::NEGATE:
+        case +OpCode::NEGATE_NUM:
+        case +OpCode::NOT:
+        case +OpCode::BIN_NOT:
+        case +OpCode::BITWISE_XOR:
+        case +OpCode::BITWISE_OR:
+        case +OpCode::BITWISE_AND:
+        case +OpCode::ADD:
+        case +OpCode::SUBTRACT:
+        case +OpCode::MULTIPLY:
+        case +OpCode::DIVIDE:
+        case +OpCode::MOD:
+        case +OpCode::BITSHIFT_LEFT:
+        case +OpCode::BITSHIFT_RIGHT:
+        case +OpCode::ADD_NUM:
+        case +OpCode::SUBTRACT_NUM:
+        case +OpCode::MULTIPLY_NUM:
+        case +OpCode::DIVIDE_NUM:
+        case +OpCode::ADD_STR:
+        case +OpCode::EQUAL:
+        case +OpCode::NOT_EQUAL:
+        case +OpCode::GREATER:
+        case +OpCode::GREATER_EQUAL:
+        case +OpCode::LESS:
+        case +OpCode::LESS_EQUAL:
+        case +OpCode::IN:
+        case +OpCode::GREATER_NUM:
+        case +OpCode::GREATER_EQUAL_NUM:
+        case +OpCode::LESS_NUM:
+        case +OpCode::LESS_EQUAL_NUM:
+        case +OpCode::RETURN:
+        case +OpCode::AWAIT:
+        case +OpCode::GET:
+        case +OpCode::SET:
+        case +OpCode::GET_INDEX:
+        case +OpCode::SET_INDEX:
+        case +OpCode::GET_INDEX_UNCHECKED:
+        case +OpCode::SET_INDEX_UNCHECKED:
+            return 1;
+        case +OpCode::POPN:
+        case +OpCode::LOAD_INT:
+        case +OpCode::CONSTANT:
+        case +OpCode::GET_UPVALUE:
+        case +OpCode::SET_UPVALUE:
+        case +OpCode::IN_RANGE:
+        case +OpCode::GET_GLOBAL:
+        case +OpCode::SET_GLOBAL:
+        case +OpCode::GET_LOCAL:
+        case +OpCode::SET_LOCAL:
+        case +OpCode::CREATE_UPVALUE:
+        case +OpCode::GET_LOCAL_UPVALUE:
+        case +OpCode::SET_LOCAL_UPVALUE:
+        case +OpCode::CALL:
+        case +OpCode::LAUNCH_ASYNC:
+        case +OpCode::CREATE_ARRAY:
+        case +OpCode::GET_RANGE:
+        case +OpCode::SET_RANGE:
+        case +OpCode::GET_PROPERTY:
+        case +OpCode::SET_PROPERTY:
+        case +OpCode::INVOKE_FROM_STACK:
+        case +OpCode::GET_SUPER:
+            return 2;
+        case +OpCode::CONSTANT_LONG:
+        case +OpCode::GET_NATIVE:
+        case +OpCode::GET_GLOBAL_LONG:
+        case +OpCode::SET_GLOBAL_LONG:
+        case +OpCode::JUMP:
+        case +OpCode::JUMP_IF_FALSE:
+        case +OpCode::JUMP_IF_TRUE:
+        case +OpCode::JUMP_IF_FALSE_POP:
+        case +OpCode::JUMP_IF_TRUE_POP:
+        case +OpCode::LOOP_IF_TRUE:
+        case +OpCode::LOOP:
+        case +OpCode::GET_PROPERTY_LONG:
+        case +OpCode::SET_PROPERTY_LONG:
+        case +OpCode::GET_PROPERTY_EFFICIENT:
+        case +OpCode::SET_PROPERTY_EFFICIENT:
+        case +OpCode::INVOKE:
+        case +OpCode::SUPER_INVOKE:
+        case +OpCode::CALL_DIRECT:
+        case +OpCode::GET_SUPER_LONG:
+        case +OpCode::INSTANCEOF:
+            return 3;
+        case +OpCode::JUMP_POPN:
+        case +OpCode::INVOKE_LONG:
+        case +OpCode::SUPER_INVOKE_LONG:
+        case +OpCode::CALL_DIRECT_LONG:
+            return 4;
+        case +OpCode::INCREMENT: {
+            // Same layout as the one described in Compiler::visitUnaryExpr
+            byte type = code[offset + 1] >> 2;
+            if (type == 7) return 2;
+            return (type == 4 || type == 6) ? 4 : 3;
+        }
+        case +OpCode::SWITCH: {
+            uInt caseNum = readShort(offset + 1);
+            return 3 + caseNum + (caseNum + 1) * 2;
+        }
+        case +OpCode::SWITCH_LONG: {
+            uInt caseNum = readShort(offset + 1);
+            return 3 + caseNum * 2 + (caseNum + 1) * 2;
+        }
+        case +OpCode::SWITCH_TABLE:
+            return 5 + (readShort(offset + 3) + 1) * 2;
+        case +OpCode::CLOSURE:
+            return 2 + asFunction(chunk.constants[code[offset + 1]])->upvalueCount * 2;
+        case +OpCode::CLOSURE_LONG:
+            return 3 + asFunction(chunk.constants[readShort(offset + 1)])->upvalueCount * 2;
+        case +OpCode::CREATE_STRUCT:
+            return 2 + code[offset + 1];
+        case +OpCode::CREATE_STRUCT_LONG:
+            return 2 + code[offset + 1] * 2;
+        default:
+            return 0;
+    }
+}
+
+// Instructions that never continue to the next one
+bool peephole::isTerminator(byte op) {
+    switch (op) {
+        case +OpCode::JUMP:
+        case +OpCode::LOOP:
+        case +OpCode::JUMP_POPN:
+        case +OpCode::RETURN:
+        case +OpCode::SWITCH:
+        case +OpCode::SWITCH_LONG:
+        case +OpCode::SWITCH_TABLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Offsets of each jump inside an instruction
+vector<uInt> peephole::jumpOperands(vector<uint8_t>& bytes) {
+    switch (bytes[0]) {
+        case +OpCode::JUMP:
+        case +OpCode::JUMP_IF_FALSE:
+        case +OpCode::JUMP_IF_TRUE:
+        case +OpCode::JUMP_IF_FALSE_POP:
+        case +OpCode::JUMP_IF_TRUE_POP:
+        case +OpCode::LOOP_IF_TRUE:
+        case +OpCode::LOOP:
+            return {1};
+        // Number of variables to pop comes before the jump
+        case +OpCode::JUMP_POPN:
+            return {2};
+        // Jumps are after the constants, the last one is for the default case
+        case +OpCode::SWITCH:
+        case +OpCode::SWITCH_LONG: {
+            uInt caseNum = (bytes[1] << 8) | bytes[2];
+            uInt start = 3 + caseNum * (bytes[0] == +OpCode::SWITCH ? 1 : 2);
+            vector<uInt> operands;
+            for (uInt i = 0; i <= caseNum; i++) operands.push_back(start + i * 2);
+            return operands;
+        }
+        case +OpCode::SWITCH_TABLE: {
+            uInt tableSize = (bytes[3] << 8) | bytes[4];
+            vector<uInt> operands;
+            for (uInt i = 0; i <= tableSize; i++) operands.push_back(5 + i * 2);
+            return operands;
+        }
+        default:
+            return {};
+    }
+}
+
+// LOOP and LOOP_IF_TRUE jump backwards, the offset is subtracted
+bool peephole::isBackwardJump(byte op) {
+    return op == +OpCode::LOOP || op == +OpCode::LOOP_IF_TRUE;
+}
+#pragma endregion
+
+// Pushes a value without any side effects, so it can be dropped if it's popped right away
+static bool isPurePush(byte op) {
+    switch (op) {
+        case +OpCode::GET_LOCAL:
+        case +OpCode::GET_UPVALUE:
+        case +OpCode::LOAD_INT:
+        case +OpCode::CONSTANT:
+        case +OpCode::CONSTANT_LONG:
+        case +OpCode::NIL:
+        case +OpCode::TRUE:
+        case +OpCode::FALSE:
+        case +OpCode::GET_NATIVE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Number of values a POP or POPN removes
+static uInt popCount(Instruction& inst) {
+    return inst.bytes[0] == +OpCode::POP ? 1 : inst.bytes[1];
+}
+
+static void setPopCount(Instruction& inst, uInt count) {
+    if (count == 0) inst.isDead = true;
+    else if (count == 1) inst.bytes = {+OpCode::POP};
+    else inst.bytes = {+OpCode::POPN, static_cast<uint8_t>(count)};
+}
+
+PeepholeOptimizer::PeepholeOptimizer(Chunk& _chunk) : chunk(_chunk) {
+    // Bytecode that can't be fully decoded is left as is
+    if (!decode()) return;
+    removeUnreachable();
+    while (optimizePass()) {
+        removeUnreachable();
+    }
+    encode();
+}
+
+#pragma region Helpers
+bool PeepholeOptimizer::decode() {
+    auto& bytecode = chunk.bytecode;
+    if (bytecode.empty() || chunk.lines.empty()) return false;
+    // Index of the instruction starting at each offset, the end of the chunk is a valid jump target as well
+    vector<int64_t> indexOf(bytecode.size() + 1, -1);
+    vector<uInt> offsets;
+    uInt lineIndex = 0;
+    for (uInt offset = 0; offset < bytecode.size();) {
+        uInt length = instructionLength(chunk, offset);
+        if (length == 0 || offset + length > bytecode.size()) return false;
+
+        Instruction inst;
+        inst.bytes.assign(bytecode.begin() + offset, bytecode.begin() + offset + length);
+        while (lineIndex < chunk.lines.size() - 1 && offset >= chunk.lines[lineIndex].end) lineIndex++;
+        inst.line = chunk.lines[lineIndex].line;
+        inst.fileIndex = chunk.lines[lineIndex].fileIndex;
+
+        indexOf[offset] = code.size();
+        offsets.push_back(offset);
+        code.push_back(inst);
+        offset += length;
+    }
+    indexOf[bytecode.size()] = code.size();
+
+    for (uInt i = 0; i < code.size(); i++) {
+        Instruction& inst = code[i];
+        bool isBackward = isBackwardJump(inst.bytes[0]);
+        for (uInt pos : jumpOperands(inst.bytes)) {
+            uInt jump = (inst.bytes[pos] << 8) | inst.bytes[pos + 1];
+            int64_t target = offsets[i] + pos + 2 + (isBackward ? -static_cast<int64_t>(jump) : jump);
+            if (target < 0 || target > static_cast<int64_t>(bytecode.size()) || indexOf[target] == -1) return false;
+            inst.targets.push_back(indexOf[target]);
+        }
+    }
+    return true;
+}
+
+void PeepholeOptimizer::encode() {
+    // Jumps don't change size, so offsets can be calculated up front
+    vector<uInt> newOffsets(code.size() + 1);
+    uInt size = 0;
+    for (uInt i = 0; i < code.size(); i++) {
+        newOffsets[i] = size;
+        if (!code[i].isDead) size += code[i].bytes.size();
+    }
+    newOffsets[code.size()] = size;
+
+    vector<uint8_t> bytecode;
+    vector<codeLine> lines;
+    bytecode.reserve(size);
+    for (uInt i = 0; i < code.size(); i++) {
+        Instruction& inst = code[i];
+        if (inst.isDead) continue;
+        vector<uInt> operands = jumpOperands(inst.bytes);
+        for (uInt k = 0; k < operands.size(); k++) {
+            uInt base = newOffsets[i] + operands[k] + 2;
+            uInt target = newOffsets[resolveTarget(inst.targets[k])];
+            uInt jump;
+            // Unconditional jumps may have been threaded to a target behind them
+            if (inst.bytes[0] == +OpCode::JUMP || inst.bytes[0] == +OpCode::LOOP) {
+                inst.bytes[0] = target >= base ? +OpCode::JUMP : +OpCode::LOOP;
+            }
+            if (isBackwardJump(inst.bytes[0])) jump = base - target;
+            else jump = target - base;
+            // Threading can make a jump longer, in which case the original code is kept
+            if (jump > UINT16_MAX) return;
+            inst.bytes[operands[k]] = (jump >> 8) & 0xff;
+            inst.bytes[operands[k] + 1] = jump & 0xff;
+        }
+
+        if (lines.empty() || lines.back().line != inst.line || lines.back().fileIndex != inst.fileIndex) {
+            if (!lines.empty()) lines.back().end = bytecode.size();
+            lines.emplace_back(inst.line, inst.fileIndex);
+        }
+        bytecode.insert(bytecode.end(), inst.bytes.begin(), inst.bytes.end());
+    }
+    if (lines.empty()) return;
+    lines.back().end = bytecode.size();
+
+    chunk.bytecode = std::move(bytecode);
+    chunk.lines = std::move(lines);
+}
+
+bool PeepholeOptimizer::optimizePass() {
+    bool changed = false;
+    // Jump threading, done first since it changes which instructions are jump targets
+    for (uInt i = 0; i < code.size(); i++) {
+        Instruction& inst = code[i];
+        if (inst.isDead) continue;
+        byte op = inst.bytes[0];
+        bool isUnconditional = op == +OpCode::JUMP || op == +OpCode::LOOP;
+        for (uInt& target : inst.targets) {
+            uInt cur = resolveTarget(target);
+            uInt best = cur;
+            bool isCycle = true;
+            // A chain longer than the number of instructions means the jumps form an infinite loop, which is left alone
+            for (uInt steps = 0; steps <= code.size(); steps++) {
+                if (cur >= code.size() || (code[cur].bytes[0] != +OpCode::JUMP && code[cur].bytes[0] != +OpCode::LOOP)) {
+                    isCycle = false;
+                    break;
+                }
+                cur = resolveTarget(code[cur].targets[0]);
+                // Conditional jumps and switches can only jump in one direction
+                if (isUnconditional || (isBackwardJump(op) ? cur <= i : cur > i)) best = cur;
+            }
+            if (isCycle) continue;
+            if (best != target) {
+                target = best;
+                changed = true;
+            }
+        }
+        // Jumping to a return is the same as returning
+        if (isUnconditional) {
+            uInt target = resolveTarget(inst.targets[0]);
+            if (target < code.size() && code[target].bytes[0] == +OpCode::RETURN) {
+                inst.bytes = {+OpCode::RETURN};
+                inst.targets.clear();
+                changed = true;
+            }
+        }
+    }
+    countJumps();
+
+    for (uInt i = 0; i < code.size(); i++) {
+        Instruction& inst = code[i];
+        if (inst.isDead) continue;
+        uInt j = next(i);
+        byte op = inst.bytes[0];
+        bool canMerge = j < code.size() && jumpsTo[j] == 0;
+
+        // Jumps to the next instruction
+        if (inst.targets.size() == 1 && resolveTarget(inst.targets[0]) == j) {
+            switch (op) {
+                case +OpCode::JUMP:
+                case +OpCode::JUMP_IF_FALSE:
+                case +OpCode::JUMP_IF_TRUE:
+                    inst.isDead = true;
+                    changed = true;
+                    continue;
+                case +OpCode::JUMP_IF_FALSE_POP:
+                case +OpCode::JUMP_IF_TRUE_POP:
+                case +OpCode::JUMP_POPN:
+                    setPopCount(inst, op == +OpCode::JUMP_POPN ? inst.bytes[1] : 1);
+                    inst.targets.clear();
+                    changed = true;
+                    continue;
+                default: break;
+            }
+        }
+        // break/continue/advance that don't need to pop anything
+        if (op == +OpCode::JUMP_POPN && inst.bytes[1] == 0) {
+            inst.bytes = {+OpCode::JUMP, 0, 0};
+            changed = true;
+        }
+        if (op == +OpCode::CONSTANT) {
+            Value val = chunk.constants[inst.bytes[1]];
+            if (isNumber(val)) {
+                double num = decodeNumber(val);
+                if (num >= 0 && num <= UINT8_MAX && std::trunc(num) == num && !std::signbit(num)) {
+                    inst.bytes = {+OpCode::LOAD_INT, static_cast<uint8_t>(num)};
+                    changed = true;
+                }
+            }
+        }
+        if (!canMerge) continue;
+        Instruction& nextInst = code[j];
+        byte nextOp = nextInst.bytes[0];
+        bool isNextPop = nextOp == +OpCode::POP || nextOp == +OpCode::POPN;
+
+        if (op == +OpCode::NOT && nextOp == +OpCode::JUMP_IF_FALSE_POP) {
+            inst.isDead = true;
+            nextInst.bytes[0] = +OpCode::JUMP_IF_TRUE_POP;
+            changed = true;
+        }
+        else if ((op == +OpCode::POP || op == +OpCode::POPN) && isNextPop) {
+            uInt count = popCount(inst) + popCount(nextInst);
+            if (count > UINT8_MAX) continue;
+            setPopCount(inst, count);
+            nextInst.isDead = true;
+            changed = true;
+        }
+        else if (isPurePush(op) && isNextPop) {
+            inst.isDead = true;
+            setPopCount(nextInst, popCount(nextInst) - 1);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Anything that isn't reachable from the first instruction is dead
+void PeepholeOptimizer::removeUnreachable() {
+    vector<bool> isReachable(code.size() + 1, false);
+    std::queue<uInt> queue;
+    auto visit = [&](uInt index) {
+        if (isReachable[index]) return;
+        isReachable[index] = true;
+        if (index < code.size()) queue.push(index);
+    };
+    visit(resolveTarget(0));
+    while (!queue.empty()) {
+        uInt i = queue.front();
+        queue.pop();
+        for (uInt target : code[i].targets) {
+            visit(resolveTarget(target));
+        }
+        if (!isTerminator(code[i].bytes[0])) visit(next(i));
+    }
+    for (uInt i = 0; i < code.size(); i++) {
+        if (!isReachable[i]) code[i].isDead = true;
+    }
+}
+
+// Next instruction that's still alive, or the end of the chunk
+uInt PeepholeOptimizer::next(uInt index) {
+    return resolveTarget(index + 1);
+}
+
+// Removed instructions pass control to the first live instruction after them
+uInt PeepholeOptimizer::resolveTarget(uInt index) {
+    while (index < code.size() && code[index].isDead) index++;
+    return index;
+}
+
+void PeepholeOptimizer::countJumps() {
+    jumpsTo.assign(code.size() + 1, 0);
+    for (Instruction& inst : code) {
+        if (inst.isDead) continue;
+        for (uInt target : inst.targets) {
+            jumpsTo[resolveTarget(target)]++;
+        }
+    }
+}
+#pragma endregion
@@ -0,0 +1,56 @@
+#pragma once
+#include "codegenDefs.h"
+// Rewrites the bytecode of a finished function chunk before it's copied into the main code block
+//
+// The chunk is decoded into instructions, jump offsets are turned into indices of the instructions they land on,
+// and the following rewrites are applied until none of them change anything:
+// - jumps that land on an unconditional jump(or a return) go straight to its target
+// - jumps to the next instruction are removed
+// - NOT followed by JUMP_IF_FALSE_POP becomes JUMP_IF_TRUE_POP
+// - POP/POPN sequences are merged into a single POPN
+// - pushes without side effects(GET_LOCAL, constants...) followed by a POP are removed
+// - CONSTANT of a small non negative integer becomes LOAD_INT
+// - code that can't be reached from the start of the function is removed
+// Two instructions are only merged if nothing jumps to the second one
+//
+// Afterwards the instructions are encoded again with new jump offsets, and the line info is rebuilt so Chunk::getLine
+// keeps pointing to the correct line
+
+namespace peephole {
+    // Bytecode helpers, also used to build the SSA IR
+    uInt instructionLength(Chunk& chunk, uInt offset);
+    bool isTerminator(byte op);
+    vector<uInt> jumpOperands(vector<uint8_t>& bytes);
+    bool isBackwardJump(byte op);
+
+    struct Instruction {
+        // Opcode and operands, jump offsets inside are rewritten when encoding
+        vector<uint8_t> bytes;
+        // Index of the instruction each jump offset(in order of appearance) lands on
+        vector<uInt> targets;
+        uInt line = 0;
+        byte fileIndex = 0;
+        bool isDead = false;
+    };
+
+    class PeepholeOptimizer {
+    public:
+        PeepholeOptimizer(Chunk& chunk);
+    private:
+        Chunk& chunk;
+        vector<Instruction> code;
+        // Number of jumps that land on each instruction, the last element is the end of the chunk
+        vector<uInt> jumpsTo;
+
+        #pragma region Helpers
+        bool decode();
+        void encode();
+        bool optimizePass();
+        void removeUnreachable();
+
+        uInt next(uInt index);
+        uInt resolveTarget(uInt index);
+        void countJumps();
+        #pragma endregion
+    };
+}
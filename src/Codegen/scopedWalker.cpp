@@ -0,0 +1,224 @@
+#include "scopedWalker.h"
+
+using namespace scopedWalker;
+
+ScopedWalker::ScopedWalker() {
+    scopeDepth = 0;
+    funcDepth = 0;
+    curUnit = nullptr;
+}
+
+void ScopedWalker::visitAssignmentExpr(AST::AssignmentExpr* expr) {
+    visitNode(expr->value);
+}
+
+void ScopedWalker::visitSetExpr(AST::SetExpr* expr) {
+    visitNode(expr->value);
+    visitNode(expr->callee);
+    if (expr->accessor.type == TokenType::LEFT_BRACKET) visitNode(expr->field);
+}
+
+void ScopedWalker::visitConditionalExpr(AST::ConditionalExpr* expr) {
+    visitNode(expr->condition);
+    visitNode(expr->mhs);
+    if (expr->rhs) visitNode(expr->rhs);
+}
+
+void ScopedWalker::visitRangeExpr(AST::RangeExpr *expr) {
+    if (expr->start) visitNode(expr->start);
+    if (expr->end) visitNode(expr->end);
+}
+
+void ScopedWalker::visitBinaryExpr(AST::BinaryExpr* expr) {
+    visitNode(expr->left);
+    // Right side of instanceof is a class name
+    if (expr->op.type != TokenType::INSTANCEOF) visitNode(expr->right);
+}
+
+void ScopedWalker::visitUnaryExpr(AST::UnaryExpr* expr) {
+    visitNode(expr->right);
+}
+
+void ScopedWalker::visitCallExpr(AST::CallExpr* expr) {
+    visitNode(expr->callee);
+    for (auto& arg : expr->args) {
+        visitNode(arg);
+    }
+}
+
+void ScopedWalker::visitNewExpr(AST::NewExpr* expr) {
+    // Callee is a class name, only args are looked at
+    for (auto& arg : expr->call->args) {
+        visitNode(arg);
+    }
+}
+
+void ScopedWalker::visitFieldAccessExpr(AST::FieldAccessExpr* expr) {
+    visitNode(expr->callee);
+    if (expr->accessor.type == TokenType::LEFT_BRACKET) visitNode(expr->field);
+}
+
+void ScopedWalker::visitAsyncExpr(AST::AsyncExpr* expr) {
+    visitNode(expr->callee);
+    for (auto& arg : expr->args) {
+        visitNode(arg);
+    }
+}
+
+void ScopedWalker::visitAwaitExpr(AST::AwaitExpr* expr) {
+    visitNode(expr->expr);
+}
+
+void ScopedWalker::visitArrayLiteralExpr(AST::ArrayLiteralExpr* expr) {
+    for (auto& mem : expr->members) {
+        visitNode(mem);
+    }
+}
+
+void ScopedWalker::visitStructLiteralExpr(AST::StructLiteral* expr) {
+    for (AST::StructEntry& entry : expr->fields) {
+        visitNode(entry.expr);
+    }
+}
+
+void ScopedWalker::visitLiteralExpr(AST::LiteralExpr* expr) {}
+
+void ScopedWalker::visitSuperExpr(AST::SuperExpr* expr) {}
+
+void ScopedWalker::visitFuncLiteral(AST::FuncLiteral* expr) {
+    visitFunc(expr->args, expr->body);
+}
+
+void ScopedWalker::visitModuleAccessExpr(AST::ModuleAccessExpr* expr) {}
+
+// This shouldn't ever be visited as every macro should be expanded before compilation
+void ScopedWalker::visitMacroExpr(AST::MacroExpr* expr) {}
+
+void ScopedWalker::visitVarDecl(AST::VarDecl* decl) {
+    if (decl->value) visitNode(decl->value);
+    // Globals are late bound and can be assigned from other modules
+    if (scopeDepth > 0) declareLocal(decl->var);
+}
+
+void ScopedWalker::visitFuncDecl(AST::FuncDecl* decl) {
+    visitFunc(decl->args, decl->body);
+}
+
+void ScopedWalker::visitClassDecl(AST::ClassDecl* decl) {
+    for (auto& _method : decl->methods) {
+        _method.method->accept(this);
+    }
+}
+
+void ScopedWalker::visitExprStmt(AST::ExprStmt* stmt) {
+    visitNode(stmt->expr);
+}
+
+void ScopedWalker::visitBlockStmt(AST::BlockStmt* stmt) {
+    beginScope();
+    for (auto& node : stmt->statements) {
+        visitNode(node);
+    }
+    endScope();
+}
+
+void ScopedWalker::visitIfStmt(AST::IfStmt* stmt) {
+    visitNode(stmt->condition);
+    visitNode(stmt->thenBranch);
+    if (stmt->elseBranch) visitNode(stmt->elseBranch);
+}
+
+void ScopedWalker::visitWhileStmt(AST::WhileStmt* stmt) {
+    visitNode(stmt->condition);
+    beginScope();
+    visitNode(stmt->body);
+    endScope();
+}
+
+void ScopedWalker::visitForStmt(AST::ForStmt* stmt) {
+    // Wrap this in a scope so if there is a var declaration in the initialization it's scoped to the loop
+    beginScope();
+    if (stmt->init) visitNode(stmt->init);
+    if (stmt->condition) visitNode(stmt->condition);
+    visitNode(stmt->body);
+    if (stmt->increment) visitNode(stmt->increment);
+    endScope();
+}
+
+void ScopedWalker::visitBreakStmt(AST::BreakStmt* stmt) {}
+
+void ScopedWalker::visitContinueStmt(AST::ContinueStmt* stmt) {}
+
+void ScopedWalker::visitSwitchStmt(AST::SwitchStmt* stmt) {
+    visitNode(stmt->expr);
+    for (AST::CaseStmt* _case : stmt->cases) {
+        beginScope();
+        _case->accept(this);
+        endScope();
+    }
+}
+
+void ScopedWalker::visitCaseStmt(AST::CaseStmt* stmt) {
+    for (auto& caseStmt : stmt->stmts) {
+        visitNode(caseStmt);
+    }
+}
+
+void ScopedWalker::visitAdvanceStmt(AST::AdvanceStmt* stmt) {}
+
+void ScopedWalker::visitReturnStmt(AST::ReturnStmt* stmt) {
+    if (stmt->expr) visitNode(stmt->expr);
+}
+
+#pragma region Helpers
+void ScopedWalker::run(vector<CSLModule*>& units) {
+    locals.clear();
+    scopeDepth = 0;
+    funcDepth = 0;
+    for (CSLModule* unit : units) {
+        curUnit = unit;
+        for (auto& stmt : unit->stmts) {
+            visitNode(stmt);
+        }
+    }
+}
+
+void ScopedWalker::visitNode(AST::ASTNodePtr& node) {
+    node->accept(this);
+}
+
+void ScopedWalker::visitFunc(vector<AST::ASTVar>& args, AST::BlockStmt* body) {
+    funcDepth++;
+    beginScope();
+    for (AST::ASTVar& var : args) {
+        declareLocal(var);
+    }
+    for (auto& stmt : body->statements) {
+        visitNode(stmt);
+    }
+    endScope();
+    funcDepth--;
+}
+
+void ScopedWalker::declareLocal(AST::ASTVar& var) {
+    locals.push_back(Local{var.name.symbol, &var, scopeDepth, funcDepth});
+}
+
+int ScopedWalker::resolveLocal(Token name) {
+    for (int i = locals.size() - 1; i >= 0; i--) {
+        if (locals[i].symbol == name.symbol) return i;
+    }
+    return -1;
+}
+
+void ScopedWalker::beginScope() {
+    scopeDepth++;
+}
+
+void ScopedWalker::endScope() {
+    scopeDepth--;
+    while (!locals.empty() && locals.back().depth > scopeDepth) {
+        locals.pop_back();
+    }
+}
+#pragma endregion
@@ -0,0 +1,83 @@
+#pragma once
+#include "../Parsing/ASTDefs.h"
+// Base of the AST passes that run before the compiler and need to know which local a name refers to
+//
+// Every visit method walks the children of the node through visitNode, passes only override the nodes they care about
+// and the hooks below. Locals are tracked the same way the compiler scopes them: function args and 'let' inside of a
+// function body, block, loop or switch case are locals, top level declarations are late bound globals
+// Closures can see the locals of the enclosing functions, so there's a single stack of locals for all functions,
+// funcDepth tells which function a local belongs to
+//
+// Passes built on this don't emit any errors, the compiler reports everything
+
+namespace scopedWalker {
+    struct Local {
+        // Interned name
+        uInt symbol = 0;
+        AST::ASTVar* var = nullptr;
+        int depth = 0;
+        // Nesting level of the function the local was declared in
+        int funcDepth = 0;
+    };
+
+    class ScopedWalker : public AST::Visitor {
+    public:
+        ScopedWalker();
+
+        #pragma region Visitor pattern
+        void visitAssignmentExpr(AST::AssignmentExpr* expr) override;
+        void visitRangeExpr(AST::RangeExpr *expr) override;
+        void visitSetExpr(AST::SetExpr* expr) override;
+        void visitConditionalExpr(AST::ConditionalExpr* expr) override;
+        void visitBinaryExpr(AST::BinaryExpr* expr) override;
+        void visitUnaryExpr(AST::UnaryExpr* expr) override;
+        void visitCallExpr(AST::CallExpr* expr) override;
+        void visitNewExpr(AST::NewExpr* expr) override;
+        void visitFieldAccessExpr(AST::FieldAccessExpr* expr) override;
+        void visitAsyncExpr(AST::AsyncExpr* expr) override;
+        void visitAwaitExpr(AST::AwaitExpr* expr) override;
+        void visitArrayLiteralExpr(AST::ArrayLiteralExpr* expr) override;
+        void visitStructLiteralExpr(AST::StructLiteral* expr) override;
+        void visitLiteralExpr(AST::LiteralExpr* expr) override;
+        void visitSuperExpr(AST::SuperExpr* expr) override;
+        void visitFuncLiteral(AST::FuncLiteral* expr) override;
+        void visitModuleAccessExpr(AST::ModuleAccessExpr* expr) override;
+        void visitMacroExpr(AST::MacroExpr* expr) override;
+
+        void visitVarDecl(AST::VarDecl* decl) override;
+        void visitFuncDecl(AST::FuncDecl* decl) override;
+        void visitClassDecl(AST::ClassDecl* decl) override;
+
+        void visitExprStmt(AST::ExprStmt* stmt) override;
+        void visitBlockStmt(AST::BlockStmt* stmt) override;
+        void visitIfStmt(AST::IfStmt* stmt) override;
+        void visitWhileStmt(AST::WhileStmt* stmt) override;
+        void visitForStmt(AST::ForStmt* stmt) override;
+        void visitBreakStmt(AST::BreakStmt* stmt) override;
+        void visitContinueStmt(AST::ContinueStmt* stmt) override;
+        void visitSwitchStmt(AST::SwitchStmt* stmt) override;
+        void visitCaseStmt(AST::CaseStmt* _case) override;
+        void visitAdvanceStmt(AST::AdvanceStmt* stmt) override;
+        void visitReturnStmt(AST::ReturnStmt* stmt) override;
+        #pragma endregion
+    protected:
+        vector<Local> locals;
+        int scopeDepth;
+        // Number of functions the walk is in
+        int funcDepth;
+        // Module that's being walked, passes that create nodes allocate them in its arena
+        CSLModule* curUnit;
+
+        // Walks every top level statement of every unit
+        void run(vector<CSLModule*>& units);
+        // Every child is visited through this, passes that replace nodes swap node out here
+        virtual void visitNode(AST::ASTNodePtr& node);
+        // Body of a function declaration or literal, args are declared in the same scope as the body
+        virtual void visitFunc(vector<AST::ASTVar>& args, AST::BlockStmt* body);
+        virtual void declareLocal(AST::ASTVar& var);
+        // Index into locals of the innermost local called name, -1 if there isn't one
+        int resolveLocal(Token name);
+        void beginScope();
+        void endScope();
+    };
+}
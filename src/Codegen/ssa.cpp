@@ -0,0 +1,654 @@
+#include "ssa.h"
+#include "peephole.h"
+#include "../codegen/valueHelpersInline.cpp"
+#include "../Includes/fmt/format.h"
+#include <queue>
+
+using namespace ssa;
+using namespace valueHelpers;
+
+// Same order as OpCode
+static const char* opNames[] = {
+    "POP", "POPN", "LOAD_INT", "CONSTANT", "CONSTANT_LONG", "NIL", "TRUE", "FALSE", "NEGATE", "NEGATE_NUM", "NOT", "BIN_NOT",
+    "INCREMENT", "BITWISE_XOR", "BITWISE_OR", "BITWISE_AND", "ADD", "SUBTRACT", "MULTIPLY", "DIVIDE", "MOD", "BITSHIFT_LEFT",
+    "BITSHIFT_RIGHT", "ADD_NUM", "SUBTRACT_NUM", "MULTIPLY_NUM", "DIVIDE_NUM", "ADD_STR", "EQUAL", "NOT_EQUAL", "GREATER",
+    "GREATER_EQUAL", "LESS", "LESS_EQUAL", "IN", "GREATER_NUM", "GREATER_EQUAL_NUM", "LESS_NUM", "LESS_EQUAL_NUM", "IN_RANGE",
+    "GET_NATIVE", "GET_GLOBAL", "GET_GLOBAL_LONG", "SET_GLOBAL", "SET_GLOBAL_LONG", "GET_LOCAL", "SET_LOCAL", "CREATE_UPVALUE",
+    "GET_LOCAL_UPVALUE", "SET_LOCAL_UPVALUE", "GET_UPVALUE", "SET_UPVALUE", "JUMP", "JUMP_IF_FALSE", "JUMP_IF_TRUE",
+    "JUMP_IF_FALSE_POP", "JUMP_IF_TRUE_POP", "LOOP_IF_TRUE", "LOOP", "JUMP_POPN", "SWITCH", "SWITCH_LONG", "SWITCH_TABLE",
+    "CALL", "RETURN", "CLOSURE", "CLOSURE_LONG", "LAUNCH_ASYNC", "AWAIT", "CREATE_ARRAY", "GET", "SET", "GET_RANGE",
+    "SET_RANGE", "GET_INDEX", "SET_INDEX", "GET_INDEX_UNCHECKED",
+    "SET_INDEX_UNCHECKED", "GET_PROPERTY", "GET_PROPERTY_LONG", "SET_PROPERTY", "SET_PROPERTY_LONG",
+    "GET_PROPERTY_EFFICIENT", "SET_PROPERTY_EFFICIENT", "INVOKE", "INVOKE_LONG", "INVOKE_FROM_STACK", "CREATE_STRUCT",
+    "CREATE_STRUCT_LONG", "GET_SUPER", "GET_SUPER_LONG", "SUPER_INVOKE", "SUPER_INVOKE_LONG", "CALL_DIRECT",
+    "CALL_DIRECT_LONG", "INSTANCEOF"
+};
+static_assert(sizeof(opNames) / sizeof(opNames[0]) == +OpCode::INSTANCEOF + 1, "Every opcode needs a name");
+
+static IRType join(IRType a, IRType b) {
+    if (a == IRType::NONE) return b;
+    if (b == IRType::NONE) return a;
+    return a == b ? a : IRType::ANY;
+}
+
+string ssa::typeToStr(IRType type) {
+    switch (type) {
+        case IRType::NONE: return "none";
+        case IRType::NUMBER: return "number";
+        case IRType::STRING: return "string";
+        case IRType::BOOL: return "bool";
+        case IRType::NIL: return "null";
+        default: return "any";
+    }
+}
+
+IRFunction::IRFunction(Chunk& _chunk, uInt _arity) : chunk(_chunk), arity(_arity) {
+    valid = splitBlocks() && buildSSA();
+    if (valid) inferTypes();
+}
+
+void IRFunction::inferTypes() {
+    for (ValueDef& def : values) {
+        def.type = def.kind == ValueKind::PARAM ? IRType::ANY : IRType::NONE;
+    }
+    // Types only ever widen, so this terminates
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        auto update = [&](uInt value, IRType type) {
+            IRType res = join(values[value].type, type);
+            if (res == values[value].type) return;
+            values[value].type = res;
+            changed = true;
+        };
+        for (uInt b = 0; b < blocks.size(); b++) {
+            for (Phi& phi : blocks[b].phis) {
+                IRType type = IRType::NONE;
+                for (uInt in : phi.incoming) type = join(type, values[in].type);
+                update(phi.value, type);
+            }
+            for (uInt i = 0; i < blocks[b].instrs.size(); i++) {
+                Instr& inst = blocks[b].instrs[i];
+                IRType type = resultType(inst);
+                // Results that are only passed through(SET_LOCAL...) are defined by another instruction
+                auto isDefinedHere = [&](uInt value) {
+                    ValueDef& def = values[value];
+                    return def.kind == ValueKind::INSTR && def.block == b && def.index == i;
+                };
+                for (uInt res : inst.results) {
+                    if (isDefinedHere(res)) update(res, type);
+                }
+                if (inst.stored != -1 && isDefinedHere(inst.stored)) update(inst.stored, type);
+            }
+        }
+    }
+}
+
+void IRFunction::lower() {
+    // Operands don't change size, so the offset of every block is known up front
+    vector<uInt> blockOffsets(blocks.size());
+    uInt size = 0;
+    for (uInt b = 0; b < blocks.size(); b++) {
+        blockOffsets[b] = size;
+        for (Instr& inst : blocks[b].instrs) size += inst.bytes.size();
+    }
+
+    vector<uint8_t> bytecode;
+    vector<codeLine> lines;
+    bytecode.reserve(size);
+    for (BasicBlock& block : blocks) {
+        for (Instr& inst : block.instrs) {
+            vector<uInt> operands = peephole::jumpOperands(inst.bytes);
+            for (uInt k = 0; k < operands.size(); k++) {
+                uInt base = bytecode.size() + operands[k] + 2;
+                uInt target = blockOffsets[inst.targets[k]];
+                bool isBackward = peephole::isBackwardJump(inst.op());
+                // Blocks keep their order, so a jump can't change direction, if it somehow did the original code is kept
+                if (isBackward ? target > base : target < base) return;
+                uInt jump = isBackward ? base - target : target - base;
+                if (jump > UINT16_MAX) return;
+                inst.bytes[operands[k]] = (jump >> 8) & 0xff;
+                inst.bytes[operands[k] + 1] = jump & 0xff;
+            }
+            if (lines.empty() || lines.back().line != inst.line || lines.back().fileIndex != inst.fileIndex) {
+                if (!lines.empty()) lines.back().end = bytecode.size();
+                lines.emplace_back(inst.line, inst.fileIndex);
+            }
+            bytecode.insert(bytecode.end(), inst.bytes.begin(), inst.bytes.end());
+        }
+    }
+    if (lines.empty()) return;
+    lines.back().end = bytecode.size();
+
+    chunk.bytecode = std::move(bytecode);
+    chunk.lines = std::move(lines);
+}
+
+string IRFunction::toString(string name) {
+    auto valueStr = [&](uInt value) { return fmt::format("v{}", value); };
+    auto typedStr = [&](uInt value) { return fmt::format("v{}:{}", value, typeToStr(values[value].type)); };
+    string str = fmt::format("======={}=======\n", name);
+    for (uInt b = 0; b < blocks.size(); b++) {
+        BasicBlock& block = blocks[b];
+        str += fmt::format("block{}:", b);
+        if (!block.preds.empty()) {
+            str += " preds";
+            for (uInt pred : block.preds) str += fmt::format(" block{}", pred);
+        }
+        str += "\n";
+        for (Phi& phi : block.phis) {
+            str += fmt::format("    {} = phi", typedStr(phi.value));
+            for (uInt i = 0; i < phi.incoming.size(); i++) {
+                str += fmt::format("{} {}", i == 0 ? "" : ",", valueStr(phi.incoming[i]));
+            }
+            str += fmt::format(" (slot {})\n", phi.slot);
+        }
+        for (Instr& inst : block.instrs) {
+            str += "    ";
+            for (uInt i = 0; i < inst.results.size(); i++) {
+                str += (i == 0 ? "" : ", ") + typedStr(inst.results[i]);
+            }
+            if (!inst.results.empty()) str += " = ";
+            str += opNames[inst.op()];
+            // Immediate operands, jump offsets are replaced by the blocks they land on
+            vector<uInt> jumps = peephole::jumpOperands(inst.bytes);
+            uInt end = jumps.empty() ? inst.bytes.size() : jumps[0];
+            for (uInt i = 1; i < end; i++) str += fmt::format(" #{}", inst.bytes[i]);
+            for (uInt i = 0; i < inst.args.size(); i++) {
+                str += (i == 0 ? " " : ", ") + valueStr(inst.args[i]);
+            }
+            for (uInt target : inst.targets) str += fmt::format(" -> block{}", target);
+            if (inst.stored != -1) str += fmt::format(" (stores {})", typedStr(inst.stored));
+            str += "\n";
+        }
+    }
+    return str;
+}
+
+#pragma region Helpers
+// Decodes the chunk and splits it into basic blocks, every jump target and every instruction after a jump starts a new block
+bool IRFunction::splitBlocks() {
+    auto& bytecode = chunk.bytecode;
+    if (bytecode.empty() || chunk.lines.empty()) return false;
+    vector<Instr> code;
+    vector<uInt> offsets;
+    vector<int64_t> indexOf(bytecode.size() + 1, -1);
+    uInt lineIndex = 0;
+    for (uInt offset = 0; offset < bytecode.size();) {
+        uInt length = peephole::instructionLength(chunk, offset);
+        if (length == 0 || offset + length > bytecode.size()) return false;
+        Instr inst;
+        inst.bytes.assign(bytecode.begin() + offset, bytecode.begin() + offset + length);
+        while (lineIndex < chunk.lines.size() - 1 && offset >= chunk.lines[lineIndex].end) lineIndex++;
+        inst.line = chunk.lines[lineIndex].line;
+        inst.fileIndex = chunk.lines[lineIndex].fileIndex;
+        indexOf[offset] = code.size();
+        offsets.push_back(offset);
+        code.push_back(inst);
+        offset += length;
+    }
+
+    vector<bool> isLeader(code.size(), false);
+    isLeader[0] = true;
+    for (uInt i = 0; i < code.size(); i++) {
+        Instr& inst = code[i];
+        bool isBackward = peephole::isBackwardJump(inst.op());
+        for (uInt pos : peephole::jumpOperands(inst.bytes)) {
+            uInt jump = (inst.bytes[pos] << 8) | inst.bytes[pos + 1];
+            int64_t target = offsets[i] + pos + 2 + (isBackward ? -static_cast<int64_t>(jump) : jump);
+            // Jumping to the end of the chunk would run off the end of the function
+            if (target < 0 || target >= static_cast<int64_t>(bytecode.size()) || indexOf[target] == -1) return false;
+            inst.targets.push_back(indexOf[target]);
+            isLeader[indexOf[target]] = true;
+        }
+        bool endsBlock = !inst.targets.empty() || peephole::isTerminator(inst.op());
+        if (endsBlock && i + 1 < code.size()) isLeader[i + 1] = true;
+    }
+    // Falling off the end of the chunk isn't allowed either
+    Instr& last = code.back();
+    if (!peephole::isTerminator(last.op())) return false;
+
+    // Instruction targets become block targets
+    vector<uInt> blockOf(code.size());
+    vector<BasicBlock> allBlocks;
+    for (uInt i = 0; i < code.size(); i++) {
+        if (isLeader[i]) allBlocks.emplace_back();
+        blockOf[i] = allBlocks.size() - 1;
+        allBlocks.back().instrs.push_back(std::move(code[i]));
+    }
+    for (uInt b = 0; b < allBlocks.size(); b++) {
+        Instr& inst = allBlocks[b].instrs.back();
+        for (uInt& target : inst.targets) target = blockOf[target];
+        allBlocks[b].succs = inst.targets;
+        if (!peephole::isTerminator(inst.op())) allBlocks[b].succs.push_back(b + 1);
+    }
+    blocks = std::move(allBlocks);
+    removeUnreachable();
+
+    for (uInt b = 0; b < blocks.size(); b++) {
+        for (uInt succ : blocks[b].succs) blocks[succ].preds.push_back(b);
+    }
+    // The entry block can't have phis for the function params, so loops back to the first instruction get a new entry block
+    if (!blocks[0].preds.empty()) {
+        for (BasicBlock& block : blocks) {
+            for (uInt& target : block.instrs.back().targets) target++;
+            for (uInt& succ : block.succs) succ++;
+            for (uInt& pred : block.preds) pred++;
+        }
+        blocks.insert(blocks.begin(), BasicBlock());
+        blocks[0].succs.push_back(1);
+        blocks[1].preds.push_back(0);
+    }
+    return true;
+}
+
+// Code after a return or an unconditional jump that nothing jumps to, blocks keep their relative order
+void IRFunction::removeUnreachable() {
+    vector<bool> isReachable(blocks.size(), false);
+    std::queue<uInt> queue;
+    isReachable[0] = true;
+    queue.push(0);
+    while (!queue.empty()) {
+        uInt b = queue.front();
+        queue.pop();
+        for (uInt succ : blocks[b].succs) {
+            if (isReachable[succ]) continue;
+            isReachable[succ] = true;
+            queue.push(succ);
+        }
+    }
+    vector<uInt> newIndex(blocks.size());
+    vector<BasicBlock> reachable;
+    for (uInt b = 0; b < blocks.size(); b++) {
+        newIndex[b] = reachable.size();
+        if (isReachable[b]) reachable.push_back(std::move(blocks[b]));
+    }
+    for (BasicBlock& block : reachable) {
+        for (uInt& target : block.instrs.back().targets) target = newIndex[target];
+        for (uInt& succ : block.succs) succ = newIndex[succ];
+    }
+    blocks = std::move(reachable);
+}
+
+bool IRFunction::buildSSA() {
+    // Slot 0 is the function(or 'this' for methods), followed by the args
+    for (uInt i = 0; i <= arity; i++) {
+        blocks[0].entryStack.push_back(newValue(ValueKind::PARAM, 0, i));
+    }
+    for (uInt b = 0; b < blocks.size(); b++) {
+        BasicBlock& block = blocks[b];
+        if (b != 0) {
+            // Blocks are visited in bytecode order, so only loop headers have predecessors that weren't visited yet
+            int64_t first = -1;
+            bool hasBackEdge = false;
+            for (uInt pred : block.preds) {
+                if (pred >= b) hasBackEdge = true;
+                else if (first == -1) first = pred;
+            }
+            if (first == -1) return false;
+            uInt height = blocks[first].exitStack.size();
+            for (uInt slot = 0; slot < height; slot++) {
+                uInt value = blocks[first].exitStack[slot];
+                bool isSame = !hasBackEdge;
+                for (uInt pred : block.preds) {
+                    if (pred >= b) continue;
+                    if (blocks[pred].exitStack.size() != height) return false;
+                    if (blocks[pred].exitStack[slot] != value) isSame = false;
+                }
+                if (isSame) {
+                    block.entryStack.push_back(value);
+                    continue;
+                }
+                // Incoming values are filled in once every block has been visited
+                Phi phi;
+                phi.value = newValue(ValueKind::PHI, b, block.phis.size());
+                phi.slot = slot;
+                block.phis.push_back(phi);
+                block.entryStack.push_back(phi.value);
+            }
+        }
+        if (!runBlock(b)) return false;
+    }
+    for (BasicBlock& block : blocks) {
+        for (Phi& phi : block.phis) {
+            for (uInt pred : block.preds) {
+                if (blocks[pred].exitStack.size() != block.entryStack.size()) return false;
+                phi.incoming.push_back(blocks[pred].exitStack[phi.slot]);
+            }
+        }
+    }
+    removeTrivialPhis();
+    return true;
+}
+
+// Runs the block with a symbolic stack
+bool IRFunction::runBlock(uInt b) {
+    BasicBlock& block = blocks[b];
+    vector<uInt> stack = block.entryStack;
+    for (uInt i = 0; i < block.instrs.size(); i++) {
+        Instr& inst = block.instrs[i];
+        auto pop = [&](uInt count) {
+            if (stack.size() < count) return false;
+            inst.args.assign(stack.end() - count, stack.end());
+            stack.resize(stack.size() - count);
+            return true;
+        };
+        auto push = [&]() {
+            uInt value = newValue(ValueKind::INSTR, b, i);
+            inst.results.push_back(value);
+            stack.push_back(value);
+        };
+        // Instructions that leave the value they read on the stack
+        auto passThrough = [&](uInt count) {
+            if (!pop(count)) return false;
+            inst.results.push_back(inst.args[0]);
+            stack.push_back(inst.args[0]);
+            return true;
+        };
+        auto validSlot = [&](uInt slot) { return slot < stack.size(); };
+        bool ok = true;
+
+        switch (inst.op()) {
+            case +OpCode::POP:
+            case +OpCode::JUMP_IF_FALSE_POP:
+            case +OpCode::JUMP_IF_TRUE_POP:
+            case +OpCode::LOOP_IF_TRUE:
+            case +OpCode::SWITCH:
+            case +OpCode::SWITCH_LONG:
+            case +OpCode::SWITCH_TABLE:
+            case +OpCode::RETURN:
+                ok = pop(1);
+                break;
+            case +OpCode::POPN:
+            case +OpCode::JUMP_POPN:
+                ok = pop(inst.bytes[1]);
+                break;
+            case +OpCode::JUMP:
+            case +OpCode::LOOP:
+                break;
+            case +OpCode::JUMP_IF_FALSE:
+            case +OpCode::JUMP_IF_TRUE:
+                ok = passThrough(1);
+                break;
+            case +OpCode::LOAD_INT:
+            case +OpCode::CONSTANT:
+            case +OpCode::CONSTANT_LONG:
+            case +OpCode::NIL:
+            case +OpCode::TRUE:
+            case +OpCode::FALSE:
+            case +OpCode::GET_NATIVE:
+            case +OpCode::GET_GLOBAL:
+            case +OpCode::GET_GLOBAL_LONG:
+            case +OpCode::GET_UPVALUE:
+            case +OpCode::GET_LOCAL_UPVALUE:
+            case +OpCode::GET_PROPERTY_EFFICIENT:
+            case +OpCode::CLOSURE:
+            case +OpCode::CLOSURE_LONG:
+                push();
+                break;
+            case +OpCode::NEGATE:
+            case +OpCode::NEGATE_NUM:
+            case +OpCode::NOT:
+            case +OpCode::BIN_NOT:
+            case +OpCode::GET_PROPERTY:
+            case +OpCode::GET_PROPERTY_LONG:
+            case +OpCode::INSTANCEOF:
+            case +OpCode::AWAIT:
+                ok = pop(1);
+                push();
+                break;
+            case +OpCode::BITWISE_XOR:
+            case +OpCode::BITWISE_OR:
+            case +OpCode::BITWISE_AND:
+            case +OpCode::ADD:
+            case +OpCode::SUBTRACT:
+            case +OpCode::MULTIPLY:
+            case +OpCode::DIVIDE:
+            case +OpCode::MOD:
+            case +OpCode::BITSHIFT_LEFT:
+            case +OpCode::BITSHIFT_RIGHT:
+            case +OpCode::ADD_NUM:
+            case +OpCode::SUBTRACT_NUM:
+            case +OpCode::MULTIPLY_NUM:
+            case +OpCode::DIVIDE_NUM:
+            case +OpCode::ADD_STR:
+            case +OpCode::EQUAL:
+            case +OpCode::NOT_EQUAL:
+            case +OpCode::GREATER:
+            case +OpCode::GREATER_EQUAL:
+            case +OpCode::LESS:
+            case +OpCode::LESS_EQUAL:
+            case +OpCode::IN:
+            case +OpCode::GREATER_NUM:
+            case +OpCode::GREATER_EQUAL_NUM:
+            case +OpCode::LESS_NUM:
+            case +OpCode::LESS_EQUAL_NUM:
+            case +OpCode::GET:
+            case +OpCode::GET_INDEX:
+            case +OpCode::GET_INDEX_UNCHECKED:
+            case +OpCode::GET_SUPER:
+            case +OpCode::GET_SUPER_LONG:
+                ok = pop(2);
+                push();
+                break;
+            case +OpCode::IN_RANGE:
+            case +OpCode::GET_RANGE:
+                ok = pop(3);
+                push();
+                break;
+            case +OpCode::SET_GLOBAL:
+            case +OpCode::SET_GLOBAL_LONG:
+            case +OpCode::SET_UPVALUE:
+            case +OpCode::SET_LOCAL_UPVALUE:
+            case +OpCode::SET_PROPERTY_EFFICIENT:
+                ok = passThrough(1);
+                break;
+            case +OpCode::SET_PROPERTY:
+            case +OpCode::SET_PROPERTY_LONG:
+                ok = passThrough(2);
+                break;
+            case +OpCode::SET:
+            case +OpCode::SET_INDEX:
+            case +OpCode::SET_INDEX_UNCHECKED:
+                ok = passThrough(3);
+                break;
+            case +OpCode::SET_RANGE:
+                ok = passThrough(4);
+                break;
+            case +OpCode::GET_LOCAL: {
+                uInt slot = inst.bytes[1];
+                if (!validSlot(slot)) return false;
+                inst.results.push_back(stack[slot]);
+                stack.push_back(stack[slot]);
+                break;
+            }
+            case +OpCode::SET_LOCAL: {
+                uInt slot = inst.bytes[1];
+                if (!validSlot(slot) || !passThrough(1)) return false;
+                inst.stored = stack.back();
+                stack[slot] = stack.back();
+                break;
+            }
+            case +OpCode::CREATE_UPVALUE: {
+                // The slot now holds the upvalue box
+                uInt slot = inst.bytes[1];
+                if (!validSlot(slot)) return false;
+                inst.stored = newValue(ValueKind::INSTR, b, i);
+                stack[slot] = inst.stored;
+                break;
+            }
+            case +OpCode::INCREMENT: {
+                byte type = inst.bytes[1] >> 2;
+                if (type == 0) {
+                    uInt slot = inst.bytes[2];
+                    if (!validSlot(slot)) return false;
+                    inst.stored = newValue(ValueKind::INSTR, b, i);
+                    stack[slot] = inst.stored;
+                }
+                // Field increments pop the instance, and the field name for obj[field]++
+                else if (type == 5 || type == 6) ok = pop(1);
+                else if (type == 7) ok = pop(2);
+                push();
+                break;
+            }
+            case +OpCode::CALL:
+            case +OpCode::LAUNCH_ASYNC:
+            case +OpCode::INVOKE:
+            case +OpCode::INVOKE_LONG:
+            case +OpCode::CALL_DIRECT:
+            case +OpCode::CALL_DIRECT_LONG:
+                // Callee(or receiver) and the args
+                ok = pop(inst.bytes[1] + 1);
+                push();
+                break;
+            case +OpCode::SUPER_INVOKE:
+            case +OpCode::SUPER_INVOKE_LONG:
+                // Superclass is on top of the args
+                ok = pop(inst.bytes[1] + 2);
+                push();
+                break;
+            case +OpCode::CREATE_ARRAY:
+            case +OpCode::CREATE_STRUCT:
+            case +OpCode::CREATE_STRUCT_LONG:
+                ok = pop(inst.bytes[1]);
+                push();
+                break;
+            default:
+                return false;
+        }
+        if (!ok) return false;
+    }
+    block.exitStack = std::move(stack);
+    return true;
+}
+
+// A phi whose incoming values are all the same value(or the phi itself) is replaced by that value
+void IRFunction::removeTrivialPhis() {
+    forwarded.resize(values.size());
+    for (uInt i = 0; i < values.size(); i++) forwarded[i] = i;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (BasicBlock& block : blocks) {
+            for (Phi& phi : block.phis) {
+                if (resolve(phi.value) != phi.value) continue;
+                int64_t same = -1;
+                bool isTrivial = true;
+                for (uInt in : phi.incoming) {
+                    uInt value = resolve(in);
+                    if (value == phi.value || value == same) continue;
+                    if (same != -1) {
+                        isTrivial = false;
+                        break;
+                    }
+                    same = value;
+                }
+                if (!isTrivial || same == -1) continue;
+                forwarded[phi.value] = same;
+                changed = true;
+            }
+        }
+    }
+
+    for (uInt b = 0; b < blocks.size(); b++) {
+        BasicBlock& block = blocks[b];
+        vector<Phi> phis;
+        for (Phi& phi : block.phis) {
+            if (resolve(phi.value) != phi.value) continue;
+            for (uInt& in : phi.incoming) in = resolve(in);
+            values[phi.value].index = phis.size();
+            phis.push_back(phi);
+        }
+        block.phis = std::move(phis);
+        for (Instr& inst : block.instrs) {
+            for (uInt& arg : inst.args) arg = resolve(arg);
+            for (uInt& res : inst.results) res = resolve(res);
+            if (inst.stored != -1) inst.stored = resolve(inst.stored);
+        }
+        for (uInt& value : block.entryStack) value = resolve(value);
+        for (uInt& value : block.exitStack) value = resolve(value);
+    }
+}
+
+uInt IRFunction::resolve(uInt value) {
+    while (forwarded[value] != value) value = forwarded[value];
+    return value;
+}
+
+uInt IRFunction::newValue(ValueKind kind, uInt block, uInt index) {
+    ValueDef def;
+    def.kind = kind;
+    def.block = block;
+    def.index = index;
+    values.push_back(def);
+    return values.size() - 1;
+}
+
+// Type of the values an instruction creates, an instruction that would produce anything else throws a runtime error
+IRType IRFunction::resultType(Instr& inst) {
+    auto argType = [&](uInt i) { return values[inst.args[i]].type; };
+    switch (inst.op()) {
+        case +OpCode::LOAD_INT:
+            return IRType::NUMBER;
+        case +OpCode::CONSTANT:
+        case +OpCode::CONSTANT_LONG: {
+            uInt index = inst.op() == +OpCode::CONSTANT ? inst.bytes[1] : (inst.bytes[1] << 8) | inst.bytes[2];
+            Value val = chunk.constants[index];
+            if (isNumber(val)) return IRType::NUMBER;
+            if (isBool(val)) return IRType::BOOL;
+            if (isNil(val)) return IRType::NIL;
+            if (isString(val)) return IRType::STRING;
+            return IRType::ANY;
+        }
+        case +OpCode::NIL:
+            return IRType::NIL;
+        case +OpCode::TRUE:
+        case +OpCode::FALSE:
+        case +OpCode::NOT:
+        case +OpCode::EQUAL:
+        case +OpCode::NOT_EQUAL:
+        case +OpCode::GREATER:
+        case +OpCode::GREATER_EQUAL:
+        case +OpCode::LESS:
+        case +OpCode::LESS_EQUAL:
+        case +OpCode::IN:
+        case +OpCode::GREATER_NUM:
+        case +OpCode::GREATER_EQUAL_NUM:
+        case +OpCode::LESS_NUM:
+        case +OpCode::LESS_EQUAL_NUM:
+        case +OpCode::IN_RANGE:
+        case +OpCode::INSTANCEOF:
+            return IRType::BOOL;
+        case +OpCode::NEGATE:
+        case +OpCode::NEGATE_NUM:
+        case +OpCode::BIN_NOT:
+        case +OpCode::INCREMENT:
+        case +OpCode::BITWISE_XOR:
+        case +OpCode::BITWISE_OR:
+        case +OpCode::BITWISE_AND:
+        case +OpCode::SUBTRACT:
+        case +OpCode::MULTIPLY:
+        case +OpCode::DIVIDE:
+        case +OpCode::MOD:
+        case +OpCode::BITSHIFT_LEFT:
+        case +OpCode::BITSHIFT_RIGHT:
+        case +OpCode::ADD_NUM:
+        case +OpCode::SUBTRACT_NUM:
+        case +OpCode::MULTIPLY_NUM:
+        case +OpCode::DIVIDE_NUM:
+            return IRType::NUMBER;
+        case +OpCode::ADD_STR:
+            return IRType::STRING;
+        case +OpCode::ADD: {
+            // Only number + number and string + string are allowed
+            IRType a = argType(0), b = argType(1);
+            if (a == IRType::NONE || b == IRType::NONE) return IRType::NONE;
+            if (a == IRType::NUMBER || b == IRType::NUMBER) return IRType::NUMBER;
+            if (a == IRType::STRING || b == IRType::STRING) return IRType::STRING;
+            return IRType::ANY;
+        }
+        default:
+            return IRType::ANY;
+    }
+}
+#pragma endregion
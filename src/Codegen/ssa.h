@@ -0,0 +1,111 @@
+#pragma once
+#include "codegenDefs.h"
+// Typed SSA form of a function, meant as a common base for optimizations that need dataflow information
+//
+// The IR is built from the bytecode of a finished function chunk, so scopes, locals and upvalues are already resolved by
+// the compiler: every local is a slot in the function's stack frame(slot 0 holds the function or 'this', followed by the args)
+// The bytecode is split into basic blocks, and every block is run with a symbolic stack of SSA values
+// GET_LOCAL doesn't create a new value, it pushes the value the slot currently holds, SET_LOCAL replaces what the slot holds
+// Where control flow merges, every slot that can hold different values gets a phi
+//
+// Instructions keep their opcode and operands, and record the values they pop and push, so lowering back to bytecode
+// only has to lay the blocks out again and recalculate jump offsets
+// Passes can rewrite an instruction to one with the same stack effect(eg. ADD -> ADD_NUM), see ssaPasses.h
+//
+// Functions using an opcode the builder doesn't understand, or jumping to the end of the chunk, are left as they are
+
+namespace ssa {
+    // Type lattice, NONE means nothing has been inferred yet and ANY means the type isn't known at compile time
+    enum class IRType {
+        NONE,
+        NUMBER,
+        STRING,
+        BOOL,
+        NIL,
+        ANY
+    };
+
+    enum class ValueKind {
+        // Contents of a stack slot when the function is called
+        PARAM,
+        INSTR,
+        PHI
+    };
+
+    struct ValueDef {
+        ValueKind kind;
+        IRType type = IRType::NONE;
+        // Block and index of the defining instruction or phi, or the slot for params
+        uInt block = 0;
+        uInt index = 0;
+    };
+
+    struct Phi {
+        uInt value = 0;
+        // Stack slot the phi merges
+        uInt slot = 0;
+        // Incoming value for each predecessor, in the same order as BasicBlock::preds
+        vector<uInt> incoming;
+    };
+
+    struct Instr {
+        // Opcode and operands, jump offsets are recalculated when lowering
+        vector<uint8_t> bytes;
+        // Blocks each jump operand(in order of appearance) lands on
+        vector<uInt> targets;
+        // Values popped from the stack, in the order they were pushed
+        vector<uInt> args;
+        // Values pushed to the stack, instructions that only peek(SET_LOCAL, JUMP_IF_FALSE...) pop and push the same value
+        vector<uInt> results;
+        // Value written to a local slot(SET_LOCAL, CREATE_UPVALUE, INCREMENT of a local), -1 if nothing is written
+        int64_t stored = -1;
+        uInt line = 0;
+        byte fileIndex = 0;
+
+        byte op() const { return bytes[0]; }
+    };
+
+    struct BasicBlock {
+        vector<Phi> phis;
+        vector<Instr> instrs;
+        vector<uInt> preds;
+        vector<uInt> succs;
+        // Symbolic stack at the start and the end of the block
+        vector<uInt> entryStack;
+        vector<uInt> exitStack;
+    };
+
+    class IRFunction {
+    public:
+        // Blocks are kept in the same order as the bytecode they came from
+        vector<BasicBlock> blocks;
+        vector<ValueDef> values;
+        // Constants are read from the chunk, lowering writes the bytecode and lines back into it
+        Chunk& chunk;
+
+        IRFunction(Chunk& chunk, uInt arity);
+        bool isValid() { return valid; }
+        // Recomputes the type of every value, phis are joined until nothing changes
+        void inferTypes();
+        void lower();
+        string toString(string name);
+    private:
+        bool valid;
+        uInt arity;
+        // Values that were found to be the same as another value(trivial phis)
+        vector<uInt> forwarded;
+
+        #pragma region Helpers
+        bool splitBlocks();
+        void removeUnreachable();
+        bool buildSSA();
+        bool runBlock(uInt index);
+        void removeTrivialPhis();
+        uInt resolve(uInt value);
+        uInt newValue(ValueKind kind, uInt block, uInt index);
+        IRType resultType(Instr& inst);
+        #pragma endregion
+    };
+
+    string typeToStr(IRType type);
+}
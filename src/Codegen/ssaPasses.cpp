@@ -0,0 +1,144 @@
+#include "ssaPasses.h"
+#include "peephole.h"
+#include <array>
+#include <bitset>
+
+using namespace ssa;
+
+PassManager::PassManager(bool _dumpIR) : dumpIR(_dumpIR) {
+    addPass(std::make_unique<TypeSpecialization>());
+}
+
+void PassManager::addPass(std::unique_ptr<Pass> pass) {
+    passes.push_back(std::move(pass));
+}
+
+bool PassManager::needsIR(Chunk& chunk, uInt arity) {
+    if (dumpIR) return true;
+    for (auto& pass : passes) {
+        if (pass->mayChange(chunk, arity)) return true;
+    }
+    return false;
+}
+
+bool PassManager::run(IRFunction& func, string funcName) {
+    bool changed = false;
+    for (auto& pass : passes) {
+        if (dumpIR) std::cout << func.toString(funcName + " before " + pass->name());
+        if (pass->run(func)) {
+            func.inferTypes();
+            changed = true;
+        }
+        if (dumpIR) std::cout << func.toString(funcName + " after " + pass->name());
+    }
+    return changed;
+}
+
+// Unchecked version of a binary op if both operands have the given type, or the op itself if there isn't one
+static byte specialize(byte op, IRType a, IRType b) {
+    if (a == IRType::STRING && b == IRType::STRING) return op == +OpCode::ADD ? +OpCode::ADD_STR : op;
+    if (a != IRType::NUMBER || b != IRType::NUMBER) return op;
+    switch (op) {
+        case +OpCode::ADD: return +OpCode::ADD_NUM;
+        case +OpCode::SUBTRACT: return +OpCode::SUBTRACT_NUM;
+        case +OpCode::MULTIPLY: return +OpCode::MULTIPLY_NUM;
+        case +OpCode::DIVIDE: return +OpCode::DIVIDE_NUM;
+        case +OpCode::GREATER: return +OpCode::GREATER_NUM;
+        case +OpCode::GREATER_EQUAL: return +OpCode::GREATER_EQUAL_NUM;
+        case +OpCode::LESS: return +OpCode::LESS_NUM;
+        case +OpCode::LESS_EQUAL: return +OpCode::LESS_EQUAL_NUM;
+        default: return op;
+    }
+}
+
+static bool isSpecializable(byte op) {
+    switch (op) {
+        case +OpCode::NEGATE:
+        case +OpCode::ADD:
+        case +OpCode::SUBTRACT:
+        case +OpCode::MULTIPLY:
+        case +OpCode::DIVIDE:
+        case +OpCode::GREATER:
+        case +OpCode::GREATER_EQUAL:
+        case +OpCode::LESS:
+        case +OpCode::LESS_EQUAL:
+            return true;
+        default: return false;
+    }
+}
+
+// Instructions that push a single value without popping anything, and whose value is always typed as ANY
+static bool pushesAny(byte op) {
+    switch (op) {
+        case +OpCode::GET_NATIVE:
+        case +OpCode::GET_GLOBAL:
+        case +OpCode::GET_GLOBAL_LONG:
+        case +OpCode::GET_UPVALUE:
+        case +OpCode::GET_LOCAL_UPVALUE:
+        case +OpCode::GET_PROPERTY_EFFICIENT:
+        case +OpCode::CLOSURE:
+        case +OpCode::CLOSURE_LONG:
+            return true;
+        default: return false;
+    }
+}
+
+// The IR types every value produced by a call, a field access or an argument that's never written to as ANY, and ANY
+// stays ANY through phis, so if the instruction that falls through into an op pushed one of those, the op can't be
+// specialized on any path
+// Only looks at the instruction right before the op, and the one before that if that one only pushed a value
+bool TypeSpecialization::mayChange(Chunk& chunk, uInt arity) {
+    auto& code = chunk.bytecode;
+    // Ops that could be specialized, along with the offsets of the instructions before them(-1 if there isn't one)
+    vector<std::array<int64_t, 3>> candidates;
+    std::bitset<LOCAL_MAX> written;
+    int64_t prev = -1, prevPrev = -1;
+    for (uInt offset = 0; offset < code.size();) {
+        uInt length = peephole::instructionLength(chunk, offset);
+        if (length == 0) return true;
+        byte op = code[offset];
+        if (op == +OpCode::SET_LOCAL || op == +OpCode::CREATE_UPVALUE) written[code[offset + 1]] = true;
+        else if (op == +OpCode::INCREMENT && (code[offset + 1] >> 2) == 0) written[code[offset + 2]] = true;
+        else if (isSpecializable(op)) candidates.push_back({offset, prev, prevPrev});
+        prevPrev = prev;
+        prev = offset;
+        offset += length;
+    }
+    auto isAny = [&](int64_t offset) {
+        if (offset == -1) return false;
+        byte op = code[offset];
+        if (op == +OpCode::GET_LOCAL) return code[offset + 1] <= arity && !written[code[offset + 1]];
+        return pushesAny(op);
+    };
+    auto isPush = [&](int64_t offset) {
+        byte op = code[offset];
+        return op == +OpCode::GET_LOCAL || op == +OpCode::LOAD_INT || op == +OpCode::CONSTANT
+               || op == +OpCode::CONSTANT_LONG || op == +OpCode::NIL || op == +OpCode::TRUE || op == +OpCode::FALSE
+               || pushesAny(op);
+    };
+    for (auto [offset, right, left] : candidates) {
+        if (isAny(right)) continue;
+        // Left operand of a binary op is only known if the right one was a single push
+        if (code[offset] != +OpCode::NEGATE && right != -1 && isPush(right) && isAny(left)) continue;
+        return true;
+    }
+    return false;
+}
+
+bool TypeSpecialization::run(IRFunction& func) {
+    bool changed = false;
+    for (BasicBlock& block : func.blocks) {
+        for (Instr& inst : block.instrs) {
+            byte op = inst.op();
+            byte newOp = op;
+            if (op == +OpCode::NEGATE && func.values[inst.args[0]].type == IRType::NUMBER) newOp = +OpCode::NEGATE_NUM;
+            else if (inst.args.size() == 2 && inst.bytes.size() == 1) {
+                newOp = specialize(op, func.values[inst.args[0]].type, func.values[inst.args[1]].type);
+            }
+            if (newOp == op) continue;
+            inst.bytes[0] = newOp;
+            changed = true;
+        }
+    }
+    return changed;
+}
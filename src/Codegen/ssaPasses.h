@@ -0,0 +1,45 @@
+#pragma once
+#include "ssa.h"
+#include <memory>
+// Passes over the SSA IR and the pass manager that runs them
+//
+// Every pass gets a valid IRFunction and has to leave it valid, values are typed again after each pass that changed something
+// Building the IR costs more than most passes, so every pass first gets a look at the bytecode and the IR is only built
+// for chunks at least one pass might change
+// The -dump-ir flag prints the IR of every function before and after every pass
+
+namespace ssa {
+    class Pass {
+    public:
+        virtual ~Pass() = default;
+        virtual string name() = 0;
+        // Cheap check on the bytecode of a chunk, returns false only if the pass can't change its IR
+        virtual bool mayChange(Chunk&, uInt) { return true; }
+        // Returns true if the function was changed
+        virtual bool run(IRFunction& func) = 0;
+    };
+
+    class PassManager {
+    public:
+        // Sets up the default pipeline
+        PassManager(bool dumpIR = false);
+        void addPass(std::unique_ptr<Pass> pass);
+        // Whether the IR of chunk is worth building, always true when dumping the IR
+        bool needsIR(Chunk& chunk, uInt arity);
+        // Returns true if any pass changed the function
+        bool run(IRFunction& func, string funcName);
+    private:
+        vector<std::unique_ptr<Pass>> passes;
+        bool dumpIR;
+    };
+
+    // Generic arithmetic and comparisons whose operands are proven to be numbers(or strings for ADD) become the
+    // unchecked opcodes, since values are tracked through locals and phis this catches cases typeInference can't(eg. a
+    // local that's only ever assigned numbers after being declared as null)
+    class TypeSpecialization : public Pass {
+    public:
+        string name() override { return "TypeSpecialization"; }
+        bool mayChange(Chunk& chunk, uInt arity) override;
+        bool run(IRFunction& func) override;
+    };
+}
@@ -0,0 +1,195 @@
+#include "typeInference.h"
+
+using namespace typeInference;
+using AST::InferredType;
+
+// Union of two types, NONE is the identity since nothing has been inferred for it yet
+static InferredType join(InferredType a, InferredType b) {
+    if (a == InferredType::NONE) return b;
+    if (b == InferredType::NONE) return a;
+    return a == b ? a : InferredType::UNKNOWN;
+}
+
+TypeInference::TypeInference(vector<CSLModule*>& units) {
+    walk = 0;
+    exprType = InferredType::UNKNOWN;
+    for (CSLModule* unit : units) {
+        for (auto& stmt : unit->stmts) {
+            inferTopLevel(stmt);
+        }
+    }
+}
+
+void TypeInference::visitAssignmentExpr(AST::AssignmentExpr* expr) {
+    InferredType type = infer(expr->value);
+    assignLocal(expr->name, type);
+    exprType = type;
+}
+
+void TypeInference::visitSetExpr(AST::SetExpr* expr) {
+    InferredType type = infer(expr->value);
+    infer(expr->callee);
+    if (expr->accessor.type == TokenType::LEFT_BRACKET) infer(expr->field);
+    exprType = type;
+}
+
+void TypeInference::visitConditionalExpr(AST::ConditionalExpr* expr) {
+    infer(expr->condition);
+    InferredType mhs = infer(expr->mhs);
+    if (expr->rhs) exprType = join(mhs, infer(expr->rhs));
+}
+
+void TypeInference::visitBinaryExpr(AST::BinaryExpr* expr) {
+    InferredType left = infer(expr->left);
+    // Right side of instanceof is a class name
+    InferredType right = expr->op.type == TokenType::INSTANCEOF ? InferredType::UNKNOWN : infer(expr->right);
+    bool isNumeric = left == InferredType::NUMBER && right == InferredType::NUMBER;
+
+    expr->operandType = InferredType::UNKNOWN;
+    switch (expr->op.type) {
+        case TokenType::AND:
+        case TokenType::OR:
+            exprType = join(left, right);
+            return;
+        case TokenType::PLUS:
+            if (isNumeric) expr->operandType = InferredType::NUMBER;
+            else if (left == InferredType::STRING && right == InferredType::STRING) expr->operandType = InferredType::STRING;
+            // Anything other than number + number or string + string is a runtime error, so the result can only be one of those
+            if (left == InferredType::NONE || right == InferredType::NONE) exprType = InferredType::NONE;
+            else if (left == InferredType::NUMBER || right == InferredType::NUMBER) exprType = InferredType::NUMBER;
+            else if (left == InferredType::STRING || right == InferredType::STRING) exprType = InferredType::STRING;
+            else exprType = InferredType::UNKNOWN;
+            return;
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+            if (isNumeric) expr->operandType = InferredType::NUMBER;
+            exprType = InferredType::NUMBER;
+            return;
+        // Integer ops still check that both numbers are whole
+        case TokenType::PERCENTAGE:
+        case TokenType::BITSHIFT_LEFT:
+        case TokenType::BITSHIFT_RIGHT:
+        case TokenType::BITWISE_AND:
+        case TokenType::BITWISE_OR:
+        case TokenType::BITWISE_XOR:
+            exprType = InferredType::NUMBER;
+            return;
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+            if (isNumeric) expr->operandType = InferredType::NUMBER;
+            exprType = InferredType::BOOL;
+            return;
+        default:
+            // ==, !=, in, instanceof
+            exprType = InferredType::BOOL;
+            return;
+    }
+}
+
+void TypeInference::visitUnaryExpr(AST::UnaryExpr* expr) {
+    expr->operandType = InferredType::UNKNOWN;
+    if (expr->op.type == TokenType::INCREMENT || expr->op.type == TokenType::DECREMENT) {
+        // Incrementing anything other than a number is a runtime error
+        if (expr->right->type == AST::ASTType::LITERAL) {
+            assignLocal(static_cast<AST::LiteralExpr*>(expr->right)->token, InferredType::NUMBER);
+        }
+        else infer(expr->right);
+        exprType = InferredType::NUMBER;
+        return;
+    }
+    InferredType right = infer(expr->right);
+    switch (expr->op.type) {
+        case TokenType::MINUS:
+            if (right == InferredType::NUMBER) expr->operandType = InferredType::NUMBER;
+            exprType = InferredType::NUMBER;
+            break;
+        case TokenType::TILDA: exprType = InferredType::NUMBER; break;
+        case TokenType::BANG: exprType = InferredType::BOOL; break;
+        default: exprType = InferredType::UNKNOWN; break;
+    }
+}
+
+void TypeInference::visitArrayLiteralExpr(AST::ArrayLiteralExpr* expr) {
+    ScopedWalker::visitArrayLiteralExpr(expr);
+    exprType = InferredType::ARRAY;
+}
+
+void TypeInference::visitLiteralExpr(AST::LiteralExpr* expr) {
+    switch (expr->token.type) {
+        case TokenType::NUMBER: exprType = InferredType::NUMBER; break;
+        case TokenType::STRING: exprType = InferredType::STRING; break;
+        case TokenType::TRUE:
+        case TokenType::FALSE: exprType = InferredType::BOOL; break;
+        case TokenType::NIL: exprType = InferredType::NIL; break;
+        case TokenType::IDENTIFIER: {
+            int index = resolveLocal(expr->token);
+            if (index == -1) break;
+            LocalType& local = localTypes[locals[index].var];
+            local.readInWalk = walk;
+            exprType = local.type;
+            break;
+        }
+        default: exprType = InferredType::UNKNOWN; break;
+    }
+}
+
+void TypeInference::visitVarDecl(AST::VarDecl* decl) {
+    // Globals are late bound and can be assigned from other modules
+    if (scopeDepth == 0) {
+        if (decl->value) infer(decl->value);
+        return;
+    }
+    InferredType type = decl->value ? infer(decl->value) : InferredType::NIL;
+    ScopedWalker::declareLocal(decl->var);
+    widen(&decl->var, type);
+}
+
+#pragma region Helpers
+// A local can be read before the assignment that widens its type(eg. in a loop), so keep going until that stops happening
+// Every local can widen at most twice(NONE -> type -> UNKNOWN), so this always terminates
+void TypeInference::inferTopLevel(AST::ASTNodePtr stmt) {
+    do {
+        changed = false;
+        walk++;
+        locals.clear();
+        scopeDepth = 0;
+        infer(stmt);
+    } while (changed);
+}
+
+// exprType is UNKNOWN whenever a node is visited, so statements and expressions that don't set it are UNKNOWN
+InferredType TypeInference::infer(AST::ASTNodePtr node) {
+    node->accept(this);
+    InferredType type = exprType;
+    exprType = InferredType::UNKNOWN;
+    return type;
+}
+
+void TypeInference::visitNode(AST::ASTNodePtr& node) {
+    infer(node);
+}
+
+// Arguments can be anything
+void TypeInference::declareLocal(AST::ASTVar& var) {
+    ScopedWalker::declareLocal(var);
+    widen(&var, InferredType::UNKNOWN);
+}
+
+void TypeInference::assignLocal(Token name, InferredType type) {
+    int index = resolveLocal(name);
+    if (index != -1) widen(locals[index].var, type);
+}
+
+// Every read so far in this walk saw the narrower type, those are only redone if there were any
+void TypeInference::widen(AST::ASTVar* var, InferredType type) {
+    LocalType& local = localTypes[var];
+    InferredType res = join(local.type, type);
+    if (res == local.type) return;
+    if (local.readInWalk == walk) changed = true;
+    local.type = res;
+}
+
+#pragma endregion
@@ -0,0 +1,59 @@
+#pragma once
+#include "../Parsing/ASTDefs.h"
+#include "../Includes/unorderedDense.h"
+#include "scopedWalker.h"
+// Infers the types of local variables and expressions, so the compiler can emit opcodes that skip runtime type checks
+//
+// The type of a local is the union of the types of every value that's ever assigned to it(initializer, assignments,
+// ++/-- and assignments from closures), anything that isn't a single known type is UNKNOWN
+// Parameters, globals, fields, call results and everything else that can't be seen at compile time are UNKNOWN
+//
+// Since a type only ever widens, each top level statement(locals never outlive one) is walked until no local that
+// was already read in that walk changes its type, at that point every BinaryExpr/UnaryExpr whose operands are proven
+// to be numbers(or strings for +) is marked
+// Widening a local nothing has read yet doesn't need another walk, so code without loops is only walked once
+// The compiler uses that to emit ADD_NUM, LESS_NUM... instead of the generic opcodes, every other operation
+// keeps its dynamic semantics and still reports type errors at runtime
+
+namespace typeInference {
+    struct LocalType {
+        AST::InferredType type = AST::InferredType::NONE;
+        // Last walk that read this local
+        uInt readInWalk = 0;
+    };
+
+    class TypeInference : public scopedWalker::ScopedWalker {
+    public:
+        TypeInference(vector<CSLModule*>& units);
+
+        #pragma region Visitor pattern
+        void visitAssignmentExpr(AST::AssignmentExpr* expr) override;
+        void visitSetExpr(AST::SetExpr* expr) override;
+        void visitConditionalExpr(AST::ConditionalExpr* expr) override;
+        void visitBinaryExpr(AST::BinaryExpr* expr) override;
+        void visitUnaryExpr(AST::UnaryExpr* expr) override;
+        void visitArrayLiteralExpr(AST::ArrayLiteralExpr* expr) override;
+        void visitLiteralExpr(AST::LiteralExpr* expr) override;
+
+        void visitVarDecl(AST::VarDecl* decl) override;
+        #pragma endregion
+    private:
+        // Type of the last visited expression
+        AST::InferredType exprType;
+        // Set when a local that was read during the current walk widened, which means another walk is needed
+        bool changed;
+        // Incremented for every walk of a top level statement
+        uInt walk;
+        ankerl::unordered_dense::map<AST::ASTVar*, LocalType> localTypes;
+
+        #pragma region Helpers
+        void inferTopLevel(AST::ASTNodePtr stmt);
+        void widen(AST::ASTVar* var, AST::InferredType type);
+        AST::InferredType infer(AST::ASTNodePtr node);
+        void visitNode(AST::ASTNodePtr& node) override;
+
+        void declareLocal(AST::ASTVar& var) override;
+        void assignLocal(Token name, AST::InferredType type);
+        #pragma endregion
+    };
+}
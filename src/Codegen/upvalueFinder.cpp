@@ -87,7 +87,7 @@ void UpvalueFinder::visitCallExpr(AST::CallExpr* expr) {
 
 void UpvalueFinder::visitNewExpr(AST::NewExpr* expr){
     // Expr->call will always be a call
-    for (AST::ASTNodePtr arg : reinterpret_cast<AST::CallExpr*>(expr->call.get())->args) {
+    for (AST::ASTNodePtr arg : expr->call->args) {
         arg->accept(this);
     }
 }
@@ -234,7 +234,7 @@ void UpvalueFinder::visitContinueStmt(AST::ContinueStmt* stmt) {}
 
 void UpvalueFinder::visitSwitchStmt(AST::SwitchStmt* stmt) {
     stmt->expr->accept(this);
-    for (const std::shared_ptr<AST::CaseStmt>& _case : stmt->cases) {
+    for (AST::CaseStmt* _case : stmt->cases) {
         beginScope();
         _case->accept(this);
         endScope();
@@ -274,8 +274,7 @@ void UpvalueFinder::declareLocalVar(AST::ASTVar& var) {
         if (local->depth != -1 && local->depth < current->scopeDepth) {
             break;
         }
-        string str = var.name.getLexeme();
-        if (str.compare(local->var->name.getLexeme()) == 0) {
+        if (var.name.sameName(local->var->name)) {
 
         }
     }
@@ -307,8 +306,7 @@ int UpvalueFinder::resolveLocal(CurrentChunkInfo* func, Token name) {
     //checks to see if there is a local variable with a provided name, if there is return the index of the stack slot of the var
     for (int i = func->localCount - 1; i >= 0; i--) {
         Local* local = &func->locals[i];
-        string str = name.getLexeme();
-        if (str.compare(local->var->name.getLexeme()) == 0) {
+        if (name.sameName(local->var->name)) {
             return i;
         }
     }
@@ -1,5 +1,6 @@
 #pragma once
 #include "../Parsing/ASTDefs.h"
+#include <array>
 // Identifies types of variable declarations(and function arguments)
 // Variable declarations can be: global, local, local upvalue
 // Function arguments can be: local, local upvalue
@@ -11,6 +12,10 @@
 // This AST pass doesn't emit any errors and in namedVar only locals and upvalues are looked at, it ignores globals and natives
 // Lets the compiler worry about semantic correctness of the variable declarations, this pass only cares if some local var is accessed
 // by a closure, in which case it must be turned into an upvaulue
+//
+// Every captured local gets its own ObjUpval, even when none of the closures capturing it outlive the frame
+// Skipping CREATE_UPVALUE for those needs closures that can point into a frame's stack(ObjClosure::upvals only holds
+// ObjUpval*), and every place that traces, copies or caches closures has to handle that, so it's left for a separate change
 
 namespace upvalueFinder {
     struct Local {
@@ -44,7 +44,7 @@ void ASTPrinter::visitUnaryExpr(UnaryExpr* expr) {
 void ASTPrinter::visitCallExpr(CallExpr* expr) {
 	expr->callee->accept(this);
 	cout << "( ";
-	for (shared_ptr<ASTNode> node : expr->args) {
+	for (ASTNode* node : expr->args) {
 		node->accept(this);
 		cout << ", ";
 	}
@@ -75,7 +75,7 @@ void ASTPrinter::visitAwaitExpr(AwaitExpr* expr) {
 
 void ASTPrinter::visitArrayLiteralExpr(ArrayLiteralExpr* expr) {
 	cout << "[ ";
-	for (shared_ptr<ASTNode> node : expr->members) {
+	for (ASTNode* node : expr->members) {
 		node->accept(this);
 		cout << ", ";
 	}
@@ -164,7 +164,7 @@ void ASTPrinter::visitExprStmt(ExprStmt* stmt) {
 
 void ASTPrinter::visitBlockStmt(BlockStmt* stmt) {
 	cout << "{ " << endl;
-	for (shared_ptr<ASTNode> line : stmt->statements) {
+	for (ASTNode* line : stmt->statements) {
 		line->accept(this);
 	}
 	cout << "}" << endl;
@@ -217,7 +217,7 @@ void ASTPrinter::visitSwitchStmt(SwitchStmt* stmt) {
 	cout << "switch (";
 	stmt->expr->accept(this);
 	cout << ") {" << endl;
-	for (shared_ptr<CaseStmt> _case : stmt->cases) {
+	for (CaseStmt* _case : stmt->cases) {
 		_case->accept(this);
 	}
 	cout << "}" << endl;
@@ -229,7 +229,7 @@ void ASTPrinter::visitCaseStmt(CaseStmt* stmt) {
 		cout << token.getLexeme() << " | ";
 	}
 	cout << ": " << endl;
-	for (shared_ptr<ASTNode> statement : stmt->stmts) {
+	for (ASTNode* statement : stmt->stmts) {
 		statement->accept(this);
 	}
 }
@@ -95,6 +95,8 @@ int disassembleInstruction(Chunk* chunk, int offset, int constantsOffset) {
 		return simpleInstruction("OP FALSE", offset);
 	case +OpCode::NEGATE:
 		return simpleInstruction("OP NEGATE", offset);
+	case +OpCode::NEGATE_NUM:
+		return simpleInstruction("OP NEGATE NUM", offset);
 	case +OpCode::NOT:
 		return simpleInstruction("OP NOT", offset);
 	case +OpCode::BIN_NOT:
@@ -167,6 +169,16 @@ int disassembleInstruction(Chunk* chunk, int offset, int constantsOffset) {
 		return simpleInstruction("OP BITSHIFT_LEFT", offset);
 	case +OpCode::BITSHIFT_RIGHT:
 		return simpleInstruction("OP BITSHIFT_RIGHT", offset);
+	case +OpCode::ADD_NUM:
+		return simpleInstruction("OP ADD NUM", offset);
+	case +OpCode::SUBTRACT_NUM:
+		return simpleInstruction("OP SUBTRACT NUM", offset);
+	case +OpCode::MULTIPLY_NUM:
+		return simpleInstruction("OP MULTIPLY NUM", offset);
+	case +OpCode::DIVIDE_NUM:
+		return simpleInstruction("OP DIVIDE NUM", offset);
+	case +OpCode::ADD_STR:
+		return simpleInstruction("OP ADD STR", offset);
 	case +OpCode::LOAD_INT:
 		return byteInstruction("OP LOAD INT", chunk, offset);
 	case +OpCode::EQUAL:
@@ -181,8 +193,18 @@ int disassembleInstruction(Chunk* chunk, int offset, int constantsOffset) {
 		return simpleInstruction("OP LESS", offset);
 	case +OpCode::LESS_EQUAL:
         return simpleInstruction("OP LESS EQUAL", offset);
+	case +OpCode::GREATER_NUM:
+		return simpleInstruction("OP GREATER NUM", offset);
+	case +OpCode::GREATER_EQUAL_NUM:
+		return simpleInstruction("OP GREATER EQUAL NUM", offset);
+	case +OpCode::LESS_NUM:
+		return simpleInstruction("OP LESS NUM", offset);
+	case +OpCode::LESS_EQUAL_NUM:
+		return simpleInstruction("OP LESS EQUAL NUM", offset);
     case +OpCode::IN:
         return simpleInstruction("OP IN", offset);
+    case +OpCode::IN_RANGE:
+        return byteInstruction("OP IN RANGE", chunk, offset);
     case +OpCode::GET_NATIVE:
         return shortInstruction("OP GET NATIVE", chunk, offset);
 	case +OpCode::GET_GLOBAL:
@@ -213,6 +235,18 @@ int disassembleInstruction(Chunk* chunk, int offset, int constantsOffset) {
 		return simpleInstruction("OP GET", offset);
 	case +OpCode::SET:
 		return byteInstruction("OP SET", chunk, offset);
+    case +OpCode::GET_RANGE:
+        return byteInstruction("OP GET RANGE", chunk, offset);
+    case +OpCode::SET_RANGE:
+        return byteInstruction("OP SET RANGE", chunk, offset);
+    case +OpCode::GET_INDEX:
+        return simpleInstruction("OP GET INDEX", offset);
+    case +OpCode::SET_INDEX:
+        return simpleInstruction("OP SET INDEX", offset);
+    case +OpCode::GET_INDEX_UNCHECKED:
+        return simpleInstruction("OP GET INDEX UNCHECKED", offset);
+    case +OpCode::SET_INDEX_UNCHECKED:
+        return simpleInstruction("OP SET INDEX UNCHECKED", offset);
 	case +OpCode::JUMP:
 		return jumpInstruction("OP JUMP", 1, chunk, offset);
 	case +OpCode::JUMP_IF_FALSE:
@@ -221,6 +255,8 @@ int disassembleInstruction(Chunk* chunk, int offset, int constantsOffset) {
 		return jumpInstruction("OP JUMP IF TRUE", 1, chunk, offset);
 	case +OpCode::JUMP_IF_FALSE_POP:
 		return jumpInstruction("OP JUMP IF FALSE POP", 1, chunk, offset);
+	case +OpCode::JUMP_IF_TRUE_POP:
+		return jumpInstruction("OP JUMP IF TRUE POP", 1, chunk, offset);
 	case +OpCode::LOOP_IF_TRUE:
 		return jumpInstruction("OP LOOP IF TRUE", -1, chunk, offset);
 	case +OpCode::LOOP:
@@ -269,6 +305,21 @@ int disassembleInstruction(Chunk* chunk, int offset, int constantsOffset) {
 		std::cout << fmt::format("{:0>4d}    | {:16} -> {:4d} ", jumps + numOfConstants * 2, "DEFAULT CASE", jumps + numOfConstants * 2 + 2 + defaultJmp) << std::endl;
 		return jumps + (numOfConstants + 1) * 2;
 	}
+	case +OpCode::SWITCH_TABLE: {
+		offset++;
+		uInt constant = constantsOffset + ((chunk->bytecode[offset] << 8) | chunk->bytecode[offset + 1]);
+		uInt16 tableSize = static_cast<uInt16>(chunk->bytecode[offset + 2] << 8) | chunk->bytecode[offset + 3];
+		offset += 4;
+		std::cout << fmt::format("{:16} {:4d} FROM ", "OP SWITCH TABLE", tableSize);
+		print(chunk->constants[constant]);
+		std::cout << std::endl;
+		for (int i = 0; i <= tableSize; i++) {
+			uInt16 caseJmp = (uInt16)(chunk->bytecode[offset] << 8) | chunk->bytecode[offset + 1];
+			std::cout << fmt::format("{:0>4d}    | {:16} {} -> {:4d}", offset, i == tableSize ? "DEFAULT CASE" : "CASE SLOT", offset, offset + 2 + caseJmp) << std::endl;
+			offset += 2;
+		}
+		return offset;
+	}
 	case +OpCode::CALL:
 		return byteInstruction("OP CALL", chunk, offset);
 	case +OpCode::RETURN:
@@ -353,6 +404,10 @@ int disassembleInstruction(Chunk* chunk, int offset, int constantsOffset) {
 		return invokeInstruction("OP SUPER INVOKE", chunk, offset, constantsOffset);
 	case +OpCode::SUPER_INVOKE_LONG:
 		return longInvokeInstruction("OP SUPER INVOKE LONG", chunk, offset, constantsOffset);
+	case +OpCode::CALL_DIRECT:
+		return invokeInstruction("OP CALL DIRECT", chunk, offset, constantsOffset);
+	case +OpCode::CALL_DIRECT_LONG:
+		return longInvokeInstruction("OP CALL DIRECT LONG", chunk, offset, constantsOffset);
     case +OpCode::INSTANCEOF:
         return constantInstruction("OP INSTANCEOF", chunk, offset, true, constantsOffset);
 	default:
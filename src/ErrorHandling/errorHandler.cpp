@@ -80,6 +80,7 @@ namespace errorHandler {
 
 		//errors during preprocessing, building of the AST tree and compiling
 		vector<CompileTimeError> compileErrors;
+		thread_local ErrorBuffer* errorBuffer = nullptr;
 	}
 
 	void showCompileErrors() {
@@ -89,6 +90,10 @@ namespace errorHandler {
 	}
 
 	void addCompileError(string msg, Token token) {
+		if (errorBuffer) {
+			errorBuffer->emplace_back(msg, token);
+			return;
+		}
 		compileErrors.emplace_back(msg, token.str.sourceFile, token);
 	}
 	void addSystemError(string msg) {
@@ -100,6 +105,22 @@ namespace errorHandler {
 		return !compileErrors.empty();
 	}
 
+	// Errors of lazily compiled functions are shown at runtime, after which they're cleared
+	void clearCompileErrors() {
+		compileErrors.clear();
+	}
+
+	ErrorBuffer* bufferCompileErrors(ErrorBuffer* buffer) {
+		ErrorBuffer* previous = errorBuffer;
+		errorBuffer = buffer;
+		return previous;
+	}
+
+	void flushCompileErrors(ErrorBuffer& buffer) {
+		for (auto& [msg, token] : buffer) addCompileError(msg, token);
+		buffer.clear();
+	}
+
     vector<string> convertCompilerErrorsToJson(){
         vector<string> errors;
         for (CompileTimeError error : compileErrors) {
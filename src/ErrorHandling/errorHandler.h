@@ -8,6 +8,15 @@ namespace errorHandler {
 	void addCompileError(string msg, Token token);
 	void addSystemError(string msg);
 	bool hasErrors();
+	void clearCompileErrors();
+
+	using ErrorBuffer = vector<std::pair<string, Token>>;
+	// While a buffer is set, compile errors reported by the calling thread go into it instead of the global list
+	// Used when modules are processed in parallel, so errors can be added in the same order no matter which thread
+	// found them
+	// Returns the buffer that was set before, so callers that might run inside another buffer can restore it
+	ErrorBuffer* bufferCompileErrors(ErrorBuffer* buffer);
+	void flushCompileErrors(ErrorBuffer& buffer);
     vector<string> convertCompilerErrorsToJson();
 
 }
\ No newline at end of file
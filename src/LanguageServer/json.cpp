@@ -0,0 +1,223 @@
+#include "json.h"
+#include "../Includes/fmt/format.h"
+#include <cstdlib>
+
+namespace json {
+    const Value& Value::operator[](std::string_view key) const {
+        static const Value null;
+        if (type != Type::OBJECT) return null;
+        for (int i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) return elements[i];
+        }
+        return null;
+    }
+
+    namespace {
+        class Reader {
+        public:
+            Reader(std::string_view _text) : text(_text), pos(0) {}
+
+            bool parseDocument(Value& out) {
+                if (!parseValue(out)) return false;
+                skipWhitespace();
+                return pos == text.size();
+            }
+        private:
+            std::string_view text;
+            size_t pos;
+
+            void skipWhitespace() {
+                while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) pos++;
+            }
+
+            bool consume(std::string_view literal) {
+                if (text.substr(pos, literal.size()) != literal) return false;
+                pos += literal.size();
+                return true;
+            }
+
+            bool parseValue(Value& out) {
+                skipWhitespace();
+                if (pos >= text.size()) return false;
+                switch (text[pos]) {
+                    case '{': return parseObject(out);
+                    case '[': return parseArray(out);
+                    case '"':
+                        out.type = Type::STRING;
+                        return parseString(out.str);
+                    case 't':
+                        out.type = Type::BOOL;
+                        out.boolean = true;
+                        return consume("true");
+                    case 'f':
+                        out.type = Type::BOOL;
+                        return consume("false");
+                    case 'n':
+                        return consume("null");
+                    default:
+                        return parseNumber(out);
+                }
+            }
+
+            bool parseObject(Value& out) {
+                out.type = Type::OBJECT;
+                pos++;
+                skipWhitespace();
+                if (consume("}")) return true;
+                while (true) {
+                    skipWhitespace();
+                    string key;
+                    if (pos >= text.size() || text[pos] != '"' || !parseString(key)) return false;
+                    skipWhitespace();
+                    if (!consume(":")) return false;
+                    out.keys.push_back(key);
+                    out.elements.emplace_back();
+                    if (!parseValue(out.elements.back())) return false;
+                    skipWhitespace();
+                    if (consume("}")) return true;
+                    if (!consume(",")) return false;
+                }
+            }
+
+            bool parseArray(Value& out) {
+                out.type = Type::ARRAY;
+                pos++;
+                skipWhitespace();
+                if (consume("]")) return true;
+                while (true) {
+                    out.elements.emplace_back();
+                    if (!parseValue(out.elements.back())) return false;
+                    skipWhitespace();
+                    if (consume("]")) return true;
+                    if (!consume(",")) return false;
+                }
+            }
+
+            bool parseHex(uInt& codepoint) {
+                if (pos + 4 > text.size()) return false;
+                codepoint = 0;
+                for (int i = 0; i < 4; i++) {
+                    char c = text[pos++];
+                    codepoint <<= 4;
+                    if (c >= '0' && c <= '9') codepoint |= c - '0';
+                    else if (c >= 'a' && c <= 'f') codepoint |= c - 'a' + 10;
+                    else if (c >= 'A' && c <= 'F') codepoint |= c - 'A' + 10;
+                    else return false;
+                }
+                return true;
+            }
+
+            static void appendUtf8(string& str, uInt codepoint) {
+                if (codepoint < 0x80) str += static_cast<char>(codepoint);
+                else if (codepoint < 0x800) {
+                    str += static_cast<char>(0xC0 | (codepoint >> 6));
+                    str += static_cast<char>(0x80 | (codepoint & 0x3F));
+                }
+                else if (codepoint < 0x10000) {
+                    str += static_cast<char>(0xE0 | (codepoint >> 12));
+                    str += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+                    str += static_cast<char>(0x80 | (codepoint & 0x3F));
+                }
+                else {
+                    str += static_cast<char>(0xF0 | (codepoint >> 18));
+                    str += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+                    str += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+                    str += static_cast<char>(0x80 | (codepoint & 0x3F));
+                }
+            }
+
+            bool parseString(string& out) {
+                pos++;
+                while (pos < text.size()) {
+                    char c = text[pos++];
+                    if (c == '"') return true;
+                    if (c != '\\') {
+                        out += c;
+                        continue;
+                    }
+                    if (pos >= text.size()) return false;
+                    switch (text[pos++]) {
+                        case '"': out += '"'; break;
+                        case '\\': out += '\\'; break;
+                        case '/': out += '/'; break;
+                        case 'b': out += '\b'; break;
+                        case 'f': out += '\f'; break;
+                        case 'n': out += '\n'; break;
+                        case 'r': out += '\r'; break;
+                        case 't': out += '\t'; break;
+                        case 'u': {
+                            uInt codepoint;
+                            if (!parseHex(codepoint)) return false;
+                            // Characters outside of the BMP are escaped as a surrogate pair
+                            if (codepoint >= 0xD800 && codepoint < 0xDC00 && consume("\\u")) {
+                                uInt low;
+                                if (!parseHex(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                            }
+                            appendUtf8(out, codepoint);
+                            break;
+                        }
+                        default: return false;
+                    }
+                }
+                return false;
+            }
+
+            bool parseNumber(Value& out) {
+                size_t start = pos;
+                while (pos < text.size() && (isdigit(text[pos]) || text[pos] == '-' || text[pos] == '+'
+                                             || text[pos] == '.' || text[pos] == 'e' || text[pos] == 'E')) pos++;
+                if (start == pos) return false;
+                string num(text.substr(start, pos - start));
+                char* end;
+                out.type = Type::NUMBER;
+                out.number = std::strtod(num.c_str(), &end);
+                return end == num.c_str() + num.size();
+            }
+        };
+    }
+
+    bool parse(std::string_view text, Value& out) {
+        out = Value();
+        return Reader(text).parseDocument(out);
+    }
+
+    string stringify(const Value& value) {
+        switch (value.type) {
+            case Type::NUL: return "null";
+            case Type::BOOL: return value.boolean ? "true" : "false";
+            case Type::NUMBER: return fmt::format("{}", value.number);
+            case Type::STRING: return quote(value.str);
+            case Type::ARRAY: {
+                string final = "[";
+                for (auto& element : value.elements) final += stringify(element) + ",";
+                if (!value.elements.empty()) final.pop_back();
+                return final + "]";
+            }
+            case Type::OBJECT: {
+                string final = "{";
+                for (int i = 0; i < value.keys.size(); i++) final += quote(value.keys[i]) + ":" + stringify(value.elements[i]) + ",";
+                if (!value.keys.empty()) final.pop_back();
+                return final + "}";
+            }
+        }
+        return "null";
+    }
+
+    string quote(std::string_view str) {
+        string final = "\"";
+        for (char c : str) {
+            switch (c) {
+                case '"': final += "\\\""; break;
+                case '\\': final += "\\\\"; break;
+                case '\n': final += "\\n"; break;
+                case '\r': final += "\\r"; break;
+                case '\t': final += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) final += fmt::format("\\u{:04x}", static_cast<int>(c));
+                    else final += c;
+            }
+        }
+        return final + "\"";
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "../common.h"
+#include <string_view>
+// Just enough JSON for the language server protocol, messages are parsed into a tree of Values
+// and responses are built as strings
+
+namespace json {
+    enum class Type {
+        NUL,
+        BOOL,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT
+    };
+
+    struct Value {
+        Type type = Type::NUL;
+        bool boolean = false;
+        double number = 0;
+        string str;
+        vector<Value> elements;
+        // Members of an object, keys[i] is the key of elements[i]
+        vector<string> keys;
+
+        // Missing members(and members of something that isn't an object) are null, so lookups can be chained
+        const Value& operator[](std::string_view key) const;
+        bool isNull() const { return type == Type::NUL; }
+        bool has(std::string_view key) const { return !(*this)[key].isNull(); }
+    };
+
+    // Returns false if text isn't valid JSON
+    bool parse(std::string_view text, Value& out);
+    string stringify(const Value& value);
+    // Quoted and escaped string
+    string quote(std::string_view str);
+}
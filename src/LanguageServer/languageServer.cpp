@@ -0,0 +1,376 @@
+#include "languageServer.h"
+#include "../ErrorHandling/errorHandler.h"
+#include "../Includes/fmt/format.h"
+#include <iostream>
+#include <filesystem>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(_WIN32) || defined(WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+using namespace languageServer;
+using std::unordered_set;
+using SemanticAnalysis::Diagnostic;
+using preprocessing::SourceCache;
+
+// Error codes defined by JSON-RPC and the language server protocol
+#define PARSE_ERROR -32700
+#define METHOD_NOT_FOUND -32601
+#define INVALID_REQUEST -32600
+
+// Order matters, semantic tokens refer to these by index
+static const vector<string> tokenTypes = {"namespace", "class", "function", "method", "property", "variable", "parameter", "macro"};
+static const vector<string> tokenModifiers = {"declaration", "local"};
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Only file URIs are supported, "file:///c%3A/dir/main.esl" becomes "c:/dir/main.esl"
+static string uriToPath(const string& uri) {
+    if (uri.substr(0, 7) != "file://") return "";
+    string path;
+    for (size_t i = 7; i < uri.size(); i++) {
+        if (uri[i] == '%' && i + 2 < uri.size() && hexDigit(uri[i + 1]) >= 0 && hexDigit(uri[i + 2]) >= 0) {
+            path += static_cast<char>(hexDigit(uri[i + 1]) * 16 + hexDigit(uri[i + 2]));
+            i += 2;
+        }
+        else path += uri[i];
+    }
+    // Windows paths start with a drive letter
+    if (path.size() > 2 && path[0] == '/' && path[2] == ':') path.erase(0, 1);
+    return SourceCache::normalPath(path);
+}
+
+string LanguageServer::pathToURI(const string& path) {
+    auto it = openURIs.find(path);
+    if (it != openURIs.end()) return it->second;
+    string uri = "file://";
+    if (path.empty() || path[0] != '/') uri += '/';
+    for (unsigned char c : path) {
+        if (isalnum(c) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~') uri += c;
+        else if (c == '\\') uri += '/';
+        else uri += fmt::format("%{:02X}", c);
+    }
+    return uri;
+}
+
+// Columns are sent as byte offsets, which is only exact for clients that accept utf-8 positions(or ascii sources)
+static string diagnosticToJSON(const Diagnostic& diagnostic) {
+    // Positions are unsigned in the protocol, some errors(eg. unterminated strings) report a negative column
+    int line = std::max(0, diagnostic.line);
+    int start = std::max(0, diagnostic.start);
+    int end = std::max(start, diagnostic.start + diagnostic.length);
+    return fmt::format("{{\"range\":{{\"start\":{{\"line\":{},\"character\":{}}},\"end\":{{\"line\":{},\"character\":{}}}}},"
+                       "\"severity\":1,\"source\":\"esl\",\"message\":{}}}",
+                       line, start, line, end, json::quote(diagnostic.message));
+}
+
+// Tokens created by macro expansion don't belong to a file, errors they cause are reported at the start of the module
+static Diagnostic toDiagnostic(const string& msg, const Token& token, CSLModule* unit) {
+    if (token.str.sourceFile) return Diagnostic(token, msg, 0);
+    Diagnostic diagnostic;
+    diagnostic.message = msg;
+    diagnostic.path = unit->file->path;
+    return diagnostic;
+}
+
+static void addDiagnostic(vector<Diagnostic>& diagnostics, const Diagnostic& diagnostic) {
+    // Modules shared by multiple projects report the same errors in each of them
+    for (Diagnostic& other : diagnostics) {
+        if (other.line == diagnostic.line && other.start == diagnostic.start && other.length == diagnostic.length
+            && other.message == diagnostic.message) return;
+    }
+    diagnostics.push_back(diagnostic);
+}
+
+LanguageServer::LanguageServer(string _mainFilePath) {
+    std::error_code ec;
+    mainFilePath = SourceCache::normalPath(std::filesystem::absolute(_mainFilePath, ec).string());
+    shutdownRequested = false;
+}
+
+int LanguageServer::run() {
+    #if defined(_WIN32) || defined(WIN32)
+    // Content-Length counts bytes, so line endings can't be translated
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+    #endif
+    string content;
+    while (readMessage(content)) {
+        json::Value message;
+        if (!json::parse(content, message)) {
+            respondError(json::Value(), PARSE_ERROR, "Couldn't parse message.");
+            continue;
+        }
+        if (message["method"].str == "exit") return shutdownRequested ? 0 : 1;
+        handleMessage(message);
+    }
+    // The client closed the pipe without asking the server to exit
+    return 1;
+}
+
+#pragma region Messages
+bool LanguageServer::readMessage(string& content) {
+    long long length = -1;
+    string line;
+    while (std::getline(std::cin, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        // Headers end with an empty line
+        if (line.empty()) {
+            if (length >= 0) break;
+            continue;
+        }
+        if (line.substr(0, 15) == "Content-Length:") length = std::strtoll(line.c_str() + 15, nullptr, 10);
+    }
+    if (!std::cin || length < 0) return false;
+    content.resize(length);
+    std::cin.read(content.data(), length);
+    return std::cin.gcount() == length;
+}
+
+void LanguageServer::send(const string& message) {
+    std::cout << "Content-Length: " << message.size() << "\r\n\r\n" << message;
+    std::cout.flush();
+}
+
+void LanguageServer::respond(const json::Value& id, const string& result) {
+    send(fmt::format("{{\"jsonrpc\":\"2.0\",\"id\":{},\"result\":{}}}", json::stringify(id), result));
+}
+
+void LanguageServer::respondError(const json::Value& id, int code, const string& message) {
+    send(fmt::format("{{\"jsonrpc\":\"2.0\",\"id\":{},\"error\":{{\"code\":{},\"message\":{}}}}}",
+                     json::stringify(id), code, json::quote(message)));
+}
+
+void LanguageServer::notify(const string& method, const string& params) {
+    send(fmt::format("{{\"jsonrpc\":\"2.0\",\"method\":{},\"params\":{}}}", json::quote(method), params));
+}
+
+void LanguageServer::handleMessage(const json::Value& message) {
+    const json::Value& id = message["id"];
+    const json::Value& params = message["params"];
+    const string& method = message["method"].str;
+    // Only requests have an id, notifications don't expect a response
+    bool isRequest = message.has("id");
+
+    if (method == "initialize") handleInitialize(id, params);
+    else if (method == "initialized") analyze();
+    else if (method == "shutdown") {
+        shutdownRequested = true;
+        respond(id, "null");
+    }
+    else if (shutdownRequested) {
+        if (isRequest) respondError(id, INVALID_REQUEST, "Server is shutting down.");
+    }
+    else if (method == "textDocument/didOpen") {
+        const json::Value& document = params["textDocument"];
+        string path = uriToPath(document["uri"].str);
+        sources.openFiles[path] = document["text"].str;
+        openURIs[path] = document["uri"].str;
+        analyze();
+    }
+    else if (method == "textDocument/didChange") {
+        // Only full document sync is supported, so the last change contains the whole document
+        const json::Value& changes = params["contentChanges"];
+        string path = uriToPath(params["textDocument"]["uri"].str);
+        if (changes.elements.empty() || !sources.openFiles.contains(path)) return;
+        sources.openFiles[path] = changes.elements.back()["text"].str;
+        analyze();
+    }
+    else if (method == "textDocument/didClose") {
+        string path = uriToPath(params["textDocument"]["uri"].str);
+        sources.openFiles.erase(path);
+        openURIs.erase(path);
+        analyze();
+    }
+    else if (method == "textDocument/didSave") {
+        // Files that aren't open are checked for changes on disk
+        analyze();
+    }
+    else if (method == "textDocument/semanticTokens/full") {
+        respond(id, semanticTokens(uriToPath(params["textDocument"]["uri"].str)));
+    }
+    else if (isRequest) respondError(id, METHOD_NOT_FOUND, fmt::format("Unsupported method {}.", method));
+}
+
+void LanguageServer::handleInitialize(const json::Value& id, const json::Value& params) {
+    // Columns are byte offsets, clients that understand them are told so
+    bool utf8 = false;
+    for (const json::Value& encoding : params["capabilities"]["general"]["positionEncodings"].elements) {
+        if (encoding.str == "utf-8") utf8 = true;
+    }
+    json::Value types, modifiers;
+    types.type = json::Type::ARRAY;
+    modifiers.type = json::Type::ARRAY;
+    for (const string& type : tokenTypes) {
+        types.elements.emplace_back();
+        types.elements.back().type = json::Type::STRING;
+        types.elements.back().str = type;
+    }
+    for (const string& modifier : tokenModifiers) {
+        modifiers.elements.emplace_back();
+        modifiers.elements.back().type = json::Type::STRING;
+        modifiers.elements.back().str = modifier;
+    }
+    string capabilities = fmt::format("{}\"textDocumentSync\":{{\"openClose\":true,\"change\":1,\"save\":true}},"
+                                      "\"semanticTokensProvider\":{{\"legend\":{{\"tokenTypes\":{},\"tokenModifiers\":{}}},\"full\":true}}",
+                                      utf8 ? "\"positionEncoding\":\"utf-8\"," : "", json::stringify(types), json::stringify(modifiers));
+    respond(id, "{\"capabilities\":{" + capabilities + "},\"serverInfo\":{\"name\":\"ESL\"}}");
+}
+#pragma endregion
+
+#pragma region Analysis
+void LanguageServer::analyze() {
+    // Every project is brought up to date below, so nothing points to modules replaced during the last analysis anymore
+    sources.releaseRetired();
+
+    vector<string> roots = {mainFilePath};
+    vector<string> openPaths;
+    for (auto& [path, source] : sources.openFiles) openPaths.push_back(path);
+    std::sort(openPaths.begin(), openPaths.end());
+    roots.insert(roots.end(), openPaths.begin(), openPaths.end());
+
+    vector<Project> analyzed;
+    unordered_set<string> covered;
+    unordered_map<string, vector<Diagnostic>> diagnostics;
+    for (string& root : roots) {
+        // The preprocessor exits the process if the main file doesn't exist
+        if (covered.contains(root) || std::filesystem::path(root).extension() != ".esl" || !sources.exists(root)) continue;
+        Project& project = analyzed.emplace_back();
+        project.root = root;
+        analyzeProject(project, diagnostics);
+        for (CSLModule* unit : project.units) covered.insert(SourceCache::normalPath(unit->file->path));
+    }
+    // Parsers of the previous analysis are only destroyed now, since their macros were in use until every module using them was parsed again
+    projects = std::move(analyzed);
+
+    // Files that no longer have any diagnostics(or are no longer part of a project) get an empty list
+    for (auto& [path, published] : publishedDiagnostics) diagnostics[path];
+    for (auto& [path, fileDiagnostics] : diagnostics) {
+        string list = "[";
+        for (Diagnostic& diagnostic : fileDiagnostics) list += diagnosticToJSON(diagnostic) + ",";
+        if (!fileDiagnostics.empty()) list.pop_back();
+        list += "]";
+        auto it = publishedDiagnostics.find(path);
+        if (it != publishedDiagnostics.end() && it->second == list) continue;
+        notify("textDocument/publishDiagnostics", fmt::format("{{\"uri\":{},\"diagnostics\":{}}}", json::quote(pathToURI(path)), list));
+        if (fileDiagnostics.empty()) publishedDiagnostics.erase(path);
+        else publishedDiagnostics[path] = list;
+    }
+}
+
+void LanguageServer::analyzeProject(Project& project, unordered_map<string, vector<Diagnostic>>& diagnostics) {
+    // Errors found while resolving imports, these are found again on every run
+    errorHandler::ErrorBuffer errors;
+    errorHandler::ErrorBuffer* previous = errorHandler::bufferCompileErrors(&errors);
+
+    preprocessing::Preprocessor preprocessor(&sources);
+    preprocessor.preprocessProject(project.root);
+    project.units = preprocessor.getSortedUnits();
+    vector<Diagnostic> resolveDiagnostics;
+    for (auto& [msg, token] : errors) resolveDiagnostics.push_back(toDiagnostic(msg, token, project.units.back()));
+    errors.clear();
+
+    // Modules are sorted, so macros are defined before they're used just like in a regular compile
+    project.parser = std::make_unique<AST::Parser>();
+    unordered_set<CSLModule*> reparsed;
+    for (CSLModule* unit : project.units) {
+        ModuleState& state = modules[unit->file->path];
+        uInt64 generation = sources.generation(unit->file->path);
+        if (state.parsedGeneration == generation && !AST::Parser::needsMacros(unit)) continue;
+        unit->clearAST();
+        project.parser->parseUnit(unit);
+        state.parsedGeneration = generation;
+        state.parseDiagnostics.clear();
+        for (auto& [msg, token] : errors) state.parseDiagnostics.push_back(toDiagnostic(msg, token, unit));
+        errors.clear();
+        reparsed.insert(unit);
+    }
+
+    // A module is analyzed again if it or any of its dependencies changed, globals declared by other modules
+    // are restored so that the analyzer sees the same state as if it went through every module
+    SemanticAnalysis::SemanticAnalyzer analyzer;
+    analyzer.setUnits(project.units);
+    unordered_set<CSLModule*> reused;
+    for (CSLModule* unit : project.units) {
+        ModuleState& state = modules[unit->file->path];
+        vector<uInt64> key = {state.parsedGeneration};
+        bool depsReused = true;
+        for (Dependency& dep : unit->deps) {
+            key.push_back(modules[dep.module->file->path].parsedGeneration);
+            depsReused = depsReused && reused.contains(dep.module);
+        }
+        if (depsReused && !reparsed.contains(unit) && key == state.analyzedFrom) {
+            analyzer.restoreUnit(unit, state.globals);
+            reused.insert(unit);
+            continue;
+        }
+        project.parser->checkImports(unit);
+        state.analysisDiagnostics.clear();
+        for (auto& [msg, token] : errors) state.analysisDiagnostics.push_back(toDiagnostic(msg, token, unit));
+        errors.clear();
+        analyzer.analyzeUnit(unit);
+        for (Diagnostic& diagnostic : analyzer.takeDiagnostics()) state.analysisDiagnostics.push_back(diagnostic);
+        state.globals = analyzer.lastUnitGlobals();
+        state.analyzedFrom = key;
+    }
+    errorHandler::bufferCompileErrors(previous);
+
+    // Same order as the diagnostics of -validate-file
+    for (Diagnostic& diagnostic : resolveDiagnostics) addDiagnostic(diagnostics[SourceCache::normalPath(diagnostic.path)], diagnostic);
+    for (CSLModule* unit : project.units) {
+        ModuleState& state = modules[unit->file->path];
+        for (Diagnostic& diagnostic : state.parseDiagnostics) addDiagnostic(diagnostics[SourceCache::normalPath(diagnostic.path)], diagnostic);
+    }
+    for (CSLModule* unit : project.units) {
+        ModuleState& state = modules[unit->file->path];
+        for (Diagnostic& diagnostic : state.analysisDiagnostics) addDiagnostic(diagnostics[SourceCache::normalPath(diagnostic.path)], diagnostic);
+    }
+}
+
+// Semantic tokens of the file encoded as described by the protocol, every token is relative to the one before it
+string LanguageServer::semanticTokens(const string& path) {
+    for (Project& project : projects) {
+        for (int i = 0; i < project.units.size(); i++) {
+            CSLModule* unit = project.units[i];
+            if (SourceCache::normalPath(unit->file->path) != path) continue;
+
+            SemanticAnalysis::SemanticAnalyzer analyzer;
+            analyzer.setUnits(project.units);
+            for (int j = 0; j < i; j++) analyzer.restoreUnit(project.units[j], modules[project.units[j]->file->path].globals);
+            vector<SemanticAnalysis::SemanticToken> tokens = analyzer.highlightUnit(unit, project.parser->getMacros());
+            std::stable_sort(tokens.begin(), tokens.end(), [](auto& a, auto& b) {
+                return a.line != b.line ? a.line < b.line : a.start < b.start;
+            });
+
+            string data;
+            int prevLine = 0, prevStart = -1;
+            for (auto& token : tokens) {
+                auto type = std::find(tokenTypes.begin(), tokenTypes.end(), token.type);
+                // Tokens can't overlap, if the analyzer visits a token twice the first one is kept
+                if (type == tokenTypes.end() || token.length <= 0 || (token.line == prevLine && token.start == prevStart)) continue;
+                int modifiers = 0;
+                for (string& modifier : token.modifiers) {
+                    auto it = std::find(tokenModifiers.begin(), tokenModifiers.end(), modifier);
+                    if (it != tokenModifiers.end()) modifiers |= 1 << (it - tokenModifiers.begin());
+                }
+                int start = token.line == prevLine && prevStart >= 0 ? token.start - prevStart : token.start;
+                data += fmt::format("{},{},{},{},{},", token.line - prevLine, start, token.length, type - tokenTypes.begin(), modifiers);
+                prevLine = token.line;
+                prevStart = token.start;
+            }
+            if (!data.empty()) data.pop_back();
+            return "{\"data\":[" + data + "]}";
+        }
+    }
+    return "{\"data\":[]}";
+}
+#pragma endregion
@@ -0,0 +1,71 @@
+#pragma once
+#include "../common.h"
+#include "../Preprocessing/preprocessor.h"
+#include "../SemanticAnalysis/semanticAnalyzer.h"
+#include "json.h"
+#include <unordered_map>
+#include <memory>
+
+namespace languageServer {
+    using std::unordered_map;
+    using std::unique_ptr;
+
+    // Long running process that speaks the language server protocol over stdin/stdout
+    // Tokens and ASTs of every module are kept between edits, after an edit only modules whose source changed are
+    // scanned and parsed again, and only those modules and the modules that import them(directly or not) are analyzed again
+    // Modules that define or invoke macros depend on every module before them, so they(and modules importing them)
+    // are always parsed and analyzed again
+    class LanguageServer {
+    public:
+        explicit LanguageServer(string mainFilePath);
+        // Handles messages until the client sends 'exit', returns the exit code of the process
+        int run();
+    private:
+        // What's known about a module from the last time it was parsed and analyzed, keyed by the path of its file
+        struct ModuleState {
+            // Generation(see SourceCache) of the module that was parsed
+            uInt64 parsedGeneration = 0;
+            // Generations of the module and its dependencies at the time it was analyzed
+            vector<uInt64> analyzedFrom;
+            vector<SemanticAnalysis::Diagnostic> parseDiagnostics;
+            vector<SemanticAnalysis::Diagnostic> analysisDiagnostics;
+            // Globals declared by the module, restored instead of analyzing the module again
+            vector<SemanticAnalysis::GlobalVar> globals;
+        };
+
+        // Main file and every module it imports
+        struct Project {
+            string root;
+            vector<CSLModule*> units;
+            // Owns the macros used when parsing units
+            unique_ptr<AST::Parser> parser;
+        };
+
+        string mainFilePath;
+        preprocessing::SourceCache sources;
+        unordered_map<string, ModuleState> modules;
+        // The main file is always a project, files open in the editor that aren't part of one are projects of their own
+        vector<Project> projects;
+        // URIs used by the editor for open files, files that aren't open get a URI made from their path
+        unordered_map<string, string> openURIs;
+        // Last diagnostics sent for each file, so only diagnostics that changed are sent
+        unordered_map<string, string> publishedDiagnostics;
+        bool shutdownRequested;
+
+        bool readMessage(string& content);
+        void send(const string& message);
+        void respond(const json::Value& id, const string& result);
+        void respondError(const json::Value& id, int code, const string& message);
+        void notify(const string& method, const string& params);
+
+        void handleMessage(const json::Value& message);
+        void handleInitialize(const json::Value& id, const json::Value& params);
+
+        // Brings every project up to date with the sources and sends the diagnostics that changed
+        void analyze();
+        void analyzeProject(Project& project, unordered_map<string, vector<SemanticAnalysis::Diagnostic>>& diagnostics);
+        string semanticTokens(const string& path);
+
+        string pathToURI(const string& path);
+    };
+}
@@ -4,6 +4,7 @@
 #include "../Objects/objects.h"
 #include "../Runtime/vm.h"
 #include "../Includes/fmt/format.h"
+#include "../codegen/valueHelpersInline.cpp"
 
 //start size of heap in KB
 #define HEAP_START_SIZE 1024
@@ -42,7 +43,7 @@ namespace memory {
 		markRoots();
 		mark();
 		sweep();
-		if (heapSize > heapSizeLimit) heapSizeLimit << 1;
+		if (heapSize > heapSizeLimit) heapSizeLimit <<= 1;
 		// After sweeping the heap all sleeping child threads are awakened
 		{
 			std::scoped_lock<std::mutex> lk(vm->pauseMtx);
@@ -56,7 +57,7 @@ namespace memory {
 		markRoots(compiler);
 		mark();
 		sweep();
-		if (heapSize > heapSizeLimit) heapSizeLimit << 1;
+		if (heapSize > heapSizeLimit) heapSizeLimit <<= 1;
 		shouldCollect = false;
 	}
 
@@ -80,29 +81,224 @@ namespace memory {
         for(auto& val : compiler->globals) valueHelpers::mark(val.val);
         for(auto func : compiler->nativeFuncs) func->marked = true;
         compiler->mainBlockFunc->marked = true;
+        if(compiler->initBlockFunc) compiler->initBlockFunc->marked = true;
+        for(auto& [func, lazy] : compiler->lazyFuncs) func->marked = true;
         gc.markObj(compiler->baseClass);
 	}
 
 	void GarbageCollector::sweep() {
 		heapSize = 0;
-        for(auto it = interned.cbegin(); it != interned.cend(); ){
-            if(!it->second->marked) it = interned.erase(it);
-            else it = std::next(it);
-        }
-		for (int i = objects.size() - 1; i >= 0; i--) {
+        interned.sweep();
+		// Survivors are compacted to the front of the vector, erasing each dead object separately is quadratic
+		uInt64 survivors = 0;
+		for (uInt64 i = 0; i < objects.size(); i++) {
 			object::Obj* obj = objects[i];
 			if (!obj->marked) {
 				delete obj;
-				objects.erase(objects.begin() + i);
 				continue;
 			}
 			heapSize += obj->getSize();
 			obj->marked = false;
+			objects[survivors++] = obj;
+		}
+		objects.resize(survivors);
+		// Isolated threads are roots of the global collection, so objects in their heaps got marked as well
+		if(!vm) return;
+		for(runtime::Thread* t : vm->childThreads) {
+			if(t->heap) t->heap->clearMarks();
 		}
-
 	}
 
 	void GarbageCollector::markObj(object::Obj* object) {
+		// Isolated threads trace into their own mark stack so that they can collect concurrently
+		if(localHeap) localHeap->markObj(object);
+		else markStack.push_back(object);
+	}
+
+	uInt64 InternHash::operator()(object::ObjString* str) const {
+		return str->hash;
+	}
+
+	bool InternEqual::operator()(const InternKey& key, object::ObjString* str) const {
+		return key.hash == str->hash && key.str == str->str;
+	}
+
+	object::ObjString* StringTable::intern(string& str) {
+		InternKey key{str, ankerl::unordered_dense::hash<std::string_view>{}(str)};
+		Shard& shard = shards[key.hash & (shardCount - 1)];
+		std::scoped_lock lk(shard.mtx);
+		auto it = shard.strings.find(key);
+		if (it != shard.strings.end()) return *it;
+		// Interned strings are visible to every thread
+		SharedHeapScope scope;
+		auto newStr = new object::ObjString(str);
+		newStr->hash = key.hash;
+		gc.heapSize += str.size();
+		shard.strings.insert(newStr);
+		return newStr;
+	}
+
+	object::ObjString* StringTable::find(std::string_view str) {
+		InternKey key{str, ankerl::unordered_dense::hash<std::string_view>{}(str)};
+		Shard& shard = shards[key.hash & (shardCount - 1)];
+		std::scoped_lock lk(shard.mtx);
+		auto it = shard.strings.find(key);
+		return it != shard.strings.end() ? *it : nullptr;
+	}
+
+	object::ObjString* StringTable::internStatic(object::ObjString* str) {
+		InternKey key{str->str, ankerl::unordered_dense::hash<std::string_view>{}(str->str)};
+		Shard& shard = shards[key.hash & (shardCount - 1)];
+		std::scoped_lock lk(shard.mtx);
+		auto it = shard.strings.find(key);
+		if (it != shard.strings.end()) return *it;
+		str->hash = key.hash;
+		str->marked = true;
+		shard.strings.insert(str);
+		return str;
+	}
+
+	void StringTable::sweep() {
+		for (Shard& shard : shards) {
+			std::scoped_lock lk(shard.mtx);
+			std::erase_if(shard.strings, [](object::ObjString* str) { return !str->marked; });
+		}
+	}
+
+	thread_local LocalHeap* localHeap = nullptr;
+
+	LocalHeap::LocalHeap(runtime::Thread* _owner) {
+		owner = _owner;
+		heapSize = 0;
+		heapSizeLimit = HEAP_START_SIZE*1024;
+		shouldCollect = false;
+	}
+
+	LocalHeap::~LocalHeap() {
+		for(object::Obj* obj : objects) delete obj;
+		if(localHeap == this) localHeap = nullptr;
+	}
+
+	void* LocalHeap::alloc(uInt64 size) {
+		heapSize += size;
+		if (heapSize > heapSizeLimit) {
+			// Collection happens once the owner reaches a safepoint, same as with the shared heap
+			shouldCollect = true;
+			owner->pauseToken.store(true, std::memory_order_relaxed);
+		}
+		byte* block = nullptr;
+		try {
+			block = new byte[size];
+		}
+		catch (const std::bad_alloc& e) {
+			errorHandler::addSystemError(fmt::format("Failed allocation, tried to allocate {} bytes", size));
+		}
+		objects.insert(reinterpret_cast<object::Obj*>(block));
+		return block;
+	}
+
+	bool LocalHeap::owns(object::Obj* object) {
+		return objects.contains(object);
+	}
+
+	void LocalHeap::collect() {
+		owner->mark(&gc);
+		while (!markStack.empty()) {
+			object::Obj* ptr = markStack.back();
+			markStack.pop_back();
+			// Shared objects can't point back into this heap, so there is no need to trace through them
+			if (ptr->marked || !owns(ptr)) continue;
+			ptr->marked = true;
+			ptr->trace();
+		}
+
+		heapSize = 0;
+		std::erase_if(objects, [&](object::Obj* obj) {
+			if (!obj->marked) {
+				delete obj;
+				return true;
+			}
+			heapSize += obj->getSize();
+			obj->marked = false;
+			return false;
+		});
+		if (heapSize > heapSizeLimit) heapSizeLimit <<= 1;
+		shouldCollect = false;
+	}
+
+	void LocalHeap::markObj(object::Obj* object) {
 		markStack.push_back(object);
 	}
+
+	Value LocalHeap::promote(Value val) {
+		using namespace valueHelpers;
+		if (!isObj(val) || !owns(decodeObj(val))) return val;
+		SharedHeapScope scope;
+		// Maps objects in this heap to their copies, keeps cycles and shared references intact
+		ankerl::unordered_dense::map<object::Obj*, object::Obj*> copies;
+		vector<object::Obj*> toFix;
+		// First every reachable object gets a shallow copy, then the copies have their pointers redirected
+		auto copyOf = [&](object::Obj* obj) -> object::Obj* {
+			if (!owns(obj)) return obj;
+			auto it = copies.find(obj);
+			if (it != copies.end()) return it->second;
+			object::Obj* copy = nullptr;
+			switch (obj->type) {
+				case object::ObjType::STRING: copy = new object::ObjString(*static_cast<object::ObjString*>(obj)); break;
+				case object::ObjType::ARRAY: copy = new object::ObjArray(*static_cast<object::ObjArray*>(obj)); break;
+				case object::ObjType::CLOSURE: copy = new object::ObjClosure(*static_cast<object::ObjClosure*>(obj)); break;
+				case object::ObjType::UPVALUE: copy = new object::ObjUpval(*static_cast<object::ObjUpval*>(obj)); break;
+				case object::ObjType::INSTANCE: copy = new object::ObjInstance(*static_cast<object::ObjInstance*>(obj)); break;
+				case object::ObjType::BOUND_METHOD: copy = new object::ObjBoundMethod(*static_cast<object::ObjBoundMethod*>(obj)); break;
+				case object::ObjType::HASH_MAP: copy = new object::ObjHashMap(*static_cast<object::ObjHashMap*>(obj)); break;
+				case object::ObjType::RANGE: copy = new object::ObjRange(*static_cast<object::ObjRange*>(obj)); break;
+				// Functions, classes, natives, files, mutexes and futures are always allocated in the shared heap
+				default: return obj;
+			}
+			copy->marked = false;
+			copies[obj] = copy;
+			toFix.push_back(copy);
+			return copy;
+		};
+		auto fixVal = [&](Value& v) { if (isObj(v)) v = encodeObj(copyOf(decodeObj(v))); };
+		auto fixFields = [&](ankerl::unordered_dense::map<object::ObjString*, Value>& fields) {
+			ankerl::unordered_dense::map<object::ObjString*, Value> fixed;
+			for (auto& field : fields) {
+				Value v = field.second;
+				fixVal(v);
+				fixed.insert_or_assign(static_cast<object::ObjString*>(copyOf(field.first)), v);
+			}
+			fields = std::move(fixed);
+		};
+
+		Value res = encodeObj(copyOf(decodeObj(val)));
+		while (!toFix.empty()) {
+			object::Obj* obj = toFix.back();
+			toFix.pop_back();
+			switch (obj->type) {
+				case object::ObjType::ARRAY:
+					for (Value& v : static_cast<object::ObjArray*>(obj)->values) fixVal(v);
+					break;
+				case object::ObjType::CLOSURE:
+					for (auto& upval : static_cast<object::ObjClosure*>(obj)->upvals)
+						upval = static_cast<object::ObjUpval*>(copyOf(upval));
+					break;
+				case object::ObjType::UPVALUE: fixVal(static_cast<object::ObjUpval*>(obj)->val); break;
+				case object::ObjType::INSTANCE: fixFields(static_cast<object::ObjInstance*>(obj)->fields); break;
+				case object::ObjType::BOUND_METHOD: {
+					auto method = static_cast<object::ObjBoundMethod*>(obj);
+					fixVal(method->receiver);
+					method->method = copyOf(method->method);
+					break;
+				}
+				case object::ObjType::HASH_MAP: fixFields(static_cast<object::ObjHashMap*>(obj)->fields); break;
+				default: break;
+			}
+		}
+		return res;
+	}
+
+	void LocalHeap::clearMarks() {
+		for (object::Obj* obj : objects) obj->marked = false;
+	}
 }
@@ -2,10 +2,13 @@
 #include "../common.h"
 #include <mutex>
 #include <atomic>
+#include <array>
+#include <string_view>
 #include "../Includes/unorderedDense.h"
 
 namespace runtime {
 	class VM;
+	class Thread;
 }
 
 namespace compileCore {
@@ -20,6 +23,47 @@ namespace object {
 
 //Lisp style mark compact garbage collector with additional non moving allocations
 namespace memory {
+	// Lookup key for interned strings, hash is computed once and then stored in the ObjString
+	struct InternKey {
+		std::string_view str;
+		uInt64 hash;
+	};
+	// Interned strings are keyed by the string inside the ObjString itself, so the table doesn't keep a second copy
+	struct InternHash {
+		using is_transparent = void;
+		using is_avalanching = void;
+		uInt64 operator()(object::ObjString* str) const;
+		uInt64 operator()(const InternKey& key) const { return key.hash; }
+	};
+	struct InternEqual {
+		using is_transparent = void;
+		bool operator()(object::ObjString* a, object::ObjString* b) const { return a == b; }
+		bool operator()(const InternKey& key, object::ObjString* str) const;
+	};
+
+	// Every string literal and string created by natives goes through here from any thread, so the table is split
+	// into shards each guarded by its own mutex, threads only contend when their strings land in the same shard
+	class StringTable {
+	public:
+		// Returns the interned string equal to str, creating it in the shared heap if it doesn't exist yet
+		object::ObjString* intern(string& str);
+		// Returns the interned string equal to str, or nullptr if there isn't one
+		object::ObjString* find(std::string_view str);
+		// Interns a string that lives outside of the heap(eg. a constant loaded from a bytecode image), it stays marked
+		// so it's never swept, returns the already interned string if there is one with the same contents
+		object::ObjString* internStatic(object::ObjString* str);
+		// Removes strings that weren't marked, only called while all threads are paused
+		void sweep();
+	private:
+		// Power of 2, the shard is picked from the low bits of the hash while the sets use the high bits
+		static constexpr uInt64 shardCount = 64;
+		struct Shard {
+			std::mutex mtx;
+			ankerl::unordered_dense::set<object::ObjString*, InternHash, InternEqual> strings;
+		};
+		std::array<Shard, shardCount> shards;
+	};
+
 	class GarbageCollector {
 	public:
 		void* alloc(uInt64 size);
@@ -30,7 +74,7 @@ namespace memory {
 		std::atomic<bool> shouldCollect;
         std::atomic<uInt64> heapSize;
         runtime::VM* vm;
-        ankerl::unordered_dense::map<string, object::ObjString*> interned;
+        StringTable interned;
 	private:
 		std::mutex allocMtx;
 		uInt64 heapSizeLimit;
@@ -46,4 +90,41 @@ namespace memory {
 	};
 
 	extern GarbageCollector gc;
+
+	// Private heap of an isolated thread(started with async_isolated), collected by its owner without stopping other threads
+	// Objects in here must never be reachable from the shared heap, values leave it only by being promoted
+	class LocalHeap {
+	public:
+		LocalHeap(runtime::Thread* _owner);
+		// Frees every object that is still in the heap
+		~LocalHeap();
+		void* alloc(uInt64 size);
+		bool owns(object::Obj* object);
+		// Uses the stack of the owner thread as roots, must only be called by the owner at a safepoint
+		void collect();
+		void markObj(object::Obj* object);
+		// Deep copies everything reachable from val that lives in this heap into the shared heap
+		Value promote(Value val);
+		// Global collections trace through isolated threads and leave their objects marked
+		void clearMarks();
+		bool shouldCollect;
+	private:
+		runtime::Thread* owner;
+		uInt64 heapSize;
+		uInt64 heapSizeLimit;
+		ankerl::unordered_dense::set<object::Obj*> objects;
+		vector<object::Obj*> markStack;
+	};
+
+	// Heap that objects allocated on this OS thread go to, nullptr means the shared heap
+	extern thread_local LocalHeap* localHeap;
+
+	// Allocations made while this is alive go to the shared heap even on isolated threads
+	class SharedHeapScope {
+	public:
+		SharedHeapScope() { prev = localHeap; localHeap = nullptr; }
+		~SharedHeapScope() { localHeap = prev; }
+	private:
+		LocalHeap* prev;
+	};
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ using namespace valueHelpers;
 #pragma region ObjString
 ObjString::ObjString(string& _str) {
 	str = _str;
+    hash = 0;
     marked = false;
 	type = ObjType::STRING;
 }
@@ -68,12 +69,7 @@ string convertBackSlashToEscape(const std::string& input)
 
 ObjString* ObjString::createStr(string str){
     str = convertBackSlashToEscape(str);
-    auto it = memory::gc.interned.find(str);
-    if(it != memory::gc.interned.end()) return it->second;
-    auto newStr = new ObjString(str);
-    memory::gc.heapSize += str.size();
-    memory::gc.interned[str] = newStr;
-    return newStr;
+    return memory::gc.interned.intern(str);
 }
 #pragma endregion
 
@@ -83,6 +79,8 @@ ObjFunc::ObjFunc() {
 	upvalueCount = 0;
 	bytecodeOffset = 0;
 	constantsOffset = 0;
+	code = nullptr;
+	constants = nullptr;
 	type = ObjType::FUNC;
 	name = "";
     marked = false;
@@ -189,6 +187,7 @@ void ObjArray::trace() {
 	while (i < arrSize && temp < numOfHeapPtr) {
 		mark(values[i]);
 		if(isObj(values[i])) temp++;
+		i++;
 	}
 }
 
@@ -361,6 +360,7 @@ uInt64 ObjMutex::getSize() {
 ObjFuture::ObjFuture(runtime::Thread* t) {
 	thread = t;
     marked = false;
+	done = false;
 	val = encodeNil();
 	type = ObjType::FUTURE;
 }
@@ -369,7 +369,11 @@ ObjFuture::~ObjFuture() {
 }
 
 void ObjFuture::startParallelExecution() {
-	fut = std::async(std::launch::async, &runtime::Thread::executeBytecode, thread);
+	fut = std::async(std::launch::async, [t = thread] {
+		// Everything the thread allocates goes to its own heap if it's isolated
+		memory::localHeap = t->heap;
+		t->executeBytecode();
+	});
 }
 
 void ObjFuture::trace() {
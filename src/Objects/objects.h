@@ -42,7 +42,9 @@ namespace object {
 		virtual ~Obj() = default;
 
 		//this reroutes the new operator to take memory which the GC gives out
+		//isolated threads allocate into their own heap
 		void* operator new(size_t size) {
+			if(memory::localHeap) return memory::localHeap->alloc(size);
 			return memory::gc.alloc(size);
 		}
 	};
@@ -55,6 +57,8 @@ namespace object {
 	class ObjString : public Obj {
 	public:
 		string str;
+		// Only computed for interned strings, used by the intern table
+		uInt64 hash;
 
 		ObjString(string& _str);
 		~ObjString() {}
@@ -90,6 +94,9 @@ namespace object {
 	public:
 		uInt64 bytecodeOffset;
 		uInt64 constantsOffset;
+		// Resolved from the offsets by the VM on the first call, nullptr until then
+		const byte* code;
+		Value* constants;
 		string name;
 		// A function can have a maximum of 255 parameters
 		byte arity;
@@ -235,6 +242,8 @@ namespace object {
 		std::future<void> fut;
 		Value val;
 		runtime::Thread* thread;
+		// Set once the thread finishes, guarded by vm->pauseMtx
+		bool done;
 
 		ObjFuture(runtime::Thread* t);
 		~ObjFuture();
@@ -3,8 +3,6 @@
 #include "../moduleDefs.h"
 
 namespace AST {
-	using std::shared_ptr;
-
 	enum class ASTType {
 		ASSIGNMENT,
 		SET,
@@ -122,7 +120,8 @@ namespace AST {
 		virtual ~ASTNode() {};
 		virtual void accept(Visitor* vis) = 0;
 	};
-	using ASTNodePtr = shared_ptr<ASTNode>;
+	// Nodes are owned by the ASTArena of the module they belong to
+	using ASTNodePtr = ASTNode*;
 
 	class ASTDecl : public ASTNode {
 	public:
@@ -148,6 +147,17 @@ namespace AST {
         }
     };
 
+    // Filled in by typeInference, NONE means nothing has been inferred yet
+    enum class InferredType{
+        NONE,
+        NUMBER,
+        STRING,
+        BOOL,
+        NIL,
+        ARRAY,
+        UNKNOWN
+    };
+
 	#pragma region Expressions
 
 	class AssignmentExpr : public ASTNode {
@@ -172,6 +182,10 @@ namespace AST {
 		ASTNodePtr field;
 		Token accessor;
 		ASTNodePtr value;
+		// Set by loopOptimizer if the field is always a non negative integer
+		bool hasNonNegativeIndex = false;
+		// Set by loopOptimizer if the field is also always below the length of the array the loop condition checked
+		bool isInBounds = false;
 
 		SetExpr(ASTNodePtr _callee, ASTNodePtr _field, Token _accessor, ASTNodePtr _val) {
 			callee = _callee;
@@ -207,6 +221,8 @@ namespace AST {
 		Token op;
 		ASTNodePtr left;
 		ASTNodePtr right;
+		// Set if both operands are proven to have the same type, lets the compiler skip runtime type checks
+		InferredType operandType = InferredType::UNKNOWN;
 
 		BinaryExpr(ASTNodePtr _left, Token _op, ASTNodePtr _right) {
 			left = _left;
@@ -224,6 +240,7 @@ namespace AST {
 		Token op;
 		ASTNodePtr right;
 		bool isPrefix;
+		InferredType operandType = InferredType::UNKNOWN;
 
 		UnaryExpr(Token _op, ASTNodePtr _right, bool _isPrefix) {
 			op = _op;
@@ -266,10 +283,10 @@ namespace AST {
 
     class NewExpr : public ASTNode{
     public:
-        shared_ptr<CallExpr> call;
+        CallExpr* call;
         Token token;
 
-        NewExpr(shared_ptr<CallExpr> _call, Token _token) {
+        NewExpr(CallExpr* _call, Token _token) {
             call = _call;
             token = _token;
             type = ASTType::NEW;
@@ -285,6 +302,10 @@ namespace AST {
 		ASTNodePtr callee;
 		Token accessor;
 		ASTNodePtr field;
+		// Set by loopOptimizer if the field is always a non negative integer
+		bool hasNonNegativeIndex = false;
+		// Set by loopOptimizer if the field is also always below the length of the array the loop condition checked
+		bool isInBounds = false;
 
 		FieldAccessExpr(ASTNodePtr _callee, Token _accessor, ASTNodePtr _field) {
 			callee = _callee;
@@ -381,9 +402,9 @@ namespace AST {
 	public:
 		vector<ASTVar> args;
         int8_t arity;
-		shared_ptr<BlockStmt> body;
+		BlockStmt* body;
 
-		FuncLiteral(vector<ASTVar> _args, shared_ptr<BlockStmt> _body) {
+		FuncLiteral(vector<ASTVar> _args, BlockStmt* _body) {
 			args = _args;
 			arity = _args.size();
 			body = _body;
@@ -572,10 +593,10 @@ namespace AST {
 	class SwitchStmt : public ASTNode {
 	public:
 		ASTNodePtr expr;
-		vector<shared_ptr<CaseStmt>> cases;
+		vector<CaseStmt*> cases;
 		bool hasDefault;
 
-		SwitchStmt(ASTNodePtr _expr, vector<shared_ptr<CaseStmt>> _cases, bool _hasDefault) {
+		SwitchStmt(ASTNodePtr _expr, vector<CaseStmt*> _cases, bool _hasDefault) {
 			expr = _expr;
 			cases = _cases;
 			hasDefault = _hasDefault;
@@ -619,10 +640,10 @@ namespace AST {
 	public:
 		vector<ASTVar> args;
         int8_t arity;
-		shared_ptr<BlockStmt> body;
+		BlockStmt* body;
 		Token name;
 
-		FuncDecl(Token _name, vector<ASTVar> _args, shared_ptr<BlockStmt> _body) {
+		FuncDecl(Token _name, vector<ASTVar> _args, BlockStmt* _body) {
 			name = _name;
 			args = _args;
 			arity = _args.size();
@@ -653,9 +674,9 @@ namespace AST {
 
     struct ClassMethod{
         bool isPublic;
-        shared_ptr<FuncDecl> method;
+        FuncDecl* method;
 
-        ClassMethod(bool _isPublic, shared_ptr<FuncDecl> _method) : isPublic(_isPublic), method(_method) {}
+        ClassMethod(bool _isPublic, FuncDecl* _method) : isPublic(_isPublic), method(_method) {}
     };
 
     struct ClassField{
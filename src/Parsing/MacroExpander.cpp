@@ -1,5 +1,8 @@
 #include "MacroExpander.h"
+#include "../ErrorHandling/errorHandler.h"
 #include <algorithm>
+#include <set>
+#include <tuple>
 
 AST::MacroExpander::MacroExpander(Parser* _parser) {
     parser = _parser;
@@ -161,14 +164,308 @@ AST::Macro::Macro(Token _name, Parser *_parser) {
     parser = _parser;
 }
 
+namespace {
+    // Where a token is in its source file, argument tokens of macro invocations are told apart by their position
+    using SpanKey = std::tuple<File*, int, int, int>;
+
+    SpanKey spanKey(const Span& span) {
+        return std::make_tuple(span.sourceFile, span.line, span.column, span.length);
+    }
+
+    uInt64 hashArgs(const vector<Token>& args) {
+        uInt64 hash = 14695981039346656037ull;
+        for (const Token& token : args) {
+            hash ^= static_cast<uInt64>(token.type) * 31 + std::hash<std::string_view>()(token.getView());
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool sameArgs(const vector<Token>& a, const vector<Token>& b) {
+        if (a.size() != b.size()) return false;
+        for (int i = 0; i < a.size(); i++) {
+            if (!a[i].equals(b[i]) || a[i].isPartOfMacro != b[i].isPartOfMacro) return false;
+        }
+        return true;
+    }
+
+    // Deep copies an expanded AST into an arena, nodes that appear multiple times(expr meta variables used more than once)
+    // are copied once, so the copy has the same shape as the original
+    // Tokens that came from the arguments of the cached invocation are moved to the positions of the new arguments
+    class ExpansionCloner : public AST::Visitor {
+    public:
+        ExpansionCloner(ASTArena& _arena, std::map<SpanKey, Span> _remappedSpans)
+            : arena(_arena), remappedSpans(std::move(_remappedSpans)) {}
+
+        AST::ASTNodePtr clone(AST::ASTNodePtr node) {
+            if (!node) return nullptr;
+            auto it = cloned.find(node);
+            if (it != cloned.end()) return it->second;
+            node->accept(this);
+            return cloned[node];
+        }
+        template<typename T>
+        T* clone(T* node) { return static_cast<T*>(clone(static_cast<AST::ASTNodePtr>(node))); }
+
+        void visitAssignmentExpr(AST::AssignmentExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->name);
+            node->value = clone(expr->value);
+        }
+        void visitSetExpr(AST::SetExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->accessor);
+            node->callee = clone(expr->callee);
+            node->field = clone(expr->field);
+            node->value = clone(expr->value);
+        }
+        void visitConditionalExpr(AST::ConditionalExpr* expr) override {
+            auto node = copy(expr);
+            node->condition = clone(expr->condition);
+            node->mhs = clone(expr->mhs);
+            node->rhs = clone(expr->rhs);
+        }
+        void visitRangeExpr(AST::RangeExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->token);
+            node->start = clone(expr->start);
+            node->end = clone(expr->end);
+        }
+        void visitBinaryExpr(AST::BinaryExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->op);
+            node->left = clone(expr->left);
+            node->right = clone(expr->right);
+        }
+        void visitUnaryExpr(AST::UnaryExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->op);
+            node->right = clone(expr->right);
+        }
+        void visitCallExpr(AST::CallExpr* expr) override {
+            auto node = copy(expr);
+            node->callee = clone(expr->callee);
+            cloneAll(node->args);
+        }
+        void visitNewExpr(AST::NewExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->token);
+            node->call = clone(expr->call);
+        }
+        void visitFieldAccessExpr(AST::FieldAccessExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->accessor);
+            node->callee = clone(expr->callee);
+            node->field = clone(expr->field);
+        }
+        void visitAsyncExpr(AST::AsyncExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->token);
+            node->callee = clone(expr->callee);
+            cloneAll(node->args);
+        }
+        void visitAwaitExpr(AST::AwaitExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->token);
+            node->expr = clone(expr->expr);
+        }
+        void visitArrayLiteralExpr(AST::ArrayLiteralExpr* expr) override {
+            auto node = copy(expr);
+            cloneAll(node->members);
+        }
+        void visitStructLiteralExpr(AST::StructLiteral* expr) override {
+            auto node = copy(expr);
+            for (AST::StructEntry& entry : node->fields) {
+                remap(entry.name);
+                entry.expr = clone(entry.expr);
+            }
+        }
+        void visitLiteralExpr(AST::LiteralExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->token);
+        }
+        void visitFuncLiteral(AST::FuncLiteral* expr) override {
+            auto node = copy(expr);
+            for (AST::ASTVar& arg : node->args) remap(arg.name);
+            node->body = clone(expr->body);
+        }
+        void visitSuperExpr(AST::SuperExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->methodName);
+        }
+        void visitModuleAccessExpr(AST::ModuleAccessExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->moduleName);
+            remap(node->ident);
+        }
+        void visitMacroExpr(AST::MacroExpr* expr) override {
+            auto node = copy(expr);
+            remap(node->macroName);
+            for (Token& token : node->args) remap(token);
+        }
+
+        void visitVarDecl(AST::VarDecl* decl) override {
+            auto node = copy(decl);
+            remap(node->var.name);
+            node->value = clone(decl->value);
+        }
+        void visitFuncDecl(AST::FuncDecl* decl) override {
+            auto node = copy(decl);
+            remap(node->name);
+            for (AST::ASTVar& arg : node->args) remap(arg.name);
+            node->body = clone(decl->body);
+        }
+        void visitClassDecl(AST::ClassDecl* decl) override {
+            auto node = copy(decl);
+            remap(node->name);
+            node->inheritedClass = clone(decl->inheritedClass);
+            for (AST::ClassMethod& method : node->methods) method.method = clone(method.method);
+            for (AST::ClassField& field : node->fields) remap(field.field);
+        }
+
+        void visitExprStmt(AST::ExprStmt* stmt) override {
+            auto node = copy(stmt);
+            node->expr = clone(stmt->expr);
+        }
+        void visitBlockStmt(AST::BlockStmt* stmt) override {
+            auto node = copy(stmt);
+            cloneAll(node->statements);
+        }
+        void visitIfStmt(AST::IfStmt* stmt) override {
+            auto node = copy(stmt);
+            node->condition = clone(stmt->condition);
+            node->thenBranch = clone(stmt->thenBranch);
+            node->elseBranch = clone(stmt->elseBranch);
+        }
+        void visitWhileStmt(AST::WhileStmt* stmt) override {
+            auto node = copy(stmt);
+            node->condition = clone(stmt->condition);
+            node->body = clone(stmt->body);
+        }
+        void visitForStmt(AST::ForStmt* stmt) override {
+            auto node = copy(stmt);
+            node->init = clone(stmt->init);
+            node->condition = clone(stmt->condition);
+            node->increment = clone(stmt->increment);
+            node->body = clone(stmt->body);
+        }
+        void visitBreakStmt(AST::BreakStmt* stmt) override {
+            auto node = copy(stmt);
+            remap(node->token);
+        }
+        void visitContinueStmt(AST::ContinueStmt* stmt) override {
+            auto node = copy(stmt);
+            remap(node->token);
+        }
+        void visitSwitchStmt(AST::SwitchStmt* stmt) override {
+            auto node = copy(stmt);
+            node->expr = clone(stmt->expr);
+            for (AST::CaseStmt*& _case : node->cases) _case = clone(_case);
+        }
+        void visitCaseStmt(AST::CaseStmt* _case) override {
+            auto node = copy(_case);
+            remap(node->caseType);
+            for (Token& constant : node->constants) remap(constant);
+            cloneAll(node->stmts);
+        }
+        void visitAdvanceStmt(AST::AdvanceStmt* stmt) override {
+            auto node = copy(stmt);
+            remap(node->token);
+        }
+        void visitReturnStmt(AST::ReturnStmt* stmt) override {
+            auto node = copy(stmt);
+            remap(node->keyword);
+            node->expr = clone(stmt->expr);
+        }
+    private:
+        ASTArena& arena;
+        std::map<SpanKey, Span> remappedSpans;
+        // Original node -> its copy
+        std::unordered_map<AST::ASTNodePtr, AST::ASTNodePtr> cloned;
+
+        // Shallow copy, children are still the ones of the original node until they're cloned
+        template<typename T>
+        T* copy(T* node) {
+            T* copied = arena.make<T>(*node);
+            cloned[node] = copied;
+            return copied;
+        }
+        void cloneAll(vector<AST::ASTNodePtr>& nodes) {
+            for (AST::ASTNodePtr& node : nodes) node = clone(node);
+        }
+        void remap(Token& token) {
+            if (remappedSpans.empty()) return;
+            auto it = remappedSpans.find(spanKey(token.str));
+            if (it != remappedSpans.end()) token.str = it->second;
+        }
+    };
+}
+
 AST::ASTNodePtr AST::Macro::expand(vector<Token> &args, const Token &callerToken) {
+    uInt64 hash = hashArgs(args);
+    // Copying an expansion into the cache costs about as much as expanding it, so arguments are only cached
+    // once they're seen a second time
+    auto it = expansions.find(hash);
+    if (it == expansions.end()) {
+        expansions[hash];
+        return expandUncached(args, callerToken);
+    }
+    if (!isCacheable(args)) return expandUncached(args, callerToken);
+    for (CachedExpansion& cached : it->second) {
+        if (!sameArgs(cached.args, args)) continue;
+        std::map<SpanKey, Span> remappedSpans;
+        for (int i = 0; i < args.size(); i++) remappedSpans[spanKey(cached.args[i].str)] = args[i].str;
+        return ExpansionCloner(parser->parsedUnit->arena, remappedSpans).clone(cached.expansion);
+    }
+
+    // Only expansions that didn't report any errors are cached, errors have to be reported for every invocation
+    errorHandler::ErrorBuffer errors;
+    errorHandler::ErrorBuffer* previous = errorHandler::bufferCompileErrors(&errors);
+    ASTNodePtr expansion;
+    try {
+        expansion = expandUncached(args, callerToken);
+    }
+    catch (ParserException& e) {
+        errorHandler::bufferCompileErrors(previous);
+        errorHandler::flushCompileErrors(errors);
+        throw e;
+    }
+    errorHandler::bufferCompileErrors(previous);
+    if (!errors.empty()) {
+        errorHandler::flushCompileErrors(errors);
+        return expansion;
+    }
+    // The expansion given to the caller gets modified(nested macros are expanded in place), so a copy is cached
+    expansions[hash].push_back(CachedExpansion{args, ExpansionCloner(expansionArena, {}).clone(expansion)});
+    return expansion;
+}
+
+// Tokens of the expansion that came from the arguments are found by their position, which only works if
+// no two argument tokens share a position, and none of them share a position with a token of a transcriber
+// (arguments of a macro invoked from its own transcriber)
+bool AST::Macro::isCacheable(vector<Token>& args) {
+    std::set<SpanKey> positions;
+    for (Token& token : args) {
+        if (token.isSynthetic || token.type == TokenType::ERROR || token.type == TokenType::NONE) return false;
+        if (!positions.insert(spanKey(token.str)).second) return false;
+    }
+    for (vector<Token>& transcriber : transcribers) {
+        for (Token& token : transcriber) {
+            if (positions.contains(spanKey(token.str))) return false;
+        }
+    }
+    return true;
+}
+
+AST::ASTNodePtr AST::Macro::expandUncached(vector<Token> &args, const Token &callerToken) {
+    ExprProbes probes;
     // Attempt to match every macro matcher to arguments ...
     for (int i = 0; i < matchers.size(); i++){
         parser->exprMetaVars.clear();
         parser->ttMetaVars.clear();
 
         // Try to interpret arguments into meta variables
-        if (!matchers[i].interpret(args)) { continue; }
+        if (!matchers[i].interpret(args, probes)) { continue; }
 
         // Expand all loops and substitute all token tree meta variables
         vector<Token> expansion = expandLoops(transcribers[i], 0, transcribers[i].size() - 1, {});
@@ -200,7 +497,7 @@ AST::ASTNodePtr AST::Macro::expand(vector<Token> &args, const Token &callerToken
         if (!isStmt){
             return stmts[0];
         } else {
-            return make_shared<AST::BlockStmt>(stmts);
+            return parser->makeNode<AST::BlockStmt>(stmts);
         }
     }
 
@@ -311,37 +608,35 @@ vector<Token> AST::Macro::expandLoops(vector<Token>& readFrom, int begin, int en
 }
 
 
-bool AST::MatchPattern::interpret(vector<Token> &args) const {
+bool AST::MatchPattern::interpret(vector<Token> &args, ExprProbes& probes) const {
     parser->currentContainer = &args;
     parser->parseMode = ParseMode::Standard;
 
-    auto isAtEnd = [&](int i) { return i >= args.size(); };
-
-    // Indicates possible transitions which consume a valid expression
-    vector<vector<int>> exprConsumeTransitions(args.size(), vector<int>(args.size() + 1));
-    parser->parseMode = ParseMode::Matcher;
-    for (int i = 0; i < args.size(); i++){
-        vector<Token> exprContainer;
-        parser->currentContainer = &exprContainer;
-        for (int len = 1; i + len <= args.size(); len++){
-            parser->currentPtr = 0;
-            exprContainer.push_back(args[i + len - 1]);
-            // Append a semicolon to terminate the expression
-            exprContainer.push_back(Token());
-            exprContainer.back().type = TokenType::SEMICOLON;
-            try {
-                parser->expression();
-                // We can fully read the expression
-                if (parser->currentPtr == len){
-                    exprConsumeTransitions[i].push_back(i + len);
-                }
+    auto isBracket = [](TokenType type, bool opening) {
+        if (opening) return type == TokenType::LEFT_PAREN || type == TokenType::LEFT_BRACE || type == TokenType::LEFT_BRACKET;
+        return type == TokenType::RIGHT_PAREN || type == TokenType::RIGHT_BRACE || type == TokenType::RIGHT_BRACKET;
+    };
+    // Possible ends of an expression that starts at i and is matched to the meta variable at j
+    // Only computed for positions the matcher actually reaches
+    auto exprConsumeTransitions = [&](int i, int j) {
+        vector<int> ends;
+        int depth = 0;
+        for (int end = i + 1; end <= args.size(); end++) {
+            // An expression never contains unbalanced brackets, and can't continue past a closing bracket it didn't open
+            TokenType type = args[end - 1].type;
+            if (isBracket(type, true)) depth++;
+            else if (isBracket(type, false) && --depth < 0) break;
+            if (depth != 0) continue;
+
+            if (end < args.size() && !exprFollowedByMetaVar[j]) {
+                bool canContinue = false;
+                for (int follower : exprFollowers[j]) canContinue |= pattern[follower].equals(args[end]);
+                if (!canContinue) continue;
             }
-            catch (ParserException& e) {}
-            // Remove the appended semicolon
-            exprContainer.pop_back();
+            if (consumesExpr(args, i, end - i, probes)) ends.push_back(end);
         }
-    }
-    parser->parseMode = ParseMode::Standard;
+        return ends;
+    };
 
     vector<vector<int>> dp(args.size() + 1, vector<int>(pattern.size() + 1));
     vector<vector<Transition>> backTransitions(args.size() + 1, vector<Transition>(pattern.size() + 1));
@@ -399,7 +694,7 @@ bool AST::MatchPattern::interpret(vector<Token> &args) const {
             }
                 // Expression
             else {
-                for (int n_i : exprConsumeTransitions[i]){
+                for (int n_i : exprConsumeTransitions(i, j)){
                     transition(n_i, j + 4, TransitionType::ConsumeExpr);
                 }
             }
@@ -475,6 +770,79 @@ bool AST::MatchPattern::interpret(vector<Token> &args) const {
     return true;
 }
 
+bool AST::MatchPattern::consumesExpr(vector<Token>& args, int i, int len, ExprProbes& probes) const {
+    uInt64 key = (static_cast<uInt64>(i) << 32) | len;
+    auto it = probes.find(key);
+    if (it != probes.end()) return it->second;
+
+    vector<Token> exprContainer(args.begin() + i, args.begin() + i + len);
+    // Append a semicolon to terminate the expression
+    exprContainer.push_back(Token());
+    exprContainer.back().type = TokenType::SEMICOLON;
+    parser->currentContainer = &exprContainer;
+    parser->currentPtr = 0;
+    parser->parseMode = ParseMode::Matcher;
+    bool consumed = false;
+    try {
+        parser->expression();
+        // We can fully read the expression
+        consumed = parser->currentPtr == len;
+    }
+    catch (ParserException& e) {}
+    parser->parseMode = ParseMode::Standard;
+    parser->currentContainer = &args;
+    probes[key] = consumed;
+    return consumed;
+}
+
+vector<int> AST::MatchPattern::epsilonClosure(int start) const {
+    vector<int> reachable;
+    vector<bool> visited(pattern.size() + 1);
+    vector<int> stack = {start};
+    while (!stack.empty()) {
+        int j = stack.back();
+        stack.pop_back();
+        if (visited[j]) continue;
+        visited[j] = true;
+        if (j == pattern.size() || tokenTypes[j] == MatcherTokenType::Neutral) {
+            reachable.push_back(j);
+            continue;
+        }
+        // Same transitions as the ones interpret takes without consuming arguments
+        switch (tokenTypes[j]) {
+            case MatcherTokenType::Ignore:
+            case MatcherTokenType::LoopBegin:
+                stack.push_back(j + 1);
+                break;
+            case MatcherTokenType::Iterate:
+                stack.push_back(loopJumps[j]);
+                break;
+            case MatcherTokenType::Skippable:
+            case MatcherTokenType::LoopEnd:
+                stack.push_back(loopJumps[j]);
+                stack.push_back(j + 1);
+                break;
+            default:
+                break;
+        }
+    }
+    return reachable;
+}
+
+// Done once per matcher so that interpret only tries to parse expressions which can be followed by the rest of the pattern
+void AST::MatchPattern::compileFollowers() {
+    exprFollowers = vector<vector<int>>(pattern.size());
+    exprFollowedByMetaVar = vector<bool>(pattern.size(), false);
+    for (int j = 0; j + 3 < pattern.size(); j++) {
+        if (tokenTypes[j] != MatcherTokenType::Neutral || pattern[j].type != TokenType::DOLLAR || pattern[j + 3].type != TokenType::EXPR) continue;
+        for (int follower : epsilonClosure(j + 4)) {
+            if (follower == pattern.size()) continue;
+            if (pattern[follower].type == TokenType::DOLLAR) exprFollowedByMetaVar[j] = true;
+            else exprFollowers[j].push_back(follower);
+        }
+    }
+}
+
 // Checks if matcher pattern contains properly written loops and meta variables.
 // Loops are also precalculated here.
 void AST::MatchPattern::processPattern() {
@@ -58,6 +58,10 @@ namespace AST {
         }
     };
 
+    // Whether args[i, i + len) of a macro invocation is a single expression, keyed by i << 32 | len
+    // Shared by every matcher of a macro since they're all tried against the same arguments
+    using ExprProbes = std::unordered_map<uInt64, bool>;
+
     struct TTMetaVar {
         std::map<vector<int>, vector<Token>> values;
         int loopDepth = 0;
@@ -71,9 +75,18 @@ namespace AST {
         vector<int> topoSort; // Order in which to process pattern indices
         vector<int> loopJumps; // Marks where to jump when encountering macro loops
         vector<MatcherTokenType> tokenTypes; // Marks types of tokens in the matcher pattern
+        // For every expr meta variable, positions of the literal tokens that can come right after the expression
+        // Expressions are only parsed if they end right before one of these(or at the end of the arguments)
+        vector<vector<int>> exprFollowers;
+        // Expr meta variables that can be followed by another meta variable, these expressions can end anywhere
+        vector<bool> exprFollowedByMetaVar;
         Parser* parser;
 
         void processPattern();
+        void compileFollowers();
+        // Token consuming positions(or the end of the pattern) reachable from j without consuming anything
+        vector<int> epsilonClosure(int j) const;
+        bool consumesExpr(vector<Token>& args, int i, int len, ExprProbes& probes) const;
 
     public:
         MatchPattern(vector<Token> _pattern, Parser* _parser) {
@@ -82,16 +95,31 @@ namespace AST {
             tokenTypes = vector<MatcherTokenType>(pattern.size(), MatcherTokenType::Neutral);
             loopJumps = vector<int>(pattern.size(), -1);
             processPattern();
+            compileFollowers();
         }
 
-        bool interpret(vector<Token>& args) const;
+        bool interpret(vector<Token>& args, ExprProbes& probes) const;
 
         vector<Token> getPattern() { return pattern; }
     };
 
+    // AST a macro expanded to, along with the arguments it was expanded from
+    struct CachedExpansion {
+        vector<Token> args;
+        ASTNodePtr expansion;
+    };
+
     class Macro {
     private:
         Parser* parser;
+        // Invocations with the same arguments expand to the same AST(up to the positions of argument tokens),
+        // keyed by a hash of the argument tokens, a hash without expansions has only been seen once
+        std::unordered_map<uInt64, vector<CachedExpansion>> expansions;
+        // Owns the cached ASTs, every invocation gets its own copy since later passes modify the AST they're given
+        ASTArena expansionArena;
+
+        bool isCacheable(vector<Token>& args);
+        ASTNodePtr expandUncached(vector<Token>& args, const Token& callerToken);
     public:
         Token name;
         vector<MatchPattern> matchers;
@@ -3,8 +3,9 @@
 #include "../DebugPrinting/ASTPrinter.h"
 #include "../Includes/fmt/format.h"
 #include "../SemanticAnalysis/semanticAnalyzer.h"
+#include <thread>
+#include <atomic>
 
-using std::make_shared;
 using namespace AST;
 
 // Have to define this in the AST namespace because parselets are c++ friend classes
@@ -20,26 +21,26 @@ namespace AST {
             case TokenType::AWAIT: {
                 // Syntax is await <expr>
                 ASTNodePtr expr = parser->expression();
-                return make_shared<AwaitExpr>(token, expr);
+                return parser->makeNode<AwaitExpr>(token, expr);
             }
             case TokenType::DOUBLE_DOT:{
-                if(!parser->prefixParselets.contains(parser->peek().type)) return make_shared<RangeExpr>(token, nullptr, nullptr, false);
+                if(!parser->prefixParselets.contains(parser->peek().type)) return parser->makeNode<RangeExpr>(token, nullptr, nullptr, false);
                 auto expr = parser->expression(+Precedence::RANGE);
-                return make_shared<RangeExpr>(token, nullptr, expr, false);
+                return parser->makeNode<RangeExpr>(token, nullptr, expr, false);
             }
             case TokenType::DOUBLE_DOT_EQUAL:{
                 auto expr = parser->expression(+Precedence::RANGE);
-                return make_shared<RangeExpr>(token, nullptr, expr, true);
+                return parser->makeNode<RangeExpr>(token, nullptr, expr, true);
             }
             case TokenType::ASYNC: {
                 ASTNodePtr expr = parser->expression();
                 if (expr->type != ASTType::CALL) throw parser->error(token, "Expected a call after 'async'.");
-                auto call = std::static_pointer_cast<CallExpr>(expr);
-                return make_shared<AsyncExpr>(token, call->callee, call->args);
+                auto call = static_cast<CallExpr*>(expr);
+                return parser->makeNode<AsyncExpr>(token, call->callee, call->args);
             }
             default: {
                 ASTNodePtr expr = parser->expression(parser->prefixPrecLevel(token.type));
-                return make_shared<UnaryExpr>(token, expr, true);
+                return parser->makeNode<UnaryExpr>(token, expr, true);
             }
         }
     }
@@ -50,7 +51,7 @@ namespace AST {
             case TokenType::SUPER: {
                 parser->consume(TokenType::DOT, "Expected '.' after super.");
                 Token ident = parser->consume(TokenType::IDENTIFIER, "Expect superclass method name.");
-                return make_shared<SuperExpr>(ident);
+                return parser->makeNode<SuperExpr>(ident);
             }
             case TokenType::LEFT_PAREN: {
                 // Grouping can contain an expr of any precedence
@@ -67,7 +68,7 @@ namespace AST {
                     } while (parser->match(TokenType::COMMA));
                 }
                 parser->consume(TokenType::RIGHT_BRACKET, "Expect ']' at the end of an array literal.");
-                return make_shared<ArrayLiteralExpr>(members);
+                return parser->makeNode<ArrayLiteralExpr>(members);
             }
                 // Struct literal
             case TokenType::LEFT_BRACE: {
@@ -82,7 +83,7 @@ namespace AST {
                     } while (parser->match(TokenType::COMMA));
                 }
                 parser->consume(TokenType::RIGHT_BRACE, "Expect '}' after struct literal.");
-                return make_shared<StructLiteral>(entries);
+                return parser->makeNode<StructLiteral>(entries);
             }
                 // Function literal
             case TokenType::FN: {
@@ -106,67 +107,67 @@ namespace AST {
                 }
                 parser->consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments");
                 parser->consume(TokenType::LEFT_BRACE, "Expect '{' after arguments.");
-                shared_ptr<BlockStmt> body = parser->blockStmt();
+                BlockStmt* body = parser->blockStmt();
 
                 parser->loopDepth = tempLoopDepth;
                 parser->switchDepth = tempSwitchDepth;
-                return make_shared<FuncLiteral>(args, body);
+                return parser->makeNode<FuncLiteral>(args, body);
             }
             case TokenType::NEW:{
                 // new keyword is followed by a call to the class that is being instantiated, class must be an identifier
                 // or module access to identifier
                 auto call = parser->expression(+Precedence::CALL - 1);
                 if(call->type != ASTType::CALL) throw parser->error(token, "Expected a call to class.");
-                auto castCall = std::static_pointer_cast<CallExpr>(call);
+                auto castCall = static_cast<CallExpr*>(call);
                 auto type = castCall->callee->type;
                 if(!(type == AST::ASTType::LITERAL || type == AST::ASTType::MODULE_ACCESS)) {
                     throw parser->error(token, "Expected a class identifier or module access to class identifier.");
                 }
-                return make_shared<NewExpr>(castCall, token);
+                return parser->makeNode<NewExpr>(castCall, token);
             }
                 //number, string, boolean or nil
             default:
-                return make_shared<LiteralExpr>(token);
+                return parser->makeNode<LiteralExpr>(token);
         }
     }
 
     // Parses =, +=, -=, *=, /=, %=, ^=, |=, &=
-    static ASTNodePtr parseAssign(ASTNodePtr left, Token op, ASTNodePtr right) {
+    static ASTNodePtr parseAssign(Parser* parser, ASTNodePtr left, Token op, ASTNodePtr right) {
         // No token other than the ones listed here will ever be passed to parseAssign
         switch (op.type) {
             case TokenType::EQUAL: {
                 break;
             }
             case TokenType::PLUS_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::PLUS, "+"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::PLUS, "+"), right);
                 break;
             }
             case TokenType::MINUS_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::MINUS, "-"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::MINUS, "-"), right);
                 break;
             }
             case TokenType::SLASH_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::SLASH, "/"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::SLASH, "/"), right);
                 break;
             }
             case TokenType::STAR_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::STAR, "*"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::STAR, "*"), right);
                 break;
             }
             case TokenType::BITWISE_XOR_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::BITWISE_XOR, "^"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::BITWISE_XOR, "^"), right);
                 break;
             }
             case TokenType::BITWISE_AND_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::BITWISE_AND, "&"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::BITWISE_AND, "&"), right);
                 break;
             }
             case TokenType::BITWISE_OR_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::BITWISE_OR, "|"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::BITWISE_OR, "|"), right);
                 break;
             }
             case TokenType::PERCENTAGE_EQUAL: {
-                right = make_shared<BinaryExpr>(left, Token(TokenType::PERCENTAGE, "%"), right);
+                right = parser->makeNode<BinaryExpr>(left, Token(TokenType::PERCENTAGE, "%"), right);
                 break;
             }
         }
@@ -177,17 +178,17 @@ namespace AST {
         // Precedence level -1 makes assignment right to left associative since parser->expression call won't stop when it hits '=' token
         // E.g. a = b = 2; gets parsed as a = (b = 2);
         auto rhs = parser->expression(parser->infixPrecLevel(token.type) - 1);
-        rhs = parseAssign(left, token, rhs);
+        rhs = parseAssign(parser, left, token, rhs);
         // Assignment can be either variable assignment or set expression
         if(left->type == ASTType::LITERAL){
             left->accept(parser->probe);
             Token temp = parser->probe->getProbedToken();
             if (temp.type != TokenType::IDENTIFIER) throw parser->error(token, "Left side is not assignable");
-            return make_shared<AssignmentExpr>(temp, rhs);
+            return parser->makeNode<AssignmentExpr>(temp, rhs);
         }
         // Set expr, e.g. a.b = 3;
-        auto fieldAccess = std::static_pointer_cast<FieldAccessExpr>(left);
-        return make_shared<SetExpr>(fieldAccess->callee, fieldAccess->field, fieldAccess->accessor, rhs);
+        auto fieldAccess = static_cast<FieldAccessExpr*>(left);
+        return parser->makeNode<SetExpr>(fieldAccess->callee, fieldAccess->field, fieldAccess->accessor, rhs);
     }
 
     //?: operator
@@ -197,7 +198,7 @@ namespace AST {
         //Makes conditional right to left associative
         // a ? b : c ? d : e gets parsed as a ? b : (c ? d : e)
         ASTNodePtr rhs = parser->expression(+Precedence::CONDITIONAL - 1);
-        return make_shared<ConditionalExpr>(left, mhs, rhs);
+        return parser->makeNode<ConditionalExpr>(left, mhs, rhs);
     }
 
     // Binary ops, module access(::) and macro invocation(!)
@@ -216,7 +217,7 @@ namespace AST {
                 Token lhs = parser->probe->getProbedToken();
                 if(lhs.type != TokenType::IDENTIFIER) throw parser->error(lhs, "Expected identifier for module name.");
                 Token ident = parser->consume(TokenType::IDENTIFIER, "Expected variable name.");
-                return make_shared<ModuleAccessExpr>(lhs, ident);
+                return parser->makeNode<ModuleAccessExpr>(lhs, ident);
             }
             case TokenType::BANG:{
                 if(left->type != ASTType::LITERAL) throw parser->error(token, "Expected macro name to be an identifier.");
@@ -228,36 +229,36 @@ namespace AST {
                 if (!parser->macros.contains(macroName.getLexeme())) {
                     throw parser->error(macroName, "Invoked macro isn't defined");
                 }
-                return make_shared<MacroExpr>(macroName, parser->readTokenTree());
+                return parser->makeNode<MacroExpr>(macroName, parser->readTokenTree());
             }
             case TokenType::INSTANCEOF:{
                 auto right = parser->expression(parser->infixPrecLevel(token.type));
                 if(!(right->type == ASTType::LITERAL || right->type == ASTType::MODULE_ACCESS)){
                     throw parser->error(token, "Right side of the 'instanceof' operator can only be an identifier.");
                 }
-                return make_shared<BinaryExpr>(left, token, right);
+                return parser->makeNode<BinaryExpr>(left, token, right);
             }
             default:{
                 ASTNodePtr right = parser->expression(parser->infixPrecLevel(token.type));
-                if(!isComparisonOp(token)) return make_shared<BinaryExpr>(left, token, right);
+                if(!isComparisonOp(token)) return parser->makeNode<BinaryExpr>(left, token, right);
 
                 // Chaining comparison ops is forbidden, here lhs is checked against op of this binary expr,
                 // After parsing rhs, rhs is compared to op of this binary expr
                 if(left->type == ASTType::BINARY){
-                    auto op = std::static_pointer_cast<BinaryExpr>(left)->op;
+                    auto op = static_cast<BinaryExpr*>(left)->op;
                     if(isComparisonOp(op)){
                         parser->error(op, "Cannot chain comparison operators.");
                         parser->error(token, "Second comparison operator here.");
                     }
                 }
                 if(right->type == ASTType::BINARY){
-                    auto op = std::static_pointer_cast<BinaryExpr>(right)->op;
+                    auto op = static_cast<BinaryExpr*>(right)->op;
                     if(isComparisonOp(op)){
                         parser->error(token, "Second comparison operator here.");
                         parser->error(op, "Cannot chain comparison operators.");
                     }
                 }
-                return make_shared<BinaryExpr>(left, token, right);
+                return parser->makeNode<BinaryExpr>(left, token, right);
             }
         }
     }
@@ -268,18 +269,18 @@ namespace AST {
             case TokenType::DOUBLE_DOT_EQUAL:{
                 if(+Precedence::RANGE < parser->prefixPrecLevel(parser->peek().type)){
                     auto expr = parser->expression(parser->infixPrecLevel(token.type));
-                    return make_shared<RangeExpr>(token, left, expr, true);
+                    return parser->makeNode<RangeExpr>(token, left, expr, true);
                 }
                 throw parser->error(token, "End inclusive range operator used without end of range.");
             }
             case TokenType::DOUBLE_DOT:{
                 if(+Precedence::RANGE < parser->prefixPrecLevel(parser->peek().type)){
                     auto expr = parser->expression(parser->infixPrecLevel(token.type));
-                    return make_shared<RangeExpr>(token, left, expr, false);
+                    return parser->makeNode<RangeExpr>(token, left, expr, false);
                 }
-                return make_shared<RangeExpr>(token, left, nullptr, false);
+                return parser->makeNode<RangeExpr>(token, left, nullptr, false);
             }
-            default: return make_shared<UnaryExpr>(token, left, false);
+            default: return parser->makeNode<UnaryExpr>(token, left, false);
         }
     }
 
@@ -291,7 +292,7 @@ namespace AST {
             } while (parser->match(TokenType::COMMA));
         }
         parser->consume(TokenType::RIGHT_PAREN, "Expect ')' after call expression.");
-        return make_shared<CallExpr>(left, args);
+        return parser->makeNode<CallExpr>(left, args);
     }
 
     ASTNodePtr parseFieldAccess(Parser* parser, ASTNodePtr left, Token token){
@@ -302,9 +303,9 @@ namespace AST {
         }
         else if (token.type == TokenType::DOT) {// Object access
             Token fieldName = parser->consume(TokenType::IDENTIFIER, "Expected a field identifier.");
-            field = make_shared<LiteralExpr>(fieldName);
+            field = parser->makeNode<LiteralExpr>(fieldName);
         }
-        return make_shared<FieldAccessExpr>(left, token, field);
+        return parser->makeNode<FieldAccessExpr>(left, token, field);
     }
 }
 
@@ -406,78 +407,110 @@ Parser::Parser() {
 #pragma endregion
 }
 
+// Conservative, any identifier followed by '!' is treated as a macro invocation
+bool Parser::needsMacros(CSLModule* unit) {
+    vector<Token>& tokens = unit->tokens;
+    for (int i = 0; i < tokens.size(); i++) {
+        if (tokens[i].type == TokenType::ADDMACRO) return true;
+        if (tokens[i].type == TokenType::BANG && i > 0 && tokens[i - 1].type == TokenType::IDENTIFIER) return true;
+    }
+    return false;
+}
+
 void Parser::parse(vector<CSLModule*>& modules) {
+    // Macros are visible to every module parsed after the one defining them, so modules that define or invoke macros
+    // are parsed in order on this thread, while other modules are parsed in parallel on their own parsers
+    // Errors are buffered per module and reported in module order once everything is parsed
+    vector<errorHandler::ErrorBuffer> errors(modules.size());
+    vector<int> ordered;
+    vector<int> independent;
+    for (int i = 0; i < modules.size(); i++) {
 #ifdef AST_DEBUG
-    ASTPrinter* astPrinter = new ASTPrinter;
-#endif
-    // Modules are already sorted using topsort
-    for (CSLModule* unit : modules) {
-        parsedUnit = unit;
-
-        // Parse tokenized source into AST
-        loopDepth = 0;
-        switchDepth = 0;
-        currentContainer = &parsedUnit->tokens;
-        currentPtr = 0;
-        while (!isAtEnd()) {
-            try {
-                if (match(TokenType::ADDMACRO)) {
-                    defineMacro();
-                    continue;
-                }
-                unit->stmts.push_back(topLevelDeclaration());
-#ifdef AST_DEBUG
-                //prints statement
-				unit->stmts[unit->stmts.size() - 1]->accept(astPrinter);
+        // Keeps the printed ASTs in order
+        ordered.push_back(i);
+#else
+        (needsMacros(modules[i]) ? ordered : independent).push_back(i);
 #endif
-            }
-            catch (ParserException& e) {
-                sync();
-            }
+    }
+
+    std::atomic<int> next = 0;
+    auto parseIndependent = [&](Parser& parser) {
+        for (int i = next++; i < independent.size(); i = next++) {
+            errorHandler::bufferCompileErrors(&errors[independent[i]]);
+            parser.parseModule(modules[independent[i]]);
+            parser.expandMacros();
         }
+        errorHandler::bufferCompileErrors(nullptr);
+    };
+    // This thread takes part once it's done with the ordered modules
+    uInt threadCount = std::min<uInt>(std::max(1u, std::thread::hardware_concurrency()) - 1,
+                                      independent.size() - (ordered.empty() && !independent.empty() ? 1 : 0));
+    vector<std::thread> threads;
+    for (uInt i = 0; i < threadCount; i++) {
+        threads.emplace_back([&] {
+            Parser parser;
+            parseIndependent(parser);
+        });
+    }
 
+    // Modules are already sorted using topsort
+    for (int i : ordered) {
+        errorHandler::bufferCompileErrors(&errors[i]);
+        parseModule(modules[i]);
         expandMacros();
     }
-    // 2 units being imported using the same alias is illegal
-    // Units imported without an alias must abide by the rule that every symbol must be unique
-    for (CSLModule* unit : modules) {
-        std::unordered_map<string, Dependency*> symbols;
-        // Symbols of this unit are also taken into account when checking uniqueness
-        for(auto decl : unit->topDeclarations){
-            symbols[decl->getName().getLexeme()] = nullptr;
-        }
-        std::unordered_map<string, Dependency*> importAliases;
+    parseIndependent(*this);
+    for (std::thread& thread : threads) thread.join();
 
-        for (Dependency& dep : unit->deps) {
-            if (dep.alias.type == TokenType::NONE) {
-                for (const auto decl : dep.module->exports) {
-                    string lexeme = decl->getName().getLexeme();
+    for (errorHandler::ErrorBuffer& buffer : errors) errorHandler::flushCompileErrors(buffer);
 
-                    if (symbols.count(lexeme) == 0) {
-                        symbols[lexeme] = &dep;
-                        continue;
-                    }
-                    // If there are 2 or more declaration which use the same symbol,
-                    // throw an error and tell the user exactly which dependencies caused the error
-
-                    string str = fmt::format("Ambiguous definition, symbol '{}' defined in {} and {}.",
-                                             lexeme, symbols[lexeme] ? symbols[lexeme]->pathString.getLexeme() : "this file", dep.pathString.getLexeme());
-                    if(!symbols[lexeme]){
-                        for(auto thisFileDecl : unit->topDeclarations){
-                            if(thisFileDecl->getName().getLexeme() != lexeme) continue;
-                            error(thisFileDecl->getName(), str);
-                        }
-                    }else error(dep.pathString, str);
+    for (CSLModule* unit : modules) checkImports(unit);
+}
+
+void Parser::parseUnit(CSLModule* unit) {
+    parseModule(unit);
+    expandMacros();
+}
+
+// 2 units being imported using the same alias is illegal
+// Units imported without an alias must abide by the rule that every symbol must be unique
+void Parser::checkImports(CSLModule* unit) {
+    std::unordered_map<string, Dependency*> symbols;
+    // Symbols of this unit are also taken into account when checking uniqueness
+    for(auto decl : unit->topDeclarations){
+        symbols[decl->getName().getLexeme()] = nullptr;
+    }
+    std::unordered_map<string, Dependency*> importAliases;
+
+    for (Dependency& dep : unit->deps) {
+        if (dep.alias.type == TokenType::NONE) {
+            for (const auto decl : dep.module->exports) {
+                string lexeme = decl->getName().getLexeme();
+
+                if (symbols.count(lexeme) == 0) {
+                    symbols[lexeme] = &dep;
+                    continue;
                 }
+                // If there are 2 or more declaration which use the same symbol,
+                // throw an error and tell the user exactly which dependencies caused the error
+
+                string str = fmt::format("Ambiguous definition, symbol '{}' defined in {} and {}.",
+                                         lexeme, symbols[lexeme] ? symbols[lexeme]->pathString.getLexeme() : "this file", dep.pathString.getLexeme());
+                if(!symbols[lexeme]){
+                    for(auto thisFileDecl : unit->topDeclarations){
+                        if(thisFileDecl->getName().getLexeme() != lexeme) continue;
+                        error(thisFileDecl->getName(), str);
+                    }
+                }else error(dep.pathString, str);
             }
-            else {
-                // Check if any imported dependencies share the same alias
-                if (importAliases.count(dep.alias.getLexeme()) > 0) {
-                    error(importAliases[dep.alias.getLexeme()]->alias, "Cannot use the same alias for 2 module imports.");
-                    error(dep.alias, "Cannot use the same alias for 2 module imports.");
-                }
-                importAliases[dep.alias.getLexeme()] = &dep;
+        }
+        else {
+            // Check if any imported dependencies share the same alias
+            if (importAliases.count(dep.alias.getLexeme()) > 0) {
+                error(importAliases[dep.alias.getLexeme()]->alias, "Cannot use the same alias for 2 module imports.");
+                error(dep.alias, "Cannot use the same alias for 2 module imports.");
             }
+            importAliases[dep.alias.getLexeme()] = &dep;
         }
     }
 }
@@ -485,25 +518,7 @@ void Parser::parse(vector<CSLModule*>& modules) {
 void Parser::highlight(vector<CSLModule*>& modules, string moduleToHighlight){
     // Modules are already sorted using topsort
     for (CSLModule* unit : modules) {
-        parsedUnit = unit;
-
-        // Parse tokenized source into AST
-        loopDepth = 0;
-        switchDepth = 0;
-        currentContainer = &parsedUnit->tokens;
-        currentPtr = 0;
-        while (!isAtEnd()) {
-            try {
-                if (match(TokenType::ADDMACRO)) {
-                    defineMacro();
-                    continue;
-                }
-                unit->stmts.push_back(topLevelDeclaration());
-            }
-            catch (ParserException& e) {
-                sync();
-            }
-        }
+        parseModule(unit);
         if(unit->file->path == moduleToHighlight){
             SemanticAnalysis::SemanticAnalyzer semanticAnalyzer;
             std::cout << semanticAnalyzer.highlight(modules, unit, macros);
@@ -513,6 +528,35 @@ void Parser::highlight(vector<CSLModule*>& modules, string moduleToHighlight){
     }
 }
 
+// Parses tokenized source into AST, macros are expanded separately by expandMacros
+void Parser::parseModule(CSLModule* unit) {
+#ifdef AST_DEBUG
+    ASTPrinter* astPrinter = new ASTPrinter;
+#endif
+    parsedUnit = unit;
+
+    loopDepth = 0;
+    switchDepth = 0;
+    currentContainer = &parsedUnit->tokens;
+    currentPtr = 0;
+    while (!isAtEnd()) {
+        try {
+            if (match(TokenType::ADDMACRO)) {
+                defineMacro();
+                continue;
+            }
+            unit->stmts.push_back(topLevelDeclaration());
+#ifdef AST_DEBUG
+            //prints statement
+            unit->stmts[unit->stmts.size() - 1]->accept(astPrinter);
+#endif
+        }
+        catch (ParserException& e) {
+            sync();
+        }
+    }
+}
+
 void Parser::defineMacro() {
     consume(TokenType::BANG, "Expected '!' after 'addMacro' token.");
     Token macroName = consume(TokenType::IDENTIFIER, "Expected macro name to be an identifier.");
@@ -550,7 +594,7 @@ ASTNodePtr Parser::expression(int prec) {
         throw error(token, "Unexpected '$' found outside of macro transcriber.");
     }
     auto& prefix = prefixParselets[token.type];
-    shared_ptr<ASTNode> left = prefix.second(this, token);
+    ASTNode* left = prefix.second(this, token);
 
 
     while(true){
@@ -587,7 +631,7 @@ ASTNodePtr Parser::expression() {
 //module level variables are put in a list to help with error reporting in compiler
 ASTNodePtr Parser::topLevelDeclaration() {
     //export is only allowed in global scope
-    shared_ptr<ASTDecl> node = nullptr;
+    ASTDecl* node = nullptr;
     bool isExported = false;
     if (match(TokenType::PUB)) isExported = true;
     if (match(TokenType::LET)) node = varDecl();
@@ -614,7 +658,7 @@ ASTNodePtr Parser::localDeclaration() {
     return statement();
 }
 
-shared_ptr<VarDecl> Parser::varDecl() {
+VarDecl* Parser::varDecl() {
     Token name = consume(TokenType::IDENTIFIER, "Expected a variable identifier.");
     ASTNodePtr expr = nullptr;
     //if no initializer is present the variable is initialized to null
@@ -622,10 +666,10 @@ shared_ptr<VarDecl> Parser::varDecl() {
         expr = expression();
     }
     consume(TokenType::SEMICOLON, "Expected a ';' after variable declaration.");
-    return make_shared<VarDecl>(name, expr);
+    return makeNode<VarDecl>(name, expr);
 }
 
-shared_ptr<FuncDecl> Parser::funcDecl() {
+FuncDecl* Parser::funcDecl() {
     //the depths are used for throwing errors for switch and loops stmts,
     //and since a function can be declared inside a loop we need to account for that
     int tempLoopDepth = loopDepth;
@@ -648,14 +692,14 @@ shared_ptr<FuncDecl> Parser::funcDecl() {
     }
     consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments");
     consume(TokenType::LEFT_BRACE, "Expect '{' after arguments.");
-    shared_ptr<BlockStmt> body = blockStmt();
+    BlockStmt* body = blockStmt();
 
     loopDepth = tempLoopDepth;
     switchDepth = tempSwitchDepth;
-    return make_shared<FuncDecl>(name, args, body);
+    return makeNode<FuncDecl>(name, args, body);
 }
 
-shared_ptr<ClassDecl> Parser::classDecl() {
+ClassDecl* Parser::classDecl() {
     Token name = consume(TokenType::IDENTIFIER, "Expected a class name.");
     ASTNodePtr inherited = nullptr;
     // Inheritance is optional
@@ -663,7 +707,7 @@ shared_ptr<ClassDecl> Parser::classDecl() {
         Token token = previous();
         // Only accept identifiers and module access
         inherited = expression(+Precedence::PRIMARY - 1);
-        if (!((inherited->type == ASTType::LITERAL && dynamic_cast<LiteralExpr*>(inherited.get())->token.type == TokenType::IDENTIFIER)
+        if (!((inherited->type == ASTType::LITERAL && dynamic_cast<LiteralExpr*>(inherited)->token.type == TokenType::IDENTIFIER)
               || inherited->type == ASTType::MODULE_ACCESS)) {
             error(token, "Superclass can only be an identifier.");
         }
@@ -690,6 +734,7 @@ shared_ptr<ClassDecl> Parser::classDecl() {
     };
 
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+        auto memberStart = currentPtr;
         try {
             bool isPublic = false;
             if (match(TokenType::PUB)) {
@@ -720,10 +765,12 @@ shared_ptr<ClassDecl> Parser::classDecl() {
             }
         }catch(ParserException& e){
             sync();
+            // sync() stops in front of '{', which can't start a member either, skip it so the loop always makes progress
+            if (currentPtr == memberStart) advance();
         }
     }
     consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
-    return make_shared<ClassDecl>(name, methods, fields, inherited);
+    return makeNode<ClassDecl>(name, methods, fields, inherited);
 }
 
 ASTNodePtr Parser::statement() {
@@ -746,13 +793,13 @@ ASTNodePtr Parser::statement() {
     return exprStmt();
 }
 
-shared_ptr<ExprStmt> Parser::exprStmt() {
+ExprStmt* Parser::exprStmt() {
     ASTNodePtr expr = expression();
     consume(TokenType::SEMICOLON, "Expected ';' after expression.");
-    return make_shared<ExprStmt>(expr);
+    return makeNode<ExprStmt>(expr);
 }
 
-shared_ptr<BlockStmt> Parser::blockStmt() {
+BlockStmt* Parser::blockStmt() {
     vector<ASTNodePtr> stmts;
     //TokenType::LEFT_BRACE is already consumed
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
@@ -763,10 +810,10 @@ shared_ptr<BlockStmt> Parser::blockStmt() {
         }
     }
     consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
-    return make_shared<BlockStmt>(stmts);
+    return makeNode<BlockStmt>(stmts);
 }
 
-shared_ptr<IfStmt> Parser::ifStmt() {
+IfStmt* Parser::ifStmt() {
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
     ASTNodePtr condition = expression();
     consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
@@ -777,10 +824,10 @@ shared_ptr<IfStmt> Parser::ifStmt() {
     if (match(TokenType::ELSE)) {
         elseBranch = statement();
     }
-    return make_shared<IfStmt>(thenBranch, elseBranch, condition);
+    return makeNode<IfStmt>(thenBranch, elseBranch, condition);
 }
 
-shared_ptr<WhileStmt> Parser::whileStmt() {
+WhileStmt* Parser::whileStmt() {
     //loopDepth is used to see if a 'continue' or 'break' statement is allowed within the body
     loopDepth++;
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
@@ -788,10 +835,10 @@ shared_ptr<WhileStmt> Parser::whileStmt() {
     consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
     ASTNodePtr body = statement();
     loopDepth--;
-    return make_shared<WhileStmt>(body, condition);
+    return makeNode<WhileStmt>(body, condition);
 }
 
-shared_ptr<ForStmt> Parser::forStmt() {
+ForStmt* Parser::forStmt() {
     loopDepth++;
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
     //initializer can either be: empty, a new variable declaration, or any expression
@@ -814,22 +861,22 @@ shared_ptr<ForStmt> Parser::forStmt() {
     //disallows declarations unless they're in a block
     ASTNodePtr body = statement();
     loopDepth--;
-    return make_shared<ForStmt>(init, condition, increment, body);
+    return makeNode<ForStmt>(init, condition, increment, body);
 }
 
-shared_ptr<BreakStmt> Parser::breakStmt() {
+BreakStmt* Parser::breakStmt() {
     if (loopDepth == 0 && switchDepth == 0) throw error(previous(), "Cannot use 'break' outside of loops or switch statements.");
     consume(TokenType::SEMICOLON, "Expect ';' after break.");
-    return make_shared<BreakStmt>(previous());
+    return makeNode<BreakStmt>(previous());
 }
 
-shared_ptr<ContinueStmt> Parser::continueStmt() {
+ContinueStmt* Parser::continueStmt() {
     if (loopDepth == 0) throw error(previous(), "Cannot use 'continue' outside of loops.");
     consume(TokenType::SEMICOLON, "Expect ';' after continue.");
-    return make_shared<ContinueStmt>(previous());
+    return makeNode<ContinueStmt>(previous());
 }
 
-shared_ptr<SwitchStmt> Parser::switchStmt() {
+SwitchStmt* Parser::switchStmt() {
     //structure:
     //switch(<expression>){
     //case <expression>: <statements>
@@ -839,12 +886,12 @@ shared_ptr<SwitchStmt> Parser::switchStmt() {
     consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
     consume(TokenType::LEFT_BRACE, "Expect '{' after switch expression.");
     switchDepth++;
-    vector<shared_ptr<CaseStmt>> cases;
+    vector<CaseStmt*> cases;
     bool hasDefault = false;
 
     while (!check(TokenType::RIGHT_BRACE) && match({ TokenType::CASE, TokenType::DEFAULT })) {
         Token prev = previous();//to see if it's a default statement
-        shared_ptr<CaseStmt> curCase = caseStmt();
+        CaseStmt* curCase = caseStmt();
         curCase->caseType = prev;
         if (prev.type == TokenType::DEFAULT) {
             //don't throw, it isn't a breaking error
@@ -855,10 +902,10 @@ shared_ptr<SwitchStmt> Parser::switchStmt() {
     }
     consume(TokenType::RIGHT_BRACE, "Expect '}' after switch body.");
     switchDepth--;
-    return make_shared<SwitchStmt>(expr, cases, hasDefault);
+    return makeNode<SwitchStmt>(expr, cases, hasDefault);
 }
 
-shared_ptr<CaseStmt> Parser::caseStmt() {
+CaseStmt* Parser::caseStmt() {
     vector<Token> matchConstants;
     //default cases don't have a match expression
     if (previous().type != TokenType::DEFAULT) {
@@ -872,30 +919,30 @@ shared_ptr<CaseStmt> Parser::caseStmt() {
     }
     consume(TokenType::COLON, "Expect ':' after 'case' or 'default'.");
     vector<ASTNodePtr> stmts;
-    while (!check(TokenType::CASE) && !check(TokenType::DEFAULT) && !isAtEnd()) {
+    while (!check(TokenType::CASE) && !check(TokenType::DEFAULT) && !check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
         try {
             stmts.push_back(localDeclaration());
         }catch(ParserException& e){
             sync();
         }
     }
-    return make_shared<CaseStmt>(matchConstants, stmts);
+    return makeNode<CaseStmt>(matchConstants, stmts);
 }
 
-shared_ptr<AdvanceStmt> Parser::advanceStmt() {
+AdvanceStmt* Parser::advanceStmt() {
     if (switchDepth == 0) throw error(previous(), "Cannot use 'advance' outside of switch statements.");
     consume(TokenType::SEMICOLON, "Expect ';' after 'advance'.");
-    return make_shared<AdvanceStmt>(previous());
+    return makeNode<AdvanceStmt>(previous());
 }
 
-shared_ptr<ReturnStmt> Parser::returnStmt() {
+ReturnStmt* Parser::returnStmt() {
     ASTNodePtr expr = nullptr;
     Token keyword = previous();
     if (!match(TokenType::SEMICOLON)) {
         expr = expression();
         consume(TokenType::SEMICOLON, "Expect ';' at the end of 'return'.");
     }
-    return make_shared<ReturnStmt>(expr, keyword);
+    return makeNode<ReturnStmt>(expr, keyword);
 }
 
 #pragma endregion
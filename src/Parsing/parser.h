@@ -59,6 +59,18 @@ namespace AST {
 		Parser();
 		void parse(vector<CSLModule*>& modules);
         void highlight(vector<CSLModule*>& modules, string moduleToHighlight);
+        // Used by the language server to parse modules one at a time
+        // Modules have to be parsed in the order they're imported in, and a module that needs macros has to be parsed
+        // by the same parser as every module before it that needs macros
+        void parseUnit(CSLModule* unit);
+        // Reports imported symbols that clash and imports that share an alias, deps of the module have to be parsed
+        void checkImports(CSLModule* unit);
+        // Whether parsing a module depends on macros defined in other modules(or defines macros used by them)
+        static bool needsMacros(CSLModule* unit);
+        unordered_map<string, unique_ptr<Macro>>& getMacros() { return macros; }
+		// Nodes are owned by the module being parsed, including the ones created while expanding macros
+		template<typename T, typename... Args>
+		T* makeNode(Args&&... args) { return parsedUnit->arena.make<T>(std::forward<Args>(args)...); }
 	private:
 		ASTProbe* probe;
 		MacroExpander* macroExpander;
@@ -90,6 +102,7 @@ namespace AST {
 		void addInfix(TokenType type, Precedence prec, InfixFunc func);
         void addPostfix(TokenType type, Precedence prec, InfixFunc func);
 
+		void parseModule(CSLModule* unit);
 		void defineMacro();
 
         #pragma region Expressions
@@ -120,22 +133,22 @@ namespace AST {
         #pragma region Statements
 		ASTNodePtr topLevelDeclaration();
 		ASTNodePtr localDeclaration();
-		shared_ptr<VarDecl> varDecl();
-		shared_ptr<FuncDecl> funcDecl();
-		shared_ptr<ClassDecl> classDecl();
+		VarDecl* varDecl();
+		FuncDecl* funcDecl();
+		ClassDecl* classDecl();
 
 		ASTNodePtr statement();
-        shared_ptr<ExprStmt> exprStmt();
-        shared_ptr<BlockStmt> blockStmt();
-        shared_ptr<IfStmt> ifStmt();
-        shared_ptr<WhileStmt> whileStmt();
-        shared_ptr<ForStmt> forStmt();
-        shared_ptr<BreakStmt> breakStmt();
-        shared_ptr<ContinueStmt> continueStmt();
-        shared_ptr<SwitchStmt> switchStmt();
-		shared_ptr<CaseStmt> caseStmt();
-        shared_ptr<AdvanceStmt> advanceStmt();
-        shared_ptr<ReturnStmt> returnStmt();
+        ExprStmt* exprStmt();
+        BlockStmt* blockStmt();
+        IfStmt* ifStmt();
+        WhileStmt* whileStmt();
+        ForStmt* forStmt();
+        BreakStmt* breakStmt();
+        ContinueStmt* continueStmt();
+        SwitchStmt* switchStmt();
+		CaseStmt* caseStmt();
+        AdvanceStmt* advanceStmt();
+        ReturnStmt* returnStmt();
 
         #pragma endregion
 
@@ -4,6 +4,13 @@
 #include <iostream>
 #include "../ErrorHandling/errorHandler.h"
 #include "../Includes/fmt/format.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <fstream>
+#include <sstream>
 
 
 using std::unordered_set;
@@ -29,9 +36,91 @@ string parsePath(path& absP, string relativeP){
     }
     return p.string() + "/" + relativeP;
 }
+// Absolute path of the file imported by pathToken, dir is the directory of the importing file
+string importPath(path& dir, const Token& pathToken){
+    string path = pathToken.getLexeme();
+    return parsePath(dir, path.substr(1, path.size() - 2)); // Extract dependency path from "" (it's a string)
+}
+
+SourceCache::~SourceCache() {
+    for (auto& [filePath, entry] : files) retired.push_back(entry.file.unit);
+    releaseRetired();
+}
+
+string SourceCache::normalPath(const string& filePath) {
+    return path(filePath).lexically_normal().string();
+}
+
+const string* SourceCache::findOpen(const string& filePath) {
+    auto it = openFiles.find(normalPath(filePath));
+    return it == openFiles.end() ? nullptr : &it->second;
+}
+
+bool SourceCache::exists(const string& filePath) {
+    std::error_code ec;
+    return findOpen(filePath) || std::filesystem::exists(filePath, ec);
+}
+
+string SourceCache::read(const string& filePath) {
+    if (const string* source = findOpen(filePath)) return *source;
+    // Unlike readFile this doesn't print anything, stdout might be used to talk to an editor
+    std::ifstream file(filePath, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+bool SourceCache::get(const string& filePath, ScannedFile& file) {
+    const string* source = findOpen(filePath);
+    std::error_code ec;
+    auto modified = source ? std::filesystem::file_time_type() : last_write_time(filePath, ec);
+    std::lock_guard lock(mtx);
+    auto it = files.find(filePath);
+    if (it == files.end()) return false;
+    Entry& entry = it->second;
+    if (source) {
+        if (entry.file.unit->file->sourceFile != *source) return false;
+    }
+    else if (entry.fromEditor || ec || modified != entry.modified) return false;
+    file = entry.file;
+    return true;
+}
+
+void SourceCache::put(const string& filePath, ScannedFile& file) {
+    bool fromEditor = findOpen(filePath);
+    std::error_code ec;
+    auto modified = fromEditor ? std::filesystem::file_time_type() : last_write_time(filePath, ec);
+    std::lock_guard lock(mtx);
+    Entry& entry = files[filePath];
+    if (entry.file.unit) retired.push_back(entry.file.unit);
+    file.generation = nextGeneration++;
+    entry.file = file;
+    entry.fromEditor = fromEditor;
+    entry.modified = modified;
+}
+
+uInt64 SourceCache::generation(const string& filePath) {
+    std::lock_guard lock(mtx);
+    auto it = files.find(filePath);
+    return it == files.end() ? 0 : it->second.file.generation;
+}
+
+void SourceCache::releaseRetired() {
+    for (CSLModule* unit : retired) {
+        delete unit->file;
+        delete unit;
+    }
+    retired.clear();
+}
 
 Preprocessor::Preprocessor(){
     projectRootPath = "";
+    cache = nullptr;
+}
+
+Preprocessor::Preprocessor(SourceCache* _cache){
+    projectRootPath = "";
+    cache = _cache;
 }
 
 Preprocessor::~Preprocessor() {
@@ -41,28 +130,106 @@ void Preprocessor::preprocessProject(string mainFilePath) {
     path p(mainFilePath);
 
     // Check file validity
-    if (p.extension().string() != ".esl" || !exists(p)) {
+    if (p.extension().string() != ".esl" || !fileExists(p.string())) {
         errorHandler::addSystemError(fmt::format("Couldn't find {}.esl", p.stem().string()));
         return;
     }
 
     projectRootPath = p.parent_path().string() + "/";
-    CSLModule* mainModule = scanFile(p.string());
+    scanFiles(p.string());
+    CSLModule* mainModule = resolveFile(p.string());
     toposort(mainModule);
 }
 
-CSLModule* Preprocessor::scanFile(string filePath) {
-    path p(filePath);
-    vector<Token> tokens = scanner.tokenizeSource(filePath, p.stem().string());
-    CSLModule* unit = new CSLModule(tokens, scanner.getFile());
-    allUnits[filePath] = unit;
+// Tokenizes the main file and every file it imports(directly or not)
+// Files are independent of each other at this point, so they're scanned in parallel as soon as they're discovered,
+// the dependency graph is built afterwards by resolveFile
+void Preprocessor::scanFiles(string mainFilePath) {
+    const uInt maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<string> queue;
+    vector<std::thread> threads;
+    // Number of files currently being scanned, once it drops to 0 with an empty queue every file has been found
+    uInt busy = 0;
+
+    std::function<void()> work = [&]() {
+        Scanner scanner;
+        std::unique_lock lock(mtx);
+        while (true) {
+            cv.wait(lock, [&] { return !queue.empty() || busy == 0; });
+            if (queue.empty()) break;
+            string filePath = queue.front();
+            queue.pop_front();
+            // References to elements of an unordered_map stay valid when other threads add to it
+            ScannedFile& file = scannedFiles[filePath];
+            busy++;
+            lock.unlock();
+
+            path dir = path(filePath).parent_path();
+            scanFile(scanner, filePath, file);
+            // Files that don't exist are reported by resolveFile
+            vector<string> imports;
+            for (auto& [pathToken, alias] : file.directives) {
+                string importedPath = importPath(dir, pathToken);
+                if (fileExists(importedPath)) imports.push_back(importedPath);
+            }
+
+            lock.lock();
+            uInt discovered = 0;
+            for (string& importedPath : imports) {
+                if (scannedFiles.contains(importedPath)) continue;
+                scannedFiles[importedPath];
+                queue.push_back(importedPath);
+                discovered++;
+            }
+            // Every new file can be picked up by a new thread, up to the number of cores
+            while (discovered-- > 0 && threads.size() + 1 < maxThreads) threads.emplace_back(work);
+            busy--;
+            cv.notify_all();
+        }
+    };
+
+    scannedFiles[mainFilePath];
+    queue.push_back(mainFilePath);
+    work();
+    // Nothing can be added to threads once work returns on this thread
+    for (std::thread& thread : threads) thread.join();
+}
+
+bool Preprocessor::fileExists(const string& filePath) {
+    return cache ? cache->exists(filePath) : std::filesystem::exists(filePath);
+}
+
+// Tokenizes a file and finds its imports, or takes both from the cache if the file didn't change since it was scanned
+void Preprocessor::scanFile(Scanner& scanner, const string& filePath, ScannedFile& file) {
+    if (cache && cache->get(filePath, file)) {
+        // The files it imports might have changed, so deps are resolved again
+        file.unit->deps.clear();
+        file.unit->resolvedDeps = false;
+        file.unit->traversed = false;
+        return;
+    }
+    string name = path(filePath).stem().string();
+    vector<Token> tokens = cache ? scanner.tokenizeSource(filePath, name, cache->read(filePath))
+                                 : scanner.tokenizeSource(filePath, name);
+    file.unit = new CSLModule(tokens, scanner.getFile());
+    // The main file is scanned on the calling thread, which might be buffering errors itself
+    errorHandler::ErrorBuffer* previous = errorHandler::bufferCompileErrors(&file.errors);
+    file.directives = retrieveDirectives(file.unit);
+    errorHandler::bufferCompileErrors(previous);
+    if (cache) cache->put(filePath, file);
+}
 
-    // Dependencies
-    vector<pair<Token, Token>> depsToParse = retrieveDirectives(unit);
+// Builds the dependency graph starting from an already scanned file, in the same order files used to be scanned in
+CSLModule* Preprocessor::resolveFile(string filePath) {
+    ScannedFile& file = scannedFiles[filePath];
+    allUnits[filePath] = file.unit;
+    errorHandler::flushCompileErrors(file.errors);
 
-    processDirectives(unit, depsToParse, p.string());
+    processDirectives(file.unit, file.directives, filePath);
 
-    return unit;
+    return file.unit;
 }
 
 void Preprocessor::toposort(CSLModule* unit) {
@@ -124,9 +291,8 @@ void Preprocessor::processDirectives(CSLModule* unit, vector<pair<Token, Token>>
     // Absolute path to the same directory as the unit that these directives belong to
     path absP = path(absolutePath).parent_path();
     for (auto& [pathToken, alias] : depsToParse) {
-        string path = pathToken.getLexeme();
         // Calculates absolute path to the file with the relative path given by pathToken
-        path = parsePath(absP, path.substr(1, path.size() - 2)); // Extract dependency path from "" (it's a string)
+        string path = importPath(absP, pathToken);
 
 
         // If we have already scanned module with name 'dep' we add it to the deps list of this module to topsort it later
@@ -141,9 +307,8 @@ void Preprocessor::processDirectives(CSLModule* unit, vector<pair<Token, Token>>
             continue;
         }
 
-        std::filesystem::path p(path);
-        if (std::filesystem::exists(p)) {
-            Dependency dep = Dependency(alias, pathToken, scanFile(path));
+        if (scannedFiles.contains(path)) {
+            Dependency dep = Dependency(alias, pathToken, resolveFile(path));
             unit->deps.push_back(dep);
         }
         else {
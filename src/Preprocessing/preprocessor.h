@@ -1,10 +1,13 @@
 #pragma once
 #include "../common.h"
 #include "scanner.h"
+#include "../ErrorHandling/errorHandler.h"
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
 #include <tuple>
+#include <mutex>
+#include <filesystem>
 
 namespace preprocessing {
     using std::unordered_set;
@@ -12,17 +15,75 @@ namespace preprocessing {
     using std::unique_ptr;
     using std::pair;
 
+    // A tokenized file along with the imports found in it, and the errors found while looking for them
+    struct ScannedFile {
+        CSLModule* unit = nullptr;
+        vector<pair<Token, Token>> directives;
+        errorHandler::ErrorBuffer errors;
+        // Unique to every scan of every file, set by SourceCache
+        uInt64 generation = 0;
+    };
+
+    // Kept between runs of the preprocessor by long running processes(the language server)
+    // A file is only scanned again if its source changed, otherwise its module(along with its AST) is reused
+    class SourceCache {
+    public:
+        // Contents of the files open in an editor keyed by normalPath, used instead of the files on disk
+        // Must not be changed while a preprocessor is running
+        unordered_map<string, string> openFiles;
+
+        // Import paths can contain things like "dir/./file.esl", open files are looked up by the normalized path
+        static string normalPath(const string& path);
+
+        SourceCache() = default;
+        SourceCache(const SourceCache&) = delete;
+        SourceCache& operator=(const SourceCache&) = delete;
+        ~SourceCache();
+
+        bool exists(const string& path);
+        // Contents of the file, either from the editor or from the disk
+        string read(const string& path);
+        // Copies the last scan of the file into 'file' if the file didn't change since, returns false otherwise
+        bool get(const string& path, ScannedFile& file);
+        // Replaces the last scan of the file, the module of the previous scan is kept until releaseRetired is called
+        // since modules of other projects might still point to it
+        // Assigns file.generation
+        void put(const string& path, ScannedFile& file);
+        // Generation of the last scan of the file, 0 if it was never scanned
+        uInt64 generation(const string& path);
+        // Deletes modules(along with their files) replaced by put
+        void releaseRetired();
+    private:
+        struct Entry {
+            ScannedFile file;
+            // Files read from the disk are checked by their modification time, files from the editor by their contents
+            bool fromEditor = false;
+            std::filesystem::file_time_type modified;
+        };
+        // Scanner threads access the cache at the same time
+        std::mutex mtx;
+        unordered_map<string, Entry> files;
+        vector<CSLModule*> retired;
+        uInt64 nextGeneration = 1;
+
+        const string* findOpen(const string& path);
+    };
+
     class Preprocessor {
     public:
         Preprocessor();
+        // Files are taken from(and added to) cache instead of always being scanned
+        explicit Preprocessor(SourceCache* cache);
         ~Preprocessor();
         void preprocessProject(string mainFilePath);
 
         vector<CSLModule*> getSortedUnits() { return sortedUnits; }
     private:
         string projectRootPath;
-        Scanner scanner;
+        SourceCache* cache;
 
+        // Every file reachable from the main file, keyed by absolute path
+        unordered_map<string, ScannedFile> scannedFiles;
         unordered_map<string, CSLModule*> allUnits;
         vector<CSLModule*> sortedUnits;
 
@@ -30,7 +91,10 @@ namespace preprocessing {
 
         void processDirectives(CSLModule* unit, vector<pair<Token, Token>>& depsToParse, string absolutePath);
 
-        CSLModule* scanFile(string unitName);
+        bool fileExists(const string& filePath);
+        void scanFiles(string mainFilePath);
+        void scanFile(Scanner& scanner, const string& filePath, ScannedFile& file);
+        CSLModule* resolveFile(string filePath);
         void toposort(CSLModule* unit);
     };
 
@@ -1,44 +1,163 @@
 #include "scanner.h"
 #include "../files.h"
 #include <iostream>
+#include <array>
+#include <bit>
+#include <deque>
+#include <mutex>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
-// Map to convert keywords in string form to their corresponding TokenType
-std::unordered_map<string, TokenType> keywordToTokenType = {
-        {"and", TokenType::AND},
-        {"break", TokenType::BREAK},
-        {"class", TokenType::CLASS},
-        {"case", TokenType::CASE},
-        {"continue", TokenType::CONTINUE},
-        {"default", TokenType::DEFAULT},
-        {"else", TokenType::ELSE},
-        {"pub", TokenType::PUB},
-        {"if", TokenType::IF},
-        {"import", TokenType::IMPORT},
-        {"null", TokenType::NIL},
-        {"advance", TokenType::ADVANCE},
-        {"or", TokenType::OR},
-        {"return", TokenType::RETURN},
-        {"super", TokenType::SUPER},
-        {"switch", TokenType::SWITCH},
-        {"let", TokenType::LET},
-        {"while", TokenType::WHILE},
-        {"false", TokenType::FALSE},
-        {"for", TokenType::FOR},
-        {"fn", TokenType::FN},
-        {"this", TokenType::THIS},
-        {"true", TokenType::TRUE},
-        {"as", TokenType::AS},
-        {"await", TokenType::AWAIT},
-        {"async", TokenType::ASYNC},
-        {"addMacro", TokenType::ADDMACRO},
-        {"expr", TokenType::EXPR},
-        {"tt", TokenType::TT},
-        {"static", TokenType::STATIC},
-        {"instanceof", TokenType::INSTANCEOF},
-        {"new", TokenType::NEW},
-        {"in", TokenType::IN},
-        {"as", TokenType::AS}
-};
+// Perfect hash of every keyword, the hash only looks at the first and last character and the length so
+// recognizing a keyword is a single table lookup and compare, the table is checked for collisions at compile time
+namespace {
+    struct Keyword {
+        std::string_view name;
+        TokenType type = TokenType::IDENTIFIER;
+    };
+
+    constexpr uInt KEYWORD_TABLE_SIZE = 64;
+
+    constexpr uInt keywordHash(std::string_view str) {
+        return (static_cast<uInt>(str.front()) * 18 + static_cast<uInt>(str.back()) * 28 + str.size()) & (KEYWORD_TABLE_SIZE - 1);
+    }
+
+    constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> makeKeywordTable() {
+        constexpr Keyword keywords[] = {
+                {"and", TokenType::AND},
+                {"break", TokenType::BREAK},
+                {"class", TokenType::CLASS},
+                {"case", TokenType::CASE},
+                {"continue", TokenType::CONTINUE},
+                {"default", TokenType::DEFAULT},
+                {"else", TokenType::ELSE},
+                {"pub", TokenType::PUB},
+                {"if", TokenType::IF},
+                {"import", TokenType::IMPORT},
+                {"null", TokenType::NIL},
+                {"advance", TokenType::ADVANCE},
+                {"or", TokenType::OR},
+                {"return", TokenType::RETURN},
+                {"super", TokenType::SUPER},
+                {"switch", TokenType::SWITCH},
+                {"let", TokenType::LET},
+                {"while", TokenType::WHILE},
+                {"false", TokenType::FALSE},
+                {"for", TokenType::FOR},
+                {"fn", TokenType::FN},
+                {"this", TokenType::THIS},
+                {"true", TokenType::TRUE},
+                {"as", TokenType::AS},
+                {"await", TokenType::AWAIT},
+                {"async", TokenType::ASYNC},
+                {"addMacro", TokenType::ADDMACRO},
+                {"expr", TokenType::EXPR},
+                {"tt", TokenType::TT},
+                {"static", TokenType::STATIC},
+                {"instanceof", TokenType::INSTANCEOF},
+                {"new", TokenType::NEW},
+                {"in", TokenType::IN}
+        };
+        std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
+        for (const Keyword& keyword : keywords) {
+            Keyword& slot = table[keywordHash(keyword.name)];
+            // Not a constant expression, so adding a keyword that collides fails to compile
+            if (!slot.name.empty()) throw "Keyword hash collision, pick new multipliers in keywordHash";
+            slot = keyword;
+        }
+        return table;
+    }
+
+    constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> keywordTable = makeKeywordTable();
+}
+
+#pragma region Fast paths
+// Skipping whitespace, comments, strings and identifiers is where the scanner spends most of its time,
+// these find the end of such a run 16 characters at a time with SSE2(always available on x86-64)
+// and finish the last few characters(or the whole run on other targets) one at a time
+// Each returns the index of the first character at or after 'pos' that ends the run, or 'size' if there is none
+#if defined(__SSE2__) || defined(_M_X64)
+#define SCANNER_SSE2
+static inline uInt blockMask(__m128i block, char c) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+}
+
+// Bytes >= 0x80 are negative and fall outside of every range
+static inline __m128i inRange(__m128i block, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(block, _mm_set1_epi8(hi + 1)));
+}
+#endif
+
+// Spaces, tabs and carriage returns, newlines are tokens
+static size_t skipBlanks(const char* src, size_t pos, size_t size) {
+#ifdef SCANNER_SSE2
+    while (pos + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+        uInt blanks = blockMask(block, ' ') | blockMask(block, '\t') | blockMask(block, '\r');
+        if (blanks != 0xFFFF) return pos + std::countr_zero(~blanks);
+        pos += 16;
+    }
+#endif
+    while (pos < size && (src[pos] == ' ' || src[pos] == '\t' || src[pos] == '\r')) pos++;
+    return pos;
+}
+
+static size_t findEither(const char* src, size_t pos, size_t size, char a, char b) {
+#ifdef SCANNER_SSE2
+    while (pos + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+        uInt found = blockMask(block, a) | blockMask(block, b);
+        if (found) return pos + std::countr_zero(found);
+        pos += 16;
+    }
+#endif
+    while (pos < size && src[pos] != a && src[pos] != b) pos++;
+    return pos;
+}
+
+// Letters, digits and '_'
+static size_t skipIdentifier(const char* src, size_t pos, size_t size) {
+#ifdef SCANNER_SSE2
+    while (pos + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+        // Setting 0x20 lowercases letters and leaves digits and '_' alone
+        __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+        __m128i valid = _mm_or_si128(inRange(lower, 'a', 'z'), inRange(block, '0', '9'));
+        uInt ident = _mm_movemask_epi8(valid) | blockMask(block, '_');
+        if (ident != 0xFFFF) return pos + std::countr_zero(~ident);
+        pos += 16;
+    }
+#endif
+    while (pos < size && (isalnum(static_cast<unsigned char>(src[pos])) || src[pos] == '_')) pos++;
+    return pos;
+}
+#pragma endregion
+
+// Names are stored in a deque so views into them stay valid as more names are added
+static std::mutex symbolMtx;
+static std::deque<string> symbolNames;
+static std::unordered_map<std::string_view, uInt> symbolIds;
+
+static uInt internLocked(std::string_view name) {
+    auto it = symbolIds.find(name);
+    if (it != symbolIds.end()) return it->second;
+    symbolNames.emplace_back(name);
+    uInt id = symbolNames.size();
+    symbolIds.emplace(symbolNames.back(), id);
+    return id;
+}
+
+uInt symbols::intern(std::string_view name) {
+    std::lock_guard<std::mutex> lk(symbolMtx);
+    return internLocked(name);
+}
+
+void symbols::internAll(const vector<std::string_view>& names, vector<uInt>& ids) {
+    ids.resize(names.size());
+    std::lock_guard<std::mutex> lk(symbolMtx);
+    for (size_t i = 0; i < names.size(); i++) ids[i] = internLocked(names[i]);
+}
 
 using namespace preprocessing;
 
@@ -52,8 +171,12 @@ Scanner::Scanner() {
 }
 
 vector<Token> Scanner::tokenizeSource(string path, string sourceName) {
+    return tokenizeSource(path, sourceName, readFile(path));
+}
+
+vector<Token> Scanner::tokenizeSource(string path, string sourceName, string source) {
     // Setup
-    curFile = new File(readFile(path), sourceName, path);
+    curFile = new File(std::move(source), sourceName, path);
     line = 0;
     start = 0;
     current = start;
@@ -62,15 +185,25 @@ vector<Token> Scanner::tokenizeSource(string path, string sourceName) {
     tokens.clear();
 
     // Tokenization
-    Token token;
     while (!isAtEnd()) {
         consumeWhitespace();
         if (isAtEnd()) break;
-        token = scanToken();
-        tokens.push_back(token);
+        tokens.push_back(scanToken());
     }
 
-    return tokens;
+    // Intern all names at once so the lock is only taken once per file
+    vector<std::string_view> names;
+    vector<uInt> ids;
+    for (Token& t : tokens) {
+        if (symbols::isName(t.type)) names.push_back(t.getView());
+    }
+    symbols::internAll(names, ids);
+    size_t i = 0;
+    for (Token& t : tokens) {
+        if (symbols::isName(t.type)) t.symbol = ids[i++];
+    }
+
+    return std::move(tokens);
 }
 
 void Scanner::reset() {
@@ -166,52 +299,49 @@ char Scanner::peekNext() {
 }
 
 void Scanner::consumeWhitespace() {
+    const char* src = curFile->sourceFile.data();
+    size_t size = curFile->sourceFile.size();
     while (true) {
-        char c = peek();
-        switch (c) {
-            case ' ':
-            case '\r':
-            case '\t':
-                advance();
-                break;
-            case '/':
-                // Standard comment
-                if (peekNext() == '/') while (!isAtEnd() && peek() != '\n') advance();
-                    // Multi-line comment
-                else if (peekNext() == '*') {
-                    advance();
-                    advance();
-                    while (!isAtEnd() && !(peek() == '*' && peekNext() == '/')) {
-                        if (peek() == '\n') {
-                            line++;
-                            curFile->lines.push_back(current);
-                        }
-                        advance();
-                    }
-                    if (!isAtEnd()) {
-                        advance();
-                        advance();
-                    }
+        current = skipBlanks(src, current, size);
+        if (current + 1 >= size || src[current] != '/') return;
+        // Standard comment, the newline is left for scanToken
+        if (src[current + 1] == '/') current = findEither(src, current + 2, size, '\n', '\n');
+        // Multi-line comment
+        else if (src[current + 1] == '*') {
+            size_t pos = current + 2;
+            while (true) {
+                pos = findEither(src, pos, size, '*', '\n');
+                if (pos >= size) break;
+                if (src[pos] == '\n') {
+                    line++;
+                    curFile->lines.push_back(pos);
                 }
-                else {
-                    return;
+                else if (pos + 1 < size && src[pos + 1] == '/') {
+                    pos += 2;
+                    break;
                 }
-                break;
-            default:
-                return;
+                pos++;
+            }
+            current = pos;
+        }
+        else {
+            return;
         }
     }
 }
 
 Token Scanner::string_() {
-    while (!isAtEnd()) {
-        if (peek() == '"') break;
-        if (peek() == '\n') {
-            line++;
-            curFile->lines.push_back(current);
-        }
-        advance();
+    const char* src = curFile->sourceFile.data();
+    size_t size = curFile->sourceFile.size();
+    size_t pos = current;
+    while (true) {
+        pos = findEither(src, pos, size, '"', '\n');
+        if (pos >= size || src[pos] == '"') break;
+        line++;
+        curFile->lines.push_back(pos);
+        pos++;
     }
+    current = pos;
 
     if (isAtEnd()) return makeToken(TokenType::ERROR);
 
@@ -236,15 +366,16 @@ Token Scanner::number() {
 
 Token Scanner::identifier() {
     //first character of the identifier has to be alphabetical, rest can be alphanumerical and '_'
-    while (isalnum(peek()) || peek() == '_') advance();
+    current = skipIdentifier(curFile->sourceFile.data(), current, curFile->sourceFile.size());
     return makeToken(identifierType());
 }
 
 TokenType Scanner::identifierType() {
-    string tokenString = curFile->sourceFile.substr(start, current - start);
+    std::string_view tokenString = std::string_view(curFile->sourceFile).substr(start, current - start);
 
     // language keyword
-    if (keywordToTokenType.contains(tokenString)) return keywordToTokenType[tokenString];
+    const Keyword& keyword = keywordTable[keywordHash(tokenString)];
+    if (keyword.name == tokenString) return keyword.type;
 
     // variable name
     return TokenType::IDENTIFIER;
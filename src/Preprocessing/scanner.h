@@ -5,7 +5,9 @@ namespace preprocessing {
 
 class Scanner {
 	public:
-		vector<Token> tokenizeSource(string source, string sourcename);
+		vector<Token> tokenizeSource(string path, string sourceName);
+		// Same as above, but the contents of the file are passed in instead of read from path
+		vector<Token> tokenizeSource(string path, string sourceName, string source);
 		File* getFile() { return curFile; }
 		Scanner();
 	private:
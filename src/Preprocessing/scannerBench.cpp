@@ -0,0 +1,48 @@
+// Measures tokenizer throughput, built as the scannerBench target(not part of the default build)
+//
+// Usage: scannerBench [path] [repetitions]
+// Without a path it tokenizes a generated ~1.2MB source with a mix of comments, identifiers, numbers and strings
+// Prints the best MB/s over all repetitions, the source is read(or generated) once so only Scanner::tokenizeSource is timed
+#include "scanner.h"
+#include "../files.h"
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+// 3000 functions with line and block comments, long identifiers, keywords, number and string literals
+// Built through a stringstream like readFile does, the allocator is then left in the same state as when ESL reads a file,
+// appending to a string instead made every repetition ~2x slower
+static string generateSource() {
+    std::stringstream out;
+    for (int f = 0; f < 3000; f++) {
+        string n = std::to_string(f);
+        out << "// function number " + n + " computes something useful\n";
+        out << "/* block comment\n   spanning lines */\nfn func" + n + "(alpha, beta, gamma) {\n";
+        out << "    let localVariable" + n + " = alpha * 2 + beta - gamma / 3.5;\n";
+        out << "    if (localVariable" + n + " > 100 and beta != null) {\n";
+        out << "        return \"a fairly long string literal number " + n + "\";\n    }\n";
+        out << "    for (let i = 0; i < 10; i++) { localVariable" + n + " += i; }\n";
+        out << "    return localVariable" + n + ";\n}\n\n";
+    }
+    return out.str();
+}
+
+int main(int argc, char* argv[]) {
+    string path = argc > 1 ? string(argv[1]) : "generated.esl";
+    int reps = argc > 2 ? std::stoi(argv[2]) : 20;
+    string source = argc > 1 ? readFile(path) : generateSource();
+
+    double best = 0;
+    size_t tokenCount = 0;
+    for (int i = 0; i < reps; i++) {
+        preprocessing::Scanner scanner;
+        string copy = source;
+        auto start = std::chrono::steady_clock::now();
+        vector<Token> tokens = scanner.tokenizeSource(path, "bench", std::move(copy));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, source.size() / seconds / 1e6);
+        tokenCount = tokens.size();
+        delete scanner.getFile();
+    }
+    printf("%zu bytes, %zu tokens, best of %d: %.1f MB/s\n", source.size(), tokenCount, reps, best);
+}
@@ -58,6 +58,19 @@ static void decThreadWait(runtime::Thread* t){
     // Only the main thread waits for mainThreadCv
     t->vm->mainThreadCv.notify_one();
 }
+static bool isCallable(Value val){
+    return isClosure(val) || isBoundMethod(val) || isNativeFn(val);
+}
+// Checks that every element of the array is a future
+static object::ObjArray* getFutureArray(runtime::Thread* t, Value arrVal){
+    if(!isArray(arrVal)) TYPE_ERROR("array", 0, arrVal);
+    auto arr = asArray(arrVal);
+    for(uInt64 i = 0; i < arr->values.size(); i++){
+        if(!isFuture(arr->values[i]))
+            t->runtimeError(fmt::format("Expected an array of futures, got '{}' at index {}", typeToStr(arr->values[i]), i), 3);
+    }
+    return arr;
+}
 #pragma endregion
 
 vector<object::ObjNativeFunc*> runtime::createNativeFuncs(){
@@ -305,9 +318,12 @@ vector<object::ObjNativeFunc*> runtime::createNativeFuncs(){
 
         auto arr = new object::ObjArray(arrSize);
         if(!isNil(fillVal)) std::fill(arr->values.begin(), arr->values.end(), fillVal);
+        if(isObj(fillVal)) arr->numOfHeapPtr = arr->values.size();
         t->push(encodeObj(arr));
     });
     NATIVE_FUNC("mutex", 0, [](Thread* t, int8_t argCount) {
+        // Mutexes and files can't be copied, so they always live in the shared heap
+        memory::SharedHeapScope scope;
         t->push(encodeObj(new object::ObjMutex()));
     });
 
@@ -315,6 +331,7 @@ vector<object::ObjNativeFunc*> runtime::createNativeFuncs(){
     NATIVE_FUNC("open_file_read", 1, [](Thread* t, int8_t argCount) {
         Value path = t->pop();
         if(!isString(path)) TYPE_ERROR("string", 0, path);
+        memory::SharedHeapScope scope;
         auto file = new object::ObjFile(asString(path)->str, 0);
         if(!file->stream.good()) t->runtimeError(fmt::format("File in path {} doesn't exist.", file->path), 7);
         file->stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -323,6 +340,7 @@ vector<object::ObjNativeFunc*> runtime::createNativeFuncs(){
     NATIVE_FUNC("open_file_write", 1, [](Thread* t, int8_t argCount) {
         Value path = t->pop();
         if(!isString(path)) TYPE_ERROR("string", 0, path);
+        memory::SharedHeapScope scope;
         auto file = new object::ObjFile(asString(path)->str, 1);
         if(!file->stream.good()) t->runtimeError(fmt::format("File in path {} doesn't exist.", file->path), 7);
         file->stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -377,6 +395,92 @@ vector<object::ObjNativeFunc*> runtime::createNativeFuncs(){
         t->push(encodeObj(new object::ObjRange(decodeNumber(start), decodeNumber(end), decodeBool(isEndInclusive))));
     });
 
+    // Data parallelism
+    NATIVE_FUNC("parallel_for", 2, [](Thread* t, int8_t argCount) {
+        // Both args stay on the stack until the job is done so that the GC can see them
+        Value func = t->peek(0);
+        Value rangeVal = t->peek(1);
+        if(!isRange(rangeVal)) TYPE_ERROR("range", 0, rangeVal);
+        if(!isCallable(func)) TYPE_ERROR("function", 1, func);
+        auto range = asRange(rangeVal);
+        if(!isInt(encodeNumber(range->start)) || !isInt(encodeNumber(range->end)))
+            t->runtimeError(fmt::format("Range {} must have integer bounds.", range->toString(nullptr)), 10);
+        if(range->start > range->end)
+            t->runtimeError(fmt::format("Start of range {} is a larger than end of range.", range->toString(nullptr)), 9);
+
+        int64_t end = static_cast<int64_t>(range->end) + (range->isEndInclusive ? 1 : 0);
+        runtime::ParallelJob job(func, static_cast<int64_t>(range->start), end, nullptr, nullptr);
+        // Reports the error of the first call that failed, as if it happened here
+        if(!t->vm->getWorkerPool()->run(t, job)) t->runtimeError(std::move(job.error), job.errorCode);
+        t->popn(2);
+        t->push(encodeNil());
+    });
+
+    // Same as 'async func(args)', except that the new thread gets a private heap which is collected independently of other threads
+    // Arguments and the return value are deep copied into the shared heap if they come from a private heap
+    NATIVE_FUNC("async_isolated", -1, [](Thread* t, int8_t argCount) {
+        if(argCount < 1) t->runtimeError("Expected a function to call, got no arguments.", 2);
+        Value callee = t->peek(argCount - 1);
+        if(!isCallable(callee)) TYPE_ERROR("function", 0, callee);
+        auto fut = t->launchAsync(argCount - 1, true);
+        t->push(encodeObj(fut));
+    });
+
+    // Futures, all of these wait on ObjFuture::done using Thread::blockUntil, so the GC can run while they're blocked
+    // Futures are kept on the stack while waiting so that they don't get collected
+    NATIVE_FUNC("await_all", 1, [](Thread* t, int8_t argCount) {
+        auto arr = getFutureArray(t, t->peek(0));
+        t->blockUntil([&]{
+            for(Value& fut : arr->values) if(!asFuture(fut)->done) return false;
+            return true;
+        });
+        auto results = new object::ObjArray(arr->values.size());
+        for(uInt64 i = 0; i < arr->values.size(); i++){
+            auto fut = asFuture(arr->values[i]);
+            // Thread object is already deleted, this only waits for the OS thread to exit
+            fut->fut.wait();
+            results->values[i] = fut->val;
+            if(isObj(fut->val)) results->numOfHeapPtr++;
+        }
+        MEM_ADD(sizeof(Value) * results->values.size());
+        t->pop();
+        t->push(encodeObj(results));
+    });
+    // Returns the index of a finished future
+    NATIVE_FUNC("await_any", 1, [](Thread* t, int8_t argCount) {
+        auto arr = getFutureArray(t, t->peek(0));
+        if(arr->values.empty()) t->runtimeError("Expected a non empty array of futures.", 3);
+        int64_t index = -1;
+        t->blockUntil([&]{
+            for(uInt64 i = 0; i < arr->values.size(); i++){
+                if(!asFuture(arr->values[i])->done) continue;
+                index = i;
+                return true;
+            }
+            return false;
+        });
+        t->pop();
+        t->push(encodeNumber(index));
+    });
+    // Returns the value of the future if it finishes in time, otherwise null
+    NATIVE_FUNC("await_timeout", 2, [](Thread* t, int8_t argCount) {
+        Value ms = t->peek(0);
+        Value futVal = t->peek(1);
+        if(!isFuture(futVal)) TYPE_ERROR("future", 0, futVal);
+        if(!isNumber(ms)) TYPE_ERROR("number", 1, ms);
+        if(decodeNumber(ms) < 0) t->runtimeError("Expected positive number for argument 1, got negative.", 3);
+        auto fut = asFuture(futVal);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(decodeNumber(ms) * 1000));
+
+        Value res = encodeNil();
+        if(t->blockUntil([&]{ return fut->done; }, deadline)){
+            fut->fut.wait();
+            res = fut->val;
+        }
+        t->popn(2);
+        t->push(res);
+    });
+
     return vector;
 }
 
@@ -399,6 +503,14 @@ do{                     \
 
 
 
+object::ObjClass* runtime::createBaseClass(){
+    auto baseClass = new object::ObjClass("base class", nullptr);
+    baseClass->methods.insert_or_assign(object::ObjString::createStr("to_string"), new object::ObjNativeFunc([](Thread* thread, int8_t argCount){
+        thread->push(encodeObj(object::ObjString::createStr(valueHelpers::toString(thread->pop()))));
+    }, 0, "to_string"));
+    return baseClass;
+}
+
 vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseClass){
     vector<object::ObjClass*> classes;
     // String
@@ -533,23 +645,31 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
         while((pos = baseString.find(delStr)) != baseString.npos){
             string temp = baseString.substr(0, pos);
             arr->values.push_back(encodeObj(object::ObjString::createStr(temp)));
+            arr->numOfHeapPtr++;
             MEM_ADD(8);
             baseString.erase(0, pos + delStr.length());
         }
         arr->values.push_back(encodeObj(object::ObjString::createStr(baseString)));
+        arr->numOfHeapPtr++;
         MEM_ADD(8);
         t->push(encodeObj(arr));
     });
     // Array
     ADD_CLASS("array");
     BOUND_NATIVE("push", 1, [](Thread*t, int8_t argCount){
+        auto arr = asArray(INLINE_PEEK(1));
+        t->checkEscape(arr, INLINE_PEEK(0));
         MEM_ADD(sizeof(Value));
-        asArray(INLINE_PEEK(1))->values.push_back(INLINE_POP());
+        // ObjArray::trace stops once it has seen numOfHeapPtr objects, so every native that adds or removes
+        // elements has to keep it up to date
+        if(isObj(INLINE_PEEK(0))) arr->numOfHeapPtr++;
+        arr->values.push_back(INLINE_POP());
     });
     BOUND_NATIVE("pop", 0, [](Thread*t, int8_t argCount){
         auto arr = asArray(t->pop());
         Value val = arr->values.back();
         MEM_ADD(-sizeof(Value));
+        if(isObj(val)) arr->numOfHeapPtr--;
         arr->values.pop_back();
         t->push(val);
     });
@@ -557,6 +677,7 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
         auto arr = asArray(t->pop());
         auto newArr = new object::ObjArray();
         newArr->values = arr->values;
+        newArr->numOfHeapPtr = arr->numOfHeapPtr;
         MEM_ADD(sizeof(Value)*newArr->values.size());
         t->push(encodeObj(newArr));
     });
@@ -571,8 +692,12 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
         isNumAndInt(t, newSize, 0);
         if(decodeNumber(newSize) < 0) t->runtimeError("Expected positive integer for argument 0, got negative.", 3);
         uInt64 s = decodeNumber(newSize);
-        auto& arr = asArray(t->peek(0))->values;
+        t->checkEscape(asArray(t->peek(0)), fill);
+        auto obj = asArray(t->peek(0));
+        auto& arr = obj->values;
         MEM_ADD(sizeof(Value)*(s - arr.size()));
+        for(uInt64 i = s; i < arr.size(); i++) if(isObj(arr[i])) obj->numOfHeapPtr--;
+        if(isObj(fill) && s > arr.size()) obj->numOfHeapPtr += s - arr.size();
         arr.resize(s, fill);
     });
     BOUND_NATIVE("length", 0, [](Thread*t, int8_t argCount){
@@ -587,8 +712,10 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
         int32_t ind = decodeInt(index);
         if(ind < 0 || ind > arr->values.size())
             t->runtimeError(fmt::format("Index {} outside of range [0, {}]", ind, arr->values.size()), 3);
+        t->checkEscape(arr, val);
 
         arr->values.insert(arr->values.begin() + ind, val);
+        if(isObj(val)) arr->numOfHeapPtr++;
         MEM_ADD(sizeof(Value));
     });
     BOUND_NATIVE("erase", 2, [](Thread*t, int8_t argCount){
@@ -604,6 +731,7 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
         if(len < 0) t->runtimeError("Expected positive integer for argument 1, got negative.", 3);
 
         auto end = (ind + len > arr->values.size()) ? arr->values.end() : arr->values.begin() + ind + len;
+        arr->numOfHeapPtr -= std::count_if(arr->values.begin() + ind, end, [](Value val){ return isObj(val); });
         arr->values.erase(arr->values.begin() + ind, end);
         MEM_ADD(-sizeof(Value));
     });
@@ -613,7 +741,9 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
         if(t->peek(0) == other) t->runtimeError("Cannot concat array to itself.", 3);
         auto& arr1 = asArray(t->peek(0))->values;
         auto& arr2 = asArray(other)->values;
+        if(t->heap) for(Value val : arr2) t->checkEscape(asArray(t->peek(0)), val);
         arr1.insert(arr1.end(), arr2.begin(), arr2.end());
+        asArray(t->peek(0))->numOfHeapPtr += asArray(other)->numOfHeapPtr;
         MEM_ADD(sizeof(Value) * arr2.size());
     });
     BOUND_NATIVE("reverse", 0, [](Thread*t, int8_t argCount){
@@ -637,6 +767,26 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
         }
         t->push(encodeBool(true));
     });
+    BOUND_NATIVE("parallel_map", 1, [](Thread*t, int8_t argCount){
+        Value func = t->peek(0);
+        if(!isCallable(func)) TYPE_ERROR("function", 0, func);
+        auto arr = asArray(t->peek(1));
+        uInt64 size = arr->values.size();
+        // Workers read the values from a copy, so calls that modify the array don't change what the other calls get
+        // Every slot of the copy is then overwritten with its result, the copy is kept on the stack during the job as a GC root
+        auto result = new object::ObjArray(size);
+        std::copy(arr->values.begin(), arr->values.end(), result->values.begin());
+        MEM_ADD(sizeof(Value) * size);
+        // Until the job is done we don't know how many results are objects, so the whole array gets traced
+        result->numOfHeapPtr = size;
+        t->push(encodeObj(result));
+
+        runtime::ParallelJob job(func, 0, size, result, result);
+        if(!t->vm->getWorkerPool()->run(t, job)) t->runtimeError(std::move(job.error), job.errorCode);
+        result->numOfHeapPtr = job.heapPtrs.load();
+        t->popn(3);
+        t->push(encodeObj(result));
+    });
     // File
     ADD_CLASS("file");
     BOUND_NATIVE("open_read", 0, [](Thread*t, int8_t argCount){
@@ -728,14 +878,22 @@ vector<object::ObjClass*> runtime::createBuiltinClasses(object::ObjClass* baseCl
     ADD_CLASS("future");
     BOUND_NATIVE("cancel", 0, [](Thread*t, int8_t argCount){
         auto fut = asFuture(t->pop());
-        fut->thread->cancelToken.store(true, std::memory_order_relaxed);
-        fut->thread->pauseToken.store(true, std::memory_order_relaxed);
+        {
+            // Thread object gets deleted under vm->mtx once it finishes, cancelling a finished future does nothing
+            std::lock_guard<std::mutex> lk(t->vm->mtx);
+            if(fut->thread) {
+                fut->thread->cancelToken.store(true, std::memory_order_relaxed);
+                fut->thread->pauseToken.store(true, std::memory_order_relaxed);
+            }
+        }
         t->push(encodeNil());
     });
     BOUND_NATIVE("is_done", 0, [](Thread*t, int8_t argCount){
         auto fut = asFuture(t->pop());
-        auto done = fut->fut.wait_until(std::chrono::system_clock::time_point::min());
-        t->push(encodeBool(!(done == std::future_status::timeout)));
+        std::unique_lock lk(t->vm->pauseMtx);
+        bool done = fut->done;
+        lk.unlock();
+        t->push(encodeBool(done));
     });
     return classes;
 }
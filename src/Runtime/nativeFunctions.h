@@ -17,6 +17,9 @@ namespace runtime {
 
     ankerl::unordered_dense::map<string, uInt> createNativeNameTable(vector<object::ObjNativeFunc *>& natives);
 
+    // Class every user class without a superclass gets its methods from
+    object::ObjClass* createBaseClass();
+
     vector<object::ObjClass*> createBuiltinClasses(object::ObjClass* baseClass);
 }
 
@@ -15,9 +15,17 @@ using namespace valueHelpers;
 runtime::Thread::Thread(VM* _vm){
     stackTop = stack;
     frameCount = 0;
+    exitFrameCount = 0;
     cancelToken.store(false);
     pauseToken.store(false);
     vm = _vm;
+    heap = nullptr;
+    defersErrors = false;
+    errorCode = 0;
+}
+
+runtime::Thread::~Thread() {
+    delete heap;
 }
 
 // Copies the callee and all arguments, otherStack points to the callee, arguments are on top of it on the stack
@@ -115,10 +123,11 @@ void runtime::Thread::callFunc(object::ObjClosure* closure, int8_t argCount) {
     if (frameCount == FRAMES_MAX) {
         runtimeError("Stack overflow.", 1);
     }
+    const byte* code = funcCode(closure->func);
 
     CallFrame* frame = &frames[frameCount++];
     frame->closure = closure;
-    frame->ip = &vm->code.bytecode[closure->func->bytecodeOffset];
+    frame->ip = code;
     frame->slots = stackTop - argCount - 1;
 }
 
@@ -134,10 +143,11 @@ void runtime::Thread::callMethod(object::Method method, int8_t argCount) {
         if (frameCount == FRAMES_MAX) {
             runtimeError("Stack overflow.", 1);
         }
+        const byte* code = funcCode(closure->func);
 
         CallFrame *frame = &frames[frameCount++];
         frame->closure = closure;
-        frame->ip = &vm->code.bytecode[closure->func->bytecodeOffset];
+        frame->ip = code;
         frame->slots = stackTop - argCount - 1;
         return;
     }
@@ -148,6 +158,15 @@ void runtime::Thread::callMethod(object::Method method, int8_t argCount) {
     return native->func(this, argCount);
 }
 
+// Every function is resolved by the VM on its first call, and lazily compiled ones are compiled then
+const byte* runtime::Thread::funcCode(object::ObjFunc* func) {
+    const byte* code = std::atomic_ref<const byte*>(func->code).load(std::memory_order_acquire);
+    if (code) [[likely]] return code;
+    code = vm->prepareFunc(func);
+    if (!code) runtimeError(fmt::format("Function {} failed to compile.", func->name), 64);
+    return code;
+}
+
 static object::ObjUpval* captureUpvalue(Value* local) {
     return asUpvalue(*local);
 }
@@ -212,6 +231,13 @@ static int64_t checkArrayBounds(runtime::Thread* t, Value& field, Value& callee,
     return index;
 }
 
+// GET_INDEX and SET_INDEX only get non negative integers as the index, so only the upper bound needs to be checked
+static uInt64 checkArrayIndex(runtime::Thread* t, Value& field, object::ObjArray* arr) {
+    uInt64 index = decodeNumber(field);
+    if (index >= arr->values.size()) { t->runtimeError(fmt::format("Index {} outside of range [0, {}].", index, arr->values.size() - 1), 9); }
+    return index;
+}
+
 __attribute__((noinline)) static void deleteThread(object::ObjFuture* _fut, runtime::VM* vm) {
     std::condition_variable &cv = vm->mainThreadCv;
     // If execution is finishing and the main thread is waiting to run the gc
@@ -228,8 +254,11 @@ __attribute__((noinline)) static void deleteThread(object::ObjFuture* _fut, runt
                 break;
             }
         }
+        // Anyone blocked on this future(await, await_all...) checks this flag, it's only ever written under vm->pauseMtx
+        _fut->done = true;
     }
     cv.notify_one();
+    vm->childThreadsCv.notify_all();
 }
 
 __attribute__((noinline)) static bool handlePauseToken(runtime::Thread* t, object::ObjFuture* fut){
@@ -243,9 +272,19 @@ __attribute__((noinline)) static bool handlePauseToken(runtime::Thread* t, objec
         deleteThread(fut, vm);
         return true;
     }
+    // Isolated threads collect their own heap without stopping anyone else
+    if (t->heap && t->heap->shouldCollect) {
+        t->heap->collect();
+        // pauseAllThreads sets the token while holding vm->mtx, so a global collection requested meanwhile isn't missed
+        std::scoped_lock lk(vm->mtx);
+        if (!memory::gc.shouldCollect.load()) {
+            t->pauseToken.store(false, std::memory_order_relaxed);
+            return false;
+        }
+    }
     // If this thread is paused and is not cancelled, then it must be paused to run the GC
-    if (!fut) {
-        // If fut is null, this is the main thread of execution which runs the GC
+    if (t == vm->mainThread) {
+        // Main thread of execution runs the GC
         if (vm->allThreadsPaused()) {
             memory::gc.collect();
         } else {
@@ -276,6 +315,43 @@ __attribute__((noinline)) static bool handlePauseToken(runtime::Thread* t, objec
     return false;
 }
 
+// Switches with at most this many cases are scanned linearly, larger ones are binary searched
+#define SWITCH_LINEAR_LIMIT 8
+
+// Case constants of SWITCH and SWITCH_LONG are sorted by their raw value
+// Returns index of the matching constant, or caseNum(default) if there's none
+template<typename T>
+static uInt searchSwitchCases(Value val, uInt caseNum, T getConstant) {
+    if (caseNum <= SWITCH_LINEAR_LIMIT) {
+        for (uInt i = 0; i < caseNum; i++) {
+            if (getConstant(i) == val) return i;
+        }
+        return caseNum;
+    }
+    uInt low = 0, high = caseNum;
+    while (low < high) {
+        uInt mid = low + (high - low) / 2;
+        Value constant = getConstant(mid);
+        if (constant == val) return mid;
+        if (constant < val) low = mid + 1;
+        else high = mid;
+    }
+    return caseNum;
+}
+#undef SWITCH_LINEAR_LIMIT
+
+// String case constants are interned, so raw values only differ for strings built at runtime(eg. by concatenation)
+// which are looked up in the intern table on a miss
+template<typename T>
+static uInt findSwitchCase(Value val, uInt caseNum, T getConstant) {
+    uInt index = searchSwitchCases(val, caseNum, getConstant);
+    if (index == caseNum && isString(val)) {
+        object::ObjString* interned = memory::gc.interned.find(asString(val)->str);
+        if (interned && interned != asString(val)) index = searchSwitchCases(encodeObj(interned), caseNum, getConstant);
+    }
+    return index;
+}
+
 static void tryIncrement(runtime::Thread *t, byte arg, Value &val) {
     if (!isNumber(val)) t->runtimeError(fmt::format("Operand must be a number, got {}.", typeToStr(val)), 3);
     t->push(val);
@@ -295,8 +371,8 @@ __attribute__((noinline)) static void printRuntimeError(CallFrame* frames, uint1
         CallFrame* frame = &frames[i];
         object::ObjFunc* function = frame->closure->func;
         // Converts ip from a pointer to a index in the array
-        uInt64 instruction = (frame->ip - 1) - vm->code.bytecode.data();
-        codeLine line = vm->code.getLine(instruction);
+        uInt64 instruction;
+        codeLine line = vm->chunkAt(frame->ip - 1, instruction)->getLine(instruction);
         //fileName:line | in <func name>
         std::cout<<fmt::format("{}:{} | in {}\n",
                                fmt::styled(line.getFileName(vm->sourceFiles), yellow),
@@ -343,6 +419,13 @@ __attribute__((noinline)) static int64_t normalizeRangeEnd(runtime::Thread* t, o
     return res;
 }
 
+// Range bounds that are passed on the stack(IN_RANGE, GET_RANGE, SET_RANGE) get the same checks as create_range
+// and the same messages, start and end are arguments 0 and 1 of create_range
+static void checkRangeBounds(runtime::Thread* t, Value start, Value end){
+    if(!isNumber(end)) t->runtimeError(fmt::format("Expected number for argument 1, got '{}'", typeToStr(end)), 3);
+    if(!isNumber(start)) t->runtimeError(fmt::format("Expected number for argument 0, got '{}'", typeToStr(start)), 3);
+}
+
 __attribute__((noinline)) static bool isInRange(object::ObjRange* range, double num) {
     int lowerBound, upperBound;
     if (range->start <= range->end) {
@@ -358,23 +441,128 @@ __attribute__((noinline)) static bool isInRange(object::ObjRange* range, double
 }
 #pragma endregion
 
+// Pushes callee and args to the stack and runs the call to completion, if called from a native the
+// current frames are left untouched and execution returns to the native once the call finishes
+bool runtime::Thread::executeCall(Value callee, Value* args, int8_t argCount, Value& result) {
+    Value* base = stackTop;
+    uint16_t prevExitFrameCount = exitFrameCount;
+    uint16_t baseFrameCount = frameCount;
+    bool success = true;
+    try {
+        push(callee);
+        for (int i = 0; i < argCount; i++) push(args[i]);
+        callValue(callee, argCount);
+    } catch (int errCode) {
+        if (defersErrors) errorCode = errCode;
+        else printRuntimeError(frames, frameCount, vm, errCode, errorString);
+        success = false;
+    }
+    // Natives and classes without constructors finish inside callValue, everything else pushed a new frame
+    if (success && frameCount > baseFrameCount) {
+        exitFrameCount = baseFrameCount;
+        executeBytecode();
+        exitFrameCount = prevExitFrameCount;
+        // executeBytecode only leaves frames behind if it was stopped by a runtime error
+        success = frameCount == baseFrameCount;
+    }
+    if (success) result = stackTop[-1];
+    frameCount = baseFrameCount;
+    stackTop = base;
+    return success;
+}
+
+bool runtime::Thread::blockUntil(const std::function<bool()>& pred, std::chrono::steady_clock::time_point deadline) {
+    bool hasDeadline = deadline != std::chrono::steady_clock::time_point::max();
+    std::unique_lock lk(vm->pauseMtx);
+    // Returns false if the deadline passed before cond became true
+    auto wait = [&](std::condition_variable& cv, const std::function<bool()>& cond) {
+        if (!hasDeadline) {
+            cv.wait(lk, cond);
+            return true;
+        }
+        return cv.wait_until(lk, deadline, cond);
+    };
+
+    if (this == vm->mainThread) {
+        // Main thread runs the GC, so instead of counting as paused it has to wake up and collect if some other thread requested it
+        while (true) {
+            if (!wait(vm->mainThreadCv, [&] { return pred() || memory::gc.shouldCollect.load(); })) return false;
+            if (!memory::gc.shouldCollect.load()) return true;
+            vm->mainThreadCv.wait(lk, [&] { return vm->allThreadsPaused(); });
+            // Release the mutex here so that GC can acquire it
+            lk.unlock();
+            memory::gc.collect();
+            lk.lock();
+        }
+    }
+    // Child threads are considered paused while blocked, and don't continue until the GC run is finished
+    vm->threadsPaused.fetch_add(1);
+    vm->mainThreadCv.notify_one();
+    if (!wait(vm->childThreadsCv, [&] { return pred() && !memory::gc.shouldCollect.load(); })) {
+        // Timed out, but if the GC is running this thread still has to stay paused until it's done
+        vm->childThreadsCv.wait(lk, [] { return !memory::gc.shouldCollect.load(); });
+    }
+    vm->threadsPaused.fetch_sub(1);
+    return pred();
+}
+
+object::ObjFuture* runtime::Thread::launchAsync(int8_t argCount, bool isolated) {
+    Value* callee = &stackTop[-1 - argCount];
+    // The new thread can't see this thread's heap, so arguments from it are sent over as copies
+    if (heap) {
+        for (Value* val = callee; val < stackTop; val++) *val = heap->promote(*val);
+    }
+    // Anything created while starting the thread(future, instance of a class being called...) is reachable from both threads
+    memory::SharedHeapScope scope;
+    auto *t = new Thread(vm);
+    if (isolated) t->heap = new memory::LocalHeap(t);
+    auto *newFut = new object::ObjFuture(t);
+    // Ensures that ObjFuture tied to this thread lives long enough for the thread to finish execution
+    t->copyVal(encodeObj(newFut));
+    // Copies the function being called and the arguments
+    // The call is set up on this OS thread, so if that fails(wrong number of arguments, a lazily compiled function that
+    // doesn't compile...) the error is reported by this thread and the new one is discarded before it ever runs
+    try {
+        t->startThread(callee, argCount + 1);
+    } catch (int errCode) {
+        errorString = std::move(t->errorString);
+        newFut->thread = nullptr;
+        newFut->done = true;
+        delete t;
+        throw errCode;
+    }
+    stackTop -= argCount + 1;
+    {
+        // Only one thread can add/remove a new child thread at any time
+        std::lock_guard<std::mutex> lk(vm->mtx);
+        vm->childThreads.push_back(t);
+    }
+    newFut->startParallelExecution();
+    return newFut;
+}
+
+void runtime::Thread::checkEscapeIsolated(object::Obj* target, Value val) {
+    if (!isObj(val) || !heap->owns(decodeObj(val))) return;
+    if (target && heap->owns(target)) return;
+    runtimeError(fmt::format("Isolated task can't store its own {} into shared memory, return it instead.", typeToStr(val)), 3);
+}
+
 void runtime::Thread::executeBytecode() {
     #ifdef DEBUG_TRACE_EXECUTION
     std::cout << "-------------Code execution starts-------------\n";
     #endif // DEBUG_TRACE_EXECUTION
     // C++ is more likely to put these locals in registers which speeds things up
     CallFrame* frame = &frames[frameCount - 1];
-    byte* ip = &vm->code.bytecode[frame->closure->func->bytecodeOffset];
+    const byte* ip = frame->ip;
     Value* slotStart = frame->slots;
-    uint64_t constantOffset = frame->closure->func->constantsOffset;
-    Value* constants = vm->code.constants.data();
+    Value* constants = frame->closure->func->constants;
 
 
     #pragma region Helpers & Macros
     #define READ_BYTE() (*ip++)
     #define READ_SHORT() (ip += 2, static_cast<uint16_t>((ip[-2] << 8) | ip[-1]))
-    #define READ_CONSTANT() (constants[constantOffset + READ_BYTE()])
-    #define READ_CONSTANT_LONG() (constants[constantOffset + READ_SHORT()])
+    #define READ_CONSTANT() (constants[READ_BYTE()])
+    #define READ_CONSTANT_LONG() (constants[READ_SHORT()])
     #define READ_STRING() (asString(READ_CONSTANT()))
     #define READ_STRING_LONG() (asString(READ_CONSTANT_LONG()))
 
@@ -385,7 +573,7 @@ void runtime::Thread::executeBytecode() {
     frame = &frames[frameCount - 1],										\
     slotStart = frame->slots,												\
     ip = frame->ip,                                                         \
-    constantOffset = frame->closure->func->constantsOffset)
+    constants = frame->closure->func->constants)
 
     #define BINARY_OP(op)                                                                                                                           \
     Value a = peek(1), b = peek(0);                                                                                                                 \
@@ -393,6 +581,10 @@ void runtime::Thread::executeBytecode() {
     *(--stackTop - 1) = encodeNumber(decodeNumber(a) op decodeNumber(b))                                                                            \
 
 
+    #define UNCHECKED_BINARY_OP(op)                                     \
+    Value a = peek(1), b = peek(0);                                     \
+    *(--stackTop - 1) = encodeNumber(decodeNumber(a) op decodeNumber(b))  \
+
     #define INT_BINARY_OP(op)                                                                                                                  \
     Value a = peek(1), b = peek(0);                                                                                                            \
     if (!isInt(a) || !isInt(b)) { runtimeError(fmt::format("Operands must be integers, got '{}' and '{}'.", typeToStr(a), typeToStr(b)), 3); } \
@@ -414,7 +606,9 @@ void runtime::Thread::executeBytecode() {
                 std::cout << "] ";
             }
             std::cout << "\n";
-            disassembleInstruction(&vm->code, ip - vm->code.bytecode.data(), frame->closure->func->constantsOffset);
+            uInt64 offset;
+            Chunk* chunk = vm->chunkAt(ip, offset);
+            disassembleInstruction(chunk, offset, frame->closure->func->constantsOffset);
         #endif
         switch(READ_BYTE()) {
             #pragma region Helper opcodes
@@ -460,6 +654,10 @@ void runtime::Thread::executeBytecode() {
                 *(stackTop - 1) ^= (1ll << 63);
                 DISPATCH();
             }
+            case +OpCode::NEGATE_NUM:{
+                *(stackTop - 1) ^= (1ll << 63);
+                DISPATCH();
+            }
             case +OpCode::NOT:{
                 push(encodeBool(isFalsey(pop())));
                 DISPATCH();
@@ -497,15 +695,14 @@ void runtime::Thread::executeBytecode() {
                         Value &num = frame->closure->upvals[slot]->val;
                         INCREMENT(num);
                     }
-                    case 3: {
-                        byte index = READ_BYTE();
-                        Globalvar &var = vm->globals[index];
-                        INCREMENT(var.val);
-                    }
+                    case 3: [[fallthrough]];
                     case 4: {
-                        byte index = READ_SHORT();
-                        Globalvar &var = vm->globals[index];
-                        INCREMENT(var.val);
+                        // Load and store are separate, same as for any other global read-modify-write from a script
+                        uInt index = type == 3 ? READ_BYTE() : READ_SHORT();
+                        Value val = vm->getGlobal(index);
+                        tryIncrement(this, arg, val);
+                        vm->setGlobal(index, val);
+                        DISPATCH();
                     }
                     case 5:[[fallthrough]];
                     case 6: {
@@ -610,6 +807,29 @@ void runtime::Thread::executeBytecode() {
                 INT_BINARY_OP(>>);
                 DISPATCH();
             }
+            // Operands are guaranteed to be numbers/strings by the compiler
+            case +OpCode::ADD_NUM: {
+                UNCHECKED_BINARY_OP(+);
+                DISPATCH();
+            }
+            case +OpCode::SUBTRACT_NUM: {
+                UNCHECKED_BINARY_OP(-);
+                DISPATCH();
+            }
+            case +OpCode::MULTIPLY_NUM: {
+                UNCHECKED_BINARY_OP(*);
+                DISPATCH();
+            }
+            case +OpCode::DIVIDE_NUM: {
+                UNCHECKED_BINARY_OP(/);
+                DISPATCH();
+            }
+            case +OpCode::ADD_STR: {
+                object::ObjString *b = asString(pop());
+                object::ObjString *a = asString(pop());
+                push(encodeObj(a->concat(b)));
+                DISPATCH();
+            }
             #pragma endregion
 
             #pragma region Comparison opcodes
@@ -673,6 +893,38 @@ void runtime::Thread::executeBytecode() {
                 push(encodeBool(isInRange(asRange(range), decodeNumber(num))));
                 DISPATCH();
             }
+            case +OpCode::GREATER_NUM:{
+                Value a = peek(1), b = peek(0);
+                *(--stackTop - 1) = encodeBool(decodeNumber(a) > decodeNumber(b));
+                DISPATCH();
+            }
+            case +OpCode::GREATER_EQUAL_NUM:{
+                Value a = peek(1), b = peek(0);
+                *(--stackTop - 1) = encodeBool(decodeNumber(a) >= decodeNumber(b) - DBL_EPSILON);
+                DISPATCH();
+            }
+            case +OpCode::LESS_NUM:{
+                Value a = peek(1), b = peek(0);
+                *(--stackTop - 1) = encodeBool(decodeNumber(a) < decodeNumber(b));
+                DISPATCH();
+            }
+            case +OpCode::LESS_EQUAL_NUM:{
+                Value a = peek(1), b = peek(0);
+                *(--stackTop - 1) = encodeBool(decodeNumber(a) < decodeNumber(b) + DBL_EPSILON);
+                DISPATCH();
+            }
+            case +OpCode::IN_RANGE:{
+                bool isEndInclusive = READ_BYTE();
+                Value end = pop(), start = pop(), num = pop();
+                checkRangeBounds(this, start, end);
+                if(!isNumber(num)){
+                    runtimeError(fmt::format("Expected number as left operand, got {}.", typeToStr(num)), 3);
+                }
+                // Never escapes this instruction, so there's no need to allocate it on the heap
+                object::ObjRange range(decodeNumber(start), decodeNumber(end), isEndInclusive);
+                push(encodeBool(isInRange(&range, decodeNumber(num))));
+                DISPATCH();
+            }
             #pragma endregion
 
             #pragma region Statements and var
@@ -682,28 +934,22 @@ void runtime::Thread::executeBytecode() {
             }
 
             case +OpCode::GET_GLOBAL:{
-                byte index = READ_BYTE();
-                Globalvar &var = vm->globals[index];
-                push(var.val);
+                push(vm->getGlobal(READ_BYTE()));
                 DISPATCH();
             }
             case +OpCode::GET_GLOBAL_LONG:{
-                uInt index = READ_SHORT();
-                Globalvar &var = vm->globals[index];
-                push(var.val);
+                push(vm->getGlobal(READ_SHORT()));
                 DISPATCH();
             }
 
             case +OpCode::SET_GLOBAL:{
-                byte index = READ_BYTE();
-                Globalvar &var = vm->globals[index];
-                var.val = peek(0);
+                checkEscape(nullptr, peek(0));
+                vm->setGlobal(READ_BYTE(), peek(0));
                 DISPATCH();
             }
             case +OpCode::SET_GLOBAL_LONG:{
-                uInt index = READ_SHORT();
-                Globalvar &var = vm->globals[index];
-                var.val = peek(0);
+                checkEscape(nullptr, peek(0));
+                vm->setGlobal(READ_SHORT(), peek(0));
                 DISPATCH();
             }
 
@@ -728,7 +974,9 @@ void runtime::Thread::executeBytecode() {
                 DISPATCH();
             }
             case +OpCode::SET_LOCAL_UPVALUE:{
-                asUpvalue(slotStart[READ_BYTE()])->val = peek(0);
+                object::ObjUpval* upval = asUpvalue(slotStart[READ_BYTE()]);
+                checkEscape(upval, peek(0));
+                upval->val = peek(0);
                 DISPATCH();
             }
 
@@ -739,6 +987,7 @@ void runtime::Thread::executeBytecode() {
             }
             case +OpCode::SET_UPVALUE:{
                 uint8_t slot = READ_BYTE();
+                checkEscape(frame->closure->upvals[slot], peek(0));
                 frame->closure->upvals[slot]->val = peek(0);
                 DISPATCH();
             }
@@ -766,6 +1015,11 @@ void runtime::Thread::executeBytecode() {
                 if (isFalsey(pop())) ip += offset;
                 DISPATCH();
             }
+            case +OpCode::JUMP_IF_TRUE_POP:{
+                uint16_t offset = READ_SHORT();
+                if (!isFalsey(pop())) ip += offset;
+                DISPATCH();
+            }
 
             case +OpCode::LOOP_IF_TRUE:{
                 uint16_t offset = READ_SHORT();
@@ -787,20 +1041,9 @@ void runtime::Thread::executeBytecode() {
             case +OpCode::SWITCH:{
                 Value val = pop();
                 uInt caseNum = READ_SHORT();
-                // Offset into jump indexes
-                byte *offset = ip + caseNum;
-                // Place in the bytecode where the jump is held
-                byte *jumpOffset = nullptr;
-                for (int i = 0; i < caseNum; i++) {
-                    if (val == READ_CONSTANT()) {
-                        jumpOffset = offset + (i * 2);
-                        break;
-                    }
-                }
-                // Default
-                if (!jumpOffset) jumpOffset = offset + caseNum * 2;
-                ip = jumpOffset;
-                uInt debug = ip - vm->code.bytecode.data();
+                uInt index = findSwitchCase(val, caseNum, [&](uInt i){ return constants[ip[i]]; });
+                // Jump offsets are after the constants, default is always the last one
+                ip += caseNum + index * 2;
                 uInt jmp = READ_SHORT();
                 ip += jmp;
                 DISPATCH();
@@ -808,18 +1051,25 @@ void runtime::Thread::executeBytecode() {
             case +OpCode::SWITCH_LONG:{
                 Value val = pop();
                 uInt caseNum = READ_SHORT();
-                // Offset into jump indexes
-                byte *offset = ip + caseNum * 2;
-                // Place in the bytecode where the jump is held
-                byte *jumpOffset = nullptr;
-                for (int i = 0; i < caseNum; i++) {
-                    if (val == READ_CONSTANT_LONG()) {
-                        jumpOffset = offset + (i * 2);
-                        break;
-                    }
+                uInt index = findSwitchCase(val, caseNum, [&](uInt i){
+                    return constants[(ip[i * 2] << 8) | ip[i * 2 + 1]];
+                });
+                ip += caseNum * 2 + index * 2;
+                uInt jmp = READ_SHORT();
+                ip += jmp;
+                DISPATCH();
+            }
+            case +OpCode::SWITCH_TABLE:{
+                Value val = pop();
+                double low = decodeNumber(READ_CONSTANT_LONG());
+                uInt size = READ_SHORT();
+                // Anything that isn't an integer inside the table range goes to default, which is right after the table
+                uInt index = size;
+                if (isNumber(val)) {
+                    double slot = decodeNumber(val) - low;
+                    if (slot >= 0 && slot < size && slot == std::trunc(slot)) index = slot;
                 }
-                if (!jumpOffset) jumpOffset = offset + caseNum * 2;
-                ip = jumpOffset;
+                ip += index * 2;
                 uInt jmp = READ_SHORT();
                 ip += jmp;
                 DISPATCH();
@@ -842,14 +1092,20 @@ void runtime::Thread::executeBytecode() {
             {
                 Value result = pop();
                 frameCount--;
-                // If we're returning from the implicit function
-                if (frameCount == 0) {
-                    // Main thread doesn't have a future nor does it need to delete the thread
+                // If we're returning from the implicit function or from a call made by executeCall
+                if (frameCount == exitFrameCount) {
+                    // Main thread and worker threads don't have a future nor do they need to delete the thread
                     auto fut = asFuture(stack[0]);
-                    if (fut == nullptr) return;
+                    if (fut == nullptr || exitFrameCount != 0) {
+                        // Leave the result in place of the callee so that executeCall can retrieve it
+                        stackTop = slotStart;
+                        push(result);
+                        return;
+                    }
 
                     // If this is a child thread that has a future attached to it, assign the value to the future
-                    fut->val = result;
+                    // Isolated threads hand over a copy since their heap is freed together with the thread
+                    fut->val = heap ? heap->promote(result) : result;
                     deleteThread(fut, vm);
                     return;
                 }
@@ -881,34 +1137,24 @@ void runtime::Thread::executeBytecode() {
             case +OpCode::LAUNCH_ASYNC:
             {
                 byte argCount = READ_BYTE();
-                auto *t = new Thread(vm);
-                auto *newFut = new object::ObjFuture(t);
-                // Ensures that ObjFuture tied to this thread lives long enough for the thread to finish execution
-                t->copyVal(encodeObj(newFut));
-                // Copies the function being called and the arguments
-                t->startThread(&stackTop[-1 - argCount], argCount + 1);
-                stackTop -= argCount + 1;
-                {
-                    // Only one thread can add/remove a new child thread at any time
-                    std::lock_guard<std::mutex> lk(vm->mtx);
-                    vm->childThreads.push_back(t);
-                }
-                newFut->startParallelExecution();
+                auto *newFut = launchAsync(argCount, false);
                 push(encodeObj(newFut));
                 DISPATCH();
             }
 
             case +OpCode::AWAIT:
             {
-                Value val = pop();
+                // Future stays on the stack while waiting so that the GC doesn't collect it
+                Value val = peek(0);
                 if (!isFuture(val))
                     runtimeError(fmt::format("Await can only be applied to a future, got {}", typeToStr(val)), 3);
                 object::ObjFuture *futToAwait = asFuture(val);
+                // Waiting this way lets the GC run while this thread is blocked
+                blockUntil([&]{ return futToAwait->done; });
+                // The thread object is already deleted at this point, this only waits for the OS thread to exit
                 futToAwait->fut.wait();
-                // Immediately delete the thread object to conserve memory
-                deleteThread(futToAwait, vm);
                 // Can safely access fut->val from this thread since the value is being read and won't be written to again
-                push(futToAwait->val);
+                stackTop[-1] = futToAwait->val;
                 DISPATCH();
             }
             #pragma endregion
@@ -950,6 +1196,7 @@ void runtime::Thread::executeBytecode() {
                         auto *newArr = new object::ObjArray(end - start);
                         for(int i = 0; i < newArr->values.size(); i++){
                             newArr->values[i] = arr->values[start + i];
+                            if(isObj(newArr->values[i])) newArr->numOfHeapPtr++;
                         }
                         push(encodeObj(newArr));
                         DISPATCH();
@@ -983,6 +1230,7 @@ void runtime::Thread::executeBytecode() {
 
                 if (isArray(callee)) {
                     object::ObjArray *arr = asArray(callee);
+                    checkEscape(arr, val);
                     if(isRange(field)){
                         auto range = asRange(field);
                         double start = normalizeRangeStart(this, range, arr->values.size());
@@ -1006,12 +1254,123 @@ void runtime::Thread::executeBytecode() {
 
                     object::ObjHashMap *instance = asHashMap(callee);
                     object::ObjString *str = asString(field);
+                    checkEscape(instance, field);
+                    checkEscape(instance, val);
                     //setting will always succeed, and we don't care if we're overriding an existing field, or creating a new one
                     instance->fields.insert_or_assign(str, val);
                     DISPATCH();
                 }
                 runtimeError(fmt::format("Expected an array or hash map, got {}.", typeToStr(callee)), 3);
             }
+
+            case +OpCode::GET_RANGE:{
+                bool isEndInclusive = READ_BYTE();
+                Value end = pop(), start = pop();
+                Value callee = pop();
+                checkRangeBounds(this, start, end);
+                if(!isArray(callee)){
+                    runtimeError(fmt::format("Expected an array, got {}.", typeToStr(callee)), 3);
+                }
+                object::ObjArray *arr = asArray(callee);
+                object::ObjRange range(decodeNumber(start), decodeNumber(end), isEndInclusive);
+                int64_t rangeStart = normalizeRangeStart(this, &range, arr->values.size());
+                int64_t rangeEnd = normalizeRangeEnd(this, &range, arr->values.size());
+                if(rangeStart > rangeEnd){
+                    runtimeError(fmt::format("Start of range {} is a larger than end of range.", range.toString(nullptr)), 9);
+                }
+                // Keep the array on the stack while allocating the slice so that the GC can see it
+                push(callee);
+                auto *newArr = new object::ObjArray(rangeEnd - rangeStart);
+                for(int i = 0; i < newArr->values.size(); i++){
+                    newArr->values[i] = arr->values[rangeStart + i];
+                    if (isObj(newArr->values[i])) newArr->numOfHeapPtr++;
+                }
+                *(stackTop - 1) = encodeObj(newArr);
+                DISPATCH();
+            }
+
+            case +OpCode::SET_RANGE:{
+                bool isEndInclusive = READ_BYTE();
+                Value end = pop(), start = pop();
+                Value callee = pop();
+                Value val = peek(0);
+                checkRangeBounds(this, start, end);
+                if(!isArray(callee)){
+                    runtimeError(fmt::format("Expected an array, got {}.", typeToStr(callee)), 3);
+                }
+                object::ObjArray *arr = asArray(callee);
+                checkEscape(arr, val);
+                object::ObjRange range(decodeNumber(start), decodeNumber(end), isEndInclusive);
+                int64_t rangeStart = normalizeRangeStart(this, &range, arr->values.size());
+                int64_t rangeEnd = normalizeRangeEnd(this, &range, arr->values.size());
+                if(rangeStart > rangeEnd){
+                    runtimeError(fmt::format("Start of range {} is a larger than end of range.", range.toString(nullptr)), 9);
+                }
+                for(int64_t i = rangeStart; i < rangeEnd; i++){
+                    if (isObj(val) && !isObj(arr->values[i])) arr->numOfHeapPtr++;
+                    else if (!isObj(val) && isObj(arr->values[i])) arr->numOfHeapPtr--;
+                    arr->values[i] = val;
+                }
+                DISPATCH();
+            }
+
+            case +OpCode::GET_INDEX:{
+                Value field = pop();
+                Value callee = pop();
+                if (isArray(callee)) {
+                    object::ObjArray *arr = asArray(callee);
+                    push(arr->values[checkArrayIndex(this, field, arr)]);
+                    DISPATCH();
+                }
+                // Same errors as GET, hash maps can only be accessed with strings
+                if (isHashMap(callee)) runtimeError(fmt::format("Expected a string for field name, got {}.", typeToStr(field)), 3);
+                runtimeError(fmt::format("Expected an array or hash map, got {}.", typeToStr(callee)), 3);
+            }
+
+            case +OpCode::SET_INDEX:{
+                Value field = pop();
+                Value callee = pop();
+                Value val = peek(0);
+                if (isArray(callee)) {
+                    object::ObjArray *arr = asArray(callee);
+                    checkEscape(arr, val);
+                    uInt64 index = checkArrayIndex(this, field, arr);
+                    if (isObj(val) && !isObj(arr->values[index])) arr->numOfHeapPtr++;
+                    else if (!isObj(val) && isObj(arr->values[index])) arr->numOfHeapPtr--;
+                    arr->values[index] = val;
+                    DISPATCH();
+                }
+                if (isHashMap(callee)) runtimeError(fmt::format("Expected a string for field name, got {}.", typeToStr(field)), 3);
+                runtimeError(fmt::format("Expected an array or hash map, got {}.", typeToStr(callee)), 3);
+            }
+            // The loop condition already compared the index to the length of this array
+            case +OpCode::GET_INDEX_UNCHECKED:{
+                Value field = pop();
+                Value callee = pop();
+                if (isArray(callee)) {
+                    push(asArray(callee)->values[decodeNumber(field)]);
+                    DISPATCH();
+                }
+                if (isHashMap(callee)) runtimeError(fmt::format("Expected a string for field name, got {}.", typeToStr(field)), 3);
+                runtimeError(fmt::format("Expected an array or hash map, got {}.", typeToStr(callee)), 3);
+            }
+
+            case +OpCode::SET_INDEX_UNCHECKED:{
+                Value field = pop();
+                Value callee = pop();
+                Value val = peek(0);
+                if (isArray(callee)) {
+                    object::ObjArray *arr = asArray(callee);
+                    checkEscape(arr, val);
+                    uInt64 index = decodeNumber(field);
+                    if (isObj(val) && !isObj(arr->values[index])) arr->numOfHeapPtr++;
+                    else if (!isObj(val) && isObj(arr->values[index])) arr->numOfHeapPtr--;
+                    arr->values[index] = val;
+                    DISPATCH();
+                }
+                if (isHashMap(callee)) runtimeError(fmt::format("Expected a string for field name, got {}.", typeToStr(field)), 3);
+                runtimeError(fmt::format("Expected an array or hash map, got {}.", typeToStr(callee)), 3);
+            }
             //TODO: implement hash map variation of these ops
             case +OpCode::GET_PROPERTY: [[fallthrough]];
             case +OpCode::GET_PROPERTY_LONG:{
@@ -1043,6 +1402,7 @@ void runtime::Thread::executeBytecode() {
                 if (it == instance->fields.end()) {
                     runtimeError(fmt::format("Class '{}' doesn't contain field '{}'", instance->klass->name->str, name->str), 4);
                 }
+                checkEscape(instance, peek(0));
                 it->second = peek(0);
                 DISPATCH();
             }
@@ -1081,6 +1441,7 @@ void runtime::Thread::executeBytecode() {
                 if (it == instance->fields.end()) {
                     runtimeError(fmt::format("Class '{}' doesn't contain field '{}'", instance->klass->name->str, name->str), 4);
                 }
+                checkEscape(instance, peek(0));
                 it->second = peek(0);
                 DISPATCH();
             }
@@ -1165,6 +1526,25 @@ void runtime::Thread::executeBytecode() {
                 DISPATCH();
             }
 
+            case +OpCode::CALL_DIRECT:{
+                // The compiler already found the method, so there's no lookup and no bound method
+                int argCount = READ_BYTE();
+                object::ObjClosure *closure = asClosure(READ_CONSTANT());
+                STORE_FRAME();
+                callMethod(closure, argCount);
+                LOAD_FRAME();
+                DISPATCH();
+            }
+            case +OpCode::CALL_DIRECT_LONG:{
+                // The compiler already found the method, so there's no lookup and no bound method
+                int argCount = READ_BYTE();
+                object::ObjClosure *closure = asClosure(READ_CONSTANT_LONG());
+                STORE_FRAME();
+                callMethod(closure, argCount);
+                LOAD_FRAME();
+                DISPATCH();
+            }
+
             case +OpCode::INSTANCEOF:{
                 auto klass = asClass(READ_CONSTANT_LONG());
                 Value val = pop();
@@ -1186,7 +1566,14 @@ void runtime::Thread::executeBytecode() {
         }
     } catch(int errCode) {
         STORE_FRAME();
-        printRuntimeError(frames, frameCount, vm, errCode, errorString);
+        if (defersErrors) errorCode = errCode;
+        else printRuntimeError(frames, frameCount, vm, errCode, errorString);
+        // Child thread that errored out still has to complete its future, otherwise anything awaiting it would block forever
+        auto fut = asFuture(stack[0]);
+        if (fut != nullptr && exitFrameCount == 0) {
+            fut->val = encodeNil();
+            deleteThread(fut, vm);
+        }
     }
 #undef READ_BYTE
 #undef READ_SHORT
@@ -1196,4 +1583,5 @@ void runtime::Thread::executeBytecode() {
 #undef READ_STRING_LONG
 #undef BINARY_OP
 #undef INT_BINARY_OP
+#undef UNCHECKED_BINARY_OP
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "../codegen/codegenDefs.h"
 #include "../Objects/objects.h"
 #include "nativeFunctions.h"
+#include <functional>
+#include <chrono>
 
 namespace runtime {
 	class VM;
@@ -9,6 +11,7 @@ namespace runtime {
 	class Thread {
 	public:
 		Thread(VM* _vm);
+		~Thread();
 		void executeBytecode();
 		void startThread(Value* otherStack, int num);
 		void mark(memory::GarbageCollector* gc);
@@ -25,18 +28,40 @@ namespace runtime {
         // Tells the thread that it should pause it's execution, merely setting this to true doesn't pause
         std::atomic<bool> pauseToken;
         Value* stackTop;
+        // Private heap of an isolated thread, nullptr for threads that allocate into the shared heap
+        memory::LocalHeap* heap;
 
         void runtimeError(string err, int errorCode);
+        // Set while running a job of the worker pool, runtime errors are then kept in errorString and errorCode instead
+        // of being printed, and the thread that submitted the job reports them
+        bool defersErrors;
+        string errorString;
+        int errorCode;
 
         void callValue(Value callee, int8_t argCount);
+        // Calls callee and runs it to completion on this thread, returns false if a runtime error occurred
+        bool executeCall(Value callee, Value* args, int8_t argCount, Value& result);
+        // Blocks until pred returns true or the deadline passes, pred is evaluated while holding vm->pauseMtx
+        // The thread counts as paused while blocked, and if this is the main thread it runs the GC when needed
+        // Anything that flips pred must do so under vm->pauseMtx and notify both vm->mainThreadCv and vm->childThreadsCv
+        // Returns the final value of pred
+        bool blockUntil(const std::function<bool()>& pred,
+                        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+        // Starts the callee with argCount arguments(on top of the stack) on a new thread, pops them and returns the future
+        // If isolated is true the new thread gets its own heap and its return value is promoted to the shared heap
+        object::ObjFuture* launchAsync(int8_t argCount, bool isolated);
+        // Objects from the heap of an isolated thread can't be stored into shared objects, target is nullptr for globals
+        void checkEscape(object::Obj* target, Value val) { if (heap) checkEscapeIsolated(target, val); }
 
     private:
 		Value stack[STACK_MAX];
 		CallFrame frames[FRAMES_MAX];
         uint16_t frameCount;
+        // executeBytecode returns once frameCount drops to this, executeCall raises it to run nested calls
+        uint16_t exitFrameCount;
 
-        string errorString;
-
+		void checkEscapeIsolated(object::Obj* target, Value val);
+		const byte* funcCode(object::ObjFunc* func);
 		void callFunc(object::ObjClosure* function, int8_t argCount);
         void callMethod(object::Method method, int8_t argCount);
 
@@ -1,43 +1,142 @@
 #include "vm.h"
 #include "../codegen/compiler.h"
+#include "../codegen/bytecodeCache.h"
 #include "../codegen/valueHelpersInline.cpp"
 #include "nativeFunctions.h"
+#include "../ErrorHandling/errorHandler.h"
 
 using std::get;
 using namespace valueHelpers;
 
-runtime::VM::VM(compileCore::Compiler* compiler) {
-    // Have to do this before assigning compiler->mainCodeBlock to code because endFuncDecl mutates mainCodeBlock
-    Value val = encodeObj(new object::ObjClosure(compiler->mainBlockFunc));
+runtime::VM::VM(compileCore::Compiler* _compiler) {
+    compiler = _compiler;
     // Main code block
     code = compiler->mainCodeBlock;
+    bytecode = code.bytecode.data();
     // Used by all threads
     nativeFuncs = compiler->nativeFuncs;
+    // For stack tracing during error printing
+    sourceFiles = compiler->sourceFiles;
     nativeClasses = runtime::createBuiltinClasses(compiler->baseClass);
     nativeClasses.push_back(compiler->baseClass);
+    init(compiler->initBlockFunc, compiler->mainBlockFunc, compiler->globals);
+}
+
+runtime::VM::VM(bytecodeCache::Image* image) {
+    compiler = nullptr;
+    code = image->code;
+    // Runs straight from the mapped image, the disassembler needs a copy inside of code
+    bytecode = image->bytecode;
+    #ifdef DEBUG_TRACE_EXECUTION
+    code.bytecode.assign(image->bytecode, image->bytecode + image->bytecodeSize);
+    #endif
+    nativeFuncs = image->nativeFuncs;
+    sourceFiles = image->sourceFiles;
+    nativeClasses = image->nativeClasses;
+    init(image->initBlockFunc, image->mainBlockFunc, image->globals);
+}
+
+void runtime::VM::init(object::ObjFunc* initFunc, object::ObjFunc* mainFunc, vector<Globalvar>& _globals) {
+    initClosure = initFunc ? new object::ObjClosure(initFunc) : nullptr;
+    mainClosure = new object::ObjClosure(mainFunc);
     rng = std::mt19937_64(0);
-    globals = compiler->globals;
-    // For stack tracing during error printing
-    sourceFiles = compiler->sourceFiles;
+    for (Globalvar& var : _globals) {
+        globals.push_back(var.val);
+        globalNames.push_back(var.name);
+    }
     memory::gc.vm = this;
+    workerPool = nullptr;
     mainThread = new Thread(this);
     // First value on the stack is the future holding the thread, mainThread has nil
     mainThread->copyVal(encodeNil());
-    mainThread->startThread(&val, 1);
 }
 
 void runtime::VM::mark(memory::GarbageCollector* gc) {
-    for (Globalvar& var : globals) valueHelpers::mark(var.val);
+    for (Value& val : globals) valueHelpers::mark(val);
     // All threads in vector are active, finished threads get deleted automatically
     for (Thread* t : childThreads) t->mark(gc);
     mainThread->mark(gc);
     for (Value& val : code.constants) valueHelpers::mark(val);
     for (auto func : nativeFuncs) func->marked = true;
     for(auto c : nativeClasses) gc->markObj(c);
+    if (initClosure) gc->markObj(initClosure);
+    gc->markObj(mainClosure);
+    // Functions that weren't called yet and constants of lazily compiled functions
+    // The cache is written from the compiler once the program is done, so the compile time values of globals and the
+    // top level code of the imported modules have to survive too, even if the program doesn't use them anymore
+    if (compiler) {
+        for (auto& [func, lazy] : compiler->lazyFuncs) func->marked = true;
+        for (Globalvar& var : compiler->globals) valueHelpers::mark(var.val);
+        if (compiler->initBlockFunc) gc->markObj(compiler->initBlockFunc);
+        for (auto& lazyChunk : compiler->lazyChunks) {
+            for (Value& val : lazyChunk->chunk.constants) valueHelpers::mark(val);
+        }
+    }
 }
 
 void runtime::VM::execute() {
-    mainThread->executeBytecode();
+    if (runModuleInit()) {
+        Value val = encodeObj(mainClosure);
+        mainThread->startThread(&val, 1);
+        mainThread->executeBytecode();
+    }
+    shutdownWorkerPool();
+}
+
+bool runtime::VM::runModuleInit() {
+    if (!initClosure) return true;
+    Value result;
+    bool success = mainThread->executeCall(encodeObj(initClosure), nullptr, 0, result);
+    initClosure = nullptr;
+    return success;
+}
+
+const byte* runtime::VM::prepareFunc(object::ObjFunc* func) {
+    std::scoped_lock<std::mutex> lk(compileMtx);
+    if (func->code) return func->code;
+    if (!compiler || !compiler->lazyFuncs.contains(func)) {
+        func->constants = code.constants.data() + func->constantsOffset;
+        std::atomic_ref<const byte*>(func->code).store(bytecode + func->bytecodeOffset, std::memory_order_release);
+        return func->code;
+    }
+    // Whatever the compiler creates belongs to the shared heap, even if an isolated thread makes the first call
+    memory::LocalHeap* heap = memory::localHeap;
+    memory::localHeap = nullptr;
+    compileCore::LazyChunk* lazyChunk = compiler->compileLazyFunc(func);
+    memory::localHeap = heap;
+    if (!lazyChunk) {
+        errorHandler::showCompileErrors();
+        errorHandler::clearCompileErrors();
+        return nullptr;
+    }
+    Chunk& chunk = lazyChunk->chunk;
+    for (object::ObjFunc* compiled : lazyChunk->funcs) {
+        compiled->constants = chunk.constants.data() + compiled->constantsOffset;
+        std::atomic_ref<const byte*>(compiled->code).store(chunk.bytecode.data() + compiled->bytecodeOffset,
+                                                          std::memory_order_release);
+    }
+    return func->code;
+}
+
+Chunk* runtime::VM::chunkAt(const byte* ip, uInt64& offset) {
+    std::scoped_lock<std::mutex> lk(compileMtx);
+    if (compiler) {
+        for (auto& lazyChunk : compiler->lazyChunks) {
+            const byte* start = lazyChunk->chunk.bytecode.data();
+            if (ip >= start && ip < start + lazyChunk->chunk.bytecode.size()) {
+                offset = ip - start;
+                return &lazyChunk->chunk;
+            }
+        }
+    }
+    offset = ip - bytecode;
+    return &code;
+}
+
+void runtime::VM::finishCompilation() {
+    if (!compiler) return;
+    std::scoped_lock<std::mutex> lk(compileMtx);
+    compiler->finishLazyFuncs();
 }
 
 bool runtime::VM::allThreadsPaused() {
@@ -60,4 +159,31 @@ void runtime::VM::unpauseAllThreads(){
         t->pauseToken.store(false, std::memory_order_relaxed);
     }
     mainThread->pauseToken.store(false, std::memory_order_relaxed);
+}
+
+bool runtime::VM::hasRunningThreads() {
+    std::scoped_lock<std::mutex> lk(mtx);
+    // Pool workers stay in childThreads until the pool is shut down, but they're idle whenever no job is running
+    // and a job always finishes before the native that started it returns
+    uInt poolWorkers = workerPool ? workerPool->workerCount() : 0;
+    return childThreads.size() > poolWorkers;
+}
+
+runtime::WorkerPool* runtime::VM::getWorkerPool() {
+    std::call_once(workerPoolInit, [&]{
+        auto pool = new WorkerPool(this);
+        // Published under mtx so that hasRunningThreads and shutdownWorkerPool can read it without creating the pool
+        std::scoped_lock<std::mutex> lk(mtx);
+        workerPool = pool;
+    });
+    return workerPool;
+}
+
+void runtime::VM::shutdownWorkerPool() {
+    WorkerPool* pool;
+    {
+        std::scoped_lock<std::mutex> lk(mtx);
+        pool = workerPool;
+    }
+    if (pool) pool->shutdown(mainThread);
 }
\ No newline at end of file
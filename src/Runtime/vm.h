@@ -2,20 +2,41 @@
 #include "../codegen/codegenDefs.h"
 #include "../Objects/objects.h"
 #include "thread.h"
+#include "workerPool.h"
 #include <condition_variable>
 #include <random>
+#include <atomic>
+
+namespace bytecodeCache {
+	struct Image;
+}
 
 namespace runtime {
 	class VM {
 	public:
 		VM(compileCore::Compiler* compiler);
+		// Program loaded from a .eslc cache or a heap snapshot
+		VM(bytecodeCache::Image* image);
+		// Runs the top level code of the imported modules(if it hasn't run yet) and then the main module
 		void execute();
+		// Only runs the top level code of the imported modules, returns false if it stopped because of a runtime error
+		bool runModuleInit();
+		// Compiles whatever the program didn't call, so the compiler holds the whole program, see Compiler::finishLazyFuncs
+		void finishCompilation();
 		void mark(memory::GarbageCollector* gc);
 		bool allThreadsPaused();
         void pauseAllThreads();
         void unpauseAllThreads();
 		// Used by all threads
-		vector<Globalvar> globals;
+		// Values of globals are kept dense and apart from their names, so global heavy code touches less memory
+		// Any thread can read/write a global at any time, so accesses go through getGlobal/setGlobal
+		vector<Value> globals;
+		// Same indexes as globals, used for errors and debugging
+		vector<string> globalNames;
+		// Relaxed atomics make concurrent accesses well defined without any locking,
+		// ordering between threads still has to come from a mutex or await
+		Value getGlobal(uInt index) { return std::atomic_ref<Value>(globals[index]).load(std::memory_order_relaxed); }
+		void setGlobal(uInt index, Value val) { std::atomic_ref<Value>(globals[index]).store(val, std::memory_order_relaxed); }
 		vector<File*> sourceFiles;
         vector<object::ObjNativeFunc*> nativeFuncs;
         vector<object::ObjClass*> nativeClasses;
@@ -23,6 +44,13 @@ namespace runtime {
         std::mt19937_64 rng;
 		// Main code block, all function look into this vector at some offset
 		Chunk code;
+		// Start of the bytecode, points either into code or into a read only mapping of a bytecode image
+		const byte* bytecode;
+		// Sets the code and constants pointers of func, compiling its body first if it's lazily compiled
+		// Returns nullptr if the body has compile errors, which are printed
+		const byte* prepareFunc(object::ObjFunc* func);
+		// Chunk that holds the instruction at ip, offset is set to the position of the instruction within the chunk
+		Chunk* chunkAt(const byte* ip, uInt64& offset);
 		// For adding/removing threads
 		std::mutex mtx;
 		vector<Thread*> childThreads;
@@ -31,8 +59,26 @@ namespace runtime {
 		std::mutex pauseMtx;
 		std::condition_variable mainThreadCv;
 		std::condition_variable childThreadsCv;
-		std::atomic<byte> threadsPaused;
+		std::atomic<uInt> threadsPaused;
 		Thread* mainThread;
+		// Top level code of the imported modules, nullptr once it ran(or if there's nothing to run)
+		object::ObjClosure* initClosure;
+		object::ObjClosure* mainClosure;
+
+		// Created on first use by the data parallel natives
+		WorkerPool* getWorkerPool();
+		// Called by the main thread once the program is done, see WorkerPool::shutdown
+		void shutdownWorkerPool();
+		// Whether threads started by the program(async calls) are still running, idle pool workers don't count
+		bool hasRunningThreads();
+	private:
+		WorkerPool* workerPool;
+		// Compiles the bodies of lazily compiled functions, nullptr if the program was loaded from an image
+		compileCore::Compiler* compiler;
+		// Held while resolving or compiling a function
+		std::mutex compileMtx;
+		void init(object::ObjFunc* initFunc, object::ObjFunc* mainFunc, vector<Globalvar>& _globals);
+		std::once_flag workerPoolInit;
 	};
 
 }
@@ -0,0 +1,167 @@
+#include "workerPool.h"
+#include "thread.h"
+#include "vm.h"
+#include "../codegen/valueHelpersInline.cpp"
+#include <thread>
+#include <algorithm>
+
+using namespace valueHelpers;
+
+// How many chunks each worker gets on average, more chunks balance uneven workloads better
+#define CHUNKS_PER_WORKER 8
+
+runtime::ParallelJob::ParallelJob(Value _func, int64_t _start, int64_t _end, object::ObjArray* _source, object::ObjArray* _result) {
+    func = _func;
+    start = _start;
+    end = _end;
+    source = _source;
+    result = _result;
+    chunkSize = 1;
+    next.store(_start);
+    heapPtrs.store(0);
+    failed.store(false);
+    errorCode = 0;
+}
+
+runtime::WorkerPool::WorkerPool(VM* _vm) {
+    vm = _vm;
+    currentJob = nullptr;
+    generation = 0;
+    activeWorkers = 0;
+    stopping = false;
+
+    uInt workerCount = std::max(1u, std::thread::hardware_concurrency());
+    for (uInt i = 0; i < workerCount; i++) {
+        auto t = new Thread(vm);
+        // Same as the main thread, workers don't have a future attached to them
+        t->copyVal(encodeNil());
+        workers.push_back(t);
+    }
+    {
+        // Only one thread can add/remove a new child thread at any time
+        std::lock_guard<std::mutex> lk(vm->mtx);
+        vm->childThreads.insert(vm->childThreads.end(), workers.begin(), workers.end());
+        liveWorkers = workers.size();
+    }
+    // Workers sleep until the next job, they're joined by shutdown
+    for (Thread* t : workers) threads.emplace_back(&WorkerPool::workerLoop, this, t);
+}
+
+bool runtime::WorkerPool::run(Thread* caller, ParallelJob& job) {
+    int64_t len = job.end - job.start;
+    if (len <= 0) return true;
+    // A worker submitting a job would wait for itself, so nested jobs are executed inline
+    // Isolated threads don't share their objects with the pool, so they run their jobs inline as well
+    if (isWorker(caller) || caller->heap) {
+        processJob(caller, &job);
+        return !job.failed.load();
+    }
+    job.chunkSize = std::max<int64_t>(1, len / (workers.size() * CHUNKS_PER_WORKER));
+
+    // Only one job runs on the pool at a time, other callers wait for it to be free
+    bool isStopped = false;
+    caller->blockUntil([&]{
+        isStopped = stopping;
+        if (currentJob == nullptr && !stopping) currentJob = &job;
+        return stopping || currentJob == &job;
+    });
+    if (isStopped) {
+        processJob(caller, &job);
+        return !job.failed.load();
+    }
+    {
+        std::scoped_lock lk(vm->pauseMtx);
+        generation++;
+        activeWorkers = workers.size();
+    }
+    vm->childThreadsCv.notify_all();
+
+    caller->blockUntil([&]{ return activeWorkers == 0; });
+    {
+        std::scoped_lock lk(vm->pauseMtx);
+        currentJob = nullptr;
+    }
+    // Wake up anyone waiting to submit a job
+    vm->childThreadsCv.notify_all();
+    vm->mainThreadCv.notify_one();
+    return !job.failed.load();
+}
+
+void runtime::WorkerPool::shutdown(Thread* caller) {
+    // Nothing can submit a job once stopping is set, and a job that's already running has to finish first
+    caller->blockUntil([&]{
+        if (currentJob == nullptr) stopping = true;
+        return stopping;
+    });
+    vm->childThreadsCv.notify_all();
+    // Workers remove themselves from vm->childThreads, waiting through blockUntil lets the GC run in the meantime
+    caller->blockUntil([&]{ return liveWorkers == 0; });
+    for (std::thread& thread : threads) thread.join();
+    threads.clear();
+}
+
+void runtime::WorkerPool::workerLoop(Thread* t) {
+    uInt64 seenGeneration = 0;
+    while (true) {
+        ParallelJob* job = nullptr;
+        // Idle workers count as paused, so the GC can run while they're waiting
+        t->blockUntil([&]{
+            if (generation != seenGeneration) {
+                seenGeneration = generation;
+                job = currentJob;
+            }
+            return job != nullptr || stopping;
+        });
+        if (!job) break;
+        processJob(t, job);
+        {
+            std::scoped_lock lk(vm->pauseMtx);
+            activeWorkers--;
+        }
+        // The caller could be the main thread or a child thread, notify both
+        vm->mainThreadCv.notify_one();
+        vm->childThreadsCv.notify_all();
+    }
+    {
+        // Same as deleteThread, a GC that's waiting for every thread to pause mustn't wait for this one anymore
+        std::scoped_lock lk(vm->pauseMtx, vm->mtx);
+        vm->childThreads.erase(std::find(vm->childThreads.begin(), vm->childThreads.end(), t));
+        liveWorkers--;
+        delete t;
+    }
+    vm->mainThreadCv.notify_one();
+    vm->childThreadsCv.notify_all();
+}
+
+void runtime::WorkerPool::processJob(Thread* t, ParallelJob* job) {
+    uInt64 heapPtrs = 0;
+    // The caller reports the error, even if the job runs inline
+    bool defersErrors = t->defersErrors;
+    t->defersErrors = true;
+    while (!job->failed.load(std::memory_order_relaxed)) {
+        int64_t chunkStart = job->next.fetch_add(job->chunkSize);
+        if (chunkStart >= job->end) break;
+        int64_t chunkEnd = std::min(chunkStart + job->chunkSize, job->end);
+
+        for (int64_t i = chunkStart; i < chunkEnd; i++) {
+            Value arg = job->source ? job->source->values[i] : encodeNumber(i);
+            Value res;
+            if (!t->executeCall(job->func, &arg, 1, res)) {
+                if (!job->failed.exchange(true)) {
+                    job->error = std::move(t->errorString);
+                    job->errorCode = t->errorCode;
+                }
+                break;
+            }
+            if (!job->result) continue;
+            job->result->values[i - job->start] = res;
+            if (isObj(res)) heapPtrs++;
+        }
+    }
+    t->defersErrors = defersErrors;
+    job->heapPtrs.fetch_add(heapPtrs);
+}
+
+bool runtime::WorkerPool::isWorker(Thread* t) {
+    return std::find(workers.begin(), workers.end(), t) != workers.end();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "../codegen/codegenDefs.h"
+#include "../Objects/objects.h"
+#include <atomic>
+#include <thread>
+
+namespace runtime {
+    class VM;
+    class Thread;
+
+    // Description of a data parallel job, every index in [start, end) is passed to func exactly once
+    struct ParallelJob {
+        Value func;
+        int64_t start;
+        int64_t end;
+        // If source is set func receives source->values[i] instead of i
+        // source can be the same array as result, each slot is then read and overwritten by the same worker
+        object::ObjArray* source;
+        // If result is set the return value of func for index i is written to result->values[i - start]
+        // Every index is written by exactly one worker, so no locking is needed
+        object::ObjArray* result;
+        int64_t chunkSize;
+        std::atomic<int64_t> next;
+        std::atomic<uInt64> heapPtrs;
+        std::atomic<bool> failed;
+        // Error of the first call that failed, set by whichever thread flipped failed
+        string error;
+        int errorCode;
+
+        ParallelJob(Value _func, int64_t _start, int64_t _end, object::ObjArray* _source, object::ObjArray* _result);
+    };
+
+    // Pool of worker threads shared by the data parallel natives(parallel_for, parallel_map)
+    // Every worker owns a Thread object which is reused between jobs instead of creating a new one per task,
+    // workers live in vm->childThreads until the pool is shut down and count as paused while idle
+    class WorkerPool {
+    public:
+        explicit WorkerPool(VM* _vm);
+        // Runs the job on the pool and blocks the caller until every index is processed, returns false if any call failed
+        bool run(Thread* caller, ParallelJob& job);
+        // Waits for the running job(if any) to finish, then stops and joins the workers
+        // Jobs submitted afterwards(by threads the program left running) are executed inline by the caller
+        void shutdown(Thread* caller);
+        // Workers that are still in vm->childThreads, read while holding vm->mtx
+        uInt workerCount() const { return liveWorkers; }
+    private:
+        VM* vm;
+        vector<Thread*> workers;
+        vector<std::thread> threads;
+        // Following fields are guarded by vm->pauseMtx
+        ParallelJob* currentJob;
+        uInt64 generation;
+        uInt activeWorkers;
+        bool stopping;
+        // Written while holding both vm->pauseMtx and vm->mtx
+        uInt liveWorkers;
+
+        void workerLoop(Thread* t);
+        void processJob(Thread* t, ParallelJob* job);
+        bool isWorker(Thread* t);
+    };
+}
@@ -17,7 +17,7 @@ CurrentChunkInfo::CurrentChunkInfo(CurrentChunkInfo* _enclosing, FuncType _type)
         // First slot is claimed for function name
         Local* local = &locals[localCount++];
         local->depth = 0;
-        local->name = "";
+        local->symbol = 0;
     }
 }
 
@@ -34,43 +34,9 @@ string SemanticAnalyzer::highlight(vector<CSLModule *> &_units, CSLModule* unitT
     units = _units;
     for (CSLModule* unit : units) {
         if(unit == unitToHighlight) generateSemanticTokens = true;
-        curUnit = unit;
-
-        for (const auto decl : unit->topDeclarations) {
-            globals.push_back(decl->getName());
-        }
-        for (int i = 0; i < unit->stmts.size(); i++) {
-            //doing this here so that even if a error is detected, we go on and possibly catch other(valid) errors
-            try {
-                unit->stmts[i]->accept(this);
-            }
-            catch (SemanticAnalyzerException e) {
-                // Do nothing, only used for unwinding the stack
-            }
-        }
-        curGlobalIndex = globals.size();
-        curUnitIndex++;
-    }
-    for(auto& it : macros){
-        createSemanticToken(it.second->name, "macro", {"declaration"});
-        for(auto& matcher : it.second->matchers){
-            auto pattern = matcher.getPattern();
-            for(int i = 0; i < pattern.size(); i++){
-                Token& token = pattern[i];
-                if(token.type == TokenType::DOLLAR && i+1 < pattern.size() && pattern[++i].type == TokenType::IDENTIFIER){
-                    createSemanticToken(pattern[i], "parameter", {"declaration"});
-                }
-            }
-        }
-        for(auto& transcriber : it.second->transcribers){
-            for(int i = 0; i < transcriber.size(); i++){
-                Token& token = transcriber[i];
-                if(token.type == TokenType::DOLLAR && i+1 < transcriber.size() && transcriber[++i].type == TokenType::IDENTIFIER){
-                    createSemanticToken(transcriber[i], "parameter", {"declaration"});
-                }
-            }
-        }
+        analyzeUnit(unit);
     }
+    highlightMacros(macros, nullptr);
     for (CSLModule* unit : units) delete unit;
     string final = "[";
     for(auto token : semanticTokens){
@@ -84,23 +50,7 @@ string SemanticAnalyzer::highlight(vector<CSLModule *> &_units, CSLModule* unitT
 string SemanticAnalyzer::generateDiagnostics(vector<CSLModule *> &_units){
     units = _units;
     vector<string> previousErrors = errorHandler::convertCompilerErrorsToJson();
-    for (CSLModule *unit: units) {
-        curUnit = unit;
-        for (const auto decl: unit->topDeclarations) {
-            globals.push_back(decl->getName());
-        }
-        for (int i = 0; i < unit->stmts.size(); i++) {
-            //doing this here so that even if a error is detected, we go on and possibly catch other(valid) errors
-            try {
-                unit->stmts[i]->accept(this);
-            }
-            catch (SemanticAnalyzerException e) {
-                // Do nothing, only used for unwinding the stack
-            }
-        }
-        curGlobalIndex = globals.size();
-        curUnitIndex++;
-    }
+    for (CSLModule *unit: units) analyzeUnit(unit);
     for (CSLModule* unit : units) delete unit;
     string final = "[";
     for(auto& str : previousErrors) final += str + ",";
@@ -113,6 +63,81 @@ string SemanticAnalyzer::generateDiagnostics(vector<CSLModule *> &_units){
     return final;
 }
 
+void SemanticAnalyzer::setUnits(vector<CSLModule*>& _units) {
+    units = _units;
+}
+
+void SemanticAnalyzer::analyzeUnit(CSLModule* unit) {
+    curUnit = unit;
+    for (const auto decl : unit->topDeclarations) {
+        globals.push_back(decl->getName());
+    }
+    for (int i = 0; i < unit->stmts.size(); i++) {
+        //doing this here so that even if a error is detected, we go on and possibly catch other(valid) errors
+        try {
+            unit->stmts[i]->accept(this);
+        }
+        catch (SemanticAnalyzerException e) {
+            // Do nothing, only used for unwinding the stack
+        }
+    }
+    curGlobalIndex = globals.size();
+    curUnitIndex++;
+}
+
+void SemanticAnalyzer::restoreUnit(CSLModule* unit, const vector<GlobalVar>& unitGlobals) {
+    curUnit = unit;
+    globals.insert(globals.end(), unitGlobals.begin(), unitGlobals.end());
+    curGlobalIndex = globals.size();
+    curUnitIndex++;
+}
+
+vector<GlobalVar> SemanticAnalyzer::lastUnitGlobals() {
+    return vector<GlobalVar>(globals.end() - curUnit->topDeclarations.size(), globals.end());
+}
+
+vector<Diagnostic> SemanticAnalyzer::takeDiagnostics() {
+    vector<Diagnostic> found = std::move(diagnostics);
+    diagnostics.clear();
+    return found;
+}
+
+vector<SemanticToken> SemanticAnalyzer::highlightUnit(CSLModule* unit, unordered_map<string, std::unique_ptr<AST::Macro>>& macros) {
+    generateSemanticTokens = true;
+    analyzeUnit(unit);
+    highlightMacros(macros, unit->file);
+    generateSemanticTokens = false;
+    vector<SemanticToken> tokens = std::move(semanticTokens);
+    semanticTokens.clear();
+    return tokens;
+}
+
+// Macros are highlighted separately since their definitions aren't part of the AST, if file isn't null only macros
+// defined in it are highlighted
+void SemanticAnalyzer::highlightMacros(unordered_map<string, std::unique_ptr<AST::Macro>>& macros, File* file) {
+    for(auto& it : macros){
+        if(file && it.second->name.str.sourceFile != file) continue;
+        createSemanticToken(it.second->name, "macro", {"declaration"});
+        for(auto& matcher : it.second->matchers){
+            auto pattern = matcher.getPattern();
+            for(int i = 0; i < pattern.size(); i++){
+                Token& token = pattern[i];
+                if(token.type == TokenType::DOLLAR && i+1 < pattern.size() && pattern[++i].type == TokenType::IDENTIFIER){
+                    createSemanticToken(pattern[i], "parameter", {"declaration"});
+                }
+            }
+        }
+        for(auto& transcriber : it.second->transcribers){
+            for(int i = 0; i < transcriber.size(); i++){
+                Token& token = transcriber[i];
+                if(token.type == TokenType::DOLLAR && i+1 < transcriber.size() && transcriber[++i].type == TokenType::IDENTIFIER){
+                    createSemanticToken(transcriber[i], "parameter", {"declaration"});
+                }
+            }
+        }
+    }
+}
+
 static Token probeToken(AST::ASTNodePtr ptr){
     AST::ASTProbe p;
     ptr->accept(&p);
@@ -224,7 +249,7 @@ void SemanticAnalyzer::visitUnaryExpr(AST::UnaryExpr* expr) {
         }
         else if (expr->right->type == AST::ASTType::FIELD_ACCESS) {
             // If a field is being incremented, compile the object, and then if it's not a dot access also compile the field
-            auto left = std::static_pointer_cast<AST::FieldAccessExpr>(expr->right);
+            auto left = static_cast<AST::FieldAccessExpr*>(expr->right);
             left->callee->accept(this);
 
             if (left->accessor.type == TokenType::DOT) {
@@ -446,7 +471,7 @@ void SemanticAnalyzer::visitClassDecl(AST::ClassDecl* decl) {
 
     for (auto& _method : decl->methods) {
         //At this point the name is guaranteed to exist as a string, so createStr just returns the already created string
-        method(_method.method.get(), className);
+        method(_method.method, className);
     }
     currentClass = nullptr;
 }
@@ -501,7 +526,7 @@ void SemanticAnalyzer::visitContinueStmt(AST::ContinueStmt* stmt) {}
 void SemanticAnalyzer::visitSwitchStmt(AST::SwitchStmt* stmt) {
     //compile the expression in parentheses
     stmt->expr->accept(this);
-    for (const std::shared_ptr<AST::CaseStmt>& _case : stmt->cases) {
+    for (AST::CaseStmt* _case : stmt->cases) {
         for (const Token& constant : _case->constants) {
             switch (constant.type) {
                 case TokenType::NUMBER:
@@ -588,7 +613,7 @@ uint16_t SemanticAnalyzer::declareGlobalVar(Token name) {
     // (globals.size() - curGlobalIndex = globals declared in current file)
     int index = curGlobalIndex;
     for (int i = curGlobalIndex; i < globals.size(); i++) {
-        if (name.getLexeme() == globals[i].name.getLexeme()) return i;
+        if (name.sameName(globals[i].name)) return i;
     }
     // Should never be hit, but here just in case
     error(name, "Couldn't find variable.");
@@ -601,8 +626,7 @@ void SemanticAnalyzer::declareLocalVar(AST::ASTVar& var, bool isParam) {
         if (local->depth != -1 && local->depth < current->scopeDepth) {
             break;
         }
-        string str = var.name.getLexeme();
-        if (str.compare(local->name) == 0) {
+        if (var.name.symbol == local->symbol) {
             error(var.name, "Already a variable with this name in this scope.");
         }
     }
@@ -615,7 +639,7 @@ void SemanticAnalyzer::addLocal(AST::ASTVar var, bool isParam) {
         return;
     }
     Local* local = &current->locals[current->localCount++];
-    local->name = var.name.getLexeme();
+    local->symbol = var.name.symbol;
     local->depth = -1;
     local->isLocalUpvalue = false;
     local->isFunctionParameter = isParam;
@@ -637,8 +661,7 @@ void SemanticAnalyzer::endScope() {
 int SemanticAnalyzer::resolveLocal(CurrentChunkInfo* func, Token name) {
     for (int i = func->localCount - 1; i >= 0; i--) {
         Local* local = &func->locals[i];
-        string str = name.getLexeme();
-        if (str.compare(local->name) == 0) {
+        if (name.symbol == local->symbol) {
             if (local->depth == -1) {
                 error(name, "Can't read local variable in its own initializer.");
             }
@@ -706,7 +729,7 @@ void SemanticAnalyzer::method(AST::FuncDecl* _method, Token className) {
 bool SemanticAnalyzer::invoke(AST::CallExpr* expr) {
     if (expr->callee->type == AST::ASTType::FIELD_ACCESS) {
         //currently we only optimizes field invoking(struct.field() or array[field]())
-        auto call = std::static_pointer_cast<AST::FieldAccessExpr>(expr->callee);
+        auto call = static_cast<AST::FieldAccessExpr*>(expr->callee);
         if (call->accessor.type == TokenType::LEFT_BRACKET) return false;
 
         call->callee->accept(this);
@@ -726,7 +749,7 @@ bool SemanticAnalyzer::invoke(AST::CallExpr* expr) {
         return true;
     }
     else if (expr->callee->type == AST::ASTType::SUPER) {
-        auto superCall = std::static_pointer_cast<AST::SuperExpr>(expr->callee);
+        auto superCall = static_cast<AST::SuperExpr*>(expr->callee);
         if (currentClass == nullptr) {
             error(superCall->methodName, "Can't use 'super' outside of a class.");
             createSemanticToken(superCall->methodName, "method");
@@ -755,7 +778,7 @@ bool SemanticAnalyzer::invoke(AST::CallExpr* expr) {
 bool SemanticAnalyzer::invoke(AST::AsyncExpr* expr) {
     if (expr->callee->type == AST::ASTType::FIELD_ACCESS) {
         //currently we only optimizes field invoking(struct.field() or array[field]())
-        auto call = std::static_pointer_cast<AST::FieldAccessExpr>(expr->callee);
+        auto call = static_cast<AST::FieldAccessExpr*>(expr->callee);
         if (call->accessor.type == TokenType::LEFT_BRACKET) return false;
 
         call->callee->accept(this);
@@ -775,7 +798,7 @@ bool SemanticAnalyzer::invoke(AST::AsyncExpr* expr) {
         return true;
     }
     else if (expr->callee->type == AST::ASTType::SUPER) {
-        auto superCall = std::static_pointer_cast<AST::SuperExpr>(expr->callee);
+        auto superCall = static_cast<AST::SuperExpr*>(expr->callee);
         if (currentClass == nullptr) {
             error(superCall->methodName, "Can't use 'super' outside of a class.");
             createSemanticToken(superCall->methodName, "method");
@@ -914,7 +937,7 @@ std::shared_ptr<ClassChunkInfo> SemanticAnalyzer::getClassFromExpr(AST::ASTNodeP
         createSemanticToken(token, "class");
     }
     else {
-        auto moduleExpr = std::static_pointer_cast<AST::ModuleAccessExpr>(expr);
+        auto moduleExpr = static_cast<AST::ModuleAccessExpr*>(expr);
         classIndex = resolveModuleVariable(moduleExpr->moduleName, moduleExpr->ident);
         token = moduleExpr->ident;
     }
@@ -951,7 +974,7 @@ int SemanticAnalyzer::checkSymbol(Token symbol) {
 int SemanticAnalyzer::resolveGlobal(Token symbol, bool canAssign) {
     bool inThisFile = false;
     int index = curGlobalIndex;
-    std::shared_ptr<AST::ASTDecl> ptr = nullptr;
+    AST::ASTDecl* ptr = nullptr;
     for (auto decl : curUnit->topDeclarations) {
         if (symbol.equals(decl->getName())) {
             // It's an error to read from a variable during its initialization
@@ -987,7 +1010,7 @@ int SemanticAnalyzer::resolveGlobal(Token symbol, bool canAssign) {
 uint32_t SemanticAnalyzer::resolveModuleVariable(Token moduleAlias, Token variable) {
     //first find the module with the correct alias
     Dependency* depPtr = nullptr;
-    for (Dependency dep : curUnit->deps) {
+    for (Dependency& dep : curUnit->deps) {
         if (dep.alias.equals(moduleAlias)) {
             depPtr = &dep;
             break;
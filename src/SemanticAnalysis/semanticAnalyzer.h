@@ -1,6 +1,8 @@
+#pragma once
 #include "../common.h"
 #include "../Parsing/ASTDefs.h"
 #include "../Parsing/parser.h"
+#include <array>
 
 
 namespace SemanticAnalysis {
@@ -12,7 +14,8 @@ namespace SemanticAnalysis {
     };
 
     struct Local {
-        string name = "";
+        // Interned name, 0 for the slot claimed by the function itself which no name resolves to
+        uInt symbol = 0;
         int depth = -1;
         bool isLocalUpvalue = false;//whether this local variable has been captured as an upvalue
         bool isFunctionParameter = false;
@@ -189,6 +192,20 @@ namespace SemanticAnalysis {
 
         string generateDiagnostics(vector<CSLModule *> &units);
 
+        // Used by the language server to analyze modules one at a time, every module before a module in units
+        // has to be analyzed(or restored) before it
+        void setUnits(vector<CSLModule *> &units);
+        void analyzeUnit(CSLModule *unit);
+        // Takes the place of analyzeUnit for a module whose analysis is still up to date,
+        // unitGlobals are the globals it declared when it was analyzed
+        void restoreUnit(CSLModule *unit, const vector<GlobalVar> &unitGlobals);
+        // Globals declared by the last analyzed module
+        vector<GlobalVar> lastUnitGlobals();
+        // Diagnostics found since the last call
+        vector<Diagnostic> takeDiagnostics();
+        // Analyzes the module and returns its semantic tokens, along with the ones of the macros defined in it
+        vector<SemanticToken> highlightUnit(CSLModule *unit, unordered_map<string, std::unique_ptr<AST::Macro>> &macros);
+
         #pragma region Visitor pattern
 
         void visitAssignmentExpr(AST::AssignmentExpr *expr) override;
@@ -275,6 +292,8 @@ namespace SemanticAnalysis {
 
         void createSemanticToken(Token token, string type, std::vector<string> modifiers = std::vector<string>());
 
+        void highlightMacros(unordered_map<string, std::unique_ptr<AST::Macro>> &macros, File *file);
+
         void namedVar(Token name, bool canAssign);
 
         // Locals
@@ -4,7 +4,9 @@
 #include "ErrorHandling/errorHandler.h"
 #include "Parsing/parser.h"
 #include "Codegen/compiler.h"
+#include "Codegen/bytecodeCache.h"
 #include "SemanticAnalysis/semanticAnalyzer.h"
+#include "LanguageServer/languageServer.h"
 #include "Runtime/vm.h"
 #include <chrono>
 
@@ -24,7 +26,8 @@ static void windowsSetTerminalProcessing(){
 
 int main(int argc, char* argv[]) {
     string path;
-    string flag;
+    string flag = "-run";
+    compileCore::CompilerOptions options;
     // For ease of use during development
     #ifdef DEBUG_MODE
     #if defined(_WIN32) || defined(WIN32)
@@ -32,25 +35,33 @@ int main(int argc, char* argv[]) {
     #else
     path = "/mnt/c/Temp/main.esl";
     #endif
-    flag = "-run";
     #else
-    if(argc == 2) {
-        path = string(argv[1]);
-        flag = "-run";
-    }
-    else if(argc == 3){
-        path = string(argv[1]);
-        flag = string(argv[2]);
-    }
-    else{
+    if(argc < 2){
         std::cout<<"No filepath entered.\n";
         return 1;
     }
+    path = string(argv[1]);
+    // Compiler options can come before or after the flag
+    for(int i = 2; i < argc; i++){
+        string arg = string(argv[i]);
+        if(arg == "-no-inline") options.inlining = false;
+        else flag = arg;
+    }
     #endif
     #if defined(_WIN32) || defined(WIN32)
     windowsSetTerminalProcessing();
     #endif
     if(flag == "-run") {
+        // Skips scanning, parsing and compiling if none of the source files changed since the last run(with this build),
+        // the cache is written next to the main file
+        string cachePath = bytecodeCache::cachePath(path);
+        bytecodeCache::Image* image = bytecodeCache::load(cachePath, options);
+        if(image){
+            auto vm = new runtime::VM(image);
+            vm->execute();
+            return 0;
+        }
+
         preprocessing::Preprocessor preprocessor;
         preprocessor.preprocessProject(path);
         vector<CSLModule *> modules = preprocessor.getSortedUnits();
@@ -62,14 +73,84 @@ int main(int argc, char* argv[]) {
         errorHandler::showCompileErrors();
         if (errorHandler::hasErrors()) exit(64);
 
-        compileCore::Compiler compiler(modules);
+        // Functions of imported modules are only compiled once they're called, the parser already went over their
+        // bodies and checkLazyFuncs compiles any body that might not compile, so its errors stop the program before it runs
+        compileCore::Compiler compiler(modules, true, options);
+        // If nothing was left for later the cache is written right away, otherwise once the program is done
+        bool isCompiled = compiler.lazyFuncs.empty();
+        compiler.checkLazyFuncs();
 
         errorHandler::showCompileErrors();
         if (errorHandler::hasErrors()) exit(64);
+        if(isCompiled) bytecodeCache::write(cachePath, compiler);
 
         auto vm = new runtime::VM(&compiler);
 
         vm->execute();
+        // Bodies checkLazyFuncs let through always compile, this only guards against the two getting out of sync
+        if(compiler.lazyCompileFailed) exit(64);
+        if(!isCompiled){
+            vm->finishCompilation();
+            // Errors in functions that were never called, the program fails with the same exit code a full compile
+            // would have, and nothing is cached
+            errorHandler::showCompileErrors();
+            if(errorHandler::hasErrors()) exit(64);
+            bytecodeCache::write(cachePath, compiler);
+        }
+    }else if(flag == "-snapshot"){
+        // Runs the top level code of every imported module and stores the resulting heap next to the main file
+        preprocessing::Preprocessor preprocessor;
+        preprocessor.preprocessProject(path);
+        vector<CSLModule *> modules = preprocessor.getSortedUnits();
+
+        AST::Parser parser;
+
+        parser.parse(modules);
+
+        errorHandler::showCompileErrors();
+        if (errorHandler::hasErrors()) exit(64);
+
+        compileCore::Compiler compiler(modules, false, options);
+
+        errorHandler::showCompileErrors();
+        if (errorHandler::hasErrors()) exit(64);
+
+        auto vm = new runtime::VM(&compiler);
+        bool initialized = vm->runModuleInit();
+        vm->shutdownWorkerPool();
+        if(!initialized) return 1;
+        string error;
+        if(!bytecodeCache::writeSnapshot(bytecodeCache::snapshotPath(path), vm, options, error)){
+            std::cout<<"Couldn't create a snapshot: "<<error<<"\n";
+            return 1;
+        }
+    }else if(flag == "-run-snapshot"){
+        // Starts from the heap stored by -snapshot, only the main module's top level code runs
+        bytecodeCache::Image* image = bytecodeCache::load(bytecodeCache::snapshotPath(path), options);
+        if(!image){
+            std::cout<<"No up to date snapshot, create one with -snapshot.\n";
+            return 1;
+        }
+        auto vm = new runtime::VM(image);
+        vm->execute();
+    }else if(flag == "-dump-ir"){
+        // Compiles the whole program without running it, printing the SSA IR of every function on the way
+        preprocessing::Preprocessor preprocessor;
+        preprocessor.preprocessProject(path);
+        vector<CSLModule *> modules = preprocessor.getSortedUnits();
+
+        AST::Parser parser;
+
+        parser.parse(modules);
+
+        errorHandler::showCompileErrors();
+        if (errorHandler::hasErrors()) exit(64);
+
+        options.dumpIR = true;
+        compileCore::Compiler compiler(modules, false, options);
+
+        errorHandler::showCompileErrors();
+        if (errorHandler::hasErrors()) exit(64);
     }else if(flag == "-validate-file"){
         preprocessing::Preprocessor preprocessor;
         preprocessor.preprocessProject(path);
@@ -87,6 +168,10 @@ int main(int argc, char* argv[]) {
         AST::Parser parser;
 
         parser.highlight(modules, path);
+    }else if(flag == "-language-server"){
+        // Talks to the editor over stdin/stdout until it's closed, path is the main file of the project
+        languageServer::LanguageServer server(path);
+        return server.run();
     }else{
         std::cout<<"Unrecognized flag.\n";
         return 1;
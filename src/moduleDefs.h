@@ -1,6 +1,9 @@
 #pragma once
 #include "common.h"
 #include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 enum class TokenType {
     // Single-character tokens.
@@ -64,8 +67,13 @@ struct Span {
 
     // Get string corresponding to this Span
     [[nodiscard]] string getStr() const {
+        return string(getView());
+    }
+
+    // Same as getStr, but points into the source file instead of copying
+    [[nodiscard]] std::string_view getView() const {
         int start = sourceFile->lines[line] + column;
-        return sourceFile->sourceFile.substr(start, length);
+        return std::string_view(sourceFile->sourceFile).substr(start, length);
     }
 
     // Get the entire line this span is in.
@@ -83,9 +91,23 @@ struct Span {
     }
 };
 
+// Interned names, every distinct identifier gets a unique id that stays the same for the whole run
+// so resolving a name is a single integer compare instead of a string compare
+// Ids start at 1, 0 means the token isn't a name(or wasn't interned)
+// Safe to call from multiple threads, the scanner threads intern the tokens of each file they tokenize
+namespace symbols {
+    uInt intern(std::string_view name);
+    // Interns every name under a single lock, ids[i] is the id of names[i]
+    void internAll(const vector<std::string_view>& names, vector<uInt>& ids);
+    // Only identifiers and 'this'(which resolves to a local variable) are interned
+    inline bool isName(TokenType type) { return type == TokenType::IDENTIFIER || type == TokenType::THIS; }
+}
+
 struct Token {
     TokenType type;
     Span str;
+    // Interned id of the lexeme if this token is a name, 0 otherwise
+    uInt symbol = 0;
 
     //for things like synthetic tokens and expanded macros
     bool isSynthetic;
@@ -97,7 +119,7 @@ struct Token {
         isPartOfMacro = false;
         type = TokenType::NONE;
     }
-    //construct a token from source file string data
+    //construct a token from source file string data, the scanner interns names once the whole file is tokenized
     Token(Span _str, TokenType _type) {
         isSynthetic = false;
         isPartOfMacro = false;
@@ -109,15 +131,33 @@ struct Token {
         isPartOfMacro = true;
         type = _type;
         syntheticStr = str;
+        if (symbols::isName(type)) symbol = symbols::intern(syntheticStr);
     }
-    string getLexeme() const {
+    // Points into the source file(or syntheticStr), only valid as long as the token and its file are
+    std::string_view getView() const {
         if (type == TokenType::ERROR) { return "Unexpected character."; }
         else if (isSynthetic) { return syntheticStr; }
-        return str.getStr();
+        return str.getView();
+    }
+    string getLexeme() const {
+        return string(getView());
+    }
+    // Replaces the lexeme of the token, type should already be set to the new type
+    void setSyntheticLexeme(string lexeme) {
+        isSynthetic = true;
+        syntheticStr = std::move(lexeme);
+        symbol = symbols::isName(type) ? symbols::intern(syntheticStr) : 0;
     }
 
     bool equals(const Token& token) const {
-        return getLexeme().compare(token.getLexeme()) == 0 && type == token.type;
+        if (type != token.type) return false;
+        if (symbol && token.symbol) return symbol == token.symbol;
+        return getView() == token.getView();
+    }
+    // Whether both tokens spell the same name, regardless of type('this' the keyword and the 'this' parameter)
+    bool sameName(const Token& token) const {
+        if (symbol && token.symbol) return symbol == token.symbol;
+        return getView() == token.getView();
     }
 };
 
@@ -128,6 +168,57 @@ namespace AST {
     class ASTDecl;
 }
 
+// Bump allocator that owns every AST node of a module, nodes point to each other with plain pointers
+// and are all destroyed at once when the module is deleted
+// Passes that create nodes(macro expansion, inlining, folding...) allocate them in the arena of the module they're working on
+class ASTArena {
+public:
+    ASTArena() = default;
+    ASTArena(const ASTArena&) = delete;
+    ASTArena& operator=(const ASTArena&) = delete;
+    ~ASTArena() {
+        clear();
+    }
+
+    // Destroys every node, the arena can be used again afterwards
+    void clear() {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); it++) it->second(it->first);
+        for (char* block : blocks) delete[] block;
+        destructors.clear();
+        blocks.clear();
+        cur = 0;
+        end = 0;
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* obj = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.emplace_back(obj, [](void* ptr) { static_cast<T*>(ptr)->~T(); });
+        }
+        return obj;
+    }
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    vector<char*> blocks;
+    uintptr_t cur = 0;
+    uintptr_t end = 0;
+    vector<std::pair<void*, void(*)(void*)>> destructors;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t ptr = (cur + align - 1) & ~(align - 1);
+        if (ptr + size > end) {
+            size_t blockSize = std::max(BLOCK_SIZE, size + align);
+            blocks.push_back(new char[blockSize]);
+            cur = reinterpret_cast<uintptr_t>(blocks.back());
+            end = cur + blockSize;
+            ptr = (cur + align - 1) & ~(align - 1);
+        }
+        cur = ptr + size;
+        return reinterpret_cast<void*>(ptr);
+    }
+};
+
 struct Dependency {
     Token alias;
     Token pathString;// For error reporting in the compiler
@@ -146,12 +237,14 @@ struct CSLModule {
     // Used for topsort once we have resolved all dependencies
     bool traversed;
 
+    // Owns every node of the AST below
+    ASTArena arena;
     // AST of this file
-    vector<std::shared_ptr<AST::ASTNode>> stmts;
+    vector<AST::ASTNode*> stmts;
     // Exported declarations
-    vector<std::shared_ptr<AST::ASTDecl>> exports;
+    vector<AST::ASTDecl*> exports;
     // Used by the compiler to look up if a global variable exists since globals are late bound
-    vector<std::shared_ptr<AST::ASTDecl>> topDeclarations;
+    vector<AST::ASTDecl*> topDeclarations;
 
     CSLModule(vector<Token> _tokens, File* _file) {
         tokens = _tokens;
@@ -159,4 +252,12 @@ struct CSLModule {
         resolvedDeps = false;
         traversed = false;
     };
+
+    // Used when a module is parsed again(by the language server), tokens and deps are kept
+    void clearAST() {
+        stmts.clear();
+        exports.clear();
+        topDeclarations.clear();
+        arena.clear();
+    }
 };
\ No newline at end of file
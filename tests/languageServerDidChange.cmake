@@ -0,0 +1,32 @@
+# Sends a half typed method inside a class through didChange, the server has to answer with diagnostics and exit
+# Run with -DESL=<path to ESL> -DWORK_DIR=<directory for the main file>
+set(mainFile ${WORK_DIR}/languageServerMain.esl)
+file(WRITE ${mainFile} "class A {}\n")
+set(uri "file://${mainFile}")
+if(NOT mainFile MATCHES "^/")
+    set(uri "file:///${mainFile}")
+endif()
+
+set(input "")
+function(addMessage body)
+    string(LENGTH "${body}" length)
+    set(input "${input}Content-Length: ${length}\r\n\r\n${body}" PARENT_SCOPE)
+endfunction()
+addMessage("{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}")
+addMessage("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"${uri}\",\"text\":\"class A {}\\n\"}}}")
+addMessage("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"${uri}\"},\"contentChanges\":[{\"text\":\"class A { fn f( {} }\\n\"}]}}")
+addMessage("{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"shutdown\"}")
+addMessage("{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}")
+file(WRITE ${WORK_DIR}/languageServerDidChange.in "${input}")
+
+execute_process(COMMAND ${ESL} ${mainFile} -language-server
+        INPUT_FILE ${WORK_DIR}/languageServerDidChange.in
+        OUTPUT_VARIABLE output
+        RESULT_VARIABLE result
+        TIMEOUT 20)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Language server didn't exit cleanly: ${result}\n${output}")
+endif()
+if(NOT output MATCHES "publishDiagnostics[^\n]*Expect argument name")
+    message(FATAL_ERROR "No diagnostics for the edited file:\n${output}")
+endif()
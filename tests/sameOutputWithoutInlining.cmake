@@ -0,0 +1,16 @@
+# Runs a script with and without -no-inline, inlining must not change what it prints
+# Run with -DESL=<path to ESL> -DSCRIPT=<script to run>
+string(REGEX REPLACE "\\.esl$" ".eslc" cache ${SCRIPT})
+file(REMOVE ${cache})
+execute_process(COMMAND ${ESL} ${SCRIPT} OUTPUT_VARIABLE inlined RESULT_VARIABLE inlinedResult TIMEOUT 20)
+file(REMOVE ${cache})
+execute_process(COMMAND ${ESL} ${SCRIPT} -no-inline OUTPUT_VARIABLE notInlined RESULT_VARIABLE notInlinedResult TIMEOUT 20)
+if(NOT inlinedResult EQUAL 0 OR NOT notInlinedResult EQUAL 0)
+    message(FATAL_ERROR "Script failed: ${inlinedResult} ${notInlinedResult}\n${inlined}\n${notInlined}")
+endif()
+if(inlined STREQUAL "")
+    message(FATAL_ERROR "Script didn't print anything")
+endif()
+if(NOT inlined STREQUAL notInlined)
+    message(FATAL_ERROR "Output changes with -no-inline\ninlined:\n${inlined}\nnot inlined:\n${notInlined}")
+endif()